@@ -0,0 +1,180 @@
+#include "AFPacketSource.hpp"
+#include <iostream>
+
+#ifdef __linux__
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <arpa/inet.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace NetworkParser {
+
+AFPacketSource::~AFPacketSource() {
+    close();
+}
+
+#ifdef __linux__
+
+bool AFPacketSource::open(const std::string& interface, size_t ringBytes, int fanoutGroup) {
+    close();
+
+    fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+    if (fd < 0) {
+        std::cerr << "Error: Could not open packet socket: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    int version = TPACKET_V3;
+    if (setsockopt(fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) != 0) {
+        std::cerr << "Error: TPACKET_V3 not supported: " << std::strerror(errno) << std::endl;
+        close();
+        return false;
+    }
+
+    tpacket_req3 request;
+    std::memset(&request, 0, sizeof(request));
+    blockCount = std::max<size_t>(2, ringBytes / kBlockSize);
+    request.tp_block_size = kBlockSize;
+    request.tp_block_nr = blockCount;
+    request.tp_frame_size = TPACKET_ALIGNMENT << 7;
+    request.tp_frame_nr = (kBlockSize / request.tp_frame_size) * blockCount;
+    request.tp_retire_blk_tov = kBlockTimeoutMs;
+    if (setsockopt(fd, SOL_PACKET, PACKET_RX_RING, &request, sizeof(request)) != 0) {
+        std::cerr << "Error: Could not set up the capture ring: " << std::strerror(errno) << std::endl;
+        close();
+        return false;
+    }
+
+    ringSize = kBlockSize * blockCount;
+    void* mapping = mmap(nullptr, ringSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED) {
+        std::cerr << "Error: Could not map the capture ring: " << std::strerror(errno) << std::endl;
+        ring = nullptr;
+        close();
+        return false;
+    }
+    ring = static_cast<uint8_t*>(mapping);
+
+    sockaddr_ll address;
+    std::memset(&address, 0, sizeof(address));
+    address.sll_family = AF_PACKET;
+    address.sll_protocol = htons(ETH_P_ALL);
+    address.sll_ifindex = if_nametoindex(interface.c_str());
+    if (address.sll_ifindex == 0 || bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        std::cerr << "Error: Could not bind to interface " << interface << ": " << std::strerror(errno) << std::endl;
+        close();
+        return false;
+    }
+
+    if (fanoutGroup >= 0) {
+        // Flow hash fanout is symmetric, both directions land on the same socket
+        int fanout = (fanoutGroup & 0xffff) | ((PACKET_FANOUT_HASH | PACKET_FANOUT_FLAG_DEFRAG) << 16);
+        if (setsockopt(fd, SOL_PACKET, PACKET_FANOUT, &fanout, sizeof(fanout)) != 0) {
+            std::cerr << "Error: Could not join fanout group: " << std::strerror(errno) << std::endl;
+            close();
+            return false;
+        }
+    }
+    return true;
+}
+
+bool AFPacketSource::nextBatch(std::vector<PacketView>& packets) {
+    packets.clear();
+    if (fd < 0) return false;
+
+    tpacket_block_desc* block = reinterpret_cast<tpacket_block_desc*>(ring + blockIndex * kBlockSize);
+    while (!(block->hdr.bh1.block_status & TP_STATUS_USER)) {
+        if (sourceStopRequested()) return false;
+        pollfd waitFor = {fd, POLLIN | POLLERR, 0};
+        poll(&waitFor, 1, 100);
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    // Blocks the kernel has filled and is waiting on us to give back
+    size_t readyBlocks = 0;
+    for (size_t i = 0; i < blockCount; i++) {
+        const tpacket_block_desc* other = reinterpret_cast<const tpacket_block_desc*>(ring + i * kBlockSize);
+        if (other->hdr.bh1.block_status & TP_STATUS_USER) readyBlocks++;
+    }
+    totals.sampleFill(static_cast<double>(readyBlocks) / blockCount);
+
+    const uint8_t* blockStart = reinterpret_cast<const uint8_t*>(block);
+    const tpacket3_hdr* header =
+        reinterpret_cast<const tpacket3_hdr*>(blockStart + block->hdr.bh1.offset_to_first_pkt);
+    for (uint32_t i = 0; i < block->hdr.bh1.num_pkts; i++) {
+        PacketView view;
+        view.data = reinterpret_cast<const uint8_t*>(header) + header->tp_mac;
+        view.length = header->tp_snaplen;
+        view.timestampSec = header->tp_sec;
+        view.timestampUsec = header->tp_nsec / 1000;
+        packets.push_back(view);
+        header = reinterpret_cast<const tpacket3_hdr*>(reinterpret_cast<const uint8_t*>(header) +
+                                                        header->tp_next_offset);
+    }
+    totals.packets += packets.size();
+    holdingBlock = true;
+    return true;
+}
+
+void AFPacketSource::releaseBatch() {
+    if (!holdingBlock) return;
+    tpacket_block_desc* block = reinterpret_cast<tpacket_block_desc*>(ring + blockIndex * kBlockSize);
+    std::atomic_thread_fence(std::memory_order_release);
+    block->hdr.bh1.block_status = TP_STATUS_KERNEL;
+    blockIndex = (blockIndex + 1) % blockCount;
+    holdingBlock = false;
+}
+
+SourceStats AFPacketSource::stats() {
+    // The kernel counters reset on every read, so they are accumulated here
+    if (fd >= 0) {
+        tpacket_stats_v3 kernelStats;
+        socklen_t length = sizeof(kernelStats);
+        if (getsockopt(fd, SOL_PACKET, PACKET_STATISTICS, &kernelStats, &length) == 0) {
+            totals.drops += kernelStats.tp_drops;
+        }
+    }
+    return totals;
+}
+
+void AFPacketSource::close() {
+    if (ring) munmap(ring, ringSize);
+    if (fd >= 0) ::close(fd);
+    ring = nullptr;
+    fd = -1;
+    holdingBlock = false;
+    blockIndex = 0;
+}
+
+#else
+
+bool AFPacketSource::open(const std::string& interface, size_t ringBytes, int fanoutGroup) {
+    std::cerr << "Error: Live capture needs Linux AF_PACKET sockets." << std::endl;
+    return false;
+}
+
+bool AFPacketSource::nextBatch(std::vector<PacketView>& packets) {
+    packets.clear();
+    return false;
+}
+
+void AFPacketSource::releaseBatch() {}
+
+SourceStats AFPacketSource::stats() {
+    return totals;
+}
+
+void AFPacketSource::close() {}
+
+#endif
+
+} // namespace NetworkParser
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string>
+#include "PacketSource.hpp"
+
+namespace NetworkParser {
+
+// Live capture from a Linux AF_PACKET socket with a TPACKET_V3 block ring
+// mapped into the process. The kernel fills whole blocks of packets and a
+// batch is one block, read in place and handed back once parsed. Sockets
+// opened with the same fanout group share the interface's traffic, the
+// kernel hashes each flow to one socket in both directions.
+class AFPacketSource : public PacketSource {
+public:
+    static constexpr size_t kBlockSize = 1 << 20;
+    static constexpr unsigned kBlockTimeoutMs = 10;  // Hand over partly filled blocks after this long
+
+    AFPacketSource() = default;
+    ~AFPacketSource() override;
+    AFPacketSource(const AFPacketSource&) = delete;
+    AFPacketSource& operator=(const AFPacketSource&) = delete;
+
+    // Bind to interface with a ring of about ringBytes. A fanoutGroup of -1 means no fanout.
+    bool open(const std::string& interface, size_t ringBytes, int fanoutGroup);
+
+    bool nextBatch(std::vector<PacketView>& packets) override;
+    void releaseBatch() override;
+    SourceStats stats() override;
+
+private:
+    int fd = -1;
+    uint8_t* ring = nullptr;
+    size_t ringSize = 0;
+    size_t blockCount = 0;
+    size_t blockIndex = 0;  // Block the next batch comes from
+    bool holdingBlock = false;
+    SourceStats totals;
+
+    void close();
+};
+
+} // namespace NetworkParser
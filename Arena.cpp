@@ -0,0 +1,39 @@
+#include "Arena.hpp"
+#include <algorithm>
+
+namespace NetworkParser {
+
+void* Arena::allocateSlow(size_t size, size_t alignment) {
+    // Move on to the next chunk, taking a fresh one where the next kept one
+    // is too small, which only happens for allocations bigger than a chunk
+    if (current < chunks.size()) current++;
+    used = 0;
+    if (current == chunks.size() || chunks[current].size < size + alignment - 1) {
+        size_t newSize = std::max(chunkSize, size + alignment - 1);
+        if (newSize > chunkSize) oversized = true;
+        chunks.insert(chunks.begin() + current, Chunk{std::make_unique<uint8_t[]>(newSize), newSize});
+    }
+
+    uint8_t* base = chunks[current].data.get();
+    size_t start = alignUp(base, 0, alignment);
+    used = start + size;
+    inUse += size;
+    return base + start;
+}
+
+void Arena::trim() {
+    // Oversized chunks go first, then whatever is beyond the retained count
+    chunks.erase(std::remove_if(chunks.begin(), chunks.end(),
+                                [&](const Chunk& chunk) { return chunk.size > chunkSize; }),
+                 chunks.end());
+    if (chunks.size() > kRetainedChunks) chunks.resize(kRetainedChunks);
+    oversized = false;
+}
+
+size_t Arena::bytesReserved() const {
+    size_t total = 0;
+    for (const Chunk& chunk : chunks) total += chunk.size;
+    return total;
+}
+
+} // namespace NetworkParser
@@ -0,0 +1,79 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+namespace NetworkParser {
+
+// Bump allocator for data that only lives until the batch it belongs to is
+// done. Chunks are kept across resets, so once warmed up an allocation is a
+// pointer increment and reset() forgets everything in O(1). Nothing
+// allocated here is destroyed, so it is for trivially destructible data only.
+class Arena {
+public:
+    static constexpr size_t kDefaultChunkSize = 64 * 1024;
+
+    explicit Arena(size_t chunkSize = kDefaultChunkSize) : chunkSize(chunkSize) {}
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    // Alignment has to be a power of two
+    void* allocate(size_t size, size_t alignment = alignof(std::max_align_t)) {
+        if (current < chunks.size()) {
+            uint8_t* base = chunks[current].data.get();
+            size_t start = alignUp(base, used, alignment);
+            if (start + size <= chunks[current].size) {
+                used = start + size;
+                inUse += size;
+                return base + start;
+            }
+        }
+        return allocateSlow(size, alignment);
+    }
+
+    uint8_t* copy(const uint8_t* data, size_t length) {
+        uint8_t* target = static_cast<uint8_t*>(allocate(length, 1));
+        if (length) std::memcpy(target, data, length);
+        return target;
+    }
+
+    // Everything allocated since the last reset is gone. Chunks bigger than
+    // usual, or beyond what a typical batch needs, are let go rather than pinned.
+    void reset() {
+        if (oversized || chunks.size() > kRetainedChunks) trim();
+        current = 0;
+        used = 0;
+        inUse = 0;
+    }
+
+    size_t bytesInUse() const { return inUse; }
+    size_t bytesReserved() const;
+
+private:
+    static constexpr size_t kRetainedChunks = 16;
+
+    struct Chunk {
+        std::unique_ptr<uint8_t[]> data;
+        size_t size;
+    };
+
+    size_t chunkSize;
+    std::vector<Chunk> chunks;
+    size_t current = 0;  // Chunk being allocated from
+    size_t used = 0;     // Bytes taken from it
+    size_t inUse = 0;    // Bytes handed out since the last reset
+    bool oversized = false;  // A chunk bigger than chunkSize is held
+
+    // Offset from base of the first address at or after base + offset with the alignment
+    static size_t alignUp(const uint8_t* base, size_t offset, size_t alignment) {
+        uintptr_t address = reinterpret_cast<uintptr_t>(base) + offset;
+        return offset + ((alignment - (address & (alignment - 1))) & (alignment - 1));
+    }
+
+    void* allocateSlow(size_t size, size_t alignment);
+    void trim();
+};
+
+} // namespace NetworkParser
@@ -0,0 +1,419 @@
+#include "ArrowWriter.hpp"
+#include <algorithm>
+#include <iostream>
+#include <type_traits>
+#include <utility>
+
+namespace NetworkParser {
+
+// Values from the Arrow format's Schema.fbs and Message.fbs
+static constexpr int16_t kMetadataV5 = 4;
+static constexpr uint8_t kHeaderSchema = 1;
+static constexpr uint8_t kHeaderDictionaryBatch = 2;
+static constexpr uint8_t kHeaderRecordBatch = 3;
+static constexpr uint8_t kTypeInt = 2;
+static constexpr uint8_t kTypeUtf8 = 5;
+static constexpr uint8_t kTypeTimestamp = 10;
+static constexpr uint8_t kTypeFixedSizeBinary = 15;
+static constexpr int16_t kUnitMicrosecond = 2;
+static constexpr uint32_t kContinuation = 0xFFFFFFFF;
+static constexpr char kMagic[8] = {'A', 'R', 'R', 'O', 'W', '1', 0, 0};
+
+template <typename T>
+static void appendLittleEndian(std::vector<uint8_t>& out, T value) {
+    auto bits = static_cast<std::make_unsigned_t<T>>(value);
+    for (size_t i = 0; i < sizeof(T); i++) out.push_back(static_cast<uint8_t>(bits >> (8 * i)));
+}
+
+static void padTo8(std::vector<uint8_t>& out) {
+    out.resize((out.size() + 7) & ~size_t(7), 0);
+}
+
+// Just enough of a FlatBuffers builder for the Arrow metadata. Like the
+// reference builder it fills the buffer back to front, so everything a table
+// points at is finished before the table, and objects are referred to by
+// their distance from the end of the buffer. Metadata runs to a few hundred
+// bytes, so prepending to a vector is cheap enough.
+class FlatBuilder {
+public:
+    using Ref = uint32_t;
+
+    template <typename T>
+    void prepend(T value) {
+        align(sizeof(T));
+        std::vector<uint8_t> bytes;
+        appendLittleEndian(bytes, value);
+        buffer.insert(buffer.begin(), bytes.begin(), bytes.end());
+    }
+
+    void prependRef(Ref ref) {
+        align(4);
+        prepend<uint32_t>(static_cast<uint32_t>(buffer.size() + 4 - ref));
+    }
+
+    void startTable() {
+        fields.clear();
+        tableEnd = buffer.size();
+    }
+
+    template <typename T>
+    void addField(uint16_t slot, T value) {
+        prepend(value);
+        fields.emplace_back(slot, buffer.size());
+    }
+
+    void addRef(uint16_t slot, Ref ref) {
+        prependRef(ref);
+        fields.emplace_back(slot, buffer.size());
+    }
+
+    Ref endTable() {
+        prepend<int32_t>(0);  // Offset to the vtable, patched below
+        Ref table = static_cast<Ref>(buffer.size());
+
+        uint16_t slotCount = 0;
+        for (const auto& field : fields) slotCount = std::max<uint16_t>(slotCount, field.first + 1);
+        std::vector<uint16_t> slots(slotCount, 0);
+        for (const auto& [slot, at] : fields) slots[slot] = static_cast<uint16_t>(table - at);
+
+        for (size_t i = slots.size(); i-- > 0;) prepend<uint16_t>(slots[i]);
+        prepend<uint16_t>(static_cast<uint16_t>(table - tableEnd));
+        prepend<uint16_t>(static_cast<uint16_t>(4 + 2 * slots.size()));
+        Ref vtable = static_cast<Ref>(buffer.size());
+
+        std::vector<uint8_t> offset;
+        appendLittleEndian<int32_t>(offset, static_cast<int32_t>(vtable - table));
+        std::copy(offset.begin(), offset.end(), buffer.end() - table);
+        return table;
+    }
+
+    Ref createString(const std::string& text) {
+        align(4, text.size() + 1);
+        buffer.insert(buffer.begin(), 1, 0);
+        buffer.insert(buffer.begin(), text.begin(), text.end());
+        prepend<uint32_t>(static_cast<uint32_t>(text.size()));
+        return static_cast<Ref>(buffer.size());
+    }
+
+    Ref createRefVector(const std::vector<Ref>& refs) {
+        for (size_t i = refs.size(); i-- > 0;) prependRef(refs[i]);
+        prepend<uint32_t>(static_cast<uint32_t>(refs.size()));
+        return static_cast<Ref>(buffer.size());
+    }
+
+    // Vector of structs already laid out little endian, all of 8 byte alignment
+    Ref createStructVector(const std::vector<uint8_t>& structs, size_t count) {
+        align(8, structs.size());
+        buffer.insert(buffer.begin(), structs.begin(), structs.end());
+        prepend<uint32_t>(static_cast<uint32_t>(count));
+        return static_cast<Ref>(buffer.size());
+    }
+
+    std::vector<uint8_t> finish(Ref root) {
+        align(8, 4);
+        prependRef(root);
+        return std::move(buffer);
+    }
+
+private:
+    std::vector<uint8_t> buffer;
+    std::vector<std::pair<uint16_t, size_t>> fields;
+    size_t tableEnd = 0;
+
+    // Pad so that size bytes prepended next end up aligned
+    void align(size_t alignment, size_t size = 0) {
+        while ((buffer.size() + size) % alignment) buffer.insert(buffer.begin(), 0);
+    }
+};
+
+static FlatBuilder::Ref intType(FlatBuilder& builder, int32_t bitWidth, bool isSigned) {
+    builder.startTable();
+    builder.addField<int32_t>(0, bitWidth);
+    builder.addField<uint8_t>(1, isSigned);
+    return builder.endTable();
+}
+
+static size_t columnWidth(ColumnType type) {
+    switch (type) {
+        case ColumnType::UInt16: return 2;
+        case ColumnType::UInt32: return 4;
+        case ColumnType::Address: return 4;
+        case ColumnType::Address6: return 16;
+        case ColumnType::UInt64: return 8;
+        case ColumnType::Timestamp: return 8;
+        case ColumnType::Dictionary: return 1;
+    }
+    return 8;
+}
+
+static FlatBuilder::Ref buildField(FlatBuilder& builder, const ColumnSpec& column, int64_t dictionaryId) {
+    FlatBuilder::Ref name = builder.createString(column.name);
+    FlatBuilder::Ref children = builder.createRefVector({});
+
+    uint8_t typeType = kTypeInt;
+    FlatBuilder::Ref type = 0;
+    FlatBuilder::Ref dictionary = 0;
+    switch (column.type) {
+        case ColumnType::UInt16:
+        case ColumnType::UInt32:
+        case ColumnType::UInt64:
+        case ColumnType::Address:
+            type = intType(builder, static_cast<int32_t>(columnWidth(column.type) * 8), false);
+            break;
+        case ColumnType::Address6:
+            typeType = kTypeFixedSizeBinary;
+            builder.startTable();
+            builder.addField<int32_t>(0, 16);
+            type = builder.endTable();
+            break;
+        case ColumnType::Timestamp:
+            typeType = kTypeTimestamp;
+            builder.startTable();
+            builder.addField<int16_t>(0, kUnitMicrosecond);
+            type = builder.endTable();
+            break;
+        case ColumnType::Dictionary: {
+            typeType = kTypeUtf8;
+            builder.startTable();
+            type = builder.endTable();
+            FlatBuilder::Ref indexType = intType(builder, 8, true);
+            builder.startTable();
+            builder.addField<int64_t>(0, dictionaryId);
+            builder.addRef(1, indexType);
+            dictionary = builder.endTable();
+            break;
+        }
+    }
+
+    builder.startTable();
+    builder.addRef(0, name);
+    builder.addField<uint8_t>(1, 0);  // Not nullable
+    builder.addField<uint8_t>(2, typeType);
+    builder.addRef(3, type);
+    if (dictionary) builder.addRef(4, dictionary);
+    builder.addRef(5, children);
+    return builder.endTable();
+}
+
+static FlatBuilder::Ref buildSchema(FlatBuilder& builder, const std::vector<ColumnSpec>& columns) {
+    std::vector<FlatBuilder::Ref> fields;
+    for (size_t i = 0; i < columns.size(); i++) {
+        fields.push_back(buildField(builder, columns[i], static_cast<int64_t>(i)));
+    }
+    FlatBuilder::Ref fieldVector = builder.createRefVector(fields);
+
+    builder.startTable();
+    builder.addField<int16_t>(0, 0);  // Little endian
+    builder.addRef(1, fieldVector);
+    return builder.endTable();
+}
+
+// One array of a record batch: its length and the body buffers it uses
+struct BatchArray {
+    size_t length;
+    std::vector<std::pair<uint64_t, uint64_t>> buffers;  // Offset and length in the body
+};
+
+// Append a buffer to a message body, keeping every buffer 8 byte aligned
+static std::pair<uint64_t, uint64_t> appendBuffer(std::vector<uint8_t>& body, const std::vector<uint8_t>& data) {
+    uint64_t offset = body.size();
+    body.insert(body.end(), data.begin(), data.end());
+    padTo8(body);
+    return {offset, data.size()};
+}
+
+static FlatBuilder::Ref buildRecordBatch(FlatBuilder& builder, size_t rows, const std::vector<BatchArray>& arrays) {
+    std::vector<uint8_t> nodes;
+    std::vector<uint8_t> buffers;
+    size_t bufferCount = 0;
+    for (const BatchArray& array : arrays) {
+        appendLittleEndian<int64_t>(nodes, static_cast<int64_t>(array.length));
+        appendLittleEndian<int64_t>(nodes, 0);  // Null count
+        for (const auto& [offset, length] : array.buffers) {
+            appendLittleEndian<int64_t>(buffers, static_cast<int64_t>(offset));
+            appendLittleEndian<int64_t>(buffers, static_cast<int64_t>(length));
+            bufferCount++;
+        }
+    }
+    FlatBuilder::Ref nodeVector = builder.createStructVector(nodes, arrays.size());
+    FlatBuilder::Ref bufferVector = builder.createStructVector(buffers, bufferCount);
+
+    builder.startTable();
+    builder.addField<int64_t>(0, static_cast<int64_t>(rows));
+    builder.addRef(1, nodeVector);
+    builder.addRef(2, bufferVector);
+    return builder.endTable();
+}
+
+static std::vector<uint8_t> buildMessage(FlatBuilder& builder, uint8_t headerType, FlatBuilder::Ref header,
+                                         size_t bodyLength) {
+    builder.startTable();
+    builder.addField<int64_t>(3, static_cast<int64_t>(bodyLength));
+    builder.addRef(2, header);
+    builder.addField<int16_t>(0, kMetadataV5);
+    builder.addField<uint8_t>(1, headerType);
+    return builder.finish(builder.endTable());
+}
+
+ArrowWriter::ArrowWriter(std::vector<ColumnSpec> columns)
+    : columns(std::move(columns)), values(this->columns.size()) {}
+
+ArrowWriter::~ArrowWriter() {
+    if (out.is_open()) close();
+}
+
+bool ArrowWriter::open(const std::string& filePath) {
+    path = filePath;
+    out.open(filePath, std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) return false;
+    writeBytes(kMagic, sizeof(kMagic));
+
+    FlatBuilder schema;
+    FlatBuilder::Ref schemaTable = buildSchema(schema, columns);
+    writeMessage(buildMessage(schema, kHeaderSchema, schemaTable, 0), {});
+
+    // Every dictionary goes out up front, ahead of the batches that index it
+    for (size_t i = 0; i < columns.size(); i++) {
+        const ColumnSpec& column = columns[i];
+        if (column.type != ColumnType::Dictionary) continue;
+
+        std::vector<uint8_t> offsets;
+        std::vector<uint8_t> text;
+        appendLittleEndian<int32_t>(offsets, 0);
+        for (const std::string& value : column.dictionary) {
+            text.insert(text.end(), value.begin(), value.end());
+            appendLittleEndian<int32_t>(offsets, static_cast<int32_t>(text.size()));
+        }
+        std::vector<uint8_t> body;
+        BatchArray array{column.dictionary.size(), {}};
+        array.buffers.push_back(appendBuffer(body, {}));  // No validity bitmap
+        array.buffers.push_back(appendBuffer(body, offsets));
+        array.buffers.push_back(appendBuffer(body, text));
+
+        FlatBuilder builder;
+        FlatBuilder::Ref data = buildRecordBatch(builder, column.dictionary.size(), {array});
+        builder.startTable();
+        builder.addField<int64_t>(0, static_cast<int64_t>(i));
+        builder.addRef(1, data);
+        FlatBuilder::Ref dictionaryBatch = builder.endTable();
+        dictionaryBlocks.push_back(
+            writeMessage(buildMessage(builder, kHeaderDictionaryBatch, dictionaryBatch, body.size()), body));
+    }
+    return out.good();
+}
+
+ArrowWriter& ArrowWriter::add(uint64_t value) {
+    std::vector<uint8_t>& column = values[next];
+    switch (columns[next].type) {
+        case ColumnType::UInt16: appendLittleEndian(column, static_cast<uint16_t>(value)); break;
+        case ColumnType::UInt32:
+        case ColumnType::Address: appendLittleEndian(column, static_cast<uint32_t>(value)); break;
+        case ColumnType::UInt64:
+        case ColumnType::Timestamp: appendLittleEndian(column, value); break;
+        case ColumnType::Dictionary: column.push_back(static_cast<uint8_t>(value)); break;
+        case ColumnType::Address6: return add(IPAddress::fromIPv4(static_cast<uint32_t>(value)));
+    }
+    next++;
+    return *this;
+}
+
+ArrowWriter& ArrowWriter::add(const IPAddress& address) {
+    if (columns[next].type != ColumnType::Address6) return add(address.ipv4());
+    std::vector<uint8_t>& column = values[next];
+    size_t at = column.size();
+    column.resize(at + 16);
+    address.toBytes(column.data() + at);
+    next++;
+    return *this;
+}
+
+void ArrowWriter::endRow() {
+    next = 0;
+    if (++rows == kBatchRows) flushBatch();
+}
+
+void ArrowWriter::flushBatch() {
+    std::vector<uint8_t> body;
+    std::vector<BatchArray> arrays;
+    for (std::vector<uint8_t>& column : values) {
+        BatchArray array{rows, {}};
+        array.buffers.push_back(appendBuffer(body, {}));  // No validity bitmap
+        array.buffers.push_back(appendBuffer(body, column));
+        arrays.push_back(std::move(array));
+        column.clear();
+    }
+
+    FlatBuilder builder;
+    FlatBuilder::Ref batch = buildRecordBatch(builder, rows, arrays);
+    recordBlocks.push_back(writeMessage(buildMessage(builder, kHeaderRecordBatch, batch, body.size()), body));
+    rows = 0;
+}
+
+bool ArrowWriter::close() {
+    if (rows) flushBatch();
+
+    // End of stream marker, then the footer that indexes every message
+    uint32_t endOfStream[2] = {kContinuation, 0};
+    writeBytes(endOfStream, sizeof(endOfStream));
+
+    FlatBuilder builder;
+    auto blockVector = [&](const std::vector<Block>& blocks) {
+        std::vector<uint8_t> structs;
+        for (const Block& block : blocks) {
+            appendLittleEndian<int64_t>(structs, static_cast<int64_t>(block.offset));
+            appendLittleEndian<int32_t>(structs, static_cast<int32_t>(block.metadataLength));
+            appendLittleEndian<int32_t>(structs, 0);  // Padding
+            appendLittleEndian<int64_t>(structs, static_cast<int64_t>(block.bodyLength));
+        }
+        return builder.createStructVector(structs, blocks.size());
+    };
+    FlatBuilder::Ref recordVector = blockVector(recordBlocks);
+    FlatBuilder::Ref dictionaryVector = blockVector(dictionaryBlocks);
+    FlatBuilder::Ref schema = buildSchema(builder, columns);
+    builder.startTable();
+    builder.addRef(1, schema);
+    builder.addRef(2, dictionaryVector);
+    builder.addRef(3, recordVector);
+    builder.addField<int16_t>(0, kMetadataV5);
+    std::vector<uint8_t> footer = builder.finish(builder.endTable());
+
+    std::vector<uint8_t> trailer;
+    appendLittleEndian<int32_t>(trailer, static_cast<int32_t>(footer.size()));
+    trailer.insert(trailer.end(), kMagic, kMagic + 6);
+    writeBytes(footer.data(), footer.size());
+    writeBytes(trailer.data(), trailer.size());
+
+    out.close();
+    if (out.fail()) {
+        std::cerr << "Error: Failed writing " << path << ".\n";
+        return false;
+    }
+    return true;
+}
+
+// Message framing: continuation marker, metadata length, metadata padded to
+// 8 bytes, then the body
+ArrowWriter::Block ArrowWriter::writeMessage(const std::vector<uint8_t>& metadata, const std::vector<uint8_t>& body) {
+    Block block{position, 0, body.size()};
+    std::vector<uint8_t> framed;
+    appendLittleEndian(framed, kContinuation);
+    appendLittleEndian<int32_t>(framed, 0);
+    framed.insert(framed.end(), metadata.begin(), metadata.end());
+    padTo8(framed);
+
+    std::vector<uint8_t> length;
+    appendLittleEndian<int32_t>(length, static_cast<int32_t>(framed.size() - 8));
+    std::copy(length.begin(), length.end(), framed.begin() + 4);
+
+    block.metadataLength = static_cast<uint32_t>(framed.size());
+    writeBytes(framed.data(), framed.size());
+    writeBytes(body.data(), body.size());
+    return block;
+}
+
+void ArrowWriter::writeBytes(const void* data, size_t length) {
+    out.write(static_cast<const char*>(data), static_cast<std::streamsize>(length));
+    position += length;
+}
+
+} // namespace NetworkParser
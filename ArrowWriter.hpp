@@ -0,0 +1,87 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "IPAddress.hpp"
+
+namespace NetworkParser {
+
+// Which files the report stage writes
+enum class ReportFormat {
+    Csv,    // Text tables, as always
+    Arrow,  // Typed columnar Arrow IPC files
+    Both,
+    None    // Only answer queries
+};
+
+inline bool writesCsv(ReportFormat format) { return format == ReportFormat::Csv || format == ReportFormat::Both; }
+inline bool writesArrow(ReportFormat format) { return format == ReportFormat::Arrow || format == ReportFormat::Both; }
+
+// Physical type of a report column
+enum class ColumnType : uint8_t {
+    UInt16,
+    UInt32,
+    UInt64,
+    Address,    // Host order IPv4 address, an unsigned 32 bit integer in the file
+    Address6,   // IPv6 address, 16 bytes of fixed size binary in network order
+    Timestamp,  // Microseconds since the epoch
+    Dictionary  // Index into a fixed list of strings
+};
+
+struct ColumnSpec {
+    std::string name;
+    ColumnType type;
+    std::vector<std::string> dictionary;  // Values of a Dictionary column, at most 127
+};
+
+// Writes a table in the Arrow IPC file format, so reports can be memory
+// mapped by pyarrow, DuckDB, polars and the like without parsing any text.
+// The schema and dictionaries are fixed when the writer is created. Rows are
+// gathered column by column and written out as a record batch every
+// kBatchRows rows, so tables too large for memory stream straight to disk.
+// Values are written little endian and no column has nulls.
+class ArrowWriter {
+public:
+    static constexpr size_t kBatchRows = 65536;
+
+    explicit ArrowWriter(std::vector<ColumnSpec> columns);
+    ~ArrowWriter();
+
+    // Writes the schema and dictionaries, false if the file can't be created
+    bool open(const std::string& filePath);
+    bool isOpen() const { return out.is_open(); }
+
+    // Values go to the columns in the order they were declared, with
+    // endRow called once every column of the row has one
+    ArrowWriter& add(uint64_t value);
+    ArrowWriter& add(const IPAddress& address);  // 16 bytes for Address6, the IPv4 address for Address
+    void endRow();
+
+    // Writes the last batch and the footer, false and an error on failure
+    bool close();
+
+private:
+    struct Block {
+        uint64_t offset;
+        uint32_t metadataLength;
+        uint64_t bodyLength;
+    };
+
+    std::vector<ColumnSpec> columns;
+    std::vector<std::vector<uint8_t>> values;  // Little endian values of each column
+    std::ofstream out;
+    std::string path;
+    uint64_t position = 0;
+    size_t rows = 0;
+    size_t next = 0;
+    std::vector<Block> dictionaryBlocks;
+    std::vector<Block> recordBlocks;
+
+    void flushBatch();
+    Block writeMessage(const std::vector<uint8_t>& metadata, const std::vector<uint8_t>& body);
+    void writeBytes(const void* data, size_t length);
+};
+
+} // namespace NetworkParser
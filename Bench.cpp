@@ -0,0 +1,472 @@
+// Benchmark harness: generates deterministic synthetic captures and times
+// each stage of the pipeline on its own, so regressions show up per stage
+// rather than only in the end to end "Processing Speed" line.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+#include "Ethernet.hpp"
+#include "HeaderBatch.hpp"
+#include "IPParser.hpp"
+#include "PCAPFileParser.hpp"
+#include "PacketSource.hpp"
+#include "PacketWorker.hpp"
+#include "ParserFactory.hpp"
+#include "ProtocolRegistry.hpp"
+#include "SyntheticCapture.hpp"
+#include "TCPParser.hpp"
+#include "UDPParser.hpp"
+
+// Every heap allocation in the process goes through here, so a stage's
+// allocations are the difference in the count across it
+static std::atomic<uint64_t> allocationCount{0};
+
+void* operator new(size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (void* block = std::malloc(size ? size : 1)) return block;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* block) noexcept {
+    std::free(block);
+}
+
+void operator delete(void* block, size_t) noexcept {
+    std::free(block);
+}
+
+namespace NetworkParser {
+namespace {
+
+struct StageResult {
+    std::string name;
+    uint64_t packets = 0;
+    double seconds = 0;
+    uint64_t allocations = 0;
+};
+
+template <typename Body>
+StageResult measure(const std::string& name, Body body) {
+    StageResult result;
+    result.name = name;
+    uint64_t allocationsBefore = allocationCount.load(std::memory_order_relaxed);
+    auto start = std::chrono::steady_clock::now();
+    result.packets = body();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    result.seconds = elapsed.count();
+    result.allocations = allocationCount.load(std::memory_order_relaxed) - allocationsBefore;
+    return result;
+}
+
+void printResults(const std::vector<StageResult>& results) {
+    std::cout << std::left << std::setw(18) << "Stage" << std::right << std::setw(12) << "Packets"
+              << std::setw(16) << "Packets/sec" << std::setw(12) << "ns/packet" << std::setw(16)
+              << "Allocs/packet" << std::setw(14) << "Allocations" << "\n";
+    for (const StageResult& result : results) {
+        std::cout << std::left << std::setw(18) << result.name << std::right << std::setw(12) << result.packets;
+        if (!result.packets) {
+            std::cout << std::setw(16) << "-" << std::setw(12) << "-" << std::setw(16) << "-" << std::setw(14)
+                      << result.allocations << "\n";
+            continue;
+        }
+        double packets = static_cast<double>(result.packets);
+        std::cout << std::fixed << std::setprecision(0) << std::setw(16) << packets / result.seconds
+                  << std::setprecision(1) << std::setw(12) << result.seconds * 1e9 / packets
+                  << std::setprecision(4) << std::setw(16) << result.allocations / packets << std::setw(14)
+                  << result.allocations << "\n";
+    }
+}
+
+// The same parser-mapping.dat and tcp-port-mapping.dat lookup the Controller does
+std::unique_ptr<ProtocolRegistry> loadRegistry() {
+    std::unordered_map<std::string, std::string> libraryMapping;
+    std::ifstream mappingFile("parser-mapping.dat");
+    std::string line;
+    while (std::getline(mappingFile, line)) {
+        size_t equalPos = line.find('=');
+        if (equalPos == std::string::npos) continue;
+        libraryMapping[line.substr(0, equalPos)] = line.substr(equalPos + 1);
+    }
+    auto registry = std::make_unique<ProtocolRegistry>(libraryMapping);
+    registry->loadTCPPortMapping("tcp-port-mapping.dat");
+    return registry;
+}
+
+// Where each packet got to in the chain, carried from one stage to the next
+struct StagedPacket {
+    PacketContext context;
+    size_t offset = 0;
+    ProtocolId next = Protocol::None;
+};
+
+bool runStages(const std::string& capturePath, size_t reassemblyCapMB) {
+    std::vector<StageResult> results;
+
+    // Views stay valid while the parser that mapped them is alive
+    PCAPFileParser capture;
+    if (!capture.parseFile(capturePath)) return false;
+    std::vector<PacketView> packets;
+    PacketView view;
+    while (capture.nextPacket(view)) packets.push_back(view);
+    if (packets.empty()) {
+        std::cerr << "Error: No packets in " << capturePath << ".\n";
+        return false;
+    }
+    uint64_t captureBytes = 0;
+    for (const PacketView& packet : packets) captureBytes += packet.length;
+    std::cout << "Capture: " << capturePath << ", " << packets.size() << " packets, " << captureBytes
+              << " bytes\n\n";
+
+    results.push_back(measure("file load", [&] {
+        PCAPFileParser file;
+        if (!file.parseFile(capturePath)) return uint64_t(0);
+        uint64_t count = 0;
+        PacketView loaded;
+        while (file.nextPacket(loaded)) count++;
+        return count;
+    }));
+
+    // Batch header decode, then decode with checksum verification, at each
+    // instruction set this CPU has up to the one the parser would pick
+    auto headers = std::make_unique<HeaderBatch>();
+    for (SimdLevel level : {SimdLevel::Scalar, SimdLevel::SSE2, SimdLevel::AVX2}) {
+        if (level > bestSimdLevel()) break;
+        for (bool verify : {false, true}) {
+            std::string name = std::string(verify ? "checksum " : "decode ") + simdLevelName(level);
+            results.push_back(measure(name, [&] {
+                for (size_t start = 0; start < packets.size(); start += HeaderBatch::kCapacity) {
+                    size_t count = std::min(packets.size() - start, HeaderBatch::kCapacity);
+                    decodeHeaders(packets.data() + start, count, *headers, verify, level);
+                }
+                return uint64_t(packets.size());
+            }));
+        }
+    }
+
+    std::unique_ptr<ProtocolRegistry> registry = loadRegistry();
+    StatsTables tables;
+    std::vector<StagedPacket> staged(packets.size());
+
+    results.push_back(measure("Ethernet", [&] {
+        EthernetParser ethernet;
+        for (size_t i = 0; i < packets.size(); i++) {
+            StagedPacket& packet = staged[i];
+            packet.context.packetNumber = i + 1;
+            packet.context.timestampSec = packets[i].timestampSec;
+            packet.context.timestampUsec = packets[i].timestampUsec;
+            ethernet.parsePacket(packets[i].data, packets[i].length, 0, packet.context);
+            packet.next = ethernet.nextProtocol();
+            packet.offset = ethernet.getOffset();
+        }
+        return uint64_t(packets.size());
+    }));
+
+    // Each later stage only sees the packets the one before handed it
+    auto layer = [&](const std::string& name, ProtocolId protocol, Parser& parser) {
+        results.push_back(measure(name, [&] {
+            uint64_t count = 0;
+            for (size_t i = 0; i < packets.size(); i++) {
+                StagedPacket& packet = staged[i];
+                if (packet.next != protocol || packet.offset >= packets[i].length) continue;
+                parser.parsePacket(packets[i].data, packets[i].length, packet.offset, packet.context);
+                packet.next = parser.nextProtocol();
+                packet.offset += parser.getOffset();
+                count++;
+            }
+            return count;
+        }));
+    };
+    IPParser ip(tables);
+    TCPParser tcp(tables, *registry);
+    UDPParser udp(tables, *registry);
+    layer("IPParser", Protocol::IP, ip);
+    layer("TCPParser", Protocol::TCP, tcp);
+    layer("UDPParser", Protocol::UDP, udp);
+
+    // Straight to the plugin, without reassembly, so this is lookup and parse cost alone
+    ParserFactory factory(*registry, tables);
+    results.push_back(measure("plugin dispatch", [&] {
+        uint64_t count = 0;
+        for (size_t i = 0; i < packets.size(); i++) {
+            StagedPacket& packet = staged[i];
+            if (packet.next < Protocol::FirstDynamic || packet.offset > packets[i].length) continue;
+            Parser* plugin = factory.getParser(packet.next);
+            if (!plugin) continue;
+            plugin->parsePacket(packets[i].data, packets[i].length, packet.offset, packet.context);
+            count++;
+            if (count % WorkBatch::kCapacity == 0) factory.flushPlugins();
+        }
+        factory.flushPlugins();
+        return count;
+    }));
+
+    // The whole chain as the Controller drives it, reassembly included
+    ReassemblyBudget budget(reassemblyCapMB << 20);
+    std::vector<uint64_t> packetNumbers(packets.size());
+    for (size_t i = 0; i < packets.size(); i++) packetNumbers[i] = i + 1;
+    PacketWorker worker(*registry, false, reassemblyCapMB ? &budget : nullptr);
+    results.push_back(measure("full chain", [&] {
+        for (size_t start = 0; start < packets.size(); start += WorkBatch::kCapacity) {
+            size_t count = std::min(packets.size() - start, WorkBatch::kCapacity);
+            worker.processBatch(packets.data() + start, packetNumbers.data() + start, count);
+        }
+        worker.finishStreams();
+        return uint64_t(packets.size());
+    }));
+
+    // Core CSV reports from the full chain's tables, written into a scratch directory
+    std::string reportDirectory = (std::filesystem::temp_directory_path() / "bench-reports-XXXXXX").string();
+    if (!mkdtemp(reportDirectory.data())) {
+        std::cerr << "Error: Could not create a directory for the reports.\n";
+        return false;
+    }
+    std::filesystem::path workingDirectory = std::filesystem::current_path();
+    std::filesystem::current_path(reportDirectory);
+    for (const char* directory : {"output-ip-csv-files", "output-tcp-csv-files", "output-udp-csv-files"}) {
+        std::filesystem::create_directory(directory);
+    }
+    const StatsTables& reportTables = worker.getTables();
+    results.push_back(measure("report generation", [&] {
+        IPParser::generateReport(reportTables.ip, ReportFormat::Csv);
+        TCPParser::generateReport(reportTables.tcp, ReportFormat::Csv);
+        UDPParser::generateReport(reportTables.udp, ReportFormat::Csv);
+        return uint64_t(packets.size());
+    }));
+    std::filesystem::current_path(workingDirectory);
+    std::filesystem::remove_all(reportDirectory);
+
+    printResults(results);
+    return true;
+}
+
+// Flow records of a table in the order the reports list them
+std::vector<FlowRecord> reportedFlows(const FlowTable& flows) {
+    std::vector<FlowRecord> records;
+    flows.forEachRecord([&](const FlowRecord& record) { records.push_back(record); });
+    return records;
+}
+
+bool sameFlow(const FlowRecord& a, const FlowRecord& b) {
+    const FlowEntry& x = a.entry;
+    const FlowEntry& y = b.entry;
+    return a.key == b.key && x.firstSeen == y.firstSeen && x.lastSeen == y.lastSeen &&
+           x.packetsToServer == y.packetsToServer && x.packetsToClient == y.packetsToClient &&
+           x.bytesToServer == y.bytesToServer && x.bytesToClient == y.bytesToClient && x.state == y.state &&
+           x.clientIsA == y.clientIsA;
+}
+
+// Number of flows of whole that split reports too, in the same row
+size_t matchingFlows(const FlowTable& whole, const FlowTable& split) {
+    std::vector<FlowRecord> expected = reportedFlows(whole);
+    std::vector<FlowRecord> actual = reportedFlows(split);
+    size_t matching = 0;
+    for (size_t i = 0; i < std::min(expected.size(), actual.size()); i++) {
+        if (sameFlow(expected[i], actual[i])) matching++;
+    }
+    return matching;
+}
+
+// Parse the capture whole, and again cut into parts each parsed by its own
+// worker and merged pairwise the way the Controller merges its workers: once
+// as runs of consecutive packets, as for several capture files, and once
+// sharded by address, as for --threads. The connection reports have to come
+// out the same row for row, with the default flow timeout, with one short
+// enough that flows go idle within the parts, and with none at all, which
+// spills every flow at the next sweep after its last packet.
+bool checkSplit(const std::string& capturePath, size_t runs) {
+    PCAPFileParser capture;
+    if (!capture.parseFile(capturePath)) return false;
+    std::vector<PacketView> packets;
+    PacketView view;
+    while (capture.nextPacket(view)) packets.push_back(view);
+    if (packets.size() < runs) {
+        std::cerr << "Error: Fewer packets in " << capturePath << " than runs.\n";
+        return false;
+    }
+
+    ProtocolRegistry registry({});
+    auto parse = [&](PacketWorker& worker, const std::vector<size_t>& indexes) {
+        std::vector<PacketView> views;
+        std::vector<uint64_t> packetNumbers;
+        for (size_t i : indexes) {
+            views.push_back(packets[i]);
+            packetNumbers.push_back(i + 1);
+        }
+        for (size_t start = 0; start < views.size(); start += WorkBatch::kCapacity) {
+            size_t count = std::min(views.size() - start, WorkBatch::kCapacity);
+            worker.processBatch(views.data() + start, packetNumbers.data() + start, count);
+        }
+        worker.finishStreams();
+    };
+
+    std::vector<size_t> all(packets.size());
+    for (size_t i = 0; i < packets.size(); i++) all[i] = i;
+
+    bool ok = true;
+    for (uint64_t timeoutUsec : {FlowTable::kDefaultIdleTimeoutUsec, uint64_t(100000), uint64_t(0)}) {
+        PacketWorker whole(registry, false, nullptr);
+        whole.setFlowTimeout(timeoutUsec);
+        parse(whole, all);
+
+        for (bool sharded : {false, true}) {
+            std::vector<std::vector<size_t>> cuts(runs);
+            for (size_t i = 0; i < packets.size(); i++) {
+                cuts[sharded ? shardForPacket(packets[i], runs) : i * runs / packets.size()].push_back(i);
+            }
+            std::vector<std::unique_ptr<PacketWorker>> parts;
+            for (size_t run = 0; run < runs; run++) {
+                parts.push_back(std::make_unique<PacketWorker>(registry, false, nullptr));
+                parts.back()->setFlowTimeout(timeoutUsec);
+                parse(*parts.back(), cuts[run]);
+            }
+            for (size_t stride = 1; stride < runs; stride *= 2) {
+                for (size_t run = 0; run + stride < runs; run += 2 * stride) {
+                    parts[run]->getTables().merge(parts[run + stride]->getTables());
+                }
+            }
+
+            const StatsTables& expected = whole.getTables();
+            const StatsTables& actual = parts[0]->getTables();
+            size_t tcpFlows = expected.tcp.flows.totalFlows();
+            size_t udpFlows = expected.udp.flows.totalFlows();
+            size_t tcpMatching = matchingFlows(expected.tcp.flows, actual.tcp.flows);
+            size_t udpMatching = matchingFlows(expected.udp.flows, actual.udp.flows);
+            bool match = tcpMatching == tcpFlows && udpMatching == udpFlows &&
+                         actual.tcp.flows.totalFlows() == tcpFlows && actual.udp.flows.totalFlows() == udpFlows &&
+                         actual.tcp.totalPackets == expected.tcp.totalPackets &&
+                         actual.udp.totalPackets == expected.udp.totalPackets;
+            std::cout << runs << (sharded ? " shards" : " runs") << ", flow timeout " << timeoutUsec / 1000
+                      << " ms: TCP " << tcpMatching << " of " << tcpFlows << " flows match ("
+                      << actual.tcp.flows.totalFlows() << " after merging), UDP " << udpMatching << " of "
+                      << udpFlows << " (" << actual.udp.flows.totalFlows() << ")" << (match ? "" : ", MISMATCH")
+                      << "\n";
+            ok = ok && match;
+        }
+    }
+    return ok;
+}
+
+// Generator options shared by both commands, false if argv[i] isn't one
+bool parseGeneratorOption(int argc, const char* argv[], int& i, SyntheticCaptureOptions& options, bool& valid) {
+    if (i + 1 >= argc) return false;
+    const char* value = argv[i + 1];
+    if (std::strcmp(argv[i], "--packets") == 0) {
+        options.packets = std::stoull(value);
+    } else if (std::strcmp(argv[i], "--flows") == 0) {
+        options.flows = std::stoul(value);
+    } else if (std::strcmp(argv[i], "--hosts") == 0) {
+        options.hosts = std::stoul(value);
+    } else if (std::strcmp(argv[i], "--tcp-ratio") == 0) {
+        options.tcpRatio = std::stod(value);
+    } else if (std::strcmp(argv[i], "--sizes") == 0) {
+        valid = parseSizeMix(value, options.sizeMix);
+        if (!valid) std::cerr << "Invalid size mix: " << value << std::endl;
+    } else if (std::strcmp(argv[i], "--seed") == 0) {
+        options.seed = std::stoull(value);
+    } else {
+        return false;
+    }
+    i++;
+    return true;
+}
+
+void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " generate <out.pcap> [generator options]\n"
+              << "       " << program << " run [--capture <pcap_file>] [--reassembly-cap <MB>] [generator options]\n"
+              << "       " << program << " split [--capture <pcap_file>] [--runs <N>] [generator options]\n"
+              << "Generator options: [--packets <N>] [--flows <N>] [--hosts <N>] [--tcp-ratio <0..1>]\n"
+              << "                   [--sizes <bytes>:<weight>,...] [--seed <N>]\n"
+              << "Without --capture, run and split use a capture generated into the temporary directory.\n"
+              << "split checks that the capture cut into N runs or shards and merged gives the same connections\n"
+              << "in the same order." << std::endl;
+}
+
+} // namespace
+} // namespace NetworkParser
+
+int main(int argc, const char* argv[]) {
+    using namespace NetworkParser;
+    if (argc < 2) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    bool generate = std::strcmp(argv[1], "generate") == 0;
+    bool split = std::strcmp(argv[1], "split") == 0;
+    if (!generate && !split && std::strcmp(argv[1], "run") != 0) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    SyntheticCaptureOptions options;
+    std::string capturePath;
+    size_t reassemblyCapMB = 64;
+    size_t runs = 4;
+    int first = 2;
+    if (generate) {
+        if (argc < 3) {
+            printUsage(argv[0]);
+            return 1;
+        }
+        capturePath = argv[2];
+        first = 3;
+    }
+    try {
+        for (int i = first; i < argc; i++) {
+            bool valid = true;
+            if (parseGeneratorOption(argc, argv, i, options, valid)) {
+                if (!valid) return 1;
+            } else if (!generate && std::strcmp(argv[i], "--capture") == 0 && i + 1 < argc) {
+                capturePath = argv[++i];
+            } else if (!generate && !split && std::strcmp(argv[i], "--reassembly-cap") == 0 && i + 1 < argc) {
+                reassemblyCapMB = std::stoul(argv[++i]);
+            } else if (split && std::strcmp(argv[i], "--runs") == 0 && i + 1 < argc) {
+                runs = std::stoul(argv[++i]);
+                if (runs == 0) throw std::invalid_argument("runs");
+            } else {
+                std::cerr << "Unknown option: " << argv[i] << std::endl;
+                printUsage(argv[0]);
+                return 1;
+            }
+        }
+    } catch (const std::exception&) {
+        std::cerr << "Invalid option value" << std::endl;
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    if (generate) return writeSyntheticCapture(capturePath, options) ? 0 : 1;
+
+    std::string generatedPath;
+    if (capturePath.empty()) {
+        generatedPath = (std::filesystem::temp_directory_path() / "bench-XXXXXX").string();
+        int fd = mkstemp(generatedPath.data());
+        if (fd < 0) {
+            std::cerr << "Error: Could not create a temporary capture file.\n";
+            return 1;
+        }
+        close(fd);
+        std::cout << "Generating " << options.packets << " packets over " << options.flows << " flows and "
+                  << options.hosts << " hosts, seed " << options.seed << "..." << std::endl;
+        if (!writeSyntheticCapture(generatedPath, options)) {
+            std::remove(generatedPath.c_str());
+            return 1;
+        }
+        capturePath = generatedPath;
+    }
+
+    bool ok = split ? checkSplit(capturePath, runs) : runStages(capturePath, reassemblyCapMB);
+    if (!generatedPath.empty()) std::remove(generatedPath.c_str());
+    return ok ? 0 : 1;
+}
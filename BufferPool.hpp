@@ -0,0 +1,42 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace NetworkParser {
+
+// Free list of byte buffers. Released buffers keep their capacity, so once
+// the pool has warmed up, acquiring a buffer no longer allocates.
+class BufferPool {
+public:
+    explicit BufferPool(size_t maxFree = 256, size_t maxCapacity = 64 * 1024)
+        : maxFree(maxFree), maxCapacity(maxCapacity) {}
+
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    // Buffer holding a copy of data
+    std::vector<uint8_t> acquire(const uint8_t* data, size_t length) {
+        std::vector<uint8_t> buffer;
+        if (!freeBuffers.empty()) {
+            buffer = std::move(freeBuffers.back());
+            freeBuffers.pop_back();
+        }
+        buffer.assign(data, data + length);
+        return buffer;
+    }
+
+    // Oversized buffers are let go rather than pinned in the pool
+    void release(std::vector<uint8_t>&& buffer) {
+        if (freeBuffers.size() >= maxFree || buffer.capacity() > maxCapacity) return;
+        freeBuffers.push_back(std::move(buffer));
+    }
+
+private:
+    size_t maxFree;
+    size_t maxCapacity;
+    std::vector<std::vector<uint8_t>> freeBuffers;
+};
+
+} // namespace NetworkParser
@@ -0,0 +1,215 @@
+#include "CaptureFormat.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+
+namespace NetworkParser {
+
+// Classic pcap magic numbers, as read in host byte order
+static constexpr uint32_t kPcapMicroseconds = 0xa1b2c3d4;
+static constexpr uint32_t kPcapMicrosecondsSwapped = 0xd4c3b2a1;
+static constexpr uint32_t kPcapNanoseconds = 0xa1b23c4d;
+static constexpr uint32_t kPcapNanosecondsSwapped = 0x4d3cb2a1;
+
+// pcapng block types
+static constexpr uint32_t kSectionHeaderBlock = 0x0A0D0D0A;  // Reads the same in either byte order
+static constexpr uint32_t kInterfaceDescriptionBlock = 1;
+static constexpr uint32_t kObsoletePacketBlock = 2;
+static constexpr uint32_t kSimplePacketBlock = 3;
+static constexpr uint32_t kEnhancedPacketBlock = 6;
+static constexpr uint32_t kByteOrderMagic = 0x1A2B3C4D;
+static constexpr uint32_t kByteOrderMagicSwapped = 0x4D3C2B1A;
+static constexpr uint16_t kOptionEnd = 0;
+static constexpr uint16_t kOptionTimestampResolution = 9;
+
+template <bool Swapped>
+static inline uint32_t read32(const uint8_t* data) {
+    uint32_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return Swapped ? __builtin_bswap32(value) : value;
+}
+
+template <bool Swapped>
+static inline uint16_t read16(const uint8_t* data) {
+    uint16_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return Swapped ? __builtin_bswap16(value) : value;
+}
+
+bool CaptureDecoder::open(const uint8_t* data, size_t available) {
+    decodeRecord = nullptr;
+    fileHeaderLength = 0;
+    corruptFile = false;
+    interfaces.clear();
+    if (available < kProbeLength) return false;
+
+    switch (read32<false>(data)) {
+        case kPcapMicroseconds: decodeRecord = decodePcap<false, false>; break;
+        case kPcapMicrosecondsSwapped: decodeRecord = decodePcap<true, false>; break;
+        case kPcapNanoseconds: decodeRecord = decodePcap<false, true>; break;
+        case kPcapNanosecondsSwapped: decodeRecord = decodePcap<true, true>; break;
+        case kSectionHeaderBlock:
+            // The section header is decoded like any other block, it sets the byte order
+            decodeRecord = decodeSectionHeader;
+            return true;
+        default:
+            std::cerr << "Error: Unsupported capture format." << std::endl;
+            return false;
+    }
+    fileHeaderLength = sizeof(PcapGlobalHeader);
+    return true;
+}
+
+size_t CaptureDecoder::fail() {
+    if (!corruptFile) std::cerr << "Error: Corrupt capture record, stopping." << std::endl;
+    corruptFile = true;
+    return 0;
+}
+
+template <bool Swapped, bool Nanosecond>
+size_t CaptureDecoder::decodePcap(CaptureDecoder& decoder, const uint8_t* data, size_t available, PacketView& view,
+                                  bool& isPacket) {
+    if (available < sizeof(PcapPacketHeader)) return 0;
+
+    uint32_t capturedLength = read32<Swapped>(data + offsetof(PcapPacketHeader, incl_len));
+    if (capturedLength > kMaxRecordLength) return decoder.fail();
+    size_t recordLength = sizeof(PcapPacketHeader) + capturedLength;
+    if (available < recordLength) return recordLength;
+
+    uint32_t fraction = read32<Swapped>(data + offsetof(PcapPacketHeader, ts_usec));
+    view.data = data + sizeof(PcapPacketHeader);
+    view.length = capturedLength;
+    view.timestampSec = read32<Swapped>(data + offsetof(PcapPacketHeader, ts_sec));
+    view.timestampUsec = Nanosecond ? fraction / 1000 : fraction;
+    isPacket = true;
+    return recordLength;
+}
+
+size_t CaptureDecoder::decodeSectionHeader(CaptureDecoder& decoder, const uint8_t* data, size_t available,
+                                           PacketView& view, bool& isPacket) {
+    if (available < 12) return 0;
+
+    // Each section declares its own byte order, interfaces are numbered per section
+    uint32_t magic = read32<false>(data + 8);
+    if (magic == kByteOrderMagic) {
+        decoder.decodeRecord = decodePcapNG<false>;
+    } else if (magic == kByteOrderMagicSwapped) {
+        decoder.decodeRecord = decodePcapNG<true>;
+    } else {
+        return decoder.fail();
+    }
+    decoder.interfaces.clear();
+
+    uint32_t blockLength = (magic == kByteOrderMagic) ? read32<false>(data + 4) : read32<true>(data + 4);
+    if (blockLength < 28 || blockLength % 4 || blockLength > kMaxRecordLength) return decoder.fail();
+    return blockLength;
+}
+
+template <bool Swapped>
+size_t CaptureDecoder::decodePcapNG(CaptureDecoder& decoder, const uint8_t* data, size_t available,
+                                    PacketView& view, bool& isPacket) {
+    if (available < 12) return 0;
+
+    uint32_t blockType = read32<Swapped>(data);
+    if (blockType == kSectionHeaderBlock) {
+        return decodeSectionHeader(decoder, data, available, view, isPacket);
+    }
+
+    uint32_t blockLength = read32<Swapped>(data + 4);
+    if (blockLength < 12 || blockLength % 4 || blockLength > kMaxRecordLength) return decoder.fail();
+    if (available < blockLength) return blockLength;
+
+    // Type and length in front, the length repeated at the end
+    const uint8_t* body = data + 8;
+    size_t bodyLength = blockLength - 12;
+
+    switch (blockType) {
+        case kInterfaceDescriptionBlock:
+            decoder.addInterface<Swapped>(body, bodyLength);
+            break;
+
+        case kEnhancedPacketBlock: {
+            if (bodyLength < 20) return decoder.fail();
+            uint32_t capturedLength = read32<Swapped>(body + 12);
+            if (capturedLength > bodyLength - 20) return decoder.fail();
+            uint64_t ticks = (static_cast<uint64_t>(read32<Swapped>(body + 4)) << 32) | read32<Swapped>(body + 8);
+            decoder.setTimestamp(view, read32<Swapped>(body), ticks);
+            view.data = body + 20;
+            view.length = capturedLength;
+            isPacket = true;
+            break;
+        }
+
+        case kSimplePacketBlock: {
+            // No timestamp, and the captured length is implied by the snap length
+            if (bodyLength < 4) return decoder.fail();
+            size_t capturedLength = std::min<size_t>(read32<Swapped>(body), bodyLength - 4);
+            if (!decoder.interfaces.empty() && decoder.interfaces[0].snapLength) {
+                capturedLength = std::min<size_t>(capturedLength, decoder.interfaces[0].snapLength);
+            }
+            view.data = body + 4;
+            view.length = capturedLength;
+            view.timestampSec = 0;
+            view.timestampUsec = 0;
+            isPacket = true;
+            break;
+        }
+
+        case kObsoletePacketBlock: {
+            if (bodyLength < 20) return decoder.fail();
+            uint32_t capturedLength = read32<Swapped>(body + 12);
+            if (capturedLength > bodyLength - 20) return decoder.fail();
+            uint64_t ticks = (static_cast<uint64_t>(read32<Swapped>(body + 4)) << 32) | read32<Swapped>(body + 8);
+            decoder.setTimestamp(view, read16<Swapped>(body), ticks);
+            view.data = body + 20;
+            view.length = capturedLength;
+            isPacket = true;
+            break;
+        }
+
+        default:
+            // Statistics, name resolution and custom blocks carry no packets
+            break;
+    }
+    return blockLength;
+}
+
+template <bool Swapped>
+void CaptureDecoder::addInterface(const uint8_t* body, size_t bodyLength) {
+    Interface interface;
+    if (bodyLength >= 8) interface.snapLength = read32<Swapped>(body + 4);
+
+    // Options follow the fixed fields, each padded to 32 bits
+    size_t position = 8;
+    while (position + 4 <= bodyLength) {
+        uint16_t code = read16<Swapped>(body + position);
+        uint16_t length = read16<Swapped>(body + position + 2);
+        if (code == kOptionEnd || position + 4 + length > bodyLength) break;
+
+        if (code == kOptionTimestampResolution && length >= 1) {
+            uint8_t resolution = body[position + 4];
+            if (resolution & 0x80) {
+                interface.ticksPerSecond = 1ull << std::min(resolution & 0x7f, 63);
+            } else {
+                interface.ticksPerSecond = 1;
+                for (uint8_t i = 0; i < resolution && i < 19; i++) interface.ticksPerSecond *= 10;
+            }
+        }
+        position += 4 + ((length + 3) & ~3u);
+    }
+    interfaces.push_back(interface);
+}
+
+void CaptureDecoder::setTimestamp(PacketView& view, uint32_t interfaceId, uint64_t ticks) const {
+    uint64_t ticksPerSecond = (interfaceId < interfaces.size()) ? interfaces[interfaceId].ticksPerSecond : 1000000;
+    uint64_t fraction = ticks % ticksPerSecond;
+    view.timestampSec = static_cast<uint32_t>(ticks / ticksPerSecond);
+    if (ticksPerSecond == 1000000) {
+        view.timestampUsec = static_cast<uint32_t>(fraction);
+    } else {
+        view.timestampUsec = static_cast<uint32_t>(static_cast<unsigned __int128>(fraction) * 1000000 / ticksPerSecond);
+    }
+}
+
+} // namespace NetworkParser
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "Ethernet.hpp"
+
+namespace NetworkParser {
+
+// View of a single captured packet. Timestamps are normalized to
+// microseconds whatever the resolution of the capture format.
+struct PacketView {
+    const uint8_t* data = nullptr;
+    size_t length = 0;
+    uint32_t timestampSec = 0;
+    uint32_t timestampUsec = 0;
+};
+
+// Decodes the records of a capture file in place. The format and byte order
+// are detected from the magic number when the file is opened, which picks a
+// decode routine specialized for them, so no per-packet format checks or
+// byte order tests remain. Supports classic pcap in microsecond and
+// nanosecond resolution, either byte order, and pcapng.
+class CaptureDecoder {
+public:
+    // Anything bigger is taken as a corrupt length field
+    static constexpr size_t kMaxRecordLength = 64 << 20;
+
+    // Bytes needed to recognise the format
+    static constexpr size_t kProbeLength = sizeof(PcapGlobalHeader);
+
+    // Detect the format from the start of the file. Returns false if it is
+    // not a supported format, otherwise headerLength says how much to skip.
+    bool open(const uint8_t* data, size_t available);
+    size_t headerLength() const { return fileHeaderLength; }
+
+    // Decode the record at data. Returns its length, which may be more than
+    // available when the record is incomplete, or 0 if not even its header is
+    // there or the file is corrupt. isPacket says whether view was filled in,
+    // pcapng also has blocks that carry no packet.
+    size_t decode(const uint8_t* data, size_t available, PacketView& view, bool& isPacket) {
+        isPacket = false;
+        return decodeRecord(*this, data, available, view, isPacket);
+    }
+
+    bool corrupt() const { return corruptFile; }
+
+private:
+    using DecodeFunc = size_t (*)(CaptureDecoder&, const uint8_t*, size_t, PacketView&, bool&);
+
+    // pcapng interface description, timestamps count in units of 1/ticksPerSecond
+    struct Interface {
+        uint64_t ticksPerSecond = 1000000;
+        uint32_t snapLength = 0;
+    };
+
+    DecodeFunc decodeRecord = nullptr;
+    size_t fileHeaderLength = 0;
+    bool corruptFile = false;
+    std::vector<Interface> interfaces;  // Of the current pcapng section
+
+    size_t fail();
+
+    template <bool Swapped, bool Nanosecond>
+    static size_t decodePcap(CaptureDecoder& decoder, const uint8_t* data, size_t available, PacketView& view,
+                             bool& isPacket);
+    template <bool Swapped>
+    static size_t decodePcapNG(CaptureDecoder& decoder, const uint8_t* data, size_t available, PacketView& view,
+                               bool& isPacket);
+    static size_t decodeSectionHeader(CaptureDecoder& decoder, const uint8_t* data, size_t available,
+                                      PacketView& view, bool& isPacket);
+    template <bool Swapped>
+    void addInterface(const uint8_t* body, size_t bodyLength);
+    void setTimestamp(PacketView& view, uint32_t interfaceId, uint64_t ticks) const;
+};
+
+} // namespace NetworkParser
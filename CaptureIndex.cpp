@@ -0,0 +1,373 @@
+#include "CaptureIndex.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <iterator>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "Ethernet.hpp"
+#include "IPParser.hpp"
+
+namespace NetworkParser {
+
+static constexpr char kIndexMagic[8] = {'P', 'C', 'A', 'P', 'I', 'D', 'X', '1'};
+static constexpr uint32_t kIndexVersion = 3;  // 2 widened flow keys to 128 bit addresses, 3 added tagged frames
+static constexpr uint8_t kProtocolTCP = 6;
+static constexpr uint8_t kProtocolUDP = 17;
+
+bool peekAddresses(const PacketView& packet, PacketContext& context) {
+    // Behind any VLAN tags or MPLS labels, as the parser sees it
+    size_t ethernetLength;
+    bool truncated;
+    if (findNetworkLayer(packet.data, packet.length, 0, ethernetLength, truncated) != 0x0800) return false;
+    if (packet.length < ethernetLength + sizeof(IPv4Header)) return false;
+
+    const IPv4Header* ipHeader = reinterpret_cast<const IPv4Header*>(packet.data + ethernetLength);
+    size_t headerLength = (ipHeader->version_internet_header_length & 0x0F) * 4;
+    if (headerLength < sizeof(IPv4Header)) return false;
+
+    context.srcAddress = ntohl(ipHeader->sourceIP);
+    context.destAddress = ntohl(ipHeader->destinationIP);
+    context.ipProtocol = ipHeader->protocol;
+    context.hasAddresses = true;
+
+    // Only the first fragment of a datagram carries the ports
+    bool firstFragment = (ntohs(ipHeader->flags_offset) & 0x1FFF) == 0;
+    size_t transport = ethernetLength + headerLength;
+    if (firstFragment && (context.ipProtocol == kProtocolTCP || context.ipProtocol == kProtocolUDP) &&
+        packet.length >= transport + 4) {
+        uint16_t ports[2];
+        std::memcpy(ports, packet.data + transport, sizeof(ports));
+        context.srcPort = ntohs(ports[0]);
+        context.destPort = ntohs(ports[1]);
+        context.hasPorts = true;
+    }
+    return true;
+}
+
+bool PacketSelection::matches(const PacketView& packet) const {
+    uint64_t timestamp = static_cast<uint64_t>(packet.timestampSec) * 1000000 + packet.timestampUsec;
+    if (timestamp < fromUsec || timestamp > toUsec) return false;
+    if (!hasHost && !hasFlow) return true;
+
+    PacketContext context;
+    if (!peekAddresses(packet, context)) return false;
+    if (hasHost && context.srcAddress != host && context.destAddress != host) return false;
+    if (hasFlow) {
+        if (!context.hasPorts) return false;
+        bool senderIsA;
+        FlowKey key = makeFlowKey(context, senderIsA);
+        if (flow.protocol == 0) key.protocol = 0;
+        if (!(key == flow)) return false;
+    }
+    return true;
+}
+
+void CaptureIndexBuilder::Posting::add(uint64_t offset) {
+    uint64_t delta = offset - last;
+    last = offset;
+    packets++;
+    while (delta >= 0x80) {
+        bytes.push_back(static_cast<uint8_t>(delta) | 0x80);
+        delta >>= 7;
+    }
+    bytes.push_back(static_cast<uint8_t>(delta));
+}
+
+void CaptureIndexBuilder::addPacket(uint64_t offset, const PacketView& packet) {
+    uint64_t timestamp = static_cast<uint64_t>(packet.timestampSec) * 1000000 + packet.timestampUsec;
+    if (packetCount++ % kBlockPackets == 0) {
+        timeBlocks.push_back(IndexTimeBlock{offset, timestamp, timestamp});
+    } else {
+        IndexTimeBlock& block = timeBlocks.back();
+        block.minTimestamp = std::min(block.minTimestamp, timestamp);
+        block.maxTimestamp = std::max(block.maxTimestamp, timestamp);
+    }
+
+    PacketContext context;
+    if (!peekAddresses(packet, context)) return;
+    hosts[context.srcAddress].add(offset);
+    if (context.destAddress != context.srcAddress) hosts[context.destAddress].add(offset);
+    if (context.hasPorts) {
+        bool senderIsA;
+        flows[makeFlowKey(context, senderIsA)].add(offset);
+    }
+}
+
+bool CaptureIndexBuilder::write(const std::string& path, uint64_t captureSize, int64_t captureModified) const {
+    // Directories in key order, each pointing at its list in the posting area
+    std::vector<std::pair<uint32_t, const Posting*>> hostList;
+    for (const auto& slot : hosts) hostList.emplace_back(slot.key, &slot.value);
+    std::sort(hostList.begin(), hostList.end(),
+              [](const auto& a, const auto& b) { return a.first < b.first; });
+    std::vector<std::pair<FlowKey, const Posting*>> flowList;
+    for (const auto& slot : flows) flowList.emplace_back(slot.key, &slot.value);
+    std::sort(flowList.begin(), flowList.end(),
+              [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    // Entries are value-initialized, which zeroes their padding, so no stray
+    // bytes reach the file
+    uint64_t postingBytes = 0;
+    std::vector<IndexHostEntry> hostEntries(hostList.size());
+    for (size_t i = 0; i < hostList.size(); i++) {
+        hostEntries[i].address = hostList[i].first;
+        hostEntries[i].packets = hostList[i].second->packets;
+        hostEntries[i].posting = postingBytes;
+        postingBytes += hostList[i].second->bytes.size();
+    }
+    std::vector<IndexFlowEntry> flowEntries(flowList.size());
+    for (size_t i = 0; i < flowList.size(); i++) {
+        flowEntries[i].key = flowList[i].first;
+        flowEntries[i].packets = flowList[i].second->packets;
+        flowEntries[i].posting = postingBytes;
+        postingBytes += flowList[i].second->bytes.size();
+    }
+
+    IndexHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, kIndexMagic, sizeof(kIndexMagic));
+    header.version = kIndexVersion;
+    header.blockPackets = kBlockPackets;
+    header.captureSize = captureSize;
+    header.captureModified = captureModified;
+    header.packetCount = packetCount;
+    header.timeBlockCount = timeBlocks.size();
+    header.stateRecordCount = stateRecords.size();
+    header.hostCount = hostEntries.size();
+    header.flowCount = flowEntries.size();
+    header.postingBytes = postingBytes;
+
+    // Written aside and renamed into place, so a half written index is never picked up
+    std::string partial = path + ".partial";
+    std::FILE* file = std::fopen(partial.c_str(), "wb");
+    if (!file) {
+        std::cerr << "Error: Could not open " << partial << " for writing.\n";
+        return false;
+    }
+    bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1;
+    ok = ok && std::fwrite(timeBlocks.data(), sizeof(IndexTimeBlock), timeBlocks.size(), file) == timeBlocks.size();
+    ok = ok && std::fwrite(stateRecords.data(), sizeof(uint64_t), stateRecords.size(), file) == stateRecords.size();
+    ok = ok && std::fwrite(hostEntries.data(), sizeof(IndexHostEntry), hostEntries.size(), file) == hostEntries.size();
+    ok = ok && std::fwrite(flowEntries.data(), sizeof(IndexFlowEntry), flowEntries.size(), file) == flowEntries.size();
+    for (const auto& [address, posting] : hostList) {
+        ok = ok && std::fwrite(posting->bytes.data(), 1, posting->bytes.size(), file) == posting->bytes.size();
+    }
+    for (const auto& [key, posting] : flowList) {
+        ok = ok && std::fwrite(posting->bytes.data(), 1, posting->bytes.size(), file) == posting->bytes.size();
+    }
+    ok = (std::fclose(file) == 0) && ok;
+    if (!ok || std::rename(partial.c_str(), path.c_str()) != 0) {
+        std::cerr << "Error: Failed writing index " << path << ".\n";
+        std::remove(partial.c_str());
+        return false;
+    }
+    return true;
+}
+
+CaptureIndex::~CaptureIndex() {
+    if (mapped) munmap(const_cast<uint8_t*>(mapped), mappedSize);
+}
+
+bool CaptureIndex::identify(const std::string& capturePath, uint64_t& size, int64_t& modified) {
+    struct stat info;
+    if (stat(capturePath.c_str(), &info) != 0) return false;
+    size = info.st_size;
+#ifdef __APPLE__
+    modified = static_cast<int64_t>(info.st_mtimespec.tv_sec) * 1000000000 + info.st_mtimespec.tv_nsec;
+#else
+    modified = static_cast<int64_t>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+#endif
+    return true;
+}
+
+bool CaptureIndex::open(const std::string& path, uint64_t captureSize, int64_t captureModified) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(IndexHeader)) {
+        close(fd);
+        return false;
+    }
+    void* mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) return false;
+    mapped = static_cast<const uint8_t*>(mapping);
+    mappedSize = info.st_size;
+
+    header = reinterpret_cast<const IndexHeader*>(mapped);
+    uint64_t expectedSize = sizeof(IndexHeader) + header->timeBlockCount * sizeof(IndexTimeBlock) +
+                            header->stateRecordCount * sizeof(uint64_t) +
+                            header->hostCount * sizeof(IndexHostEntry) +
+                            header->flowCount * sizeof(IndexFlowEntry) + header->postingBytes;
+    if (std::memcmp(header->magic, kIndexMagic, sizeof(kIndexMagic)) != 0 || header->version != kIndexVersion ||
+        header->blockPackets != CaptureIndexBuilder::kBlockPackets || header->captureSize != captureSize ||
+        header->captureModified != captureModified || expectedSize != mappedSize) {
+        munmap(mapping, mappedSize);
+        mapped = nullptr;
+        header = nullptr;
+        return false;
+    }
+
+    const uint8_t* at = mapped + sizeof(IndexHeader);
+    timeBlocks = reinterpret_cast<const IndexTimeBlock*>(at);
+    at += header->timeBlockCount * sizeof(IndexTimeBlock);
+    stateRecords = reinterpret_cast<const uint64_t*>(at);
+    at += header->stateRecordCount * sizeof(uint64_t);
+    hosts = reinterpret_cast<const IndexHostEntry*>(at);
+    at += header->hostCount * sizeof(IndexHostEntry);
+    flows = reinterpret_cast<const IndexFlowEntry*>(at);
+    at += header->flowCount * sizeof(IndexFlowEntry);
+    postings = at;
+
+    // Index lookups jump around rather than read front to back
+    madvise(mapping, mappedSize, MADV_RANDOM);
+    return true;
+}
+
+std::vector<uint64_t> CaptureIndex::decodePosting(uint64_t posting, uint32_t packets) const {
+    std::vector<uint64_t> offsets;
+    offsets.reserve(packets);
+    const uint8_t* at = postings + posting;
+    const uint8_t* end = postings + header->postingBytes;
+    uint64_t offset = 0;
+    for (uint32_t i = 0; i < packets && at < end; i++) {
+        uint64_t delta = 0;
+        for (int shift = 0; at < end && shift < 64; shift += 7) {
+            uint8_t byte = *at++;
+            delta |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) break;
+        }
+        offset += delta;
+        offsets.push_back(offset);
+    }
+    return offsets;
+}
+
+std::vector<uint64_t> CaptureIndex::flowOffsets(const FlowKey& key) const {
+    auto lookup = [&](const FlowKey& wanted) {
+        const IndexFlowEntry* end = flows + header->flowCount;
+        const IndexFlowEntry* entry = std::lower_bound(
+            flows, end, wanted, [](const IndexFlowEntry& a, const FlowKey& b) { return a.key < b; });
+        if (entry == end || !(entry->key == wanted)) return std::vector<uint64_t>();
+        return decodePosting(entry->posting, entry->packets);
+    };
+    if (key.protocol != 0) return lookup(key);
+
+    // Any protocol, so the TCP and UDP flows on these ports together
+    FlowKey tcp = key;
+    FlowKey udp = key;
+    tcp.protocol = kProtocolTCP;
+    udp.protocol = kProtocolUDP;
+    std::vector<uint64_t> tcpOffsets = lookup(tcp);
+    std::vector<uint64_t> udpOffsets = lookup(udp);
+    std::vector<uint64_t> offsets;
+    std::merge(tcpOffsets.begin(), tcpOffsets.end(), udpOffsets.begin(), udpOffsets.end(),
+               std::back_inserter(offsets));
+    return offsets;
+}
+
+std::vector<RecordRange> CaptureIndex::rangesFor(const PacketSelection& selection, uint64_t fileSize) const {
+    // Blocks whose packets may fall in the time window
+    size_t blockCount = header->timeBlockCount;
+    std::vector<bool> blockWanted(blockCount);
+    for (size_t b = 0; b < blockCount; b++) {
+        blockWanted[b] = timeBlocks[b].minTimestamp <= selection.toUsec &&
+                         timeBlocks[b].maxTimestamp >= selection.fromUsec;
+    }
+    auto blockEnd = [&](size_t b) { return b + 1 < blockCount ? timeBlocks[b + 1].offset : fileSize; };
+
+    std::vector<RecordRange> ranges;
+    if (selection.hasHost || selection.hasFlow) {
+        std::vector<uint64_t> offsets;
+        if (selection.hasHost) {
+            const IndexHostEntry* end = hosts + header->hostCount;
+            const IndexHostEntry* entry = std::lower_bound(
+                hosts, end, selection.host, [](const IndexHostEntry& a, uint32_t b) { return a.address < b; });
+            if (entry != end && entry->address == selection.host) offsets = decodePosting(entry->posting, entry->packets);
+        }
+        if (selection.hasFlow) {
+            std::vector<uint64_t> flowList = flowOffsets(selection.flow);
+            if (selection.hasHost) {
+                std::vector<uint64_t> both;
+                std::set_intersection(offsets.begin(), offsets.end(), flowList.begin(), flowList.end(),
+                                      std::back_inserter(both));
+                offsets.swap(both);
+            } else {
+                offsets.swap(flowList);
+            }
+        }
+
+        // One record at each offset, in a block the time window wants
+        for (uint64_t offset : offsets) {
+            auto next = std::upper_bound(timeBlocks, timeBlocks + blockCount, offset,
+                                         [](uint64_t a, const IndexTimeBlock& b) { return a < b.offset; });
+            size_t b = next - timeBlocks;
+            if (b > 0 && blockWanted[b - 1]) ranges.push_back(RecordRange{offset, offset + 1});
+        }
+    } else {
+        for (size_t b = 0; b < blockCount; b++) {
+            if (blockWanted[b]) ranges.push_back(RecordRange{timeBlocks[b].offset, blockEnd(b)});
+        }
+    }
+
+    if (header->stateRecordCount) {
+        for (size_t i = 0; i < header->stateRecordCount; i++) {
+            ranges.push_back(RecordRange{stateRecords[i], stateRecords[i] + 1});
+        }
+        std::sort(ranges.begin(), ranges.end(),
+                  [](const RecordRange& a, const RecordRange& b) { return a.begin < b.begin; });
+    }
+
+    // Join ranges that touch, so no record is decoded twice
+    std::vector<RecordRange> merged;
+    for (const RecordRange& next : ranges) {
+        if (!merged.empty() && next.begin <= merged.back().end) {
+            merged.back().end = std::max(merged.back().end, next.end);
+        } else {
+            merged.push_back(next);
+        }
+    }
+    return merged;
+}
+
+SelectiveReader::SelectiveReader(PCAPFileParser& file, const PacketSelection& selection, const CaptureIndex* index,
+                                 CaptureIndexBuilder* builder)
+    : file(file), selection(selection), builder(builder) {
+    // The index only helps when there is something to select
+    if (index && selection.active()) {
+        ranges = index->rangesFor(selection, file.fileSize());
+        indexed = true;
+        file.adviseRandomAccess();
+        if (!ranges.empty()) file.seek(ranges[0].begin);
+    }
+}
+
+bool SelectiveReader::next(PacketView& packet) {
+    bool isPacket;
+    uint64_t offset;
+    while (true) {
+        if (indexed) {
+            if (range == ranges.size()) return false;
+            if (file.position() >= ranges[range].end) {
+                if (++range == ranges.size()) return false;
+                file.seek(ranges[range].begin);
+                continue;
+            }
+        }
+        if (!file.nextRecord(packet, isPacket, offset)) return false;
+
+        if (!isPacket) {
+            if (builder) builder->addStateRecord(offset);
+            continue;
+        }
+        read++;
+        if (builder) builder->addPacket(offset, packet);
+        if (!selection.active() || selection.matches(packet)) return true;
+    }
+}
+
+} // namespace NetworkParser
@@ -0,0 +1,164 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "CaptureFormat.hpp"
+#include "FlatHashMap.hpp"
+#include "FlowTable.hpp"
+#include "PCAPFileParser.hpp"
+
+namespace NetworkParser {
+
+// The part of a capture to analyse. Every condition that is set must hold.
+struct PacketSelection {
+    bool hasHost = false;
+    uint32_t host = 0;          // Either end of the packet
+    bool hasFlow = false;
+    FlowKey flow;               // Canonical key, protocol 0 matches TCP or UDP
+    uint64_t fromUsec = 0;      // Packet timestamps, inclusive
+    uint64_t toUsec = UINT64_MAX;
+
+    bool active() const { return hasHost || hasFlow || fromUsec > 0 || toUsec < UINT64_MAX; }
+    bool matches(const PacketView& packet) const;
+};
+
+// Addresses, ports and protocol read straight from an Ethernet/IPv4 frame,
+// tagged or not, without running the parser chain. False if it isn't IPv4.
+bool peekAddresses(const PacketView& packet, PacketContext& context);
+
+// Layout of the index sidecar, in host byte order so it can be used in place
+// once mapped. After the header come the time blocks, the offsets of records
+// that carry no packet, the host and flow directories sorted by key, and the
+// posting lists they point into. A posting list holds the file offsets of a
+// host's or flow's packet records, ascending, each stored as a varint of its
+// distance from the one before.
+struct IndexHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t blockPackets;
+    uint64_t captureSize;       // The capture the index was built from
+    int64_t captureModified;    // Its modification time in nanoseconds
+    uint64_t packetCount;
+    uint64_t timeBlockCount;
+    uint64_t stateRecordCount;
+    uint64_t hostCount;
+    uint64_t flowCount;
+    uint64_t postingBytes;
+};
+
+// A run of blockPackets consecutive packet records
+struct IndexTimeBlock {
+    uint64_t offset;            // First record of the block
+    uint64_t minTimestamp;      // Microseconds, captures are not always in time order
+    uint64_t maxTimestamp;
+};
+
+struct IndexHostEntry {
+    uint32_t address;
+    uint32_t packets;
+    uint64_t posting;           // Offset into the posting lists
+};
+
+struct IndexFlowEntry {
+    FlowKey key;
+    uint32_t packets;
+    uint64_t posting;
+};
+
+// Gathers the index while the capture is read front to back
+class CaptureIndexBuilder {
+public:
+    static constexpr uint32_t kBlockPackets = 1024;
+
+    CaptureIndexBuilder() : hosts(1024), flows(1024) {}
+
+    void addPacket(uint64_t offset, const PacketView& packet);
+    void addStateRecord(uint64_t offset) { stateRecords.push_back(offset); }
+
+    // False with an error on cerr if the file can't be written
+    bool write(const std::string& path, uint64_t captureSize, int64_t captureModified) const;
+
+private:
+    struct Posting {
+        std::vector<uint8_t> bytes;
+        uint64_t last = 0;
+        uint32_t packets = 0;
+
+        void add(uint64_t offset);
+    };
+
+    std::vector<IndexTimeBlock> timeBlocks;
+    std::vector<uint64_t> stateRecords;
+    FlatHashMap<uint32_t, Posting> hosts;
+    FlatHashMap<FlowKey, Posting, FlowKeyHash> flows;
+    uint64_t packetCount = 0;
+};
+
+// Range of the capture file to read record by record, [begin, end)
+struct RecordRange {
+    uint64_t begin;
+    uint64_t end;
+};
+
+// A memory mapped index sidecar
+class CaptureIndex {
+public:
+    CaptureIndex() = default;
+    ~CaptureIndex();
+    CaptureIndex(const CaptureIndex&) = delete;
+    CaptureIndex& operator=(const CaptureIndex&) = delete;
+
+    // Sidecar path for a capture
+    static std::string pathFor(const std::string& capturePath) { return capturePath + ".idx"; }
+
+    // Size and modification time an index is checked against
+    static bool identify(const std::string& capturePath, uint64_t& size, int64_t& modified);
+
+    // False if the file is missing, damaged or was built from another capture
+    bool open(const std::string& path, uint64_t captureSize, int64_t captureModified);
+
+    uint64_t packetCount() const { return header->packetCount; }
+
+    // Where the packets a selection may match lie, in file order. Every
+    // record that carries no packet is included, the decoder needs them.
+    std::vector<RecordRange> rangesFor(const PacketSelection& selection, uint64_t fileSize) const;
+
+private:
+    const uint8_t* mapped = nullptr;
+    size_t mappedSize = 0;
+    const IndexHeader* header = nullptr;
+    const IndexTimeBlock* timeBlocks = nullptr;
+    const uint64_t* stateRecords = nullptr;
+    const IndexHostEntry* hosts = nullptr;
+    const IndexFlowEntry* flows = nullptr;
+    const uint8_t* postings = nullptr;
+
+    std::vector<uint64_t> decodePosting(uint64_t posting, uint32_t packets) const;
+    std::vector<uint64_t> flowOffsets(const FlowKey& key) const;
+};
+
+// Hands out the packets of a mapped capture that a selection asks for. With
+// an index it visits only the ranges the index points at, otherwise it reads
+// the whole file, feeding every record to the builder if there is one.
+class SelectiveReader {
+public:
+    SelectiveReader(PCAPFileParser& file, const PacketSelection& selection, const CaptureIndex* index,
+                    CaptureIndexBuilder* builder);
+
+    bool next(PacketView& packet);
+
+    // Packet records read, matching or not
+    uint64_t packetsRead() const { return read; }
+
+private:
+    PCAPFileParser& file;
+    const PacketSelection& selection;
+    CaptureIndexBuilder* builder;
+    std::vector<RecordRange> ranges;
+    size_t range = 0;
+    bool indexed = false;
+    uint64_t read = 0;
+};
+
+} // namespace NetworkParser
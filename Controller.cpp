@@ -1,21 +1,32 @@
 #include "Controller.hpp"
 #include "IPParser.hpp"
+#include "IPv6Parser.hpp"
 #include "TCPParser.hpp"
 #include "UDPParser.hpp"
+#include "PacketPipeline.hpp"
+#include "AFPacketSource.hpp"
+#include "PCAPReplaySource.hpp"
+#include "QueryEngine.hpp"
+#include "Metrics.hpp"
+#include <algorithm>
+#include <atomic>
 #include <iostream>
 #include <fstream>
 #include <chrono>
-#include <dlfcn.h>
+#include <functional>
+#include <thread>
+#include <unistd.h>
 
 namespace NetworkParser {
 
 std::unordered_map<std::string, std::string> Controller::libraryMapping;
 
-Controller::Controller() {
+Controller::Controller(const ControllerOptions& options) : options(options) {
+    fileParser.setUseHugePages(options.useHugePages);
+
     std::ifstream mappingFile("parser-mapping.dat");
     if (!mappingFile) {
         std::cerr << "Couldn't open mapping file" << std::endl;
-        return;
     }
 
     std::string line;
@@ -28,102 +39,519 @@ Controller::Controller() {
         libraryMapping[protocol] = libPath;
     }
 
-    parserFactory = std::make_unique<ParserFactory>(libraryMapping);
-}
+    // Resolve protocol names, libraries and port mappings once, up front
+    registry = std::make_unique<ProtocolRegistry>(libraryMapping);
+    registry->loadTCPPortMapping("tcp-port-mapping.dat");
+
+    std::vector<std::string> protocolNames;
+    for (ProtocolId id = 0; id < registry->size(); id++) protocolNames.push_back(registry->nameOf(id));
+    Metrics::instance().setProtocolNames(std::move(protocolNames));
 
-Controller::~Controller() {
-    // Close all loaded libraries
-    for (void* handle : loadedHandles) {
-        if (handle) dlclose(handle);
+    // One budget for every worker, so the cap holds for the whole process
+    if (options.reassemblyCapMB > 0) {
+        reassemblyBudget = std::make_unique<ReassemblyBudget>(options.reassemblyCapMB << 20);
+    }
+
+    size_t threadCount = std::max<size_t>(1, options.threads);
+    for (size_t i = 0; i < threadCount; i++) {
+        workers.push_back(std::make_unique<PacketWorker>(*registry, threadCount > 1, reassemblyBudget.get()));
+        workers.back()->setFlowTimeout(options.flowTimeoutSec * 1000000);
+        workers.back()->setVerifyChecksums(options.verifyChecksums);
+        workers.back()->setFragmentSlots(options.fragmentSlots);
+        if (options.filter.active()) workers.back()->setFilter(&this->options.filter);
+        workers.back()->getTables().setInterval(static_cast<uint64_t>(options.intervalSec * 1000000));
+        if (options.topTalkers) workers.back()->getTables().approximate(options.topTalkers);
     }
 }
 
+Controller::~Controller() = default;
+
+// Replayed packets wait in a backlog sized as if the memory cap were a ring of frames this big
+static constexpr size_t kReplayFrameBytes = 2048;
+
 bool Controller::loadPCAPFile(const std::string& filePath) {
     _filePath = filePath;
-    if (!fileParser.parseFile(filePath)) {
+
+    if (options.replayRate > 0) {
+        size_t backlog = (options.memoryCapMB << 20) / kReplayFrameBytes / workers.size();
+        for (size_t w = 0; w < workers.size(); w++) {
+            auto source = std::make_unique<PCAPReplaySource>(options.replayRate, backlog, w, workers.size());
+            if (!source->open(filePath)) {
+                std::cerr << "Failed to parse PCAP file: " << filePath << std::endl;
+                sources.clear();
+                return false;
+            }
+            sources.push_back(std::move(source));
+        }
+        return true;
+    }
+
+    bool opened = options.streaming ? streamReader.open(filePath) : fileParser.parseFile(filePath);
+    if (!opened) {
         std::cerr << "Failed to parse PCAP file: " << filePath << std::endl;
         return false;
     }
+
+    if (options.useIndex) {
+        uint64_t size;
+        int64_t modified;
+        if (options.streaming) {
+            std::cerr << "Warning: The index needs a mapped file, ignoring it when streaming.\n";
+        } else if (CaptureIndex::identify(filePath, size, modified)) {
+            // A stale or damaged index is rebuilt rather than trusted
+            captureIndex = std::make_unique<CaptureIndex>();
+            if (!captureIndex->open(CaptureIndex::pathFor(filePath), size, modified)) {
+                captureIndex.reset();
+                indexBuilder = std::make_unique<CaptureIndexBuilder>();
+            }
+        }
+    }
     return true;
 }
 
-void Controller::processPackets() {
-    const auto& packets = fileParser.getPackets();
-    if (packets.empty()) {
-        std::cerr << "No packets found in the file.\n";
-        return;
+bool Controller::loadPCAPFiles(const std::vector<std::string>& paths) {
+    if (paths.size() == 1) return loadPCAPFile(paths[0]);
+
+    // Opened by the worker that reads them, a file that fails is skipped then
+    filePaths = paths;
+    return !filePaths.empty();
+}
+
+bool Controller::openInterface(const std::string& interface) {
+    // Every worker gets its own socket, the memory cap is split between their rings
+    size_t ringBytes = (options.memoryCapMB << 20) / workers.size();
+    int fanoutGroup = workers.size() > 1 ? static_cast<int>(getpid() & 0xffff) : -1;
+    for (size_t w = 0; w < workers.size(); w++) {
+        auto source = std::make_unique<AFPacketSource>();
+        if (!source->open(interface, ringBytes, fanoutGroup)) {
+            std::cerr << "Failed to open interface: " << interface << std::endl;
+            sources.clear();
+            return false;
+        }
+        sources.push_back(std::move(source));
     }
+    return true;
+}
 
-    auto startTime = std::chrono::high_resolution_clock::now();
-    int count = 0;
-
-    for (size_t i = 0; i < packets.size(); i++) {
-        const auto& packet = packets[i];
-        std::string protocol = "Ethernet";
-        const uint8_t* currentPacketData = packet.data();
-        size_t currentPacketLength = packet.size();
-        size_t offset = 0;
-        Stats placeholder, ph1;
-
-        while (!protocol.empty() && protocol != "None") {
-            std::unique_ptr<Parser> parser = parserFactory->createParser(protocol);
-            if (!parser) {
-                std::cerr << "Error: Failed to create parser for protocol: " << protocol << "\n";
-                break;
+size_t Controller::processMappedFile() {
+    size_t count = 0;
+    PacketView packet;
+    std::vector<PacketView> packets;
+    std::vector<uint64_t> packetNumbers;
+    packets.reserve(HeaderBatch::kCapacity);
+    packetNumbers.reserve(HeaderBatch::kCapacity);
+    auto flush = [&]() {
+        workers[0]->processBatch(packets.data(), packetNumbers.data(), packets.size());
+        packets.clear();
+        packetNumbers.clear();
+    };
+
+    // Views into the mapping stay valid, so packets are handed over a batch at a time
+    SelectiveReader reader(fileParser, options.selection, captureIndex.get(), indexBuilder.get());
+    while (reader.next(packet)) {
+        packets.push_back(packet);
+        packetNumbers.push_back(++count);
+        if (packets.size() == HeaderBatch::kCapacity) flush();
+    }
+    flush();
+    packetsVisited = reader.packetsRead();
+    return count;
+}
+
+size_t Controller::processStream() {
+    size_t count = 0;
+    PacketPipeline pipeline(streamReader, options.memoryCapMB << 20);
+    pipeline.start();
+
+    std::vector<PacketView> packets;
+    std::vector<uint64_t> packetNumbers;
+    while (PacketBatch* batch = pipeline.nextBatch()) {
+        for (const PacketView& packet : batch->packets) {
+            if (options.selection.active() && !options.selection.matches(packet)) continue;
+            packets.push_back(packet);
+            packetNumbers.push_back(++count);
+        }
+        workers[0]->processBatch(packets.data(), packetNumbers.data(), packets.size());
+        packets.clear();
+        packetNumbers.clear();
+        pipeline.releaseBatch(batch);
+    }
+    return count;
+}
+
+size_t Controller::processSharded() {
+    size_t workerCount = workers.size();
+    size_t count = 0;
+
+    // Each worker gets a fixed pool of work batches, which bounds the packets in flight
+    std::vector<std::unique_ptr<WorkBatch>> workBatches;
+    std::vector<std::vector<WorkBatch*>> freeBatches(workerCount);
+    std::vector<WorkBatch*> openBatches(workerCount, nullptr);
+    for (size_t w = 0; w < workerCount; w++) {
+        for (size_t i = 0; i < PacketWorker::kQueueDepth; i++) {
+            workBatches.push_back(std::make_unique<WorkBatch>());
+            workBatches.back()->packets.reserve(WorkBatch::kCapacity);
+            workBatches.back()->packetNumbers.reserve(WorkBatch::kCapacity);
+            freeBatches[w].push_back(workBatches.back().get());
+        }
+        workers[w]->start();
+    }
+
+    std::unique_ptr<PacketPipeline> pipeline;
+    std::unordered_map<PacketBatch*, size_t> sourceReferences;  // Open or queued work batches using a stream buffer
+
+    auto releaseSource = [&](PacketBatch* source) {
+        if (--sourceReferences[source] == 0) {
+            sourceReferences.erase(source);
+            pipeline->releaseBatch(source);
+        }
+    };
+
+    auto reclaimBatches = [&]() {
+        for (size_t w = 0; w < workerCount; w++) {
+            WorkBatch* batch;
+            while (workers[w]->reclaim(batch)) {
+                if (batch->source) releaseSource(batch->source);
+                batch->packets.clear();
+                batch->packetNumbers.clear();
+                batch->source = nullptr;
+                freeBatches[w].push_back(batch);
             }
+        }
+    };
 
-            // Validate offset and length
-            if (offset >= currentPacketLength) {
-                //std::cerr << "Error: Offset exceeds packet length\n";
-                break;
+    auto flush = [&](size_t w) {
+        WorkBatch* batch = openBatches[w];
+        if (!batch) return;
+        while (!workers[w]->submit(batch)) {
+            reclaimBatches();
+            std::this_thread::yield();
+        }
+        openBatches[w] = nullptr;
+    };
+
+    auto dispatch = [&](const PacketView& packet, PacketBatch* source) {
+        size_t w = shardForPacket(packet, workerCount);
+        if (!openBatches[w]) {
+            while (freeBatches[w].empty()) {
+                reclaimBatches();
+                if (freeBatches[w].empty()) std::this_thread::yield();
+            }
+            openBatches[w] = freeBatches[w].back();
+            freeBatches[w].pop_back();
+            openBatches[w]->source = source;
+            if (source) sourceReferences[source]++;
+        }
+
+        WorkBatch* batch = openBatches[w];
+        batch->packets.push_back(packet);
+        batch->packetNumbers.push_back(++count);
+        if (batch->packets.size() == WorkBatch::kCapacity) flush(w);
+    };
+
+    if (options.streaming) {
+        pipeline = std::make_unique<PacketPipeline>(streamReader, options.memoryCapMB << 20);
+        pipeline->start();
+
+        bool finished = false;
+        while (!finished) {
+            PacketBatch* source = nullptr;
+            if (!pipeline->tryNextBatch(source, finished)) {
+                // Stream buffers only come back once workers are done with them
+                reclaimBatches();
+                if (!finished) std::this_thread::yield();
+                continue;
+            }
+
+            // The loop holds a reference of its own, otherwise reclaiming every
+            // batch taken so far would recycle the buffer while it is still read
+            sourceReferences[source]++;
+            for (const PacketView& packet : source->packets) {
+                if (options.selection.active() && !options.selection.matches(packet)) continue;
+                dispatch(packet, source);
             }
+            // Work batches never span stream buffers, so each buffer can be recycled on its own
+            for (size_t w = 0; w < workerCount; w++) flush(w);
+            releaseSource(source);
+        }
+    } else {
+        PacketView packet;
+        SelectiveReader reader(fileParser, options.selection, captureIndex.get(), indexBuilder.get());
+        while (reader.next(packet)) {
+            dispatch(packet, nullptr);
+        }
+        for (size_t w = 0; w < workerCount; w++) flush(w);
+        packetsVisited = reader.packetsRead();
+    }
 
-            ph1 = parser->parsePacket(currentPacketData, currentPacketLength, offset, placeholder);
-            placeholder = ph1;
-            protocol = parser->nextParser();
-            offset += parser->getOffset();
+    for (size_t w = 0; w < workerCount; w++) {
+        while (!workers[w]->submit(nullptr)) {
+            reclaimBatches();
+            std::this_thread::yield();
         }
-        count++;
     }
+    for (auto& worker : workers) worker->join();
+    reclaimBatches();
 
+    return count;
+}
+
+size_t Controller::processSources() {
+    std::atomic<uint64_t> packetCounter{0};
+    for (size_t w = 0; w < workers.size(); w++) {
+        workers[w]->startSource(*sources[w], packetCounter);
+    }
+
+    // A replay ends on its own when the file runs out, otherwise stop at the deadline or on interrupt
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(options.durationSec);
+    while (true) {
+        bool finished = std::all_of(workers.begin(), workers.end(),
+                                    [](const auto& worker) { return worker->sourceFinished(); });
+        if (finished) break;
+        if (options.durationSec && std::chrono::steady_clock::now() >= deadline) requestSourceStop();
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    for (auto& worker : workers) worker->join();
+
+    return packetCounter.load();
+}
+
+size_t Controller::processFiles() {
+    // Each worker reads a run of consecutive files, so its flows see capture
+    // time move forward, and the pairwise merge then joins neighbouring runs
+    // in order, continuing a flow from one run into the next
+    std::atomic<size_t> count{0};
+    std::atomic<size_t> failed{0};
+    std::vector<std::thread> threads;
+    size_t fileCount = filePaths.size();
+    size_t workerCount = workers.size();
+    for (size_t w = 0; w < workerCount; w++) {
+        threads.emplace_back([&, w] {
+            for (size_t file = w * fileCount / workerCount; file < (w + 1) * fileCount / workerCount; file++) {
+                size_t packets = 0;
+                if (!processFile(*workers[w], filePaths[file], packets)) failed++;
+                count += packets;
+            }
+        });
+    }
+    for (std::thread& thread : threads) thread.join();
+
+    std::cout << "Files: " << fileCount - failed << " of " << fileCount << " processed\n";
+    return count;
+}
+
+bool Controller::processFile(PacketWorker& worker, const std::string& filePath, size_t& count) {
+    std::vector<PacketView> packets;
+    std::vector<uint64_t> packetNumbers;
+    packets.reserve(HeaderBatch::kCapacity);
+    packetNumbers.reserve(HeaderBatch::kCapacity);
+    auto flush = [&]() {
+        worker.processBatch(packets.data(), packetNumbers.data(), packets.size());
+        packets.clear();
+        packetNumbers.clear();
+    };
+
+    // Packet numbers count from 1 in every file
+    if (options.streaming) {
+        PCAPStreamReader reader;
+        if (!reader.open(filePath)) {
+            std::cerr << "Failed to parse PCAP file: " << filePath << std::endl;
+            return false;
+        }
+        PacketPipeline pipeline(reader, (options.memoryCapMB << 20) / workers.size());
+        pipeline.start();
+        while (PacketBatch* batch = pipeline.nextBatch()) {
+            for (const PacketView& packet : batch->packets) {
+                if (options.selection.active() && !options.selection.matches(packet)) continue;
+                packets.push_back(packet);
+                packetNumbers.push_back(++count);
+            }
+            flush();
+            pipeline.releaseBatch(batch);
+        }
+        return true;
+    }
+
+    PCAPFileParser file;
+    file.setUseHugePages(options.useHugePages);
+    if (!file.parseFile(filePath)) {
+        std::cerr << "Failed to parse PCAP file: " << filePath << std::endl;
+        return false;
+    }
+    PacketView packet;
+    SelectiveReader reader(file, options.selection, nullptr, nullptr);
+    while (reader.next(packet)) {
+        packets.push_back(packet);
+        packetNumbers.push_back(++count);
+        if (packets.size() == HeaderBatch::kCapacity) flush();
+    }
+    flush();
+    return true;
+}
+
+void Controller::mergeTables() {
+    // Fold every worker's tables into the first one as a tree: in each round
+    // pairs of tables merge in parallel, so N workers take log2(N) rounds.
+    // The later worker always merges into the earlier one.
+    for (size_t stride = 1; stride < workers.size(); stride *= 2) {
+        std::vector<std::thread> merges;
+        for (size_t w = 0; w + stride < workers.size(); w += 2 * stride) {
+            merges.emplace_back([this, w, stride] { workers[w]->getTables().merge(workers[w + stride]->getTables()); });
+        }
+        for (std::thread& thread : merges) thread.join();
+    }
+}
+
+void Controller::processPackets() {
+    // Timed end to end, so in streaming mode this includes reading the file
+    auto startTime = std::chrono::high_resolution_clock::now();
+    if (!options.metricsPath.empty()) Metrics::instance().startExport(options.metricsPath, options.metricsIntervalSec);
+    size_t count;
+    if (!sources.empty()) {
+        count = processSources();
+    } else if (!filePaths.empty()) {
+        count = processFiles();
+    } else if (workers.size() > 1) {
+        count = processSharded();
+    } else {
+        count = options.streaming ? processStream() : processMappedFile();
+    }
     auto endTime = std::chrono::high_resolution_clock::now();
     std::chrono::duration<double> elapsedTime = endTime - startTime;
 
-    // Generate core reports
-    IPParser::generateReport();
-    TCPParser::generateReport();
-    UDPParser::generateReport();
-    
-    // Generate dynamic protocol reports
-    generateReportsDynamically();
+    finishIndex();
+    Metrics::instance().stopExport();
+    printPacketErrorSummary(std::cerr);
+
+    if (count == 0) {
+        std::cerr << "No packets found in the file.\n";
+        return;
+    }
+
+    for (auto& worker : workers) worker->finishStreams();
+
+    mergeTables();
+    StatsTables& tables = workers[0]->getTables();
+    tables.ip.finishSketches();
+
+    // Generate core and dynamic protocol reports concurrently, each one
+    // reads its own tables and writes its own files
+    if (options.reportFormat != ReportFormat::None) {
+        std::vector<std::thread> reportThreads;
+        reportThreads.emplace_back([&] { IPParser::generateReport(tables.ip, options.reportFormat); });
+        reportThreads.emplace_back([&] { IPv6Parser::generateReport(tables.ipv6, options.reportFormat); });
+        reportThreads.emplace_back([&] { TCPParser::generateReport(tables.tcp, options.reportFormat); });
+        reportThreads.emplace_back([&] { UDPParser::generateReport(tables.udp, options.reportFormat); });
+        generateReportsDynamically(reportThreads);
+        for (std::thread& thread : reportThreads) thread.join();
+    }
+
+    // Answer queries straight from the merged tables
+    if (!options.queries.empty()) {
+        QueryEngine engine(tables);
+        for (const std::string& query : options.queries) {
+            std::cout << "\n" << query << "\n";
+            engine.run(query, std::cout);
+        }
+        std::cout << std::endl;
+    }
 
     // Performance metrics
     if (elapsedTime.count() > 0) {
-        double packetsPerSecond = packets.size() / elapsedTime.count();
+        double packetsPerSecond = count / elapsedTime.count();
         std::cout << "Total Packets: " << count << std::endl;
         std::cout << "Elapsed time: " << elapsedTime.count() << " seconds\n";
         std::cout << "Processing Speed: " << packetsPerSecond << " packets per second\n";
     }
+    if (options.filter.active()) {
+        uint64_t filteredOut = 0;
+        for (auto& worker : workers) filteredOut += worker->packetsFilteredOut();
+        std::cout << "Filter: " << count - filteredOut << " of " << count << " packets matched\n";
+    }
+    uint64_t unaddressed = 0;
+    uint64_t unchecked = 0;
+    for (auto& worker : workers) {
+        unaddressed += worker->packetsUnaddressed();
+        unchecked += worker->packetsUnchecked();
+    }
+    if (unaddressed) {
+        std::cerr << "Warning: --filter host and net tests take IPv4 addresses, they failed on " << unaddressed
+                  << " IPv6 packets\n";
+    }
+    if (unchecked && options.verifyChecksums) {
+        std::cerr << "Warning: --verify-checksums only checks untagged IPv4 frames, " << unchecked
+                  << " tagged or IPv6 packets were parsed unchecked\n";
+    }
+
+    size_t lostFlows = tables.tcp.flows.lostFlows() + tables.udp.flows.lostFlows();
+    if (lostFlows) {
+        std::cerr << "Warning: " << lostFlows << " connections could not be written to the flow spill file "
+                  << "and are missing from the connection reports\n";
+    }
+
+    // Capture health for live and replayed sources
+    if (!sources.empty()) {
+        SourceStats sourceStats;
+        for (auto& source : sources) sourceStats.add(source->stats());
+        std::cout << "Dropped Packets: " << sourceStats.drops << std::endl;
+        std::cout << "Ring Fill: " << sourceStats.averageFill() * 100 << "% average, "
+                  << sourceStats.peakFill * 100 << "% peak\n";
+    }
 }
 
-void Controller::generateReportsDynamically() {
-    for (const auto& [proto, libPath] : libraryMapping) {
-        void* handle = dlopen(libPath.c_str(), RTLD_LAZY);
-        if (!handle) {
-            std::cerr << "Failed to load library for " << proto << ": " << dlerror() << "\n";
-            continue;
+void Controller::finishIndex() {
+    if (captureIndex) {
+        std::cout << "Index: " << CaptureIndex::pathFor(_filePath) << ", read " << packetsVisited << " of "
+                  << captureIndex->packetCount() << " packets\n";
+    } else if (indexBuilder) {
+        uint64_t size;
+        int64_t modified;
+        std::string indexPath = CaptureIndex::pathFor(_filePath);
+        if (CaptureIndex::identify(_filePath, size, modified) && indexBuilder->write(indexPath, size, modified)) {
+            std::cout << "Index: Wrote " << indexPath << "\n";
         }
+        indexBuilder.reset();
+    }
+}
+
+void Controller::generateReportsDynamically(std::vector<std::thread>& reportThreads) {
+    // Protocols served by the same library share its state, so each library
+    // gets one thread that calls its hook once per protocol mapped to it
+    std::vector<std::pair<void*, std::vector<std::function<void()>>>> libraries;
+    for (ProtocolId id = Protocol::FirstDynamic; id < registry->size(); id++) {
+        void* handle = registry->libraryHandle(id);
+        if (!handle) continue;  // Reported when the registry loaded it
 
-        using GenerateReportFunc = void (*)();
-        GenerateReportFunc genReport = (GenerateReportFunc)dlsym(handle, "genReport");
-        
-        if (genReport) {
-            //std::cout << "Generating report for " << proto << "...\n";
-            genReport();
+        std::function<void()> hook;
+        const std::string& proto = registry->nameOf(id);
+        if (const NPPlugin* plugin = registry->plugin(id)) {
+            if (!plugin->report) continue;
+            std::vector<void*> states;
+            for (auto& worker : workers) {
+                if (void* state = worker->pluginState(id)) states.push_back(state);
+            }
+            hook = [plugin, proto, states = std::move(states)] {
+                if (plugin->report(proto.c_str(), states.data(), states.size()) != 0) {
+                    std::cerr << "Report for " << proto << " failed\n";
+                }
+            };
+        } else if (ProtocolRegistry::ReportFunc genReport = registry->reportFunction(id)) {
+            hook = genReport;
         } else {
-            std::cerr << "Failed to find report function for " << proto 
-                     << ": " << dlerror() << "\n";
+            std::cerr << "Failed to find report function for " << proto << "\n";
+            continue;
         }
+
+        auto library = std::find_if(libraries.begin(), libraries.end(),
+                                    [&](const auto& entry) { return entry.first == handle; });
+        if (library == libraries.end()) library = libraries.insert(libraries.end(), {handle, {}});
+        library->second.push_back(std::move(hook));
+    }
+
+    for (auto& [handle, hooks] : libraries) {
+        reportThreads.emplace_back([hooks = std::move(hooks)] {
+            for (const std::function<void()>& hook : hooks) hook();
+        });
     }
 }
 
@@ -4,29 +4,79 @@
 #include <unordered_map>
 #include <string>
 #include <memory>
+#include <thread>
 #include <vector>
 #include "PCAPFileParser.hpp"
-#include "ParserFactory.hpp"
+#include "PCAPStreamReader.hpp"
+#include "PacketSource.hpp"
+#include "PacketWorker.hpp"
+#include "ArrowWriter.hpp"
+#include "CaptureIndex.hpp"
+#include "PacketFilter.hpp"
 
 namespace NetworkParser {
 
+// Command line tunables for a run
+struct ControllerOptions {
+    bool useHugePages = false;
+    bool streaming = false;      // Read through a bounded pipeline instead of mapping the file
+    size_t memoryCapMB = 64;     // Packet data held in flight when streaming
+    size_t threads = 1;          // Worker threads, packets are sharded by address pair
+    size_t flowTimeoutSec = 120; // Idle time after which a TCP/UDP flow is finished
+    size_t reassemblyCapMB = 64; // Out of order TCP data held for plugins, 0 turns reassembly off
+    size_t fragmentSlots = IPDefragmenter::kDefaultSlots;  // IPv4 datagrams reassembled at once per worker, 0 turns it off
+    double replayRate = 0;       // Packets per second to replay the file at as if live, 0 reads it flat out
+    size_t durationSec = 0;      // Stop a live capture or replay after this long, 0 runs until interrupted
+    double intervalSec = 1;      // Length of the time series intervals
+    size_t topTalkers = 0;       // Report this many heaviest hosts and address pairs from sketches, 0 keeps exact tables
+    ReportFormat reportFormat = ReportFormat::Csv;
+    std::vector<std::string> queries;  // Run against the merged tables once processing is done
+    bool useIndex = false;       // Read the capture through its index sidecar, building it on first use
+    PacketSelection selection;   // Only these packets are processed
+    std::string metricsPath;     // Write counters and parser latencies here as JSON, empty for none
+    double metricsIntervalSec = 10;  // How often the metrics file is rewritten while processing
+    bool verifyChecksums = false;  // Drop packets whose IPv4, TCP or UDP checksum is wrong
+    PacketFilter filter;         // Only packets it matches reach the parsers, inactive if empty
+};
+
 class Controller {
 public:
-    Controller();
+    explicit Controller(const ControllerOptions& options = ControllerOptions());
     ~Controller();
     bool loadPCAPFile(const std::string& filePath);
+
+    // Several captures, such as the rotated files of one link, reported as
+    // one. Given in capture order, they are split into one run of
+    // consecutive files per worker.
+    bool loadPCAPFiles(const std::vector<std::string>& filePaths);
+
+    bool openInterface(const std::string& interface);
     void processPackets();
 
 private:
+    ControllerOptions options;
     PCAPFileParser fileParser;
-    std::unique_ptr<ParserFactory> parserFactory;
+    PCAPStreamReader streamReader;
+    std::unique_ptr<ProtocolRegistry> registry;
+    std::unique_ptr<ReassemblyBudget> reassemblyBudget;
+    std::vector<std::unique_ptr<PacketWorker>> workers;
+    std::vector<std::unique_ptr<PacketSource>> sources;  // One per worker for live capture and replay
     std::string _filePath;
+    std::vector<std::string> filePaths;                 // Set when there is more than one capture file
+    std::unique_ptr<CaptureIndex> captureIndex;         // Valid sidecar for a mapped file
+    std::unique_ptr<CaptureIndexBuilder> indexBuilder;  // Or the one being built while it is read
+    uint64_t packetsVisited = 0;                        // Packet records read from a mapped file
     static std::unordered_map<std::string, std::string> libraryMapping;
-    
-    std::vector<void*> loadedHandles;  // Track all loaded library handles
-    
-    void generateReportsDynamically();
-    void loadProtocolLibraries();
+
+    size_t processMappedFile();
+    size_t processStream();
+    size_t processSharded();
+    size_t processSources();
+    size_t processFiles();
+    bool processFile(PacketWorker& worker, const std::string& filePath, size_t& count);
+    void mergeTables();
+    void generateReportsDynamically(std::vector<std::thread>& reportThreads);
+    void finishIndex();
 };
 
 } // namespace NetworkParser
\ No newline at end of file
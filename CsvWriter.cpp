@@ -0,0 +1,129 @@
+#include "CsvWriter.hpp"
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <iostream>
+#include <unistd.h>
+
+namespace NetworkParser {
+
+CsvWriter::CsvWriter() : buffer(kBufferSize) {}
+
+CsvWriter::~CsvWriter() {
+    if (fd >= 0) close();
+}
+
+bool CsvWriter::open(const std::string& filePath) {
+    path = filePath;
+    fd = ::open(filePath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    return fd >= 0;
+}
+
+void CsvWriter::line(std::string_view text) {
+    add(text);
+    endRow();
+}
+
+CsvWriter& CsvWriter::add(uint64_t value) {
+    char* at = separator(reserve(kMaxFieldLength));
+    used = std::to_chars(at, at + kMaxFieldLength, value).ptr - buffer.data();
+    return *this;
+}
+
+CsvWriter& CsvWriter::add(std::string_view text) {
+    if (text.size() + 1 > buffer.size()) {
+        // Too big to buffer, so it goes straight out after what is already held
+        used = separator(reserve(1)) - buffer.data();
+        flush();
+        size_t written = 0;
+        while (!failed && written < text.size()) {
+            ssize_t result = ::write(fd, text.data() + written, text.size() - written);
+            if (result < 0 && errno == EINTR) continue;
+            if (result <= 0) failed = true;
+            else written += result;
+        }
+        return *this;
+    }
+    char* at = separator(reserve(text.size() + 1));
+    std::memcpy(at, text.data(), text.size());
+    used = at + text.size() - buffer.data();
+    return *this;
+}
+
+CsvWriter& CsvWriter::addAddress(uint32_t address) {
+    char* at = separator(reserve(kMaxFieldLength));
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        at = std::to_chars(at, at + 3, (address >> shift) & 0xFF).ptr;
+        if (shift) *at++ = '.';
+    }
+    used = at - buffer.data();
+    return *this;
+}
+
+CsvWriter& CsvWriter::addAddress(const IPAddress& address) {
+    if (address.isIPv4()) return addAddress(address.ipv4());
+
+    uint8_t bytes[16];
+    address.toBytes(bytes);
+    char* at = separator(reserve(kMaxFieldLength));
+    inet_ntop(AF_INET6, bytes, at, INET6_ADDRSTRLEN);
+    used = at + std::strlen(at) - buffer.data();
+    return *this;
+}
+
+CsvWriter& CsvWriter::addTimestamp(uint64_t usec) {
+    char* at = separator(reserve(kMaxFieldLength));
+    at = std::to_chars(at, at + 20, usec / 1000000).ptr;
+    *at++ = '.';
+    uint32_t fraction = static_cast<uint32_t>(usec % 1000000);
+    for (int digit = 5; digit >= 0; digit--) {
+        at[digit] = static_cast<char>('0' + fraction % 10);
+        fraction /= 10;
+    }
+    used = at + 6 - buffer.data();
+    return *this;
+}
+
+void CsvWriter::endRow() {
+    *reserve(1) = '\n';
+    used++;
+    rowStarted = false;
+}
+
+bool CsvWriter::close() {
+    flush();
+    if (::close(fd) != 0) failed = true;
+    fd = -1;
+    if (failed) {
+        std::cerr << "Error: Failed writing " << path << ".\n";
+        return false;
+    }
+    return true;
+}
+
+char* CsvWriter::reserve(size_t length) {
+    if (used + length > buffer.size()) flush();
+    return buffer.data() + used;
+}
+
+// Comma ahead of every field but the first of a row
+char* CsvWriter::separator(char* at) {
+    if (rowStarted) *at++ = ',';
+    rowStarted = true;
+    return at;
+}
+
+void CsvWriter::flush() {
+    size_t written = 0;
+    while (!failed && written < used) {
+        ssize_t result = ::write(fd, buffer.data() + written, used - written);
+        if (result < 0 && errno == EINTR) continue;
+        if (result <= 0) failed = true;
+        else written += result;
+    }
+    used = 0;
+}
+
+} // namespace NetworkParser
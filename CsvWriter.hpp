@@ -0,0 +1,58 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "IPAddress.hpp"
+
+namespace NetworkParser {
+
+// Buffered CSV table writer for the reports. Numbers are formatted with
+// std::to_chars straight into a large buffer, which goes to the file with a
+// single write each time it fills, so a table of millions of rows costs a
+// few hundred syscalls and no iostream formatting. Fields of a row are
+// separated by commas as they are added.
+class CsvWriter {
+public:
+    static constexpr size_t kBufferSize = 1 << 20;
+
+    CsvWriter();
+    ~CsvWriter();
+
+    CsvWriter(const CsvWriter&) = delete;
+    CsvWriter& operator=(const CsvWriter&) = delete;
+
+    // False if the file can't be created
+    bool open(const std::string& filePath);
+
+    // A whole line such as the header, written as given
+    void line(std::string_view text);
+
+    CsvWriter& add(uint64_t value);
+    CsvWriter& add(std::string_view text);
+    CsvWriter& addAddress(uint32_t address);    // Host order IPv4 address as a dotted quad
+    CsvWriter& addAddress(const IPAddress& address);  // Dotted quad if IPv4-mapped, else IPv6 text
+    CsvWriter& addTimestamp(uint64_t usec);     // Microseconds since the epoch as seconds.microseconds
+    void endRow();
+
+    // Writes what is buffered, false and an error on failure
+    bool close();
+
+private:
+    static constexpr size_t kMaxFieldLength = 48;  // Longest number, address or timestamp plus a comma
+
+    std::vector<char> buffer;
+    size_t used = 0;
+    int fd = -1;
+    bool failed = false;
+    bool rowStarted = false;
+    std::string path;
+
+    // Room for length more bytes, flushing the buffer if needed
+    char* reserve(size_t length);
+    char* separator(char* at);
+    void flush();
+};
+
+} // namespace NetworkParser
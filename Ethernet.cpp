@@ -3,34 +3,99 @@
 #include <sstream>
 #include <iostream>
 #include "IPParser.hpp"
+#include "Metrics.hpp"
 
 namespace NetworkParser {
 
-Stats EthernetParser::parsePacket(const uint8_t* packet, size_t length, size_t offset, Stats ip_add_stats) {
-    if (length < offset + sizeof(EthernetFrameHeader)) {
-        std::cerr << "Error: Malformed Ethernet packet - insufficient length." << std::endl;
-        return ip_add_stats;
+// Ethertypes of the network layers parsed and of the tags in front of them
+static constexpr uint16_t kEtherTypeIPv4 = 0x0800;
+static constexpr uint16_t kEtherTypeIPv6 = 0x86DD;
+static constexpr uint16_t kEtherTypeVLAN = 0x8100;     // 802.1Q customer tag
+static constexpr uint16_t kEtherTypeQinQ = 0x88A8;     // 802.1ad service tag
+static constexpr uint16_t kEtherTypeQinQOld = 0x9100;  // Service tag before 802.1ad
+static constexpr uint16_t kEtherTypeMPLS = 0x8847;
+static constexpr uint16_t kEtherTypeMPLSMulticast = 0x8848;
+
+// Deeper stacks of tags or labels than this are not followed
+static constexpr size_t kMaxTags = 8;
+
+static uint16_t readBigEndian16(const uint8_t* at) {
+    return static_cast<uint16_t>((at[0] << 8) | at[1]);
+}
+
+uint16_t findNetworkLayer(const uint8_t* frame, size_t length, size_t offset, size_t& at, bool& truncated) {
+    truncated = false;
+    at = offset + sizeof(EthernetFrameHeader);
+    if (length < at) {
+        truncated = true;
+        return 0;
+    }
+    uint16_t ethType = readBigEndian16(frame + offset + 12);
+
+    // VLAN tags, QinQ has an outer service tag in front of the customer tag.
+    // Each is the tag control word followed by the next ethertype.
+    for (size_t tags = 0; ethType == kEtherTypeVLAN || ethType == kEtherTypeQinQ || ethType == kEtherTypeQinQOld;
+         tags++) {
+        if (tags == kMaxTags) return 0;
+        if (length < at + 4) {
+            truncated = true;
+            return 0;
+        }
+        ethType = readBigEndian16(frame + at + 2);
+        at += 4;
     }
 
-    const EthernetFrameHeader* ethHeader = reinterpret_cast<const EthernetFrameHeader*>(packet + offset);
-    uint16_t ethType = ntohs(ethHeader->etherType);
+    // MPLS label stack entries up to the one with the bottom of stack bit.
+    // Labels don't say what they carry, so the IP version nibble decides.
+    if (ethType == kEtherTypeMPLS || ethType == kEtherTypeMPLSMulticast) {
+        for (size_t labels = 0;; labels++) {
+            if (labels == kMaxTags) return 0;
+            if (length < at + 4) {
+                truncated = true;
+                return 0;
+            }
+            bool bottom = frame[at + 2] & 0x01;
+            at += 4;
+            if (bottom) break;
+        }
+        if (length <= at) return 0;
+        uint8_t version = frame[at] >> 4;
+        ethType = (version == 4) ? kEtherTypeIPv4 : (version == 6) ? kEtherTypeIPv6 : 0;
+    }
+    return ethType;
+}
+
+void EthernetParser::parsePacket(const uint8_t* packet, size_t length, size_t offset, PacketContext& context) {
+    nextProtocolId = Protocol::None;
+    headerLength = sizeof(EthernetFrameHeader);
+
+    size_t at;
+    bool truncated;
+    uint16_t ethType = findNetworkLayer(packet, length, offset, at, truncated);
+    if (truncated) {
+        reportPacketError(PacketError::EthernetTruncated);
+        return;
+    }
 
     // Determine the next protocol to parse
-    if (ethType == 0x0800) {
-        nextProtocol = "IP";
+    if (ethType == kEtherTypeIPv4) {
+        nextProtocolId = Protocol::IP;
+    } else if (ethType == kEtherTypeIPv6) {
+        nextProtocolId = Protocol::IPv6;
     } else {
-        nextProtocol = "";
+        return;
     }
-
-    return ip_add_stats;
+    context.networkOffset = at;
+    headerLength = at - offset;
 }
 
 size_t EthernetParser::getOffset() const {
-    return sizeof(EthernetFrameHeader); // Ethernet header is always 14 bytes
+    // The Ethernet header with any VLAN tags and MPLS labels after it
+    return headerLength;
 }
 
-std::string EthernetParser::nextParser() const {
-    return nextProtocol;
+ProtocolId EthernetParser::nextProtocol() const {
+    return nextProtocolId;
 }
 
 } // namespace NetworkParser
\ No newline at end of file
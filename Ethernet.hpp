@@ -7,13 +7,21 @@ namespace NetworkParser {
 class EthernetParser : public Parser {
 public:
     EthernetParser() = default;
-    Stats parsePacket(const uint8_t* packet, size_t length, size_t offset, Stats ip_add_stats) override;
+    void parsePacket(const uint8_t* packet, size_t length, size_t offset, PacketContext& context) override;
     size_t getOffset() const override;
-    std::string nextParser() const override;
+    ProtocolId nextProtocol() const override;
 
 private:
-    std::string nextProtocol = "IP";
+    ProtocolId nextProtocolId = Protocol::IP;
+    size_t headerLength = 0;
 };
+
+// Steps over the Ethernet header at offset and any VLAN, QinQ or MPLS tags
+// after it, as the parser does. Sets at to the network header and returns
+// its ethertype, which behind MPLS comes from the IP version. Returns 0 if
+// the tags go deeper than the parser follows or the frame ends first, with
+// truncated set in that case.
+uint16_t findNetworkLayer(const uint8_t* frame, size_t length, size_t offset, size_t& at, bool& truncated);
 #pragma pack(push, 1) // Ensure no padding in structs
 // PCAP Global Header
 struct PcapGlobalHeader {
@@ -0,0 +1,142 @@
+// A minimal protocol plugin written against PluginABI.h alone. It counts the
+// packets and payload bytes it is handed and the connections they belong to,
+// and writes one line per protocol to <protocol>-example-summary.csv.
+//
+// make plugin builds ExamplePlugin/libExamplePlugin.so. Map a protocol to it
+// in parser-mapping.dat, e.g. HTTP=ExamplePlugin/libExamplePlugin.so
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../PluginABI.h"
+
+// Connections are told apart by a hash of their addresses and ports, kept in
+// an open addressing set per state that doubles when half full
+#define EXAMPLE_INITIAL_SLOTS 1024
+
+typedef struct ExampleState {
+    uint64_t packets;
+    uint64_t payloadBytes;
+    uint64_t tcpPackets;
+    uint64_t udpPackets;
+    uint64_t* connections;  // 0 marks a free slot
+    size_t slotCount;
+    size_t connectionCount;
+} ExampleState;
+
+static uint64_t mix(uint64_t hash, uint64_t value) {
+    hash ^= value + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+    return hash;
+}
+
+// The same key for both directions of a connection, never 0
+static uint64_t connectionKey(const NPPacket* packet) {
+    uint64_t a = packet->srcPort;
+    uint64_t b = packet->destPort;
+    if (packet->ipVersion == 6) {
+        for (size_t i = 0; i < 16; i++) {
+            a = mix(a, packet->srcAddress6[i]);
+            b = mix(b, packet->destAddress6[i]);
+        }
+    } else {
+        a = mix(a, packet->srcAddress);
+        b = mix(b, packet->destAddress);
+    }
+    uint64_t key = mix(mix(a ^ b, a + b), packet->ipProtocol);
+    return key ? key : 1;
+}
+
+static void insertKey(uint64_t* slots, size_t slotCount, uint64_t key, size_t* count) {
+    size_t slot = key & (slotCount - 1);
+    while (slots[slot] != 0) {
+        if (slots[slot] == key) return;
+        slot = (slot + 1) & (slotCount - 1);
+    }
+    slots[slot] = key;
+    (*count)++;
+}
+
+// Without the memory to grow the set, counting stops rather than failing the run
+static void addConnection(ExampleState* state, uint64_t key) {
+    if (2 * (state->connectionCount + 1) > state->slotCount) {
+        size_t slotCount = state->slotCount ? 2 * state->slotCount : EXAMPLE_INITIAL_SLOTS;
+        uint64_t* slots = (uint64_t*)calloc(slotCount, sizeof(uint64_t));
+        if (!slots) return;
+        size_t count = 0;
+        for (size_t i = 0; i < state->slotCount; i++) {
+            if (state->connections[i] != 0) insertKey(slots, slotCount, state->connections[i], &count);
+        }
+        free(state->connections);
+        state->connections = slots;
+        state->slotCount = slotCount;
+    }
+    insertKey(state->connections, state->slotCount, key, &state->connectionCount);
+}
+
+static void* createState(const char* protocol) {
+    (void)protocol;
+    return calloc(1, sizeof(ExampleState));
+}
+
+static void destroyState(void* opaque) {
+    ExampleState* state = (ExampleState*)opaque;
+    if (state) free(state->connections);
+    free(state);
+}
+
+static void parseBatch(void* opaque, const NPPacket* packets, size_t count, const NPAllocator* scratch) {
+    ExampleState* state = (ExampleState*)opaque;
+    (void)scratch;  // Nothing here outlives the packet it is read from
+    for (size_t i = 0; i < count; i++) {
+        const NPPacket* packet = &packets[i];
+        state->packets++;
+        state->payloadBytes += packet->payloadLength;
+        if (packet->ipProtocol == 6) state->tcpPackets++;
+        if (packet->ipProtocol == 17) state->udpPackets++;
+        addConnection(state, connectionKey(packet));
+    }
+}
+
+// Every worker saw its own share of the connections, so the sets are merged
+// before counting
+static int report(const char* protocol, void* const* states, size_t stateCount) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s-example-summary.csv", protocol);
+    FILE* file = fopen(path, "w");
+    if (!file) return 1;
+
+    ExampleState total;
+    memset(&total, 0, sizeof(total));
+    for (size_t i = 0; i < stateCount; i++) {
+        const ExampleState* state = (const ExampleState*)states[i];
+        total.packets += state->packets;
+        total.payloadBytes += state->payloadBytes;
+        total.tcpPackets += state->tcpPackets;
+        total.udpPackets += state->udpPackets;
+        for (size_t slot = 0; slot < state->slotCount; slot++) {
+            if (state->connections[slot] != 0) addConnection(&total, state->connections[slot]);
+        }
+    }
+
+    fprintf(file, "Protocol,Packets,Payload Bytes,TCP Packets,UDP Packets,Connections\n");
+    fprintf(file, "%s,%llu,%llu,%llu,%llu,%zu\n", protocol, (unsigned long long)total.packets,
+            (unsigned long long)total.payloadBytes, (unsigned long long)total.tcpPackets,
+            (unsigned long long)total.udpPackets, total.connectionCount);
+    free(total.connections);
+    return fclose(file) == 0 ? 0 : 1;
+}
+
+static const NPPlugin plugin = {
+    NP_PLUGIN_ABI_VERSION,
+    sizeof(NPPlugin),
+    NP_PLUGIN_THREAD_STATE,  // Each state is only touched by its own worker
+    NULL,                    // No ports claimed, parser-mapping.dat routes traffic here
+    0,
+    createState,
+    destroyState,
+    parseBatch,
+    report,
+};
+
+const NPPlugin* networkParserPlugin(uint32_t hostAbiVersion) {
+    return hostAbiVersion == NP_PLUGIN_ABI_VERSION ? &plugin : NULL;
+}
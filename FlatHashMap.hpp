@@ -0,0 +1,145 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace NetworkParser {
+
+// Finalizer from splitmix64, spreads integer keys over the whole table
+inline uint64_t hashMix(uint64_t key) {
+    key ^= key >> 30;
+    key *= 0xbf58476d1ce4e5b9ull;
+    key ^= key >> 27;
+    key *= 0x94d049bb133111ebull;
+    key ^= key >> 31;
+    return key;
+}
+
+template <typename Key>
+struct FlatHash {
+    size_t operator()(const Key& key) const { return hashMix(static_cast<uint64_t>(key)); }
+};
+
+// Open addressing hash map with linear probing over a single flat slot array.
+// Keys and values are stored inline, so lookups touch one or two cache lines
+// and inserting never allocates except when the table grows.
+template <typename Key, typename Value, typename Hash = FlatHash<Key>>
+class FlatHashMap {
+public:
+    struct Slot {
+        Key key;
+        Value value;
+    };
+
+    class const_iterator {
+    public:
+        const_iterator(const FlatHashMap* map, size_t index) : map(map), index(index) { skipEmpty(); }
+        const Slot& operator*() const { return map->slots[index]; }
+        const Slot* operator->() const { return &map->slots[index]; }
+        const_iterator& operator++() { index++; skipEmpty(); return *this; }
+        bool operator!=(const const_iterator& other) const { return index != other.index; }
+        bool operator==(const const_iterator& other) const { return index == other.index; }
+
+    private:
+        const FlatHashMap* map;
+        size_t index;
+        void skipEmpty() { while (index < map->used.size() && !map->used[index]) index++; }
+    };
+
+    explicit FlatHashMap(size_t initialCapacity = 16) { allocate(initialCapacity); }
+
+    // Find the value for key, inserting a default constructed one if absent
+    Value& operator[](const Key& key) {
+        if ((count + 1) * 4 > slots.size() * 3) grow();
+        size_t index = hasher(key) & mask;
+        while (used[index]) {
+            if (slots[index].key == key) return slots[index].value;
+            index = (index + 1) & mask;
+        }
+        used[index] = 1;
+        slots[index].key = key;
+        slots[index].value = Value();
+        count++;
+        return slots[index].value;
+    }
+
+    Value* find(const Key& key) {
+        size_t index = indexOf(key);
+        return used[index] ? &slots[index].value : nullptr;
+    }
+
+    const Value* find(const Key& key) const {
+        size_t index = indexOf(key);
+        return used[index] ? &slots[index].value : nullptr;
+    }
+
+    // Remove key, shifting later entries of the probe run back so no tombstones are needed
+    bool erase(const Key& key) {
+        size_t hole = indexOf(key);
+        if (!used[hole]) return false;
+
+        size_t next = (hole + 1) & mask;
+        while (used[next]) {
+            size_t home = hasher(slots[next].key) & mask;
+            // The entry may fill the hole only if the hole lies between its home slot and itself
+            if (((next - home) & mask) >= ((next - hole) & mask)) {
+                slots[hole] = std::move(slots[next]);
+                hole = next;
+            }
+            next = (next + 1) & mask;
+        }
+        used[hole] = 0;
+        slots[hole].value = Value();  // Let go of anything the value owns
+        count--;
+        return true;
+    }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    void clear() {
+        std::fill(used.begin(), used.end(), 0);
+        count = 0;
+    }
+
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, used.size()); }
+
+private:
+    std::vector<Slot> slots;
+    std::vector<uint8_t> used;
+    size_t mask = 0;
+    size_t count = 0;
+    Hash hasher;
+
+    // Slot holding key, or the empty slot that ends its probe run
+    size_t indexOf(const Key& key) const {
+        size_t index = hasher(key) & mask;
+        while (used[index] && !(slots[index].key == key)) {
+            index = (index + 1) & mask;
+        }
+        return index;
+    }
+
+    void allocate(size_t capacity) {
+        size_t size = 16;
+        while (size < capacity) size <<= 1;
+        slots.assign(size, Slot());
+        used.assign(size, 0);
+        mask = size - 1;
+        count = 0;
+    }
+
+    void grow() {
+        std::vector<Slot> oldSlots = std::move(slots);
+        std::vector<uint8_t> oldUsed = std::move(used);
+        allocate(oldSlots.size() * 2);
+        for (size_t i = 0; i < oldSlots.size(); i++) {
+            if (oldUsed[i]) (*this)[oldSlots[i].key] = std::move(oldSlots[i].value);
+        }
+    }
+};
+
+} // namespace NetworkParser
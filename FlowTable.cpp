@@ -0,0 +1,367 @@
+#include "FlowTable.hpp"
+#include <algorithm>
+#include <iostream>
+#include <tuple>
+#include "StatsTables.hpp"
+
+namespace NetworkParser {
+
+// TCP flag bits
+static constexpr uint8_t kFin = 0x01;
+static constexpr uint8_t kSyn = 0x02;
+static constexpr uint8_t kRst = 0x04;
+static constexpr uint8_t kAck = 0x10;
+
+static constexpr size_t kSpillChunk = 4096;    // Records handed out or read from a run at a time
+static constexpr size_t kSpillRun = 16384;     // Evictions sorted and written out together
+
+bool FlowKey::operator<(const FlowKey& other) const {
+    return std::tie(addressA, addressB, portA, portB, protocol) <
+           std::tie(other.addressA, other.addressB, other.portA, other.portB, other.protocol);
+}
+
+const char* flowStateName(FlowState state) {
+    switch (state) {
+        case FlowState::Active: return "ACTIVE";
+        case FlowState::SynSent: return "SYN_SENT";
+        case FlowState::SynReceived: return "SYN_RECEIVED";
+        case FlowState::Established: return "ESTABLISHED";
+        case FlowState::Closing: return "CLOSING";
+        case FlowState::Closed: return "CLOSED";
+        case FlowState::Reset: return "RESET";
+    }
+    return "UNKNOWN";
+}
+
+FlowTable::FlowTable() : active(1024) {}
+
+FlowTable::~FlowTable() {
+    if (spill) std::fclose(spill);
+}
+
+// Report order. The fields after the key only break ties between records of
+// a flow that closed and reopened within the same microsecond.
+bool FlowTable::recordBefore(const FlowRecord& a, const FlowRecord& b) {
+    const FlowEntry& x = a.entry;
+    const FlowEntry& y = b.entry;
+    return std::tie(x.firstSeen, a.key, x.lastSeen, x.packetsToServer, x.packetsToClient, x.bytesToServer,
+                    x.bytesToClient) <
+           std::tie(y.firstSeen, b.key, y.lastSeen, y.packetsToServer, y.packetsToClient, y.bytesToServer,
+                    y.bytesToClient);
+}
+
+bool FlowTable::isFinished(const FlowEntry& entry, uint64_t at) const {
+    uint64_t idle = (at > entry.lastSeen) ? at - entry.lastSeen : 0;
+    if (entry.state == FlowState::Closed || entry.state == FlowState::Reset) {
+        return idle > std::min(kClosedLingerUsec, idleTimeoutUsec);
+    }
+    return idle > idleTimeoutUsec;
+}
+
+// Whether later is more of the same connection as earlier, as update would
+// have decided when later's first packet arrived
+bool FlowTable::continues(const FlowEntry& earlier, const FlowEntry& later) const {
+    bool reopened = later.opened && (earlier.state == FlowState::Closed || earlier.state == FlowState::Reset);
+    return !isFinished(earlier, later.firstSeen) && !reopened;
+}
+
+// One entry for the packets of both, seen from earlier's client
+FlowEntry FlowTable::combine(const FlowEntry& earlier, const FlowEntry& later) {
+    FlowEntry entry = earlier;
+    bool sameClient = (later.clientIsA == earlier.clientIsA);
+    entry.firstSeen = std::min(earlier.firstSeen, later.firstSeen);
+    entry.lastSeen = std::max(earlier.lastSeen, later.lastSeen);
+    entry.packetsToServer += sameClient ? later.packetsToServer : later.packetsToClient;
+    entry.packetsToClient += sameClient ? later.packetsToClient : later.packetsToServer;
+    entry.bytesToServer += sameClient ? later.bytesToServer : later.bytesToClient;
+    entry.bytesToClient += sameClient ? later.bytesToClient : later.bytesToServer;
+    auto fromEarlier = [sameClient](uint8_t mask) {
+        return sameClient ? mask : static_cast<uint8_t>(((mask & 1) << 1) | ((mask & 2) >> 1));
+    };
+    entry.finMask |= fromEarlier(later.finMask);
+    uint8_t laterAcks = fromEarlier(later.ackMask);
+    entry.ackMask |= laterAcks;
+
+    // A piece picked up mid-connection stays Active, which says nothing new,
+    // unless it holds the client's ACK to a SYN-ACK the earlier piece ended on
+    if (later.state != FlowState::Active) {
+        entry.state = later.state;
+    } else if (entry.state == FlowState::SynReceived && (laterAcks & 1)) {
+        entry.state = FlowState::Established;
+    }
+    if (entry.finMask && entry.state != FlowState::Reset) {
+        entry.state = (entry.finMask == 3) ? FlowState::Closed : FlowState::Closing;
+    }
+    return entry;
+}
+
+void FlowTable::update(const PacketContext& context, uint64_t payloadBytes) {
+    uint64_t timestamp = context.timestampMicros();
+
+    // Canonical key, remembering which side sent this packet
+    bool senderIsA;
+    FlowKey key = makeFlowKey(context, senderIsA);
+
+    uint8_t flags = context.tcpFlags;
+    bool opening = (flags & kSyn) && !(flags & kAck);
+
+    FlowEntry* entry = active.find(key);
+    if (entry) {
+        // A packet after the flow finished, or a fresh SYN on a closed flow, starts a new record
+        bool reopened = opening && (entry->state == FlowState::Closed || entry->state == FlowState::Reset);
+        if (isFinished(*entry, timestamp) || reopened) {
+            evict(key, *entry);
+            active.erase(key);
+            entry = nullptr;
+        }
+    }
+
+    if (!entry) {
+        entry = &active[key];
+        entry->firstSeen = timestamp;
+        // A SYN-ACK means the receiver opened the connection
+        bool synAck = (flags & kSyn) && (flags & kAck);
+        entry->clientIsA = synAck ? !senderIsA : senderIsA;
+        entry->state = FlowState::Active;
+        entry->opened = opening;
+    }
+
+    bool fromClient = (senderIsA == entry->clientIsA);
+    entry->lastSeen = std::max(entry->lastSeen, timestamp);
+    if (fromClient) {
+        entry->packetsToServer++;
+        entry->bytesToServer += payloadBytes;
+    } else {
+        entry->packetsToClient++;
+        entry->bytesToClient += payloadBytes;
+    }
+
+    if (context.ipProtocol == 6) {
+        if (flags & kAck) entry->ackMask |= fromClient ? 1 : 2;
+        if (flags & kRst) {
+            entry->state = FlowState::Reset;
+        } else {
+            if (opening && entry->state == FlowState::Active && entry->packetsToServer + entry->packetsToClient == 1) {
+                entry->state = FlowState::SynSent;
+            } else if ((flags & kSyn) && (flags & kAck) && !fromClient &&
+                       (entry->state == FlowState::SynSent || entry->state == FlowState::Active)) {
+                entry->state = FlowState::SynReceived;
+            } else if ((flags & kAck) && fromClient && entry->state == FlowState::SynReceived) {
+                entry->state = FlowState::Established;
+            }
+
+            if (flags & kFin) {
+                entry->finMask |= fromClient ? 1 : 2;
+                entry->state = (entry->finMask == 3) ? FlowState::Closed : FlowState::Closing;
+            }
+        }
+    }
+
+    if (timestamp > now) now = timestamp;
+    if (now - lastSweep >= kClosedLingerUsec) sweep();
+}
+
+void FlowTable::sweep() {
+    lastSweep = now;
+    expired.clear();
+    for (const auto& slot : active) {
+        if (isFinished(slot.value, now)) expired.push_back(slot.key);
+    }
+    for (const FlowKey& key : expired) {
+        evict(key, *active.find(key));
+        active.erase(key);
+    }
+}
+
+void FlowTable::evict(const FlowKey& key, const FlowEntry& entry) {
+    pending.push_back(FlowRecord{key, entry});
+    spilledCount++;
+    if (pending.size() == kSpillRun) writeRun();
+}
+
+void FlowTable::writeRun() {
+    std::sort(pending.begin(), pending.end(), recordBefore);
+    if (!spill) spill = std::tmpfile();
+    long offset = (spill && std::fseek(spill, 0, SEEK_END) == 0) ? std::ftell(spill) : -1;
+    if (offset >= 0 && std::fwrite(pending.data(), sizeof(FlowRecord), pending.size(), spill) == pending.size()) {
+        runs.push_back(SpillRun{offset, pending.size()});
+    } else {
+        if (!lostCount) std::cerr << "Error: Could not write the flow spill file, dropping evicted flows.\n";
+        lostCount += pending.size();
+        spilledCount -= pending.size();
+    }
+    pending.clear();
+}
+
+FlowTable::RecordMerger::RecordMerger(const FlowTable& table, bool withActive) : table(table) {
+    for (const SpillRun& run : table.runs) {
+        Source source;
+        source.offset = run.offset;
+        source.remaining = run.count;
+        sources.push_back(std::move(source));
+    }
+    Source pending;
+    pending.records = table.pending;
+    std::sort(pending.records.begin(), pending.records.end(), recordBefore);
+    sources.push_back(std::move(pending));
+    if (withActive) {
+        Source active;
+        active.records = table.sortedActive();
+        sources.push_back(std::move(active));
+    }
+
+    for (size_t i = 0; i < sources.size(); i++) {
+        if (refill(sources[i])) heap.push_back(i);
+    }
+    std::make_heap(heap.begin(), heap.end(), [this](size_t a, size_t b) { return later(a, b); });
+}
+
+// Makes sure the source has a record at its position, false once it is drained
+bool FlowTable::RecordMerger::refill(Source& source) {
+    if (source.position < source.records.size()) return true;
+    if (!source.remaining) return false;
+
+    source.records.resize(std::min(source.remaining, kSpillChunk));
+    size_t count = 0;
+    if (std::fseek(table.spill, source.offset, SEEK_SET) == 0) {
+        count = std::fread(source.records.data(), sizeof(FlowRecord), source.records.size(), table.spill);
+    }
+    if (count < source.records.size()) {
+        std::cerr << "Error: Could not read back the flow spill file, " << source.remaining - count
+                  << " flows are missing from the report.\n";
+        source.remaining = count;
+    }
+    source.records.resize(count);
+    source.position = 0;
+    source.offset += static_cast<long>(count * sizeof(FlowRecord));
+    source.remaining -= count;
+    return count > 0;
+}
+
+bool FlowTable::RecordMerger::later(size_t a, size_t b) const {
+    return recordBefore(sources[b].records[sources[b].position], sources[a].records[sources[a].position]);
+}
+
+bool FlowTable::RecordMerger::next(std::vector<FlowRecord>& chunk) {
+    auto order = [this](size_t a, size_t b) { return later(a, b); };
+    chunk.clear();
+    while (!heap.empty() && chunk.size() < kSpillChunk) {
+        std::pop_heap(heap.begin(), heap.end(), order);
+        Source& source = sources[heap.back()];
+        chunk.push_back(source.records[source.position++]);
+        if (refill(source)) {
+            std::push_heap(heap.begin(), heap.end(), order);
+        } else {
+            heap.pop_back();
+        }
+    }
+    return !chunk.empty();
+}
+
+std::vector<FlowRecord> FlowTable::sortedActive() const {
+    std::vector<FlowRecord> records;
+    records.reserve(active.size());
+    for (const auto& slot : active) {
+        records.push_back(FlowRecord{slot.key, slot.value});
+    }
+    std::sort(records.begin(), records.end(), recordBefore);
+    return records;
+}
+
+void FlowTable::merge(FlowTable& other) {
+    // Spilled records of a flow come in capture order, so the first one
+    // found for a flow we still have active is the one that may continue it.
+    // Whatever the outcome our entry is done with, as later records of the
+    // flow in other start after it.
+    RecordMerger spilled(other, false);
+    std::vector<FlowRecord> chunk;
+    while (spilled.next(chunk)) {
+        for (const FlowRecord& record : chunk) {
+            FlowEntry* existing = active.find(record.key);
+            if (!existing) {
+                evict(record.key, record.entry);
+            } else if (continues(*existing, record.entry)) {
+                evict(record.key, combine(*existing, record.entry));
+                active.erase(record.key);
+            } else {
+                evict(record.key, *existing);
+                evict(record.key, record.entry);
+                active.erase(record.key);
+            }
+        }
+    }
+
+    for (const auto& slot : other.active) {
+        FlowEntry entry = slot.value;
+        if (FlowEntry* existing = active.find(slot.key)) {
+            if (continues(*existing, entry)) {
+                entry = combine(*existing, entry);
+            } else {
+                evict(slot.key, *existing);
+            }
+        }
+        active[slot.key] = entry;
+    }
+    other.active.clear();
+    if (other.spill) std::fclose(other.spill);
+    other.spill = nullptr;
+    other.runs.clear();
+    other.pending.clear();
+    other.spilledCount = 0;
+    lostCount += other.lostCount;
+    other.lostCount = 0;
+    now = std::max(now, other.now);
+}
+
+void writeFlowRow(CsvWriter& out, const FlowRecord& record) {
+    const FlowEntry& entry = record.entry;
+    out.addAddress(record.clientAddress())
+        .addAddress(record.serverAddress())
+        .add(record.clientPort())
+        .add(record.serverPort())
+        .add(entry.packetsToClient)
+        .add(entry.packetsToServer)
+        .add(entry.bytesToClient)
+        .add(entry.bytesToServer)
+        .add(flowStateName(entry.state))
+        .addTimestamp(entry.firstSeen)
+        .addTimestamp(entry.lastSeen);
+    out.endRow();
+}
+
+std::vector<ColumnSpec> flowColumns(bool ipv6) {
+    std::vector<std::string> states;
+    for (int state = 0; state <= static_cast<int>(FlowState::Reset); state++) {
+        states.push_back(flowStateName(static_cast<FlowState>(state)));
+    }
+    ColumnType address = ipv6 ? ColumnType::Address6 : ColumnType::Address;
+    return {{"ip1", address},
+            {"ip2", address},
+            {"srcPort", ColumnType::UInt16},
+            {"destPort", ColumnType::UInt16},
+            {"packetsIn", ColumnType::UInt64},
+            {"packetsOut", ColumnType::UInt64},
+            {"bytesIn", ColumnType::UInt64},
+            {"bytesOut", ColumnType::UInt64},
+            {"state", ColumnType::Dictionary, states},
+            {"firstSeen", ColumnType::Timestamp},
+            {"lastSeen", ColumnType::Timestamp}};
+}
+
+void appendFlowRow(ArrowWriter& writer, const FlowRecord& record) {
+    const FlowEntry& entry = record.entry;
+    writer.add(record.clientAddress())
+        .add(record.serverAddress())
+        .add(record.clientPort())
+        .add(record.serverPort())
+        .add(entry.packetsToClient)
+        .add(entry.packetsToServer)
+        .add(entry.bytesToClient)
+        .add(entry.bytesToServer)
+        .add(static_cast<uint64_t>(entry.state))  // Dictionary index, the states in declaration order
+        .add(entry.firstSeen)
+        .add(entry.lastSeen);
+    writer.endRow();
+}
+
+} // namespace NetworkParser
@@ -0,0 +1,212 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include "Parser.hpp"
+#include "ArrowWriter.hpp"
+#include "CsvWriter.hpp"
+#include "FlatHashMap.hpp"
+
+namespace NetworkParser {
+
+// Bidirectional 5-tuple. The endpoint with the lower (address, port) is
+// always stored as A, so both directions of a flow map to the same key.
+// IPv4 addresses are IPv4-mapped, so both families share the table.
+struct FlowKey {
+    IPAddress addressA;
+    IPAddress addressB;
+    uint16_t portA = 0;
+    uint16_t portB = 0;
+    uint8_t protocol = 0;
+
+    bool operator==(const FlowKey& other) const {
+        return addressA == other.addressA && addressB == other.addressB &&
+               portA == other.portA && portB == other.portB && protocol == other.protocol;
+    }
+    bool operator<(const FlowKey& other) const;
+};
+
+struct FlowKeyHash {
+    size_t operator()(const FlowKey& key) const {
+        // The upper 96 bits are zero for IPv4-mapped keys, which then hash as they did with 32 bit addresses
+        uint64_t addresses = (key.addressA.low << 32) | static_cast<uint32_t>(key.addressB.low);
+        uint64_t upper = key.addressA.high ^ (key.addressB.high << 1) ^ ((key.addressA.low >> 32) ^ 0xFFFF) ^
+                         (((key.addressB.low >> 32) ^ 0xFFFF) << 32);
+        uint64_t ports = (static_cast<uint64_t>(key.portA) << 24) | (key.portB << 8) | key.protocol;
+        return hashMix(addresses ^ (upper * 0x9E3779B97F4A7C15ull) ^ hashMix(ports));
+    }
+};
+
+// Canonical key for the flow a packet belongs to. senderIsA tells which side
+// of the key sent this packet.
+inline FlowKey makeFlowKey(const PacketContext& context, bool& senderIsA) {
+    FlowKey key;
+    key.protocol = context.ipProtocol;
+    IPAddress source = context.srcAddress6;
+    IPAddress destination = context.destAddress6;
+    if (context.ipVersion != 6) {
+        source = IPAddress::fromIPv4(context.srcAddress);
+        destination = IPAddress::fromIPv4(context.destAddress);
+    }
+    senderIsA = (source < destination) || (source == destination && context.srcPort <= context.destPort);
+    if (senderIsA) {
+        key.addressA = source;
+        key.portA = context.srcPort;
+        key.addressB = destination;
+        key.portB = context.destPort;
+    } else {
+        key.addressA = destination;
+        key.portA = context.destPort;
+        key.addressB = source;
+        key.portB = context.srcPort;
+    }
+    return key;
+}
+
+enum class FlowState : uint8_t {
+    Active,       // UDP, or TCP picked up without seeing the handshake
+    SynSent,
+    SynReceived,
+    Established,
+    Closing,      // FIN seen from one side
+    Closed,       // FIN seen from both sides
+    Reset
+};
+
+const char* flowStateName(FlowState state);
+
+// Everything tracked for one flow. Client is the side that sent the first SYN,
+// or the sender of the first packet seen when the handshake was missed.
+struct FlowEntry {
+    uint64_t firstSeen = 0;  // Microseconds since the epoch
+    uint64_t lastSeen = 0;
+    uint64_t packetsToServer = 0;
+    uint64_t packetsToClient = 0;
+    uint64_t bytesToServer = 0;
+    uint64_t bytesToClient = 0;
+    FlowState state = FlowState::Active;
+    uint8_t finMask = 0;       // 1 = client sent FIN, 2 = server sent FIN
+    uint8_t ackMask = 0;       // 1 = client sent ACK, 2 = server sent ACK
+    bool clientIsA = true;
+    bool opened = false;       // The first packet was a SYN
+};
+
+// A finished or still active flow as written to the connection reports
+struct FlowRecord {
+    FlowKey key;
+    FlowEntry entry;
+
+    IPAddress clientAddress() const { return entry.clientIsA ? key.addressA : key.addressB; }
+    IPAddress serverAddress() const { return entry.clientIsA ? key.addressB : key.addressA; }
+    bool isIPv4() const { return key.addressA.isIPv4() && key.addressB.isIPv4(); }
+    uint16_t clientPort() const { return entry.clientIsA ? key.portA : key.portB; }
+    uint16_t serverPort() const { return entry.clientIsA ? key.portB : key.portA; }
+};
+
+// Flow table keyed by 5-tuple. Flows that go idle, or that were closed or
+// reset and then went quiet, are evicted and spilled to an anonymous temp
+// file, which keeps memory proportional to the number of concurrently active
+// flows rather than to every connection in the capture. A flow is considered
+// finished purely from its own packet timestamps, so the set of records does
+// not depend on when sweeps run or how packets were sharded across threads.
+// Records are read back ordered by first packet, then key, so neither does
+// their order: evictions are sorted into runs as they are spilled, and the
+// runs are merged with the active flows when read.
+class FlowTable {
+public:
+    static constexpr uint64_t kDefaultIdleTimeoutUsec = 120ull * 1000000;
+    static constexpr uint64_t kClosedLingerUsec = 5ull * 1000000;
+
+    FlowTable();
+    ~FlowTable();
+    FlowTable(const FlowTable&) = delete;
+    FlowTable& operator=(const FlowTable&) = delete;
+
+    void setIdleTimeout(uint64_t usec) { idleTimeoutUsec = usec; }
+
+    // Account one packet of the flow described by context
+    void update(const PacketContext& context, uint64_t payloadBytes);
+
+    // Take over every flow of other, which is left empty. When both tables
+    // hold a flow, other's packets are taken to follow ours in capture time,
+    // as with consecutive files, and its first record of the flow continues
+    // our active one unless the flow had finished in between.
+    void merge(FlowTable& other);
+
+    size_t activeFlows() const { return active.size(); }
+    size_t totalFlows() const { return active.size() + spilledCount; }
+    size_t lostFlows() const { return lostCount; }  // Evicted but never written to the spill file
+
+    // Visit every flow, spilled or active, by first packet and then key
+    template <typename Callback>
+    void forEachRecord(Callback callback) const {
+        RecordMerger merger(*this, true);
+        std::vector<FlowRecord> chunk;
+        while (merger.next(chunk)) {
+            for (const FlowRecord& record : chunk) callback(record);
+        }
+    }
+
+private:
+    // A sorted stretch of the spill file
+    struct SpillRun {
+        long offset;
+        size_t count;
+    };
+
+    // Hands out a table's records in report order a chunk at a time, merging
+    // its spill runs, its pending evictions and, if asked, its active flows
+    class RecordMerger {
+    public:
+        RecordMerger(const FlowTable& table, bool withActive);
+        bool next(std::vector<FlowRecord>& chunk);
+
+    private:
+        struct Source {
+            std::vector<FlowRecord> records;
+            size_t position = 0;
+            long offset = 0;       // Where the rest of a spill run starts
+            size_t remaining = 0;  // Records of the run still in the file
+        };
+
+        const FlowTable& table;
+        std::vector<Source> sources;
+        std::vector<size_t> heap;  // Sources with records left, earliest on top
+
+        bool refill(Source& source);
+        bool later(size_t a, size_t b) const;
+    };
+
+    FlatHashMap<FlowKey, FlowEntry, FlowKeyHash> active;
+    std::FILE* spill = nullptr;
+    std::vector<SpillRun> runs;
+    std::vector<FlowRecord> pending;  // Evicted since the last run was written
+    size_t spilledCount = 0;          // Records in runs and pending
+    size_t lostCount = 0;
+    uint64_t idleTimeoutUsec = kDefaultIdleTimeoutUsec;
+    uint64_t now = 0;
+    uint64_t lastSweep = 0;
+    std::vector<FlowKey> expired;     // Scratch list reused by sweep
+
+    static bool recordBefore(const FlowRecord& a, const FlowRecord& b);
+    bool isFinished(const FlowEntry& entry, uint64_t at) const;
+    bool continues(const FlowEntry& earlier, const FlowEntry& later) const;
+    static FlowEntry combine(const FlowEntry& earlier, const FlowEntry& later);
+    void evict(const FlowKey& key, const FlowEntry& entry);
+    void writeRun();
+    void sweep();
+    std::vector<FlowRecord> sortedActive() const;
+};
+
+// Write one connection report row: ip1,ip2,srcPort,destPort,packetsIn,packetsOut,bytesIn,bytesOut,state,firstSeen,lastSeen
+void writeFlowRow(CsvWriter& out, const FlowRecord& record);
+
+// Arrow columns of the connection reports, the same as the CSV with integer
+// addresses, microsecond timestamps and a dictionary encoded state. IPv6
+// flows go to tables of their own with 16 byte binary addresses.
+std::vector<ColumnSpec> flowColumns(bool ipv6 = false);
+
+// Append one connection report row to writer
+void appendFlowRow(ArrowWriter& writer, const FlowRecord& record);
+
+} // namespace NetworkParser
@@ -0,0 +1,306 @@
+#include "HeaderBatch.hpp"
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#if defined(__x86_64__) || defined(__i386__)
+#define NETWORK_PARSER_X86 1
+#include <immintrin.h>
+#endif
+
+namespace NetworkParser {
+
+namespace {
+
+constexpr size_t kEthernetLength = 14;
+constexpr size_t kMinimalIPv4 = kEthernetLength + 20;  // Enough for the addresses
+constexpr uint16_t kEtherTypeIPv4 = 0x0800;
+constexpr uint8_t kTCP = 6;
+constexpr uint8_t kUDP = 17;
+
+uint16_t read16(const uint8_t* at) {
+    return static_cast<uint16_t>((at[0] << 8) | at[1]);
+}
+
+uint32_t read32(const uint8_t* at) {
+    return (static_cast<uint32_t>(read16(at)) << 16) | read16(at + 2);
+}
+
+// The ones' complement sum doesn't depend on byte order (RFC 1071), so words
+// are added as the CPU loads them and the folded result is swapped at the end
+uint16_t finishSum(uint64_t sum, size_t i, const uint8_t* data, size_t length) {
+    for (; i + 2 <= length; i += 2) {
+        uint16_t word;
+        std::memcpy(&word, data + i, 2);
+        sum += word;
+    }
+    if (i < length) {
+        uint16_t word = 0;
+        std::memcpy(&word, data + i, 1);  // Padded with a zero byte
+        sum += word;
+    }
+    while (sum >> 16) sum = (sum & 0xFFFF) + (sum >> 16);
+    uint16_t folded = static_cast<uint16_t>(sum);
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    folded = static_cast<uint16_t>((folded << 8) | (folded >> 8));
+#endif
+    return folded;
+}
+
+uint16_t sumScalar(const uint8_t* data, size_t length) {
+    uint64_t sum = 0;
+    size_t i = 0;
+    for (; i + 4 <= length; i += 4) {
+        uint32_t word;
+        std::memcpy(&word, data + i, 4);
+        sum += word;
+    }
+    return finishSum(sum, i, data, length);
+}
+
+#ifdef NETWORK_PARSER_X86
+
+// 32 bit words widened into 64 bit lanes, which can't overflow for any packet
+uint16_t sumSSE2(const uint8_t* data, size_t length) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i low = zero;
+    __m128i high = zero;
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i words = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        low = _mm_add_epi64(low, _mm_unpacklo_epi32(words, zero));
+        high = _mm_add_epi64(high, _mm_unpackhi_epi32(words, zero));
+    }
+    uint64_t lanes[2];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), _mm_add_epi64(low, high));
+    return finishSum(lanes[0] + lanes[1], i, data, length);
+}
+
+__attribute__((target("avx2"))) uint16_t sumAVX2(const uint8_t* data, size_t length) {
+    __m256i first = _mm256_setzero_si256();
+    __m256i second = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 16));
+        first = _mm256_add_epi64(first, _mm256_cvtepu32_epi64(low));
+        second = _mm256_add_epi64(second, _mm256_cvtepu32_epi64(high));
+    }
+    uint64_t lanes[4];
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), _mm256_add_epi64(first, second));
+    return finishSum(lanes[0] + lanes[1] + lanes[2] + lanes[3], i, data, length);
+}
+
+#endif
+
+void decodeOne(const PacketView& packet, HeaderBatch& batch, size_t i) {
+    const uint8_t* data = packet.data;
+    size_t length = packet.length;
+    batch.etherType[i] = length >= kEthernetLength ? read16(data + 12) : 0;
+    batch.sourceIP[i] = 0;
+    batch.destinationIP[i] = 0;
+    batch.totalLength[i] = 0;
+    batch.fragment[i] = 0;
+    batch.sourcePort[i] = 0;
+    batch.destinationPort[i] = 0;
+    batch.headerLength[i] = 0;
+    batch.ipProtocol[i] = 0;
+    batch.status[i] = 0;
+    if (batch.etherType[i] != kEtherTypeIPv4 || length < kMinimalIPv4) return;
+
+    const uint8_t* ip = data + kEthernetLength;
+    uint8_t version = ip[0] >> 4;
+    uint8_t headerLength = (ip[0] & 0x0F) * 4;
+    batch.headerLength[i] = headerLength;
+    batch.totalLength[i] = read16(ip + 2);
+    batch.fragment[i] = read16(ip + 6);
+    batch.ipProtocol[i] = ip[9];
+    batch.sourceIP[i] = read32(ip + 12);
+    batch.destinationIP[i] = read32(ip + 16);
+    batch.status[i] = HeaderBatch::HasIPv4;
+
+    size_t available = length - kEthernetLength;
+    if (version != 4 || headerLength < 20 || headerLength > available || batch.totalLength[i] < headerLength ||
+        batch.totalLength[i] > available) {
+        return;
+    }
+    batch.status[i] |= HeaderBatch::ValidIPv4;
+
+    bool transport = batch.ipProtocol[i] == kTCP || batch.ipProtocol[i] == kUDP;
+    if (!transport || (batch.fragment[i] & 0x1FFF) || headerLength + 4u > available) return;
+    batch.sourcePort[i] = read16(ip + headerLength);
+    batch.destinationPort[i] = read16(ip + headerLength + 2);
+    batch.status[i] |= HeaderBatch::HasPorts;
+}
+
+#ifdef NETWORK_PARSER_X86
+
+// 32 bits at offset from each of four packets, zero where mask is clear
+__attribute__((target("avx2"))) __m128i gatherWords(const int* base, __m256i offsets, long long offset,
+                                                     __m128i mask) {
+    __m256i at = _mm256_add_epi64(offsets, _mm256_set1_epi64x(offset));
+    return _mm256_mask_i64gather_epi32(_mm_setzero_si128(), base, at, mask, 1);
+}
+
+// Four 32 bit lanes narrowed to the SoA array's width
+__attribute__((target("avx2"))) void store32(uint32_t* to, __m128i lanes) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(to), lanes);
+}
+
+__attribute__((target("avx2"))) void store16(uint16_t* to, __m128i lanes) {
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(to), _mm_packus_epi32(lanes, lanes));
+}
+
+__attribute__((target("avx2"))) void store8(uint8_t* to, __m128i lanes) {
+    __m128i words = _mm_packus_epi32(lanes, lanes);
+    int bytes = _mm_cvtsi128_si32(_mm_packus_epi16(words, words));
+    std::memcpy(to, &bytes, 4);
+}
+
+// Four packets at a time: their header words are gathered into one register
+// per field, byte swapped with a shuffle and checked with lane compares.
+// Packets too short for the minimal IPv4 header are left to decodeOne.
+__attribute__((target("avx2"))) size_t decodeAVX2(const PacketView* packets, size_t count, HeaderBatch& batch) {
+    const __m128i swap16 = _mm_setr_epi8(1, 0, -1, -1, 5, 4, -1, -1, 9, 8, -1, -1, 13, 12, -1, -1);
+    const __m128i swapHigh16 = _mm_setr_epi8(3, 2, -1, -1, 7, 6, -1, -1, 11, 10, -1, -1, 15, 14, -1, -1);
+    const __m128i swap32 = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    const __m128i byteMask = _mm_set1_epi32(0xFF);
+    const __m128i zero = _mm_setzero_si128();
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        // Offsets from the first packet, so one base pointer serves all four gathers
+        const uint8_t* base = packets[i].data;
+        uintptr_t origin = reinterpret_cast<uintptr_t>(base);
+        auto offsetOf = [&](size_t lane) {
+            return static_cast<long long>(reinterpret_cast<uintptr_t>(packets[i + lane].data) - origin);
+        };
+        __m256i offsets = _mm256_setr_epi64x(0, offsetOf(1), offsetOf(2), offsetOf(3));
+        auto clamp = [](size_t length) { return static_cast<int>(std::min<size_t>(length, INT_MAX)); };
+        __m128i lengths = _mm_setr_epi32(clamp(packets[i].length), clamp(packets[i + 1].length),
+                                         clamp(packets[i + 2].length), clamp(packets[i + 3].length));
+        __m128i whole = _mm_cmpgt_epi32(lengths, _mm_set1_epi32(kMinimalIPv4 - 1));
+        const int* gatherBase = reinterpret_cast<const int*>(base);
+
+        __m128i ethernetWord = gatherWords(gatherBase, offsets, 12, whole);  // etherType, version and IHL, TOS
+        __m128i lengthWord = gatherWords(gatherBase, offsets, 16, whole);    // total length, identification
+        __m128i fragmentWord = gatherWords(gatherBase, offsets, 20, whole);  // flags and fragment offset, TTL, protocol
+        __m128i source = _mm_shuffle_epi8(gatherWords(gatherBase, offsets, 26, whole), swap32);
+        __m128i destination = _mm_shuffle_epi8(gatherWords(gatherBase, offsets, 30, whole), swap32);
+
+        __m128i etherType = _mm_shuffle_epi8(ethernetWord, swap16);
+        __m128i versionIHL = _mm_and_si128(_mm_srli_epi32(ethernetWord, 16), byteMask);
+        __m128i headerLength = _mm_slli_epi32(_mm_and_si128(versionIHL, _mm_set1_epi32(0x0F)), 2);
+        __m128i totalLength = _mm_shuffle_epi8(lengthWord, swap16);
+        __m128i fragment = _mm_shuffle_epi8(fragmentWord, swap16);
+        __m128i protocol = _mm_srli_epi32(fragmentWord, 24);
+
+        __m128i ipv4 = _mm_and_si128(whole, _mm_cmpeq_epi32(etherType, _mm_set1_epi32(kEtherTypeIPv4)));
+        __m128i available = _mm_sub_epi32(lengths, _mm_set1_epi32(kEthernetLength));
+        __m128i valid = _mm_and_si128(ipv4, _mm_cmpeq_epi32(_mm_srli_epi32(versionIHL, 4), _mm_set1_epi32(4)));
+        valid = _mm_andnot_si128(_mm_cmplt_epi32(headerLength, _mm_set1_epi32(20)), valid);
+        valid = _mm_andnot_si128(_mm_cmpgt_epi32(headerLength, available), valid);
+        valid = _mm_andnot_si128(_mm_cmplt_epi32(totalLength, headerLength), valid);
+        valid = _mm_andnot_si128(_mm_cmpgt_epi32(totalLength, available), valid);
+
+        __m128i transport = _mm_or_si128(_mm_cmpeq_epi32(protocol, _mm_set1_epi32(kTCP)),
+                                         _mm_cmpeq_epi32(protocol, _mm_set1_epi32(kUDP)));
+        __m128i ports = _mm_and_si128(valid, transport);
+        ports = _mm_and_si128(ports, _mm_cmpeq_epi32(_mm_and_si128(fragment, _mm_set1_epi32(0x1FFF)), zero));
+        ports = _mm_andnot_si128(_mm_cmpgt_epi32(_mm_add_epi32(headerLength, _mm_set1_epi32(4)), available), ports);
+        __m256i portOffsets = _mm256_add_epi64(offsets, _mm256_cvtepu32_epi64(headerLength));
+        __m128i portWord = gatherWords(gatherBase, portOffsets, kEthernetLength, ports);
+        __m128i sourcePort = _mm_shuffle_epi8(portWord, swap16);
+        __m128i destinationPort = _mm_shuffle_epi8(portWord, swapHigh16);
+
+        __m128i status = _mm_or_si128(_mm_and_si128(ipv4, _mm_set1_epi32(HeaderBatch::HasIPv4)),
+                                      _mm_and_si128(valid, _mm_set1_epi32(HeaderBatch::ValidIPv4)));
+        status = _mm_or_si128(status, _mm_and_si128(ports, _mm_set1_epi32(HeaderBatch::HasPorts)));
+
+        store32(batch.sourceIP + i, _mm_and_si128(source, ipv4));
+        store32(batch.destinationIP + i, _mm_and_si128(destination, ipv4));
+        store16(batch.etherType + i, etherType);
+        store16(batch.totalLength + i, _mm_and_si128(totalLength, ipv4));
+        store16(batch.fragment + i, _mm_and_si128(fragment, ipv4));
+        store16(batch.sourcePort + i, sourcePort);
+        store16(batch.destinationPort + i, destinationPort);
+        store8(batch.headerLength + i, _mm_and_si128(headerLength, ipv4));
+        store8(batch.ipProtocol + i, _mm_and_si128(protocol, ipv4));
+        store8(batch.status + i, status);
+
+        int shortPackets = _mm_movemask_ps(_mm_castsi128_ps(whole)) ^ 0xF;
+        for (int lane = 0; lane < 4; lane++) {
+            if (shortPackets & (1 << lane)) decodeOne(packets[i + lane], batch, i + lane);
+        }
+    }
+    return i;
+}
+
+#endif
+
+void verifyChecksum(const PacketView& packet, HeaderBatch& batch, size_t i, SimdLevel level) {
+    if (!(batch.status[i] & HeaderBatch::ValidIPv4)) return;
+    const uint8_t* ip = packet.data + kEthernetLength;
+    size_t headerLength = batch.headerLength[i];
+    if (onesComplementSum(ip, headerLength, level) != 0xFFFF) {
+        batch.status[i] |= HeaderBatch::IPChecksumBad;
+        return;
+    }
+
+    // Fragments can only be checked once reassembled, and the rest of the segment must have been captured
+    if (!(batch.status[i] & HeaderBatch::HasPorts) || (batch.fragment[i] & 0x3FFF)) return;
+    const uint8_t* segment = ip + headerLength;
+    size_t segmentLength = batch.totalLength[i] - headerLength;
+    bool tcp = batch.ipProtocol[i] == kTCP;
+    if (segmentLength < (tcp ? 20u : 8u)) return;
+    if (!tcp && read16(segment + 6) == 0) return;  // No checksum sent
+
+    uint64_t sum = (batch.sourceIP[i] >> 16) + (batch.sourceIP[i] & 0xFFFF) + (batch.destinationIP[i] >> 16) +
+                   (batch.destinationIP[i] & 0xFFFF) + batch.ipProtocol[i] + segmentLength;
+    sum += onesComplementSum(segment, segmentLength, level);
+    while (sum >> 16) sum = (sum & 0xFFFF) + (sum >> 16);
+    if (sum != 0xFFFF) batch.status[i] |= HeaderBatch::TransportChecksumBad;
+}
+
+} // namespace
+
+SimdLevel bestSimdLevel() {
+#ifdef NETWORK_PARSER_X86
+    static const SimdLevel level = __builtin_cpu_supports("avx2") ? SimdLevel::AVX2 : SimdLevel::SSE2;
+    return level;
+#else
+    return SimdLevel::Scalar;
+#endif
+}
+
+const char* simdLevelName(SimdLevel level) {
+    switch (level) {
+    case SimdLevel::AVX2: return "avx2";
+    case SimdLevel::SSE2: return "sse2";
+    default: return "scalar";
+    }
+}
+
+uint16_t onesComplementSum(const uint8_t* data, size_t length, SimdLevel level) {
+#ifdef NETWORK_PARSER_X86
+    if (level == SimdLevel::AVX2) return sumAVX2(data, length);
+    if (level == SimdLevel::SSE2) return sumSSE2(data, length);
+#endif
+    return sumScalar(data, length);
+}
+
+void decodeHeaders(const PacketView* packets, size_t count, HeaderBatch& batch, bool verifyChecksums,
+                   SimdLevel level) {
+    count = std::min(count, HeaderBatch::kCapacity);
+    batch.count = count;
+
+    size_t i = 0;
+#ifdef NETWORK_PARSER_X86
+    if (level == SimdLevel::AVX2) i = decodeAVX2(packets, count, batch);
+#endif
+    for (; i < count; i++) decodeOne(packets[i], batch, i);
+
+    if (!verifyChecksums) return;
+    for (i = 0; i < count; i++) verifyChecksum(packets[i], batch, i, level);
+}
+
+} // namespace NetworkParser
@@ -0,0 +1,51 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "CaptureFormat.hpp"
+
+namespace NetworkParser {
+
+// Instruction sets the batch decoder and checksums have routines for
+enum class SimdLevel { Scalar, SSE2, AVX2 };
+
+// Best level this CPU supports, detected once
+SimdLevel bestSimdLevel();
+const char* simdLevelName(SimdLevel level);
+
+// Ethernet/IPv4/TCP/UDP headers of a run of packets, one array per field so
+// a whole batch is decoded and checked with vector instructions. Fields are
+// in host byte order and zero where the packet doesn't have them.
+struct HeaderBatch {
+    static constexpr size_t kCapacity = 256;
+
+    enum Status : uint8_t {
+        HasIPv4 = 1,               // IPv4 ethertype and a minimal header captured, addresses are set
+        ValidIPv4 = 2,             // Passes IPParser's version, header length and total length checks
+        HasPorts = 4,              // First fragment of a TCP or UDP segment with its ports captured
+        IPChecksumBad = 8,
+        TransportChecksumBad = 16  // Only checked for unfragmented segments captured in full
+    };
+
+    size_t count = 0;
+    alignas(32) uint32_t sourceIP[kCapacity];
+    alignas(32) uint32_t destinationIP[kCapacity];
+    alignas(32) uint16_t etherType[kCapacity];
+    alignas(32) uint16_t totalLength[kCapacity];
+    alignas(32) uint16_t fragment[kCapacity];  // Flags and fragment offset
+    alignas(32) uint16_t sourcePort[kCapacity];
+    alignas(32) uint16_t destinationPort[kCapacity];
+    alignas(32) uint8_t headerLength[kCapacity];  // IPv4 header bytes
+    alignas(32) uint8_t ipProtocol[kCapacity];
+    alignas(32) uint8_t status[kCapacity];
+};
+
+// Decode up to kCapacity packets into batch. With verifyChecksums the IPv4
+// header checksum of every valid packet and the TCP or UDP checksum of every
+// segment that can be checked are verified as well.
+void decodeHeaders(const PacketView* packets, size_t count, HeaderBatch& batch, bool verifyChecksums,
+                   SimdLevel level = bestSimdLevel());
+
+// Internet checksum sum of data as big endian 16 bit words, folded to 16 bits
+uint16_t onesComplementSum(const uint8_t* data, size_t length, SimdLevel level = bestSimdLevel());
+
+} // namespace NetworkParser
@@ -0,0 +1,69 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include "FlatHashMap.hpp"
+
+namespace NetworkParser {
+
+// IPv6 address as two host order halves, so it compares and hashes as two
+// integers. IPv4 addresses are held IPv4-mapped (::ffff:a.b.c.d) wherever
+// both families share a key, which keeps their numeric order.
+struct IPAddress {
+    uint64_t high = 0;
+    uint64_t low = 0;
+
+    static IPAddress fromIPv4(uint32_t address) { return {0, 0x0000FFFF00000000ull | address}; }
+
+    // From 16 bytes in network order
+    static IPAddress fromBytes(const uint8_t* bytes) {
+        IPAddress address;
+        for (int i = 0; i < 8; i++) address.high = (address.high << 8) | bytes[i];
+        for (int i = 8; i < 16; i++) address.low = (address.low << 8) | bytes[i];
+        return address;
+    }
+
+    void toBytes(uint8_t* bytes) const {
+        for (int i = 0; i < 8; i++) bytes[i] = static_cast<uint8_t>(high >> (56 - 8 * i));
+        for (int i = 0; i < 8; i++) bytes[8 + i] = static_cast<uint8_t>(low >> (56 - 8 * i));
+    }
+
+    bool isIPv4() const { return high == 0 && (low >> 32) == 0x0000FFFF; }
+    uint32_t ipv4() const { return static_cast<uint32_t>(low); }
+
+    bool operator==(const IPAddress& other) const { return high == other.high && low == other.low; }
+    bool operator!=(const IPAddress& other) const { return !(*this == other); }
+    bool operator<(const IPAddress& other) const {
+        return high < other.high || (high == other.high && low < other.low);
+    }
+};
+
+// Ordered pair of addresses, the key of the IPv6 interaction table
+struct IPAddressPair {
+    IPAddress source;
+    IPAddress destination;
+
+    bool operator==(const IPAddressPair& other) const {
+        return source == other.source && destination == other.destination;
+    }
+    bool operator<(const IPAddressPair& other) const {
+        return source < other.source || (source == other.source && destination < other.destination);
+    }
+};
+
+template <>
+struct FlatHash<IPAddress> {
+    size_t operator()(const IPAddress& key) const { return hashMix(key.low ^ hashMix(key.high)); }
+};
+
+template <>
+struct FlatHash<IPAddressPair> {
+    size_t operator()(const IPAddressPair& key) const {
+        FlatHash<IPAddress> hash;
+        return hashMix(hash(key.source) ^ (hash(key.destination) << 1));
+    }
+};
+
+// Dotted quad for IPv4-mapped addresses, RFC 5952 text for the rest
+std::string ipAddressToString(const IPAddress& address);
+
+} // namespace NetworkParser
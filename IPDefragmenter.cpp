@@ -0,0 +1,169 @@
+#include "IPDefragmenter.hpp"
+#include "IPParser.hpp"
+#include <algorithm>
+#include <cstring>
+#include <netinet/in.h>
+
+namespace NetworkParser {
+
+// Set the bits of units [first, last), returns how many were not set before
+static size_t markUnits(uint64_t* words, size_t first, size_t last) {
+    size_t added = 0;
+    while (first < last) {
+        size_t bit = first % 64;
+        size_t count = std::min<size_t>(64 - bit, last - first);
+        uint64_t mask = (count == 64 ? ~0ull : (1ull << count) - 1) << bit;
+        added += __builtin_popcountll(mask & ~words[first / 64]);
+        words[first / 64] |= mask;
+        first += count;
+    }
+    return added;
+}
+
+// Number of units [0, last) that are set
+static size_t countUnits(const uint64_t* words, size_t last) {
+    size_t set = 0;
+    for (size_t word = 0; word < last / 64; word++) set += __builtin_popcountll(words[word]);
+    if (last % 64) set += __builtin_popcountll(words[last / 64] & ((1ull << (last % 64)) - 1));
+    return set;
+}
+
+IPDefragmenter::IPDefragmenter(FragmentStats& stats, size_t slotCount)
+    : stats(stats), slotCount(slotCount), index(slotCount * 2) {}
+
+const uint8_t* IPDefragmenter::accept(const uint8_t* packet, size_t offset, PacketContext& context,
+                                      size_t& datagramLength) {
+    const IPv4Header* ipHeader = reinterpret_cast<const IPv4Header*>(packet + offset);
+    size_t headerLength = (ipHeader->version_internet_header_length & 0x0F) * 4;
+    size_t length = ntohs(ipHeader->totalLength) - headerLength;
+    uint16_t flagsOffset = ntohs(ipHeader->flags_offset);
+    size_t fragmentOffset = static_cast<size_t>(flagsOffset & 0x1FFF) * 8;
+    bool moreFragments = flagsOffset & 0x2000;
+    size_t end = fragmentOffset + length;
+    stats.fragments++;
+
+    uint64_t timestamp = context.timestampMicros();
+    if (timestamp > now) now = timestamp;
+    if (now - lastSweep >= kSweepIntervalUsec) sweep();
+
+    // Every fragment but the last carries a multiple of 8 bytes
+    if (!length || end > kMaxPayload || (moreFragments && length % 8)) {
+        stats.invalid++;
+        return nullptr;
+    }
+
+    // The pool is only set up once a capture turns out to have fragments
+    if (!storage) {
+        slots.resize(slotCount);
+        storage.reset(new uint8_t[slotCount * (kMaxHeader + kMaxPayload)]);
+        units = std::make_unique<uint64_t[]>(slotCount * kUnitWords);
+        for (size_t slot = slotCount; slot > 0; slot--) freeSlots.push_back(static_cast<uint32_t>(slot - 1));
+    }
+
+    FragmentKey key;
+    key.source = ntohl(ipHeader->sourceIP);
+    key.destination = ntohl(ipHeader->destinationIP);
+    key.identification = ntohs(ipHeader->identification);
+    key.protocol = ipHeader->protocol;
+    const uint32_t* found = index.find(key);
+    uint32_t slot = found ? *found : acquire(key, timestamp);
+    Slot& entry = slots[slot];
+
+    // A second last fragment that disagrees, or data past the end, spoils the datagram
+    if ((!moreFragments && entry.payloadLength && entry.payloadLength != end) ||
+        (entry.payloadLength && end > entry.payloadLength)) {
+        stats.invalid++;
+        evict(slot);
+        return nullptr;
+    }
+    if (!moreFragments) entry.payloadLength = end;
+
+    uint8_t* base = data(slot);
+    std::memcpy(base + kMaxHeader + fragmentOffset, packet + offset + headerLength, length);
+    if (fragmentOffset == 0) {
+        entry.headerLength = headerLength;
+        std::memcpy(base + kMaxHeader - headerLength, packet + offset, headerLength);
+    }
+    entry.fragments++;
+    uint64_t* bitmap = units.get() + slot * kUnitWords;
+    entry.unitsReceived += markUnits(bitmap, fragmentOffset / 8, (end + 7) / 8);
+
+    size_t neededUnits = (entry.payloadLength + 7) / 8;
+    if (!entry.headerLength || !entry.payloadLength || entry.unitsReceived < neededUnits) return nullptr;
+    if (countUnits(bitmap, neededUnits) < neededUnits) return nullptr;  // Units past the end were counted
+    if (entry.headerLength + entry.payloadLength > 0xFFFF) {
+        stats.invalid++;
+        evict(slot);
+        return nullptr;
+    }
+
+    // The first fragment's header now describes the whole datagram
+    uint8_t* datagram = base + kMaxHeader - entry.headerLength;
+    IPv4Header* datagramHeader = reinterpret_cast<IPv4Header*>(datagram);
+    datagramLength = entry.headerLength + entry.payloadLength;
+    datagramHeader->totalLength = htons(static_cast<uint16_t>(datagramLength));
+    datagramHeader->flags_offset &= htons(0x4000);  // Keep don't fragment, clear the rest
+    stats.reassembled++;
+    index.erase(entry.key);
+    completed = slot;
+    return datagram;
+}
+
+void IPDefragmenter::release() {
+    if (completed == UINT32_MAX) return;
+    Slot& entry = slots[completed];
+    std::fill_n(units.get() + completed * kUnitWords, kUnitWords, 0);
+    entry = Slot();
+    freeSlots.push_back(completed);
+    completed = UINT32_MAX;
+}
+
+void IPDefragmenter::finish() {
+    release();
+    for (uint32_t slot = 0; slot < slots.size(); slot++) {
+        if (!slots[slot].inUse) continue;
+        stats.timedOut++;
+        evict(slot);
+    }
+}
+
+uint32_t IPDefragmenter::acquire(const FragmentKey& key, uint64_t timestamp) {
+    if (freeSlots.empty()) {
+        // Make room by giving up on the datagram that has waited longest
+        uint32_t oldest = 0;
+        for (uint32_t slot = 1; slot < slots.size(); slot++) {
+            if (slots[slot].firstSeen < slots[oldest].firstSeen) oldest = slot;
+        }
+        stats.overflows++;
+        evict(oldest);
+    }
+    uint32_t slot = freeSlots.back();
+    freeSlots.pop_back();
+    Slot& entry = slots[slot];
+    entry.key = key;
+    entry.firstSeen = timestamp;
+    entry.inUse = true;
+    index[key] = slot;
+    return slot;
+}
+
+void IPDefragmenter::evict(uint32_t slot) {
+    Slot& entry = slots[slot];
+    stats.droppedFragments += entry.fragments;
+    index.erase(entry.key);
+    std::fill_n(units.get() + slot * kUnitWords, kUnitWords, 0);
+    entry = Slot();
+    freeSlots.push_back(slot);
+}
+
+void IPDefragmenter::sweep() {
+    lastSweep = now;
+    for (uint32_t slot = 0; slot < slots.size(); slot++) {
+        const Slot& entry = slots[slot];
+        if (!entry.inUse || slot == completed || now - entry.firstSeen < kTimeoutUsec) continue;
+        stats.timedOut++;
+        evict(slot);
+    }
+}
+
+} // namespace NetworkParser
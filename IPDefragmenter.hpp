@@ -0,0 +1,92 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "Parser.hpp"
+#include "FlatHashMap.hpp"
+#include "StatsTables.hpp"
+
+namespace NetworkParser {
+
+// The datagram a fragment belongs to, RFC 791's (source, destination, id, protocol)
+struct FragmentKey {
+    uint32_t source = 0;
+    uint32_t destination = 0;
+    uint16_t identification = 0;
+    uint8_t protocol = 0;
+
+    bool operator==(const FragmentKey& other) const {
+        return source == other.source && destination == other.destination &&
+               identification == other.identification && protocol == other.protocol;
+    }
+};
+
+struct FragmentKeyHash {
+    size_t operator()(const FragmentKey& key) const {
+        uint64_t addresses = (static_cast<uint64_t>(key.source) << 32) | key.destination;
+        return hashMix(addresses ^ hashMix((static_cast<uint64_t>(key.identification) << 8) | key.protocol));
+    }
+};
+
+// Puts fragmented IPv4 datagrams back together so the transport layer sees
+// each datagram once, whole. Unfragmented packets never come here. Datagrams
+// being collected live in a fixed number of slots of a pool allocated on the
+// first fragment, so a flood of fragments costs bounded memory and no
+// allocation per packet. A datagram still incomplete after kTimeoutUsec of
+// capture time is dropped, and when every slot is taken the oldest datagram
+// makes room for the new one.
+class IPDefragmenter {
+public:
+    static constexpr size_t kDefaultSlots = 64;
+    static constexpr uint64_t kTimeoutUsec = 30ull * 1000000;
+    static constexpr uint64_t kSweepIntervalUsec = 1000000;
+
+    IPDefragmenter(FragmentStats& stats, size_t slotCount = kDefaultSlots);
+    IPDefragmenter(const IPDefragmenter&) = delete;
+    IPDefragmenter& operator=(const IPDefragmenter&) = delete;
+
+    // One fragment whose IPv4 header, already validated, is at packet + offset.
+    // Returns the whole datagram with the header of its first fragment once the
+    // last missing piece arrives, nullptr until then. The datagram stays valid
+    // until release() is called.
+    const uint8_t* accept(const uint8_t* packet, size_t offset, PacketContext& context, size_t& datagramLength);
+    void release();
+
+    // Drop every incomplete datagram, at the end of the capture
+    void finish();
+
+private:
+    // Largest header in front of the payload and largest payload a datagram can have
+    static constexpr size_t kMaxHeader = 60;
+    static constexpr size_t kMaxPayload = 65535 - 20;
+    static constexpr size_t kUnitWords = (kMaxPayload / 8 + 64) / 64;  // Bitmap of 8 byte units
+
+    struct Slot {
+        FragmentKey key;
+        uint64_t firstSeen = 0;
+        uint64_t fragments = 0;
+        size_t headerLength = 0;   // 0 until the first fragment arrived
+        size_t payloadLength = 0;  // 0 until the last fragment arrived
+        size_t unitsReceived = 0;
+        bool inUse = false;
+    };
+
+    FragmentStats& stats;
+    size_t slotCount;
+    std::vector<Slot> slots;
+    std::unique_ptr<uint8_t[]> storage;  // kMaxHeader + kMaxPayload bytes per slot
+    std::unique_ptr<uint64_t[]> units;   // kUnitWords per slot, bit set for each unit received
+    std::vector<uint32_t> freeSlots;
+    FlatHashMap<FragmentKey, uint32_t, FragmentKeyHash> index;
+    uint32_t completed = UINT32_MAX;  // Slot handed out by accept, freed by release
+    uint64_t now = 0;
+    uint64_t lastSweep = 0;
+
+    uint8_t* data(uint32_t slot) { return storage.get() + slot * (kMaxHeader + kMaxPayload); }
+    uint32_t acquire(const FragmentKey& key, uint64_t timestamp);
+    void evict(uint32_t slot);
+    void sweep();
+};
+
+} // namespace NetworkParser
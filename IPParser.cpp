@@ -1,29 +1,22 @@
 #include "IPParser.hpp"
+#include "Metrics.hpp"
+#include "Sketches.hpp"
 #include <iostream>
-#include <fstream>
 #include <netinet/ip.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 
 namespace NetworkParser {
 
-std::map<std::string, Stats> ipIndividualStats;
-std::map<std::string, Stats> ipInteractionStats;
-std::string ipFirstTimestamp;
-std::string ipLastTimestamp;
-size_t ipTotalPackets = 0;
-size_t ipTotalBytes = 0;
-
-
-Stats IPParser::parsePacket(const uint8_t* packet, size_t length, size_t offset, Stats ip_add_stats) {
-    Stats placeholder;
+void IPParser::parsePacket(const uint8_t* packet, size_t length, size_t offset, PacketContext& context) {
+    nextProtocolId = Protocol::None;
+    headerLength = sizeof(IPv4Header);
     if (length < offset + sizeof(IPv4Header)) {
-        std::cerr << "Error: Malformed IP packet - insufficient length for IPv4 header." << std::endl;
-        return placeholder;
+        reportPacketError(PacketError::IPTruncated);
+        return;
     }
 
-    ipHeader = reinterpret_cast<const IPv4Header*>(packet + offset);
-
+    const IPv4Header* ipHeader = reinterpret_cast<const IPv4Header*>(packet + offset);
     uint8_t version = (ipHeader->version_internet_header_length >> 4) & 0x0F;
     uint8_t IHL = (ipHeader->version_internet_header_length) & 0x0F; 
     uint16_t totalLength = ntohs(ipHeader->totalLength);
@@ -31,80 +24,93 @@ Stats IPParser::parsePacket(const uint8_t* packet, size_t length, size_t offset,
 
     // Validate the version
     if (version != 4) {
-        std::cerr << "Error: Invalid IP version (" << static_cast<int>(version) << "). Expected 4 (IPv4)." << std::endl;
-        return placeholder;
+        reportPacketError(PacketError::IPVersion);
+        return;
     }
 
     // Validate the IHL (must be at least 5, as the minimum IPv4 header size is 20 bytes)
     if (IHL < 5 || headerLengthInBytes > length - offset) {
-        std::cerr << "Error: Malformed IP packet - invalid header length." << std::endl;
-        return placeholder;
+        reportPacketError(PacketError::IPHeaderLength);
+        return;
     }
 
     // Validate the total length (must be at least the header length and not exceed the packet length)
     if (totalLength < headerLengthInBytes || totalLength > length - offset) {
-        std::cerr << "Error: Malformed IP packet - invalid total length." << std::endl;
-        return placeholder;
+        reportPacketError(PacketError::IPTotalLength);
+        return;
     }
 
-    // Convert source and destination IP addresses to string format
+    // Addresses stay binary here, they are only formatted when the reports are written
     uint32_t sourceIP = ntohl(ipHeader->sourceIP);
-    std::string srcIpStr = ipAddToString(sourceIP);
-
     uint32_t destIP = ntohl(ipHeader->destinationIP);
-    std::string destIpStr = ipAddToString(destIP);
 
     // Update global statistics
-    ipTotalPackets++;
-    ipTotalBytes += (totalLength - headerLengthInBytes);
-
+    uint64_t timestamp = context.timestampMicros();
+    if (!stats.totalPackets || timestamp < stats.firstTimestamp) stats.firstTimestamp = timestamp;
+    if (timestamp > stats.lastTimestamp) stats.lastTimestamp = timestamp;
+    stats.totalPackets++;
+    stats.totalBytes += (totalLength - headerLengthInBytes);
+    stats.timeSeries.add(timestamp, totalLength - headerLengthInBytes);
 
 
-    // Update individual IP statistics
-    ipIndividualStats[srcIpStr].packetsOut++;
-    ipIndividualStats[srcIpStr].bytesOut += (totalLength - headerLengthInBytes);
-    ipIndividualStats[destIpStr].packetsIn++;
-    ipIndividualStats[destIpStr].bytesIn += (totalLength - headerLengthInBytes);
 
-    // Update interaction statistics
-    std::string interactionKey = srcIpStr + "<--->" + destIpStr;
-    ipInteractionStats[interactionKey].packetsOut++;
-    ipInteractionStats[interactionKey].bytesOut += (totalLength);
-    
-    placeholder.ip1 = srcIpStr;
-    placeholder.ip2 = destIpStr;
-    return placeholder;
-}
+    if (stats.sketches) {
+        stats.sketches->add(sourceIP, destIP, totalLength - headerLengthInBytes, totalLength);
+    } else {
+        // Update individual IP statistics
+        Counters& sourceStats = stats.individualStats[sourceIP];
+        sourceStats.packetsOut++;
+        sourceStats.bytesOut += (totalLength - headerLengthInBytes);
+        Counters& destStats = stats.individualStats[destIP];
+        destStats.packetsIn++;
+        destStats.bytesIn += (totalLength - headerLengthInBytes);
+
+        // Update interaction statistics
+        Counters& interactionStats = stats.interactionStats[addressPairKey(sourceIP, destIP)];
+        interactionStats.packetsOut++;
+        interactionStats.bytesOut += (totalLength);
+    }
 
-size_t IPParser::getOffset() const {
-    return sizeof(IPv4Header);
+    context.ipVersion = 4;
+    context.ipProtocol = ipHeader->protocol;
+    context.srcAddress = sourceIP;
+    context.destAddress = destIP;
+    context.hasAddresses = true;
+    context.transportOffset = offset + headerLengthInBytes;
+    context.networkEnd = offset + totalLength;
+    headerLength = headerLengthInBytes;
+
+    // Only the first fragment has the transport header. The worker puts
+    // fragments back together before the transport layer when it can.
+    uint16_t flagsOffset = ntohs(ipHeader->flags_offset);
+    context.ipFragment = (flagsOffset & (kMoreFragments | kFragmentOffsetMask)) != 0;
+    if (!(flagsOffset & kFragmentOffsetMask)) nextProtocolId = transportProtocol(ipHeader->protocol);
 }
 
-std::string IPParser::nextParser() const {
-    uint8_t protocol = ipHeader->protocol;
-    return (protocol == 6) ? "TCP" : "UDP";
+ProtocolId IPParser::transportProtocol(uint8_t ipProtocol) {
+    if (ipProtocol == IPPROTO_TCP) return Protocol::TCP;
+    if (ipProtocol == IPPROTO_UDP) return Protocol::UDP;
+    return Protocol::None;
 }
 
 std::string IPParser::ipAddToString(const uint32_t ipAdd) {
-    std::string ipString = std::to_string((ipAdd >> 24) & 0xFF) + "." +
-                           std::to_string((ipAdd >> 16) & 0xFF) + "." +
-                           std::to_string((ipAdd >> 8) & 0xFF) + "." +
-                           std::to_string(ipAdd & 0xFF);
-    return ipString;
+    return ipv4ToString(ipAdd);
 }
 
 
-void IPParser::generateReport() {
+void IPParser::generateReport(const IPStatsTable& stats, ReportFormat format) {
+    if (writesCsv(format)) writeCsvReport(stats);
+    if (writesArrow(format)) writeArrowReport(stats);
+}
+
+void IPParser::writeCsvReport(const IPStatsTable& stats) {
     // Generate IP individual stats report
-    std::ofstream ipStatsFile("output-ip-csv-files/ip-individual-stats.csv");
-    if (ipStatsFile.is_open()) {
-        ipStatsFile << "ipAddress,packetsIn,packetsOut,bytesIn,bytesOut\n";
-        for (const auto& [ipAddress, stats] : ipIndividualStats) {
-            ipStatsFile << ipAddress << ","
-                        << stats.packetsIn << ","
-                        << stats.packetsOut << ","
-                        << stats.bytesIn << ","
-                        << stats.bytesOut << "\n";
+    CsvWriter ipStatsFile;
+    if (ipStatsFile.open("output-ip-csv-files/ip-individual-stats.csv")) {
+        ipStatsFile.line("ipAddress,packetsIn,packetsOut,bytesIn,bytesOut");
+        for (const auto& [ipAddress, ipStats] : sortedByKey(stats.individualStats)) {
+            ipStatsFile.addAddress(ipAddress);
+            appendCounters(ipStatsFile, ipStats);
         }
         ipStatsFile.close();
     } else {
@@ -112,43 +118,128 @@ void IPParser::generateReport() {
     }
 
     // Generate IP interaction stats report
-    std::ofstream ipInteractionStatsFile("output-ip-csv-files/ip-interaction-stats.csv");
-    if (ipInteractionStatsFile.is_open()) {
-    ipInteractionStatsFile << "srcIp,destIp,packetsIn,packetsOut,bytesIn,bytesOut\n";
-    for (const auto& [interaction, stats] : ipInteractionStats) {
-        // Find the separator "<--->" in the interaction string
-        size_t separatorPos = interaction.find("<--->");
-        if (separatorPos != std::string::npos) {
-            // Extract the source IP and destination IP
-            std::string srcIp = interaction.substr(0, separatorPos);
-            std::string destIp = interaction.substr(separatorPos + 5); // Skip the separator length
-
-            // Write to the CSV file
-            ipInteractionStatsFile << srcIp << ","
-                                   << destIp << ","
-                                   << stats.packetsIn << ","
-                                   << stats.packetsOut << ","
-                                   << stats.bytesIn << ","
-                                   << stats.bytesOut << "\n";
+    CsvWriter ipInteractionStatsFile;
+    if (ipInteractionStatsFile.open("output-ip-csv-files/ip-interaction-stats.csv")) {
+        ipInteractionStatsFile.line("srcIp,destIp,packetsIn,packetsOut,bytesIn,bytesOut");
+        for (const auto& [interaction, interactionStats] : sortedByKey(stats.interactionStats)) {
+            ipInteractionStatsFile.addAddress(static_cast<uint32_t>(interaction >> 32))
+                .addAddress(static_cast<uint32_t>(interaction));
+            appendCounters(ipInteractionStatsFile, interactionStats);
         }
+        ipInteractionStatsFile.close();
+    } else {
+        std::cerr << "Error: Could not open ip-interaction-stats.csv for writing.\n";
     }
-    ipInteractionStatsFile.close();
-} else {
-    std::cerr << "Error: Could not open ip-interaction-stats.csv for writing.\n";
-}
 
     // Generate general summary report for IP
-    std::ofstream ipSummaryFile("output-ip-csv-files/ip-general-summary.csv");
-    if (ipSummaryFile.is_open()) {
-        ipSummaryFile << "#packets,bytes,#unique-ips,uniqueInteractions\n";
-        ipSummaryFile << ipTotalPackets << ","
-                      << ipTotalBytes << ","
-                      << ipIndividualStats.size() << ","
-                      << ipInteractionStats.size() << "\n";
+    CsvWriter ipSummaryFile;
+    if (ipSummaryFile.open("output-ip-csv-files/ip-general-summary.csv")) {
+        ipSummaryFile.line("#packets,bytes,#unique-ips,uniqueInteractions,firstTimestamp,lastTimestamp");
+        ipSummaryFile.add(stats.totalPackets)
+            .add(stats.totalBytes)
+            .add(stats.uniqueAddresses())
+            .add(stats.uniqueInteractions())
+            .addTimestamp(stats.firstTimestamp)
+            .addTimestamp(stats.lastTimestamp);
+        ipSummaryFile.endRow();
         ipSummaryFile.close();
     } else {
         std::cerr << "Error: Could not open ip-general-summary.csv for writing.\n";
     }
+
+    // Generate per interval time series for IP
+    CsvWriter ipTimeSeriesFile;
+    if (ipTimeSeriesFile.open("output-ip-csv-files/ip-time-series.csv")) {
+        ipTimeSeriesFile.line("intervalStart,packets,bytes");
+        stats.timeSeries.writeRows(ipTimeSeriesFile);
+        ipTimeSeriesFile.close();
+    } else {
+        std::cerr << "Error: Could not open ip-time-series.csv for writing.\n";
+    }
+
+    // Generate fragment reassembly summary
+    CsvWriter fragmentFile;
+    if (fragmentFile.open("output-ip-csv-files/ip-fragment-summary.csv")) {
+        const FragmentStats& fragments = stats.fragments;
+        fragmentFile.line("fragments,reassembled,timedOut,overflows,invalid,droppedFragments");
+        fragmentFile.add(fragments.fragments)
+            .add(fragments.reassembled)
+            .add(fragments.timedOut)
+            .add(fragments.overflows)
+            .add(fragments.invalid)
+            .add(fragments.droppedFragments);
+        fragmentFile.endRow();
+        fragmentFile.close();
+    } else {
+        std::cerr << "Error: Could not open ip-fragment-summary.csv for writing.\n";
+    }
+}
+
+void IPParser::writeArrowReport(const IPStatsTable& stats) {
+    // Addresses are written as host order integers, so 10.0.0.1 is 167772161
+    ArrowWriter ipStatsTable(counterColumns({{"ipAddress", ColumnType::Address}}));
+    if (ipStatsTable.open("output-ip-csv-files/ip-individual-stats.arrow")) {
+        for (const auto& [ipAddress, ipStats] : sortedByKey(stats.individualStats)) {
+            ipStatsTable.add(ipAddress);
+            appendCounters(ipStatsTable, ipStats);
+        }
+        ipStatsTable.close();
+    } else {
+        std::cerr << "Error: Could not open ip-individual-stats.arrow for writing.\n";
+    }
+
+    ArrowWriter ipInteractionStatsTable(counterColumns({{"srcIp", ColumnType::Address}, {"destIp", ColumnType::Address}}));
+    if (ipInteractionStatsTable.open("output-ip-csv-files/ip-interaction-stats.arrow")) {
+        for (const auto& [interaction, interactionStats] : sortedByKey(stats.interactionStats)) {
+            ipInteractionStatsTable.add(interaction >> 32).add(interaction & 0xFFFFFFFF);
+            appendCounters(ipInteractionStatsTable, interactionStats);
+        }
+        ipInteractionStatsTable.close();
+    } else {
+        std::cerr << "Error: Could not open ip-interaction-stats.arrow for writing.\n";
+    }
+
+    ArrowWriter ipSummaryTable({{"#packets", ColumnType::UInt64},
+                                {"bytes", ColumnType::UInt64},
+                                {"#unique-ips", ColumnType::UInt64},
+                                {"uniqueInteractions", ColumnType::UInt64},
+                                {"firstTimestamp", ColumnType::Timestamp},
+                                {"lastTimestamp", ColumnType::Timestamp}});
+    if (ipSummaryTable.open("output-ip-csv-files/ip-general-summary.arrow")) {
+        ipSummaryTable.add(stats.totalPackets)
+            .add(stats.totalBytes)
+            .add(stats.uniqueAddresses())
+            .add(stats.uniqueInteractions())
+            .add(stats.firstTimestamp)
+            .add(stats.lastTimestamp);
+        ipSummaryTable.endRow();
+        ipSummaryTable.close();
+    } else {
+        std::cerr << "Error: Could not open ip-general-summary.arrow for writing.\n";
+    }
+
+    if (!writeTimeSeriesArrow("output-ip-csv-files/ip-time-series.arrow", stats.timeSeries)) {
+        std::cerr << "Error: Could not write ip-time-series.arrow.\n";
+    }
+
+    const FragmentStats& fragments = stats.fragments;
+    std::vector<ColumnSpec> fragmentColumns;
+    for (const char* name : {"fragments", "reassembled", "timedOut", "overflows", "invalid", "droppedFragments"}) {
+        fragmentColumns.push_back({name, ColumnType::UInt64});
+    }
+    ArrowWriter fragmentTable(fragmentColumns);
+    if (fragmentTable.open("output-ip-csv-files/ip-fragment-summary.arrow")) {
+        fragmentTable.add(fragments.fragments)
+            .add(fragments.reassembled)
+            .add(fragments.timedOut)
+            .add(fragments.overflows)
+            .add(fragments.invalid)
+            .add(fragments.droppedFragments);
+        fragmentTable.endRow();
+        fragmentTable.close();
+    } else {
+        std::cerr << "Error: Could not open ip-fragment-summary.arrow for writing.\n";
+    }
 }
 
-} // namespace NetworkParser
\ No newline at end of file
+} // namespace NetworkParser
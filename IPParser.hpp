@@ -1,23 +1,16 @@
 #pragma once
 #include "Parser.hpp"
+#include "StatsTables.hpp"
+#include "ArrowWriter.hpp"
+#include "CsvWriter.hpp"
 #include <string>
-#include <map>
 #include <vector>
-#include <set>
 #include <ctime>
 #include <cstdint>
 #include <netinet/in.h> // For ntohl and ntohs
 
 namespace NetworkParser {
 
-// Declare global variables
-extern std::map<std::string, Stats> ipIndividualStats;
-extern std::map<std::string, Stats> ipInteractionStats;
-extern std::string ipFirstTimestamp;
-extern std::string ipLastTimestamp;
-extern size_t ipTotalPackets;
-extern size_t ipTotalBytes;
-
 // IPv4 Header structure (packed for alignment)
 #pragma pack(push, 1)
 struct IPv4Header {
@@ -36,13 +29,26 @@ struct IPv4Header {
 
 class IPParser : public Parser {
 public:
-    Stats parsePacket(const uint8_t* packet, size_t length, size_t offset, Stats ip_add_stats) override;
-    std::string nextParser() const override;
-    static void generateReport();
-    size_t getOffset() const override;
+    // flags_offset bits, in host order
+    static constexpr uint16_t kMoreFragments = 0x2000;
+    static constexpr uint16_t kFragmentOffsetMask = 0x1FFF;
+
+    explicit IPParser(StatsTables& tables) : stats(tables.ip) {}
+    void parsePacket(const uint8_t* packet, size_t length, size_t offset, PacketContext& context) override;
+    ProtocolId nextProtocol() const override { return nextProtocolId; }
+    static void generateReport(const IPStatsTable& stats, ReportFormat format);
+    size_t getOffset() const override { return headerLength; }
+    static std::string ipAddToString(const uint32_t ipAdd);
+
+    // Parser for the transport header of an IP protocol number, None if there is none
+    static ProtocolId transportProtocol(uint8_t ipProtocol);
 private:
-    std::string ipAddToString(const uint32_t ipAdd);
-    const IPv4Header* ipHeader;
+    static void writeCsvReport(const IPStatsTable& stats);
+    static void writeArrowReport(const IPStatsTable& stats);
+
+    IPStatsTable& stats;
+    ProtocolId nextProtocolId = Protocol::None;
+    size_t headerLength = 0;  // IHL, options included
 };
 
 }  // namespace NetworkParser
\ No newline at end of file
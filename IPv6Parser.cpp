@@ -0,0 +1,227 @@
+#include "IPv6Parser.hpp"
+#include "IPParser.hpp"
+#include "Metrics.hpp"
+#include <iostream>
+#include <netinet/in.h>
+
+namespace NetworkParser {
+
+// Extension headers whose length field counts 8 byte units after the first 8
+static bool isOptionsHeader(uint8_t header) {
+    switch (header) {
+        case 0:    // Hop-by-hop options
+        case 43:   // Routing
+        case 60:   // Destination options
+        case 135:  // Mobility
+        case 139:  // Host identity protocol
+        case 140:  // Shim6
+            return true;
+        default:
+            return false;
+    }
+}
+
+static constexpr uint8_t kFragmentHeader = 44;
+static constexpr uint8_t kAuthenticationHeader = 51;  // Length in 4 byte units, minus 2
+
+bool findUpperLayer(const uint8_t* packet, size_t offset, size_t end, size_t& at, uint8_t& protocol,
+                    bool& firstFragment) {
+    const IPv6Header* ipHeader = reinterpret_cast<const IPv6Header*>(packet + offset);
+    uint8_t next = ipHeader->nextHeader;
+    at = offset + sizeof(IPv6Header);
+    firstFragment = true;
+    for (size_t headers = 0; headers < IPv6Parser::kMaxExtensionHeaders; headers++) {
+        size_t extensionLength;
+        if (isOptionsHeader(next)) {
+            if (end < at + 8) break;
+            extensionLength = (packet[at + 1] + 1) * 8;
+        } else if (next == kFragmentHeader) {
+            if (end < at + 8) break;
+            extensionLength = 8;
+            if ((packet[at + 2] << 8 | packet[at + 3]) & 0xFFF8) firstFragment = false;
+        } else if (next == kAuthenticationHeader) {
+            if (end < at + 8) break;
+            extensionLength = (packet[at + 1] + 2) * 4;
+        } else {
+            break;
+        }
+
+        if (end < at + extensionLength) return false;
+        next = packet[at];
+        at += extensionLength;
+    }
+    protocol = next;
+    // Cut off in the middle of the chain, or longer than we follow
+    return !(isOptionsHeader(next) || next == kFragmentHeader || next == kAuthenticationHeader);
+}
+
+void IPv6Parser::parsePacket(const uint8_t* packet, size_t length, size_t offset, PacketContext& context) {
+    nextProtocolId = Protocol::None;
+    headerLength = sizeof(IPv6Header);
+    if (length < offset + sizeof(IPv6Header)) {
+        reportPacketError(PacketError::IPv6Truncated);
+        return;
+    }
+
+    const IPv6Header* ipHeader = reinterpret_cast<const IPv6Header*>(packet + offset);
+    if ((packet[offset] >> 4) != 6) {
+        reportPacketError(PacketError::IPv6Version);
+        return;
+    }
+
+    uint16_t payloadLength = ntohs(ipHeader->payloadLength);
+    if (payloadLength > length - offset - sizeof(IPv6Header)) {
+        reportPacketError(PacketError::IPv6PayloadLength);
+        return;
+    }
+    size_t end = offset + sizeof(IPv6Header) + payloadLength;
+
+    // Walk the extension headers to the upper layer. Only the first fragment
+    // of a datagram has the transport header.
+    size_t at;
+    uint8_t next;
+    bool firstFragment;
+    if (!findUpperLayer(packet, offset, end, at, next, firstFragment)) {
+        reportPacketError(PacketError::IPv6ExtensionHeader);
+        return;
+    }
+
+    // Addresses stay binary here, they are only formatted when the reports are written
+    IPAddress sourceIP = IPAddress::fromBytes(ipHeader->sourceIP);
+    IPAddress destIP = IPAddress::fromBytes(ipHeader->destinationIP);
+    size_t upperLayerBytes = end - at;
+
+    uint64_t timestamp = context.timestampMicros();
+    if (!stats.totalPackets || timestamp < stats.firstTimestamp) stats.firstTimestamp = timestamp;
+    if (timestamp > stats.lastTimestamp) stats.lastTimestamp = timestamp;
+    stats.totalPackets++;
+    stats.totalBytes += upperLayerBytes;
+    stats.timeSeries.add(timestamp, upperLayerBytes);
+
+    Counters& sourceStats = stats.individualStats[sourceIP];
+    sourceStats.packetsOut++;
+    sourceStats.bytesOut += upperLayerBytes;
+    Counters& destStats = stats.individualStats[destIP];
+    destStats.packetsIn++;
+    destStats.bytesIn += upperLayerBytes;
+
+    Counters& interactionStats = stats.interactionStats[{sourceIP, destIP}];
+    interactionStats.packetsOut++;
+    interactionStats.bytesOut += sizeof(IPv6Header) + payloadLength;
+
+    context.ipVersion = 6;
+    context.ipProtocol = next;
+    context.srcAddress6 = sourceIP;
+    context.destAddress6 = destIP;
+    context.hasAddresses = true;
+    context.transportOffset = at;
+    context.networkEnd = end;
+    headerLength = at - offset;
+
+    if (firstFragment) nextProtocolId = IPParser::transportProtocol(next);
+}
+
+void IPv6Parser::generateReport(const IPv6StatsTable& stats, ReportFormat format) {
+    if (writesCsv(format)) writeCsvReport(stats);
+    if (writesArrow(format)) writeArrowReport(stats);
+}
+
+void IPv6Parser::writeCsvReport(const IPv6StatsTable& stats) {
+    CsvWriter individualFile;
+    if (individualFile.open("output-ip-csv-files/ipv6-individual-stats.csv")) {
+        individualFile.line("ipAddress,packetsIn,packetsOut,bytesIn,bytesOut");
+        for (const auto& [ipAddress, ipStats] : sortedByKey(stats.individualStats)) {
+            individualFile.addAddress(ipAddress);
+            appendCounters(individualFile, ipStats);
+        }
+        individualFile.close();
+    } else {
+        std::cerr << "Error: Could not open ipv6-individual-stats.csv for writing.\n";
+    }
+
+    CsvWriter interactionFile;
+    if (interactionFile.open("output-ip-csv-files/ipv6-interaction-stats.csv")) {
+        interactionFile.line("srcIp,destIp,packetsIn,packetsOut,bytesIn,bytesOut");
+        for (const auto& [interaction, interactionStats] : sortedByKey(stats.interactionStats)) {
+            interactionFile.addAddress(interaction.source).addAddress(interaction.destination);
+            appendCounters(interactionFile, interactionStats);
+        }
+        interactionFile.close();
+    } else {
+        std::cerr << "Error: Could not open ipv6-interaction-stats.csv for writing.\n";
+    }
+
+    CsvWriter summaryFile;
+    if (summaryFile.open("output-ip-csv-files/ipv6-general-summary.csv")) {
+        summaryFile.line("#packets,bytes,#unique-ips,uniqueInteractions,firstTimestamp,lastTimestamp");
+        summaryFile.add(stats.totalPackets)
+            .add(stats.totalBytes)
+            .add(stats.individualStats.size())
+            .add(stats.interactionStats.size())
+            .addTimestamp(stats.firstTimestamp)
+            .addTimestamp(stats.lastTimestamp);
+        summaryFile.endRow();
+        summaryFile.close();
+    } else {
+        std::cerr << "Error: Could not open ipv6-general-summary.csv for writing.\n";
+    }
+
+    CsvWriter timeSeriesFile;
+    if (timeSeriesFile.open("output-ip-csv-files/ipv6-time-series.csv")) {
+        timeSeriesFile.line("intervalStart,packets,bytes");
+        stats.timeSeries.writeRows(timeSeriesFile);
+        timeSeriesFile.close();
+    } else {
+        std::cerr << "Error: Could not open ipv6-time-series.csv for writing.\n";
+    }
+}
+
+void IPv6Parser::writeArrowReport(const IPv6StatsTable& stats) {
+    // Addresses are 16 byte binary in network order
+    ArrowWriter individualTable(counterColumns({{"ipAddress", ColumnType::Address6}}));
+    if (individualTable.open("output-ip-csv-files/ipv6-individual-stats.arrow")) {
+        for (const auto& [ipAddress, ipStats] : sortedByKey(stats.individualStats)) {
+            individualTable.add(ipAddress);
+            appendCounters(individualTable, ipStats);
+        }
+        individualTable.close();
+    } else {
+        std::cerr << "Error: Could not open ipv6-individual-stats.arrow for writing.\n";
+    }
+
+    ArrowWriter interactionTable(counterColumns({{"srcIp", ColumnType::Address6}, {"destIp", ColumnType::Address6}}));
+    if (interactionTable.open("output-ip-csv-files/ipv6-interaction-stats.arrow")) {
+        for (const auto& [interaction, interactionStats] : sortedByKey(stats.interactionStats)) {
+            interactionTable.add(interaction.source).add(interaction.destination);
+            appendCounters(interactionTable, interactionStats);
+        }
+        interactionTable.close();
+    } else {
+        std::cerr << "Error: Could not open ipv6-interaction-stats.arrow for writing.\n";
+    }
+
+    ArrowWriter summaryTable({{"#packets", ColumnType::UInt64},
+                              {"bytes", ColumnType::UInt64},
+                              {"#unique-ips", ColumnType::UInt64},
+                              {"uniqueInteractions", ColumnType::UInt64},
+                              {"firstTimestamp", ColumnType::Timestamp},
+                              {"lastTimestamp", ColumnType::Timestamp}});
+    if (summaryTable.open("output-ip-csv-files/ipv6-general-summary.arrow")) {
+        summaryTable.add(stats.totalPackets)
+            .add(stats.totalBytes)
+            .add(stats.individualStats.size())
+            .add(stats.interactionStats.size())
+            .add(stats.firstTimestamp)
+            .add(stats.lastTimestamp);
+        summaryTable.endRow();
+        summaryTable.close();
+    } else {
+        std::cerr << "Error: Could not open ipv6-general-summary.arrow for writing.\n";
+    }
+
+    if (!writeTimeSeriesArrow("output-ip-csv-files/ipv6-time-series.arrow", stats.timeSeries)) {
+        std::cerr << "Error: Could not write ipv6-time-series.arrow.\n";
+    }
+}
+
+} // namespace NetworkParser
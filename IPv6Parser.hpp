@@ -0,0 +1,49 @@
+#pragma once
+#include "Parser.hpp"
+#include "StatsTables.hpp"
+#include <cstdint>
+
+namespace NetworkParser {
+
+#pragma pack(push, 1)
+struct IPv6Header {
+    uint32_t versionClassFlow;  // Version, traffic class and flow label
+    uint16_t payloadLength;     // Everything after this header, extension headers included
+    uint8_t nextHeader;
+    uint8_t hopLimit;
+    uint8_t sourceIP[16];
+    uint8_t destinationIP[16];
+};
+#pragma pack(pop)
+
+// Parses the IPv6 header and walks the extension headers after it to the
+// transport header. Records into the IPv6 tables and hands TCP and UDP on to
+// the same parsers as IPv4, with 128 bit addresses in the context.
+class IPv6Parser : public Parser {
+public:
+    // Longer chains of extension headers than this are not followed
+    static constexpr size_t kMaxExtensionHeaders = 8;
+
+    explicit IPv6Parser(StatsTables& tables) : stats(tables.ipv6) {}
+    void parsePacket(const uint8_t* packet, size_t length, size_t offset, PacketContext& context) override;
+    ProtocolId nextProtocol() const override { return nextProtocolId; }
+    size_t getOffset() const override { return headerLength; }
+    static void generateReport(const IPv6StatsTable& stats, ReportFormat format);
+
+private:
+    static void writeCsvReport(const IPv6StatsTable& stats);
+    static void writeArrowReport(const IPv6StatsTable& stats);
+
+    IPv6StatsTable& stats;
+    ProtocolId nextProtocolId = Protocol::None;
+    size_t headerLength = 0;  // Fixed header and extension headers
+};
+
+// Walks the extension headers of the IPv6 packet whose fixed header is at
+// offset, up to end. Sets at to the upper layer header and protocol to its
+// type, and firstFragment false for any fragment but the first. False if the
+// chain is cut off or longer than kMaxExtensionHeaders.
+bool findUpperLayer(const uint8_t* packet, size_t offset, size_t end, size_t& at, uint8_t& protocol,
+                    bool& firstFragment);
+
+} // namespace NetworkParser
@@ -0,0 +1,221 @@
+#include "Metrics.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+namespace NetworkParser {
+
+namespace {
+
+struct ErrorKind {
+    const char* name;
+    const char* message;
+    ProtocolId protocol;
+    bool logged;  // UDP problems were never logged, only counted now
+};
+
+constexpr ErrorKind kErrorKinds[] = {
+    {"EthernetTruncated", "Malformed Ethernet packet - insufficient length", Protocol::Ethernet, true},
+    {"IPTruncated", "Malformed IP packet - insufficient length for IPv4 header", Protocol::IP, true},
+    {"IPVersion", "Invalid IP version, expected 4 (IPv4)", Protocol::IP, true},
+    {"IPHeaderLength", "Malformed IP packet - invalid header length", Protocol::IP, true},
+    {"IPTotalLength", "Malformed IP packet - invalid total length", Protocol::IP, true},
+    {"TCPTruncated", "Malformed TCP packet - insufficient length for TCP header", Protocol::TCP, true},
+    {"UDPTruncated", "Malformed UDP packet - insufficient length for UDP header", Protocol::UDP, false},
+    {"UDPLength", "Malformed UDP packet - length mismatch", Protocol::UDP, false},
+    {"IPChecksum", "Bad IPv4 header checksum, packet dropped", Protocol::IP, true},
+    {"TCPChecksum", "Bad TCP checksum, packet dropped", Protocol::TCP, true},
+    {"UDPChecksum", "Bad UDP checksum, packet dropped", Protocol::UDP, true},
+    {"IPv6Truncated", "Malformed IPv6 packet - insufficient length for IPv6 header", Protocol::IPv6, true},
+    {"IPv6Version", "Invalid IP version, expected 6 (IPv6)", Protocol::IPv6, true},
+    {"IPv6PayloadLength", "Malformed IPv6 packet - invalid payload length", Protocol::IPv6, true},
+    {"IPv6ExtensionHeader", "Malformed IPv6 packet - truncated extension header", Protocol::IPv6, true},
+};
+constexpr size_t kErrorKindCount = static_cast<size_t>(PacketError::Count);
+static_assert(sizeof(kErrorKinds) / sizeof(kErrorKinds[0]) == kErrorKindCount, "Every PacketError needs a kind");
+
+constexpr int64_t kErrorLogIntervalNs = 1000000000;
+
+// Each thread counts its errors in a slot of its own
+struct alignas(64) ErrorSlot {
+    std::atomic<uint64_t> counts[kErrorKindCount] = {};
+};
+
+std::mutex errorSlotsMutex;
+std::vector<std::unique_ptr<ErrorSlot>> errorSlots;
+thread_local ErrorSlot* threadErrors = nullptr;
+std::atomic<int64_t> nextErrorLog[kErrorKindCount] = {};  // Steady clock time a kind may be logged again
+
+int64_t steadyNanoseconds() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+} // namespace
+
+void reportPacketError(PacketError error) {
+    if (!threadErrors) {
+        std::lock_guard<std::mutex> lock(errorSlotsMutex);
+        errorSlots.push_back(std::make_unique<ErrorSlot>());
+        threadErrors = errorSlots.back().get();
+    }
+    size_t kind = static_cast<size_t>(error);
+    bump(threadErrors->counts[kind]);
+    if (!kErrorKinds[kind].logged) return;
+
+    int64_t now = steadyNanoseconds();
+    int64_t next = nextErrorLog[kind].load(std::memory_order_relaxed);
+    if (now < next || !nextErrorLog[kind].compare_exchange_strong(next, now + kErrorLogIntervalNs)) return;
+
+    std::cerr << "Error: " << kErrorKinds[kind].message << ".";
+    if (next) std::cerr << " (" << packetErrorTotals()[kind] << " so far, logged at most once a second)";
+    std::cerr << std::endl;
+}
+
+std::vector<uint64_t> packetErrorTotals() {
+    std::vector<uint64_t> totals(kErrorKindCount);
+    std::lock_guard<std::mutex> lock(errorSlotsMutex);
+    for (const auto& slot : errorSlots) {
+        for (size_t kind = 0; kind < kErrorKindCount; kind++) {
+            totals[kind] += slot->counts[kind].load(std::memory_order_relaxed);
+        }
+    }
+    return totals;
+}
+
+void printPacketErrorSummary(std::ostream& out) {
+    std::vector<uint64_t> totals = packetErrorTotals();
+    for (size_t kind = 0; kind < kErrorKindCount; kind++) {
+        if (totals[kind]) out << "Malformed Packets: " << totals[kind] << " x " << kErrorKinds[kind].message << "\n";
+    }
+}
+
+void LatencyHistogram::addTo(std::vector<uint64_t>& totals) const {
+    for (size_t bucket = 0; bucket < kBuckets; bucket++) {
+        totals[bucket] += counts[bucket].load(std::memory_order_relaxed);
+    }
+}
+
+Metrics& Metrics::instance() {
+    static Metrics metrics;
+    return metrics;
+}
+
+Metrics::Metrics() : startCycles(readCycles()), startTime(std::chrono::steady_clock::now()) {}
+
+MetricsSlot* Metrics::addThread(size_t protocolCount) {
+    std::lock_guard<std::mutex> lock(mutex);
+    slots.push_back(std::make_unique<MetricsSlot>(protocolCount));
+    return slots.back().get();
+}
+
+void Metrics::setProtocolNames(std::vector<std::string> names) {
+    std::lock_guard<std::mutex> lock(mutex);
+    protocolNames = std::move(names);
+}
+
+bool Metrics::writeFile(const std::string& path) {
+    std::vector<uint64_t> errors = packetErrorTotals();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - startTime;
+    // Cycle counts become nanoseconds at the rate the counter ran over the whole run
+    double cyclesPerNs = elapsed.count() > 0 ? (readCycles() - startCycles) / (elapsed.count() * 1e9) : 1;
+    if (cyclesPerNs <= 0) cyclesPerNs = 1;
+
+    std::string partial = path + ".partial";
+    std::ofstream out(partial, std::ios::trunc);
+    if (!out) {
+        std::cerr << "Error: Could not open " << partial << " for writing.\n";
+        return false;
+    }
+
+    out << "{\n  \"instrumented\": " << (kMetricsEnabled ? "true" : "false") << ",\n"
+        << "  \"elapsedSec\": " << elapsed.count() << ",\n"
+        << "  \"cyclesPerNs\": " << cyclesPerNs << ",\n"
+        << "  \"protocols\": {";
+    bool firstProtocol = true;
+    for (size_t protocol = 1; protocol < protocolNames.size(); protocol++) {
+        uint64_t packets = 0;
+        uint64_t bytes = 0;
+        std::vector<uint64_t> histogram(LatencyHistogram::kBuckets);
+        for (const auto& slot : slots) {
+            if (protocol >= slot->protocols.size()) continue;
+            const MetricsSlot::ProtocolMetrics& metrics = slot->protocols[protocol];
+            packets += metrics.packets.load(std::memory_order_relaxed);
+            bytes += metrics.bytes.load(std::memory_order_relaxed);
+            metrics.cycles.addTo(histogram);
+        }
+        uint64_t protocolErrors = 0;
+        for (size_t kind = 0; kind < kErrorKindCount; kind++) {
+            if (kErrorKinds[kind].protocol == protocol) protocolErrors += errors[kind];
+        }
+
+        out << (firstProtocol ? "\n" : ",\n") << "    \"" << protocolNames[protocol] << "\": {\"packets\": " << packets
+            << ", \"bytes\": " << bytes << ", \"errors\": " << protocolErrors;
+        firstProtocol = false;
+
+        // Quantiles are the start of the bucket they fall in, within 1/16 below the true value
+        uint64_t count = 0;
+        double sum = 0;
+        for (size_t bucket = 0; bucket < histogram.size(); bucket++) {
+            count += histogram[bucket];
+            sum += static_cast<double>(LatencyHistogram::bucketStart(bucket)) * histogram[bucket];
+        }
+        if (count) {
+            out << ", \"latencyNs\": {\"count\": " << count << ", \"mean\": " << sum / count / cyclesPerNs;
+            const std::pair<const char*, double> quantiles[] = {
+                {"p50", 0.5}, {"p90", 0.9}, {"p99", 0.99}, {"p999", 0.999}, {"max", 1.0}};
+            for (const auto& [name, quantile] : quantiles) {
+                uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(quantile * count + 0.5));
+                uint64_t seen = 0;
+                size_t bucket = 0;
+                while (bucket + 1 < histogram.size() && seen + histogram[bucket] < rank) seen += histogram[bucket++];
+                out << ", \"" << name << "\": " << LatencyHistogram::bucketStart(bucket) / cyclesPerNs;
+            }
+            out << "}";
+        }
+        out << "}";
+    }
+    out << "\n  },\n  \"errors\": {";
+    for (size_t kind = 0; kind < kErrorKindCount; kind++) {
+        out << (kind ? ", " : "") << "\"" << kErrorKinds[kind].name << "\": " << errors[kind];
+    }
+    out << "}\n}\n";
+    out.close();
+
+    if (!out || std::rename(partial.c_str(), path.c_str()) != 0) {
+        std::cerr << "Error: Failed writing metrics " << path << ".\n";
+        std::remove(partial.c_str());
+        return false;
+    }
+    return true;
+}
+
+void Metrics::startExport(const std::string& path, double intervalSec) {
+    exportPath = path;
+    exportStop = false;
+    auto interval = std::chrono::duration<double>(intervalSec > 0 ? intervalSec : 10);
+    exporter = std::thread([this, interval] {
+        std::unique_lock<std::mutex> lock(exportMutex);
+        while (!exportWake.wait_for(lock, interval, [this] { return exportStop; })) {
+            lock.unlock();
+            writeFile(exportPath);
+            lock.lock();
+        }
+    });
+}
+
+void Metrics::stopExport() {
+    if (!exporter.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(exportMutex);
+        exportStop = true;
+    }
+    exportWake.notify_one();
+    exporter.join();
+    writeFile(exportPath);
+}
+
+} // namespace NetworkParser
@@ -0,0 +1,159 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Parser.hpp"
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace NetworkParser {
+
+// Per parser timing and counters are compiled in with make METRICS=1
+#ifdef NETWORK_PARSER_METRICS
+constexpr bool kMetricsEnabled = true;
+#else
+constexpr bool kMetricsEnabled = false;
+#endif
+
+// Ways a packet can be malformed. Each is counted, and logged at most once a
+// second, so a dirty capture doesn't spend its time writing to stderr.
+enum class PacketError : uint8_t {
+    EthernetTruncated,
+    IPTruncated,
+    IPVersion,
+    IPHeaderLength,
+    IPTotalLength,
+    TCPTruncated,
+    UDPTruncated,
+    UDPLength,
+    IPChecksum,
+    TCPChecksum,
+    UDPChecksum,
+    IPv6Truncated,
+    IPv6Version,
+    IPv6PayloadLength,
+    IPv6ExtensionHeader,
+    Count
+};
+
+void reportPacketError(PacketError error);
+
+// Totals over every thread so far, indexed by PacketError
+std::vector<uint64_t> packetErrorTotals();
+
+// One line per kind of malformed packet seen, nothing if there were none
+void printPacketErrorSummary(std::ostream& out);
+
+// Timestamp counter where there is one, nanoseconds otherwise
+inline uint64_t readCycles() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// Counts a single writer adds to while other threads may read them. Relaxed
+// load and store instead of an atomic add, since only the owner writes.
+inline void bump(std::atomic<uint64_t>& counter, uint64_t amount = 1) {
+    counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+// HDR style histogram: 16 linear sub-buckets per power of two, so any value
+// is placed within 1/16 of itself from 0 up to 2^64.
+class LatencyHistogram {
+public:
+    static constexpr unsigned kSubBucketBits = 4;
+    static constexpr size_t kSubBuckets = size_t(1) << kSubBucketBits;
+    static constexpr size_t kBuckets = (64 - kSubBucketBits + 1) * kSubBuckets;
+
+    void record(uint64_t value) { bump(counts[bucketFor(value)]); }
+
+    // Add this histogram's counts to totals, which has kBuckets entries
+    void addTo(std::vector<uint64_t>& totals) const;
+
+    static size_t bucketFor(uint64_t value) {
+        if (value < kSubBuckets) return value;
+        unsigned exponent = 63 - __builtin_clzll(value);
+        unsigned shift = exponent - kSubBucketBits;
+        return (shift + 1) * kSubBuckets + ((value >> shift) & (kSubBuckets - 1));
+    }
+
+    // Smallest value that lands in a bucket
+    static uint64_t bucketStart(size_t bucket) {
+        if (bucket < kSubBuckets) return bucket;
+        unsigned shift = bucket / kSubBuckets - 1;
+        return (kSubBuckets + bucket % kSubBuckets) << shift;
+    }
+
+private:
+    std::atomic<uint64_t> counts[kBuckets] = {};
+};
+
+// One worker thread's counters, aligned so no two threads write to the same
+// cache line. Indexed by ProtocolId.
+struct alignas(64) MetricsSlot {
+    struct alignas(64) ProtocolMetrics {
+        std::atomic<uint64_t> packets{0};
+        std::atomic<uint64_t> bytes{0};
+        LatencyHistogram cycles;
+    };
+
+    explicit MetricsSlot(size_t protocolCount) : protocols(protocolCount) {}
+
+    void record(ProtocolId protocol, uint64_t bytes, uint64_t cycles) {
+        if (protocol >= protocols.size()) return;
+        ProtocolMetrics& metrics = protocols[protocol];
+        bump(metrics.packets);
+        bump(metrics.bytes, bytes);
+        metrics.cycles.record(cycles);
+    }
+
+    std::vector<ProtocolMetrics> protocols;
+};
+
+// Every thread's slots, and the metrics file written from them
+class Metrics {
+public:
+    static Metrics& instance();
+
+    // Slot for a new worker thread, owned here and valid for the whole run
+    MetricsSlot* addThread(size_t protocolCount);
+
+    void setProtocolNames(std::vector<std::string> names);
+
+    // Snapshot every counter into a JSON file, replacing it in one rename
+    bool writeFile(const std::string& path);
+
+    // Write the file every intervalSec from a background thread until
+    // stopExport, which writes it one last time
+    void startExport(const std::string& path, double intervalSec);
+    void stopExport();
+
+private:
+    Metrics();
+
+    std::mutex mutex;
+    std::vector<std::unique_ptr<MetricsSlot>> slots;
+    std::vector<std::string> protocolNames;
+    uint64_t startCycles;
+    std::chrono::steady_clock::time_point startTime;
+
+    std::thread exporter;
+    std::mutex exportMutex;
+    std::condition_variable exportWake;
+    bool exportStop = false;
+    std::string exportPath;
+};
+
+} // namespace NetworkParser
@@ -1,46 +1,104 @@
 #include "PCAPFileParser.hpp"
-#include <fstream>
 #include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 namespace NetworkParser {
 
+PCAPFileParser::~PCAPFileParser() {
+    unmapFile();
+}
+
 bool PCAPFileParser::parseFile(const std::string& filePath) {
-    std::ifstream file(filePath, std::ios::binary);
-    if (!file) {
+    unmapFile();
+
+    int fd = open(filePath.c_str(), O_RDONLY);
+    if (fd < 0) {
         return false; // Failed to open the file
     }
 
-    // Read global header
-    file.read(reinterpret_cast<char*>(&header), sizeof(header));
-    if (file.gcount() != sizeof(header)) {
+    struct stat fileInfo;
+    if (fstat(fd, &fileInfo) != 0 || static_cast<size_t>(fileInfo.st_size) < CaptureDecoder::kProbeLength) {
+        close(fd);
         return false; // Failed to read the global header
     }
 
-    headerParsed = true;
+    void* mapping = mmap(nullptr, fileInfo.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // The mapping keeps its own reference to the file
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
 
-    // Parse packets
-    while (file) {
-        PcapPacketHeader packetHeader;
-        file.read(reinterpret_cast<char*>(&packetHeader), sizeof(packetHeader));
+    mappedData = static_cast<const uint8_t*>(mapping);
+    mappedSize = fileInfo.st_size;
 
-        if (file.gcount() != sizeof(packetHeader)) {
-            break; // End of file or read error
-        }
+    // Packets are consumed front to back, let the kernel read ahead aggressively
+    madvise(mapping, mappedSize, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+    if (useHugePages) {
+        // Only honoured when the kernel supports huge pages for file-backed mappings
+        madvise(mapping, mappedSize, MADV_HUGEPAGE);
+    }
+#endif
 
-        std::vector<uint8_t> packet(packetHeader.incl_len);
-        file.read(reinterpret_cast<char*>(packet.data()), packetHeader.incl_len);
+    if (!decoder.open(mappedData, mappedSize)) {
+        unmapFile();
+        return false;
+    }
+    headerParsed = true;
+    cursor = decoder.headerLength();
 
-        if (file.gcount() != static_cast<std::streamsize>(packetHeader.incl_len)) {
-            break; // End of file or read error
-        }
+    return true;
+}
 
-        packets.push_back(std::move(packet));
+bool PCAPFileParser::nextPacket(PacketView& view) {
+    // Skip over records that carry no packet, such as pcapng interface blocks
+    bool isPacket;
+    uint64_t offset;
+    while (nextRecord(view, isPacket, offset)) {
+        if (isPacket) return true;
     }
+    return false;
+}
 
+bool PCAPFileParser::nextRecord(PacketView& view, bool& isPacket, uint64_t& offset) {
+    if (!headerParsed || cursor >= mappedSize) return false;
+
+    size_t recordLength = decoder.decode(mappedData + cursor, mappedSize - cursor, view, isPacket);
+    if (recordLength == 0 || recordLength > mappedSize - cursor) {
+        return false; // End of file, or a truncated final record
+    }
+    offset = cursor;
+    cursor += recordLength;
     return true;
 }
 
-const std::vector<std::vector<uint8_t>>& PCAPFileParser::getPackets() const {
-    return packets;
+void PCAPFileParser::seek(uint64_t offset) {
+    if (!headerParsed) return;
+    cursor = std::min<uint64_t>(std::max<uint64_t>(offset, decoder.headerLength()), mappedSize);
+}
+
+void PCAPFileParser::adviseRandomAccess() {
+    if (mappedData) madvise(const_cast<uint8_t*>(mappedData), mappedSize, MADV_RANDOM);
+}
+
+void PCAPFileParser::rewind() {
+    if (!headerParsed) return;
+    decoder.open(mappedData, mappedSize);
+    cursor = decoder.headerLength();
+}
+
+void PCAPFileParser::unmapFile() {
+    if (mappedData) {
+        munmap(const_cast<uint8_t*>(mappedData), mappedSize);
+        mappedData = nullptr;
+        mappedSize = 0;
+    }
+    headerParsed = false;
+    cursor = 0;
+}
 }
-}
\ No newline at end of file
@@ -2,18 +2,46 @@
 
 #include <vector>
 #include <string>
-#include "Ethernet.hpp"
+#include "CaptureFormat.hpp"
 
 namespace NetworkParser {
+
 class PCAPFileParser {
 public:
     PCAPFileParser() : headerParsed(false) {}
+    ~PCAPFileParser();
+    PCAPFileParser(const PCAPFileParser&) = delete;
+    PCAPFileParser& operator=(const PCAPFileParser&) = delete;
+
     bool parseFile(const std::string& filePath);
-    const std::vector<std::vector<uint8_t>>& getPackets() const;
+
+    // Advance to the next packet record, returns false at end of file
+    bool nextPacket(PacketView& view);
+    void rewind();
+
+    // Advance to the next record of any kind, giving where it starts in the
+    // file. Records that carry no packet still have to be decoded in order.
+    bool nextRecord(PacketView& view, bool& isPacket, uint64_t& offset);
+
+    // Carry on reading from a record offset previously given by nextRecord
+    void seek(uint64_t offset);
+    uint64_t position() const { return cursor; }
+    uint64_t fileSize() const { return mappedSize; }
+
+    // Reads are about to jump around the file rather than run front to back
+    void adviseRandomAccess();
+
+    void setUseHugePages(bool enable) { useHugePages = enable; }
 
 private:
-    NetworkParser::PcapGlobalHeader header;
+    CaptureDecoder decoder;
     bool headerParsed;
-    std::vector<std::vector<uint8_t>> packets;  // Store packets
+    bool useHugePages = false;
+
+    const uint8_t* mappedData = nullptr;  // Whole capture file mapped read-only
+    size_t mappedSize = 0;
+    size_t cursor = 0;
+
+    void unmapFile();
 };
-}
\ No newline at end of file
+}
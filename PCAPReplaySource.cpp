@@ -0,0 +1,66 @@
+#include "PCAPReplaySource.hpp"
+#include <algorithm>
+#include <thread>
+
+namespace NetworkParser {
+
+PCAPReplaySource::PCAPReplaySource(double packetsPerSecond, size_t backlogPackets, size_t shard, size_t shardCount)
+    : packetsPerSecond(packetsPerSecond),
+      backlogPackets(std::max<size_t>(1, backlogPackets)),
+      shard(shard),
+      shardCount(shardCount) {}
+
+bool PCAPReplaySource::open(const std::string& filePath) {
+    return fileParser.parseFile(filePath);
+}
+
+// Next packet of the file, true if it belongs to this shard
+bool PCAPReplaySource::takePacket(PacketView& packet) {
+    if (!fileParser.nextPacket(packet)) {
+        exhausted = true;
+        return false;
+    }
+    released++;
+    return shardForPacket(packet, shardCount) == shard;
+}
+
+bool PCAPReplaySource::nextBatch(std::vector<PacketView>& packets) {
+    packets.clear();
+    if (!started) {
+        startTime = std::chrono::steady_clock::now();
+        started = true;
+    }
+
+    while (!exhausted && !sourceStopRequested()) {
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - startTime;
+        uint64_t due = static_cast<uint64_t>(elapsed.count() * packetsPerSecond);
+
+        // Packets that came due while the backlog was full are lost, as on a live link
+        PacketView packet;
+        while (!exhausted && due > released + backlogPackets) {
+            if (takePacket(packet)) totals.drops++;
+        }
+
+        // How full the backlog is as this batch is read from it
+        double fill = std::min(1.0, static_cast<double>(due - std::min(due, released)) / backlogPackets);
+
+        while (!exhausted && released < due && packets.size() < kBatchPackets) {
+            if (takePacket(packet)) packets.push_back(packet);
+        }
+
+        if (!packets.empty()) {
+            totals.sampleFill(fill);
+            totals.packets += packets.size();
+            return true;
+        }
+
+        // Nothing for this shard yet, wait for the next packet to come due
+        if (released >= due) {
+            std::chrono::duration<double> nextDue((released + 1) / packetsPerSecond);
+            std::this_thread::sleep_until(startTime + std::chrono::duration_cast<std::chrono::steady_clock::duration>(nextDue));
+        }
+    }
+    return false;
+}
+
+} // namespace NetworkParser
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include "PCAPFileParser.hpp"
+#include "PacketSource.hpp"
+
+namespace NetworkParser {
+
+// Stand-in for a live link that plays a capture file back at a fixed packet
+// rate. Packets come due on a schedule and wait in a backlog of bounded size,
+// standing in for the capture ring. Those that come due while the backlog is
+// full are dropped, as the kernel would drop them. Like a fanout group, each
+// worker replays the whole file but keeps only its own shard of it, and
+// packets are handed out as views into the mapped file.
+class PCAPReplaySource : public PacketSource {
+public:
+    static constexpr size_t kBatchPackets = 256;
+
+    PCAPReplaySource(double packetsPerSecond, size_t backlogPackets, size_t shard, size_t shardCount);
+
+    bool open(const std::string& filePath);
+
+    bool nextBatch(std::vector<PacketView>& packets) override;
+    void releaseBatch() override {}
+    SourceStats stats() override { return totals; }
+
+private:
+    PCAPFileParser fileParser;
+    double packetsPerSecond;
+    size_t backlogPackets;
+    size_t shard;
+    size_t shardCount;
+    uint64_t released = 0;  // Packets of the whole file that have come due and been taken or dropped
+    bool exhausted = false;
+    bool started = false;
+    std::chrono::steady_clock::time_point startTime;
+    SourceStats totals;
+
+    bool takePacket(PacketView& packet);
+};
+
+} // namespace NetworkParser
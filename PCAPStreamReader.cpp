@@ -0,0 +1,99 @@
+#include "PCAPStreamReader.hpp"
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace NetworkParser {
+
+PCAPStreamReader::~PCAPStreamReader() {
+    if (fd >= 0) close(fd);
+}
+
+bool PCAPStreamReader::open(const std::string& filePath) {
+    if (fd >= 0) close(fd);
+    carry.clear();
+    endOfFile = false;
+
+    fd = ::open(filePath.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false; // Failed to open the file
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    // Identify the format, anything past the file header is kept for the first batch
+    carry.resize(CaptureDecoder::kProbeLength);
+    if (readInto(carry.data(), carry.size()) != carry.size() || !decoder.open(carry.data(), carry.size())) {
+        carry.clear();
+        return false; // Failed to read the global header
+    }
+    carry.erase(carry.begin(), carry.begin() + decoder.headerLength());
+    return true;
+}
+
+size_t PCAPStreamReader::readInto(uint8_t* destination, size_t size) {
+    size_t total = 0;
+    while (total < size) {
+        ssize_t n = read(fd, destination + total, size - total);
+        if (n <= 0) {
+            endOfFile = true;
+            break;
+        }
+        total += n;
+    }
+    return total;
+}
+
+bool PCAPStreamReader::fillBatch(PacketBatch& batch) {
+    batch.packets.clear();
+    if (fd < 0) return false;
+
+    // Blocks without packets, such as pcapng statistics, don't make a batch,
+    // so keep reading until there is a packet or the file ends
+    do {
+        // Start with whatever was cut off at the end of the previous batch.
+        // A carry that held part of an oversized record gives its memory back.
+        size_t filled = carry.size();
+        if (batch.buffer.size() < filled) batch.buffer.resize(filled);
+        std::memcpy(batch.buffer.data(), carry.data(), filled);
+        if (carry.capacity() > batch.buffer.size()) {
+            std::vector<uint8_t>().swap(carry);
+        } else {
+            carry.clear();
+        }
+
+        size_t recordStart = 0;
+        while (true) {
+            if (!endOfFile && filled < batch.buffer.size()) {
+                filled += readInto(batch.buffer.data() + filled, batch.buffer.size() - filled);
+            }
+
+            size_t recordLength = 0;
+            while (true) {
+                PacketView view;
+                bool isPacket;
+                recordLength = decoder.decode(batch.buffer.data() + recordStart, filled - recordStart, view, isPacket);
+                if (recordLength == 0 || recordLength > filled - recordStart) break;
+
+                if (isPacket) batch.packets.push_back(view);
+                recordStart += recordLength;
+            }
+            if (decoder.corrupt()) {
+                endOfFile = true;
+                break;
+            }
+
+            // A single record larger than the whole batch, grow this batch to
+            // fit it. The pipeline shrinks it back before refilling it.
+            if (recordStart == 0 && !endOfFile && filled == batch.buffer.size() && recordLength > filled) {
+                batch.buffer.resize(recordLength);
+                continue;
+            }
+            break;
+        }
+
+        if (!endOfFile) carry.assign(batch.buffer.begin() + recordStart, batch.buffer.begin() + filled);
+    } while (batch.packets.empty() && !endOfFile);
+    return !batch.packets.empty();
+}
+
+} // namespace NetworkParser
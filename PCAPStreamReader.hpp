@@ -0,0 +1,38 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "PCAPFileParser.hpp"
+
+namespace NetworkParser {
+
+// A fixed-size chunk of whole packet records copied out of the capture file
+struct PacketBatch {
+    std::vector<uint8_t> buffer;
+    std::vector<PacketView> packets;  // Views into buffer
+};
+
+// Reads a capture sequentially with read(2) into caller supplied batches,
+// so memory use is bounded by the batches in flight rather than the file size
+class PCAPStreamReader {
+public:
+    PCAPStreamReader() = default;
+    ~PCAPStreamReader();
+    PCAPStreamReader(const PCAPStreamReader&) = delete;
+    PCAPStreamReader& operator=(const PCAPStreamReader&) = delete;
+
+    bool open(const std::string& filePath);
+
+    // Fill the batch with as many whole records as fit, returns false once the file is exhausted
+    bool fillBatch(PacketBatch& batch);
+
+private:
+    int fd = -1;
+    CaptureDecoder decoder;
+    std::vector<uint8_t> carry;  // Partial record left over from the previous batch
+    bool endOfFile = false;
+
+    size_t readInto(uint8_t* destination, size_t size);
+};
+
+} // namespace NetworkParser
@@ -0,0 +1,465 @@
+#include "PacketFilter.hpp"
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <utility>
+#include "Ethernet.hpp"
+#include "IPv6Parser.hpp"
+#include "StatsTables.hpp"
+
+namespace NetworkParser {
+
+namespace {
+
+constexpr uint16_t kEtherTypeIPv4 = 0x0800;
+constexpr uint16_t kEtherTypeIPv6 = 0x86DD;
+constexpr uint8_t kICMP = 1;
+constexpr uint8_t kTCP = 6;
+constexpr uint8_t kUDP = 17;
+constexpr uint8_t kICMPv6 = 58;
+
+// Expression tree, only kept while compiling
+struct Node {
+    enum Kind { Test, And, Or, Not } kind;
+    int left = -1;
+    int right = -1;
+    FilterInstruction test{};
+};
+
+bool tokenize(const std::string& expression, std::vector<std::string>& tokens, std::string& error) {
+    size_t i = 0;
+    while (i < expression.size()) {
+        char c = expression[i];
+        if (std::isspace(static_cast<unsigned char>(c))) {
+            i++;
+        } else if (c == '(' || c == ')' || c == '!') {
+            tokens.push_back(std::string(1, c));
+            i++;
+        } else if (c == '&' || c == '|') {
+            if (i + 1 >= expression.size() || expression[i + 1] != c) {
+                error = std::string("unexpected '") + c + "'";
+                return false;
+            }
+            tokens.push_back(expression.substr(i, 2));
+            i += 2;
+        } else {
+            size_t start = i;
+            while (i < expression.size() && !std::isspace(static_cast<unsigned char>(expression[i])) &&
+                   std::string("()!&|").find(expression[i]) == std::string::npos) {
+                i++;
+            }
+            tokens.push_back(expression.substr(start, i - start));
+        }
+    }
+    return true;
+}
+
+bool parseNumber(const std::string& text, uint32_t maximum, uint32_t& value) {
+    auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+    return result.ec == std::errc() && result.ptr == text.data() + text.size() && value <= maximum;
+}
+
+FilterInstruction rangeTest(FilterField field, uint32_t low, uint32_t high) {
+    return FilterInstruction{field, false, low, high, 0, 0};
+}
+
+// Recursive descent over the tokens. "and" and "or" bind equally and group
+// left to right, as in tcpdump; "not" binds tighter than both.
+class FilterParser {
+public:
+    FilterParser(const std::vector<std::string>& tokens, std::vector<Node>& nodes, std::string& error)
+        : tokens(tokens), nodes(nodes), error(error) {}
+
+    bool parse(int& root) {
+        if (!parseExpression(root)) return false;
+        if (position < tokens.size()) return fail("unexpected '" + tokens[position] + "'");
+        return true;
+    }
+
+private:
+    const std::vector<std::string>& tokens;
+    std::vector<Node>& nodes;
+    std::string& error;
+    size_t position = 0;
+
+    bool fail(const std::string& message) {
+        error = message;
+        return false;
+    }
+
+    bool atEnd() const { return position >= tokens.size(); }
+
+    bool accept(const char* word) {
+        if (atEnd() || tokens[position] != word) return false;
+        position++;
+        return true;
+    }
+
+    bool expectValue(const char* after, std::string& value) {
+        if (atEnd()) return fail(std::string("expected a value after ") + after);
+        value = tokens[position++];
+        return true;
+    }
+
+    int add(Node::Kind kind, int left, int right = -1) {
+        Node node;
+        node.kind = kind;
+        node.left = left;
+        node.right = right;
+        nodes.push_back(node);
+        return static_cast<int>(nodes.size() - 1);
+    }
+
+    int add(const FilterInstruction& test) {
+        Node node;
+        node.kind = Node::Test;
+        node.test = test;
+        nodes.push_back(node);
+        return static_cast<int>(nodes.size() - 1);
+    }
+
+    // One test for src or dst, both ends otherwise
+    int addEnds(const std::string& direction, FilterField source, FilterField destination, FilterInstruction test) {
+        test.field = source;
+        int sourceTest = add(test);
+        if (direction == "src") return sourceTest;
+        test.field = destination;
+        int destinationTest = add(test);
+        if (direction == "dst") return destinationTest;
+        return add(Node::Or, sourceTest, destinationTest);
+    }
+
+    bool parseExpression(int& node) {
+        if (!parseUnary(node)) return false;
+        while (true) {
+            Node::Kind kind;
+            if (accept("and") || accept("&&")) {
+                kind = Node::And;
+            } else if (accept("or") || accept("||")) {
+                kind = Node::Or;
+            } else {
+                return true;
+            }
+            int right;
+            if (!parseUnary(right)) return false;
+            node = add(kind, node, right);
+        }
+    }
+
+    bool parseUnary(int& node) {
+        if (accept("not") || accept("!")) {
+            int child;
+            if (!parseUnary(child)) return false;
+            node = add(Node::Not, child);
+            return true;
+        }
+        if (accept("(")) return parseExpression(node) && (accept(")") || fail("expected ')'"));
+        return parsePrimitive(node);
+    }
+
+    bool parsePrimitive(int& node) {
+        if (atEnd()) return fail("expression ends early");
+
+        std::string protocol;
+        for (const char* name : {"ip6", "ip", "tcp", "udp", "icmp6", "icmp"}) {
+            if (accept(name)) protocol = name;
+            if (!protocol.empty()) break;
+        }
+        std::string direction;
+        if (accept("src")) direction = "src";
+        else if (accept("dst")) direction = "dst";
+
+        std::string type;
+        for (const char* name : {"host", "net", "port", "portrange", "proto", "less", "greater"}) {
+            if (accept(name)) type = name;
+            if (!type.empty()) break;
+        }
+
+        if (type.empty()) {
+            if (!direction.empty()) return fail("expected host, net, port or portrange after " + direction);
+            if (protocol.empty()) return fail("unknown primitive '" + tokens[position] + "'");
+            node = add(protocolTest(protocol));
+            return true;
+        }
+
+        std::string value;
+        if (!expectValue(type.c_str(), value)) return false;
+
+        if (type == "less" || type == "greater") {
+            uint32_t bytes;
+            if (!protocol.empty() || !direction.empty()) return fail(type + " takes no qualifiers");
+            if (!parseNumber(value, UINT32_MAX, bytes)) return fail("bad length " + value);
+            node = add(type == "less" ? rangeTest(FilterField::Length, 0, bytes)
+                                      : rangeTest(FilterField::Length, bytes, UINT32_MAX));
+            return true;
+        }
+
+        if (type == "proto") {
+            if ((!protocol.empty() && protocol != "ip" && protocol != "ip6") || !direction.empty()) {
+                return fail("proto only takes ip or ip6");
+            }
+            uint32_t number;
+            if (value == "tcp" || value == "udp" || value == "icmp" || value == "icmp6") {
+                node = add(protocolTest(value));
+            } else if (parseNumber(value, 255, number)) {
+                node = add(rangeTest(FilterField::IPProtocol, number, number));
+            } else {
+                return fail("bad protocol " + value);
+            }
+            // Without ip or ip6 either version will do
+            if (!protocol.empty()) node = add(Node::And, add(protocolTest(protocol)), node);
+            return true;
+        }
+
+        if (type == "host" || type == "net") {
+            if (!protocol.empty() && protocol != "ip") return fail(type + " can't follow " + protocol);
+            uint32_t address;
+            uint32_t bits = 32;
+            std::string text = value;
+            size_t slash = value.find('/');
+            if (type == "net" && slash != std::string::npos) {
+                if (!parseNumber(value.substr(slash + 1), 32, bits)) return fail("bad prefix length in " + value);
+                text.erase(slash);
+            }
+            if (!parseIPv4(text, address)) return fail("bad address " + value);
+            uint32_t mask = bits ? ~uint32_t(0) << (32 - bits) : 0;
+            if (address & ~mask) return fail("host bits set in net " + value);
+            node = addEnds(direction, FilterField::SourceIP, FilterField::DestinationIP,
+                           FilterInstruction{FilterField::SourceIP, true, address, mask, 0, 0});
+            return true;
+        }
+
+        // port or portrange
+        if (!protocol.empty() && protocol != "tcp" && protocol != "udp") return fail(type + " can't follow " + protocol);
+        uint32_t low;
+        uint32_t high;
+        size_t dash = value.find('-');
+        if (type == "port") {
+            if (!parseNumber(value, 65535, low)) return fail("bad port " + value);
+            high = low;
+        } else if (dash == std::string::npos || !parseNumber(value.substr(0, dash), 65535, low) ||
+                   !parseNumber(value.substr(dash + 1), 65535, high) || low > high) {
+            return fail("bad port range " + value);
+        }
+        node = addEnds(direction, FilterField::SourcePort, FilterField::DestinationPort,
+                       rangeTest(FilterField::SourcePort, low, high));
+        if (!protocol.empty()) node = add(Node::And, add(protocolTest(protocol)), node);
+        return true;
+    }
+
+    static FilterInstruction protocolTest(const std::string& protocol) {
+        if (protocol == "ip") return rangeTest(FilterField::EtherType, kEtherTypeIPv4, kEtherTypeIPv4);
+        if (protocol == "ip6") return rangeTest(FilterField::EtherType, kEtherTypeIPv6, kEtherTypeIPv6);
+        uint8_t number = protocol == "tcp" ? kTCP : protocol == "udp" ? kUDP : protocol == "icmp6" ? kICMPv6 : kICMP;
+        return rangeTest(FilterField::IPProtocol, number, number);
+    }
+};
+
+// Lays the tree out as tests with forward jumps. Jump targets are labels
+// while emitting and become instruction positions once every label is placed.
+class FilterCompiler {
+public:
+    static constexpr int kAcceptLabel = -1;
+    static constexpr int kRejectLabel = -2;
+
+    explicit FilterCompiler(const std::vector<Node>& nodes) : nodes(nodes) {}
+
+    bool compile(int root, std::vector<FilterInstruction>& program, std::string& error) {
+        emit(root, kAcceptLabel, kRejectLabel);
+        if (tests.size() >= FilterInstruction::kReject) {
+            error = "expression is too long";
+            return false;
+        }
+        auto resolve = [&](int label) -> uint16_t {
+            if (label == kAcceptLabel) return FilterInstruction::kAccept;
+            if (label == kRejectLabel) return FilterInstruction::kReject;
+            return static_cast<uint16_t>(labelPositions[label]);
+        };
+        program.clear();
+        for (size_t i = 0; i < tests.size(); i++) {
+            FilterInstruction instruction = tests[i];
+            instruction.onTrue = resolve(jumps[i].first);
+            instruction.onFalse = resolve(jumps[i].second);
+            program.push_back(instruction);
+        }
+        return true;
+    }
+
+private:
+    const std::vector<Node>& nodes;
+    std::vector<FilterInstruction> tests;
+    std::vector<std::pair<int, int>> jumps;
+    std::vector<size_t> labelPositions;
+
+    int newLabel() {
+        labelPositions.push_back(0);
+        return static_cast<int>(labelPositions.size() - 1);
+    }
+
+    void place(int label) { labelPositions[label] = tests.size(); }
+
+    void emit(int index, int onTrue, int onFalse) {
+        const Node& node = nodes[index];
+        switch (node.kind) {
+        case Node::Test:
+            tests.push_back(node.test);
+            jumps.push_back({onTrue, onFalse});
+            break;
+        case Node::Not:
+            emit(node.left, onFalse, onTrue);
+            break;
+        case Node::And: {
+            int right = newLabel();
+            emit(node.left, right, onFalse);
+            place(right);
+            emit(node.right, onTrue, onFalse);
+            break;
+        }
+        case Node::Or: {
+            int right = newLabel();
+            emit(node.left, onTrue, right);
+            place(right);
+            emit(node.right, onTrue, onFalse);
+            break;
+        }
+        }
+    }
+};
+
+uint16_t read16(const uint8_t* at) {
+    return static_cast<uint16_t>((at[0] << 8) | at[1]);
+}
+
+uint32_t read32(const uint8_t* at) {
+    return (static_cast<uint32_t>(read16(at)) << 16) | read16(at + 2);
+}
+
+// The frame being filtered. Where its network and transport headers are is
+// only worked out if an instruction asks for one of their fields.
+class FrameFields {
+public:
+    FrameFields(const uint8_t* data, size_t length) : data(data), length(length) {}
+
+    bool load(FilterField field, uint32_t& value) {
+        switch (field) {
+        case FilterField::Length:
+            value = static_cast<uint32_t>(std::min<size_t>(length, UINT32_MAX));
+            return true;
+        case FilterField::EtherType:
+            if (!findNetwork()) return false;
+            value = etherType;
+            return true;
+        case FilterField::IPProtocol:
+            if (!hasIP()) return false;
+            value = protocol;
+            return true;
+        case FilterField::SourceIP:
+            if (!hasIP() || etherType != kEtherTypeIPv4) return false;
+            value = read32(data + network + 12);
+            return true;
+        case FilterField::DestinationIP:
+            if (!hasIP() || etherType != kEtherTypeIPv4) return false;
+            value = read32(data + network + 16);
+            return true;
+        case FilterField::SourcePort:
+            if (!hasPorts()) return false;
+            value = read16(data + transport);
+            return true;
+        case FilterField::DestinationPort:
+            if (!hasPorts()) return false;
+            value = read16(data + transport + 2);
+            return true;
+        }
+        return false;
+    }
+
+private:
+    const uint8_t* data;
+    size_t length;
+    int8_t found = -1;  // Not looked at yet
+    int8_t ip = -1;
+    uint16_t etherType = 0;
+    size_t network = 0;
+    uint8_t protocol = 0;
+    bool firstFragment = true;
+    size_t transport = 0;
+
+    bool findNetwork() {
+        if (found < 0) {
+            bool truncated;
+            etherType = findNetworkLayer(data, length, 0, network, truncated);
+            found = etherType != 0;
+        }
+        return found;
+    }
+
+    // An IPv4 or IPv6 header, with the protocol and transport header after it
+    bool hasIP() {
+        if (ip < 0) {
+            ip = false;
+            if (!findNetwork()) return ip;
+            const uint8_t* header = data + network;
+            if (etherType == kEtherTypeIPv4) {
+                ip = length >= network + 20 && (header[0] >> 4) == 4 && (header[0] & 0x0F) >= 5;
+                if (ip) {
+                    protocol = header[9];
+                    transport = network + (header[0] & 0x0F) * 4;
+                    firstFragment = (read16(header + 6) & 0x1FFF) == 0;
+                }
+            } else if (etherType == kEtherTypeIPv6 && length >= network + sizeof(IPv6Header) &&
+                       (header[0] >> 4) == 6) {
+                size_t end = std::min(length, network + sizeof(IPv6Header) + read16(header + 4));
+                ip = findUpperLayer(data, network, end, transport, protocol, firstFragment);
+            }
+        }
+        return ip;
+    }
+
+    bool hasPorts() {
+        return hasIP() && (protocol == kTCP || protocol == kUDP) && firstFragment && length >= transport + 4;
+    }
+};
+
+} // namespace
+
+bool PacketFilter::compile(const std::string& text, std::string& error) {
+    std::vector<std::string> tokens;
+    if (!tokenize(text, tokens, error)) return false;
+    if (tokens.empty()) {
+        error = "empty expression";
+        return false;
+    }
+
+    std::vector<Node> nodes;
+    int root;
+    FilterParser parser(tokens, nodes, error);
+    if (!parser.parse(root)) return false;
+
+    std::vector<FilterInstruction> compiled;
+    FilterCompiler compiler(nodes);
+    if (!compiler.compile(root, compiled, error)) return false;
+    expression = text;
+    program = std::move(compiled);
+    addressTests = std::any_of(program.begin(), program.end(), [](const FilterInstruction& instruction) {
+        return instruction.field == FilterField::SourceIP || instruction.field == FilterField::DestinationIP;
+    });
+    return true;
+}
+
+bool PacketFilter::matches(const uint8_t* data, size_t length) const {
+    FrameFields fields(data, length);
+    size_t position = 0;
+    while (true) {
+        const FilterInstruction& instruction = program[position];
+        uint32_t value;
+        bool passed = fields.load(instruction.field, value) &&
+                      (instruction.masked ? (value & instruction.high) == instruction.low
+                                          : value >= instruction.low && value <= instruction.high);
+        uint16_t next = passed ? instruction.onTrue : instruction.onFalse;
+        if (next == FilterInstruction::kAccept) return true;
+        if (next == FilterInstruction::kReject) return false;
+        position = next;
+    }
+}
+
+} // namespace NetworkParser
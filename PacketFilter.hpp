@@ -0,0 +1,69 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace NetworkParser {
+
+// Header fields a filter instruction can test, read straight from the frame
+enum class FilterField : uint8_t {
+    Length,          // Captured bytes
+    EtherType,       // Of the network header, behind any VLAN tags or MPLS labels
+    IPProtocol,      // IPv4 protocol or the IPv6 header after the extension headers
+    SourceIP,        // These need an IPv4 header
+    DestinationIP,
+    SourcePort,      // These need the first fragment of a TCP or UDP datagram
+    DestinationPort
+};
+
+// One test of a compiled filter. The field passes if it is within
+// [low, high], or with masked if (field & high) == low. Execution goes on
+// at onTrue or onFalse, which always point forward, so every packet runs at
+// most one pass over the program.
+struct FilterInstruction {
+    static constexpr uint16_t kAccept = 0xFFFF;
+    static constexpr uint16_t kReject = 0xFFFE;
+
+    FilterField field;
+    bool masked;
+    uint32_t low;
+    uint32_t high;
+    uint16_t onTrue;
+    uint16_t onFalse;
+};
+
+// A tcpdump style capture filter, compiled once into a flat program of
+// tests and jumps that runs on the raw bytes of each frame:
+//
+//   tcp port 443 and net 10.0.0.0/8
+//   not (udp and dst portrange 1024-2047) or host 192.168.1.1
+//
+// Primitives are ip, ip6, tcp, udp, icmp, icmp6, [ip|ip6] proto <n>,
+// [src|dst] host <ip>, [src|dst] net <ip>/<bits>, [tcp|udp] [src|dst] port
+// <n>, [tcp|udp] [src|dst] portrange <n>-<m>, less <bytes> and greater
+// <bytes>, combined with and/&&, or/||, not/! and parentheses. A test on a
+// field the packet doesn't have fails, so "not tcp" matches every packet that
+// isn't TCP. VLAN tags and MPLS labels are stepped over as by the parser, and
+// everything but host and net, which take IPv4 addresses, matches IPv6 too.
+class PacketFilter {
+public:
+    // False with a message in error if expression doesn't parse
+    bool compile(const std::string& expression, std::string& error);
+
+    bool active() const { return !program.empty(); }
+    const std::string& text() const { return expression; }
+    const std::vector<FilterInstruction>& instructions() const { return program; }
+
+    // Whether a host or net test is in the program, which fails on IPv6
+    bool testsAddresses() const { return addressTests; }
+
+    bool matches(const uint8_t* data, size_t length) const;
+
+private:
+    std::string expression;
+    std::vector<FilterInstruction> program;
+    bool addressTests = false;
+};
+
+} // namespace NetworkParser
@@ -0,0 +1,71 @@
+#include "PacketPipeline.hpp"
+#include <algorithm>
+
+namespace NetworkParser {
+
+static size_t batchCountForCap(size_t memoryCapBytes) {
+    return std::max<size_t>(2, memoryCapBytes / PacketPipeline::kBatchBytes);
+}
+
+PacketPipeline::PacketPipeline(PCAPStreamReader& reader, size_t memoryCapBytes)
+    : reader(reader),
+      fullBatches(batchCountForCap(memoryCapBytes)),
+      freeBatches(batchCountForCap(memoryCapBytes)) {
+    size_t batchCount = batchCountForCap(memoryCapBytes);
+    for (size_t i = 0; i < batchCount; i++) {
+        pool.push_back(std::make_unique<PacketBatch>());
+        pool.back()->buffer.resize(kBatchBytes);
+        freeBatches.tryPush(pool.back().get());
+    }
+}
+
+PacketPipeline::~PacketPipeline() {
+    stopping = true;
+    if (readerThread.joinable()) readerThread.join();
+}
+
+void PacketPipeline::start() {
+    readerThread = std::thread(&PacketPipeline::readerLoop, this);
+}
+
+void PacketPipeline::readerLoop() {
+    PacketBatch* batch = nullptr;
+    while (!stopping) {
+        if (!freeBatches.tryPop(batch)) {
+            std::this_thread::yield();  // Parser is behind, wait for a batch to come back
+            continue;
+        }
+        // A batch grown to hold an oversized record goes back to its normal
+        // size, so a few jumbo or corrupt lengths don't stay resident past the cap
+        if (batch->buffer.size() > kBatchBytes) std::vector<uint8_t>(kBatchBytes).swap(batch->buffer);
+        if (!reader.fillBatch(*batch)) break;
+        while (!fullBatches.tryPush(batch)) std::this_thread::yield();
+    }
+    readerDone.store(true, std::memory_order_release);
+}
+
+PacketBatch* PacketPipeline::nextBatch() {
+    PacketBatch* batch = nullptr;
+    bool finished = false;
+    while (!tryNextBatch(batch, finished)) {
+        if (finished) return nullptr;
+        std::this_thread::yield();
+    }
+    return batch;
+}
+
+bool PacketPipeline::tryNextBatch(PacketBatch*& batch, bool& finished) {
+    if (fullBatches.tryPop(batch)) return true;
+    if (readerDone.load(std::memory_order_acquire)) {
+        // The reader may have pushed its last batch just before finishing
+        if (fullBatches.tryPop(batch)) return true;
+        finished = true;
+    }
+    return false;
+}
+
+void PacketPipeline::releaseBatch(PacketBatch* batch) {
+    freeBatches.tryPush(batch);
+}
+
+} // namespace NetworkParser
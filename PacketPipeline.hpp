@@ -0,0 +1,47 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "PCAPStreamReader.hpp"
+#include "SPSCRing.hpp"
+
+namespace NetworkParser {
+
+// Reader thread filling packet batches from a PCAPStreamReader and handing them
+// to the parsing thread through a pair of SPSC rings. The number of batches in
+// flight is fixed up front, which caps the memory used for packet data.
+class PacketPipeline {
+public:
+    static constexpr size_t kBatchBytes = 1 << 20;
+
+    PacketPipeline(PCAPStreamReader& reader, size_t memoryCapBytes);
+    ~PacketPipeline();
+    PacketPipeline(const PacketPipeline&) = delete;
+    PacketPipeline& operator=(const PacketPipeline&) = delete;
+
+    void start();
+
+    // Blocks until a filled batch is available, returns nullptr once the file is exhausted
+    PacketBatch* nextBatch();
+
+    // Non-blocking variant, sets finished once the file is exhausted
+    bool tryNextBatch(PacketBatch*& batch, bool& finished);
+
+    // Hand a processed batch back to the reader for refilling
+    void releaseBatch(PacketBatch* batch);
+
+private:
+    PCAPStreamReader& reader;
+    std::vector<std::unique_ptr<PacketBatch>> pool;
+    SPSCRing<PacketBatch*> fullBatches;
+    SPSCRing<PacketBatch*> freeBatches;
+    std::thread readerThread;
+    std::atomic<bool> readerDone{false};
+    std::atomic<bool> stopping{false};
+
+    void readerLoop();
+};
+
+} // namespace NetworkParser
@@ -0,0 +1,60 @@
+#include "PacketSource.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include "Ethernet.hpp"
+#include "IPParser.hpp"
+#include "IPv6Parser.hpp"
+
+namespace NetworkParser {
+
+static std::atomic<bool> stopRequested{false};
+
+void requestSourceStop() {
+    stopRequested.store(true, std::memory_order_relaxed);
+}
+
+bool sourceStopRequested() {
+    return stopRequested.load(std::memory_order_relaxed);
+}
+
+void SourceStats::sampleFill(double fill) {
+    fillSum += fill;
+    fillSamples++;
+    peakFill = std::max(peakFill, fill);
+}
+
+void SourceStats::add(const SourceStats& other) {
+    packets += other.packets;
+    drops += other.drops;
+    fillSum += other.fillSum;
+    fillSamples += other.fillSamples;
+    peakFill = std::max(peakFill, other.peakFill);
+}
+
+size_t shardForPacket(const PacketView& packet, size_t shardCount) {
+    if (shardCount <= 1) return 0;
+
+    // Tagged frames are sharded on the addresses behind their tags
+    size_t at;
+    bool truncated;
+    uint16_t ethType = findNetworkLayer(packet.data, packet.length, 0, at, truncated);
+    uint64_t key;
+    if (ethType == 0x0800 && packet.length >= at + sizeof(IPv4Header)) {
+        const IPv4Header* ipHeader = reinterpret_cast<const IPv4Header*>(packet.data + at);
+        key = ipHeader->sourceIP ^ ipHeader->destinationIP;
+    } else if (ethType == 0x86DD && packet.length >= at + sizeof(IPv6Header)) {
+        // Both directions fold to the same key, as for IPv4
+        const IPv6Header* ipHeader = reinterpret_cast<const IPv6Header*>(packet.data + at);
+        uint64_t words[4];
+        std::memcpy(words, ipHeader->sourceIP, sizeof(ipHeader->sourceIP));
+        std::memcpy(words + 2, ipHeader->destinationIP, sizeof(ipHeader->destinationIP));
+        key = words[0] ^ words[1] ^ words[2] ^ words[3];
+        key ^= key >> 32;
+    } else {
+        return 0;
+    }
+    return ((key * 0x9E3779B97F4A7C15ull) >> 32) % shardCount;
+}
+
+} // namespace NetworkParser
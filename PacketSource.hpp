@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "CaptureFormat.hpp"
+
+namespace NetworkParser {
+
+// What a source saw over its lifetime
+struct SourceStats {
+    uint64_t packets = 0;     // Handed on to the parsers
+    uint64_t drops = 0;       // Lost before they could be read
+    double fillSum = 0;       // Ring fill sampled once per batch, 0 to 1
+    uint64_t fillSamples = 0;
+    double peakFill = 0;
+
+    void sampleFill(double fill);
+    void add(const SourceStats& other);
+    double averageFill() const { return fillSamples ? fillSum / fillSamples : 0; }
+};
+
+// Somewhere live packets come from. Each worker thread drives its own source.
+// Batches are views into memory the source owns, so nothing is copied on the
+// way to the parsers, and they stay valid until releaseBatch.
+class PacketSource {
+public:
+    virtual ~PacketSource() = default;
+
+    // Wait for the next batch, false once the source is exhausted or stopped
+    virtual bool nextBatch(std::vector<PacketView>& packets) = 0;
+
+    // Hand the memory of the last batch back to the source
+    virtual void releaseBatch() = 0;
+
+    virtual SourceStats stats() = 0;
+};
+
+// Ask every source to stop after its current batch. Safe to call from a signal handler.
+void requestSourceStop();
+bool sourceStopRequested();
+
+// Pick a worker from the IPv4 address pair. The hash is symmetric, so both
+// directions of a conversation are handled by the same worker.
+size_t shardForPacket(const PacketView& packet, size_t shardCount);
+
+} // namespace NetworkParser
@@ -0,0 +1,219 @@
+#include "PacketWorker.hpp"
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <netinet/in.h>
+
+namespace NetworkParser {
+
+PacketWorker::PacketWorker(const ProtocolRegistry& registry, bool serializePlugins, ReassemblyBudget* reassemblyBudget)
+    : parserFactory(registry, tables, serializePlugins),
+      inbox(kQueueDepth),
+      outbox(kQueueDepth) {
+    if constexpr (kMetricsEnabled) metrics = Metrics::instance().addThread(registry.size());
+    defragmenter = std::make_unique<IPDefragmenter>(tables.ip.fragments);
+    if (reassemblyBudget) {
+        reassembler = std::make_unique<TCPReassembler>(*reassemblyBudget, tables.tcp.reassembly,
+                                                       static_cast<StreamConsumer&>(*this));
+    }
+}
+
+PacketWorker::~PacketWorker() {
+    if (thread.joinable()) thread.join();
+}
+
+bool PacketWorker::admit(const PacketView& packet) {
+    bool addressTests = filter && filter->testsAddresses();
+    if (headers || addressTests) {
+        size_t at;
+        bool truncated;
+        uint16_t ethType = findNetworkLayer(packet.data, packet.length, 0, at, truncated);
+        if (headers && (ethType == 0x86DD || (ethType == 0x0800 && at != sizeof(EthernetFrameHeader)))) unchecked++;
+        if (addressTests && ethType == 0x86DD) unaddressed++;
+    }
+    if (filter && !filter->matches(packet.data, packet.length)) {
+        filteredOut++;
+        return false;
+    }
+    return true;
+}
+
+void PacketWorker::processPacket(const PacketView& packet, uint64_t packetNumber) {
+    if (admit(packet)) parsePacket(packet, packetNumber);
+}
+
+void PacketWorker::parsePacket(const PacketView& packet, uint64_t packetNumber) {
+    PacketContext context;
+    context.packetNumber = packetNumber;
+    context.timestampSec = packet.timestampSec;
+    context.timestampUsec = packet.timestampUsec;
+
+    runChain(Protocol::Ethernet, packet.data, packet.length, 0, context);
+}
+
+void PacketWorker::processBatch(const PacketView* packets, const uint64_t* packetNumbers, size_t count) {
+    if (!headers) {
+        for (size_t i = 0; i < count; i++) processPacket(packets[i], packetNumbers[i]);
+        parserFactory.flushPlugins();
+        return;
+    }
+
+    // The filter goes first, so packets it rejects cost no checksum and
+    // aren't counted as malformed
+    for (size_t start = 0; start < count;) {
+        admitted.clear();
+        admittedNumbers.clear();
+        for (; start < count && admitted.size() < HeaderBatch::kCapacity; start++) {
+            if (!admit(packets[start])) continue;
+            admitted.push_back(packets[start]);
+            admittedNumbers.push_back(packetNumbers[start]);
+        }
+
+        decodeHeaders(admitted.data(), admitted.size(), *headers, true);
+        for (size_t i = 0; i < admitted.size(); i++) {
+            uint8_t status = headers->status[i];
+            if (status & HeaderBatch::IPChecksumBad) {
+                reportPacketError(PacketError::IPChecksum);
+            } else if (status & HeaderBatch::TransportChecksumBad) {
+                reportPacketError(headers->ipProtocol[i] == IPPROTO_TCP ? PacketError::TCPChecksum
+                                                                        : PacketError::UDPChecksum);
+            } else {
+                parsePacket(admitted[i], admittedNumbers[i]);
+            }
+        }
+    }
+    parserFactory.flushPlugins();
+}
+
+void PacketWorker::runChain(ProtocolId protocol, const uint8_t* packet, size_t length, size_t offset,
+                            PacketContext& context) {
+    while (protocol != Protocol::None) {
+        Parser* parser = parserFactory.getParser(protocol);
+        if (!parser) {
+            // No parser for this protocol, its library failure was reported at startup
+            break;
+        }
+
+        // Validate offset and length
+        if (offset >= length) {
+            //std::cerr << "Error: Offset exceeds packet length\n";
+            break;
+        }
+
+        if constexpr (kMetricsEnabled) {
+            uint64_t start = readCycles();
+            parser->parsePacket(packet, length, offset, context);
+            metrics->record(protocol, length - offset, readCycles() - start);
+        } else {
+            parser->parsePacket(packet, length, offset, context);
+        }
+        ProtocolId next = parser->nextProtocol();
+        offset += parser->getOffset();
+
+        // Fragments are held until their datagram is whole, which then goes
+        // on to the transport layer from the defragmenter's copy
+        if (protocol == Protocol::IP && context.ipFragment && defragmenter) {
+            size_t datagramLength;
+            const uint8_t* datagram = defragmenter->accept(packet, context.networkOffset, context, datagramLength);
+            if (datagram) {
+                size_t headerLength = (datagram[0] & 0x0F) * 4;  // The first fragment's, options included
+                context.ipFragment = false;
+                context.networkOffset = 0;
+                context.transportOffset = static_cast<uint32_t>(headerLength);
+                context.networkEnd = static_cast<uint32_t>(datagramLength);
+                runChain(IPParser::transportProtocol(context.ipProtocol), datagram, datagramLength, headerLength,
+                         context);
+                defragmenter->release();
+            }
+            break;
+        }
+
+        // Application data over TCP is put back in stream order first, the
+        // reassembler calls consumeStream with contiguous ranges. Empty
+        // segments go too, since SYN and FIN move the stream along.
+        if (protocol == Protocol::TCP && next >= Protocol::FirstDynamic && reassembler && context.hasAddresses) {
+            size_t end = context.networkEnd ? std::min<size_t>(length, context.networkEnd) : length;
+            reassembler->accept(next, packet, end, std::min(offset, end), context);
+            break;
+        }
+        protocol = next;
+    }
+}
+
+void PacketWorker::consumeStream(ProtocolId protocol, const uint8_t* packet, size_t length, size_t offset,
+                                 PacketContext& context) {
+    runChain(protocol, packet, length, offset, context);
+}
+
+void PacketWorker::setFlowTimeout(uint64_t usec) {
+    tables.tcp.flows.setIdleTimeout(usec);
+    tables.udp.flows.setIdleTimeout(usec);
+    if (reassembler) reassembler->setIdleTimeout(usec);
+}
+
+void PacketWorker::setVerifyChecksums(bool verify) {
+    if (verify && !headers) {
+        headers = std::make_unique<HeaderBatch>();
+        admitted.reserve(HeaderBatch::kCapacity);
+        admittedNumbers.reserve(HeaderBatch::kCapacity);
+    }
+    if (!verify) headers.reset();
+}
+
+void PacketWorker::finishStreams() {
+    if (reassembler) reassembler->finish();
+    if (defragmenter) defragmenter->finish();
+    parserFactory.flushPlugins();
+}
+
+void PacketWorker::setFragmentSlots(size_t slots) {
+    if (slots) {
+        defragmenter = std::make_unique<IPDefragmenter>(tables.ip.fragments, slots);
+    } else {
+        defragmenter.reset();
+    }
+}
+
+void PacketWorker::start() {
+    thread = std::thread(&PacketWorker::run, this);
+}
+
+void PacketWorker::startSource(PacketSource& source, std::atomic<uint64_t>& packetCounter) {
+    sourceDone = false;
+    thread = std::thread(&PacketWorker::runSource, this, std::ref(source), std::ref(packetCounter));
+}
+
+void PacketWorker::runSource(PacketSource& source, std::atomic<uint64_t>& packetCounter) {
+    std::vector<PacketView> packets;
+    std::vector<uint64_t> packetNumbers;
+    while (source.nextBatch(packets)) {
+        uint64_t first = packetCounter.fetch_add(packets.size(), std::memory_order_relaxed);
+        packetNumbers.resize(packets.size());
+        for (size_t i = 0; i < packets.size(); i++) packetNumbers[i] = first + i + 1;
+        processBatch(packets.data(), packetNumbers.data(), packets.size());
+        source.releaseBatch();
+    }
+    sourceDone.store(true, std::memory_order_release);
+}
+
+void PacketWorker::join() {
+    if (thread.joinable()) thread.join();
+}
+
+void PacketWorker::run() {
+    WorkBatch* batch = nullptr;
+    while (true) {
+        if (!inbox.tryPop(batch)) {
+            std::this_thread::yield();
+            continue;
+        }
+        if (!batch) break;  // End of input
+
+        processBatch(batch->packets.data(), batch->packetNumbers.data(), batch->packets.size());
+
+        // The outbox is as deep as the inbox, so there is always room to return the batch
+        while (!outbox.tryPush(batch)) std::this_thread::yield();
+    }
+}
+
+} // namespace NetworkParser
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "HeaderBatch.hpp"
+#include "Metrics.hpp"
+#include "PCAPStreamReader.hpp"
+#include "PacketFilter.hpp"
+#include "PacketSource.hpp"
+#include "ParserFactory.hpp"
+#include "ProtocolRegistry.hpp"
+#include "SPSCRing.hpp"
+#include "StatsTables.hpp"
+#include "TCPReassembler.hpp"
+#include "IPDefragmenter.hpp"
+
+namespace NetworkParser {
+
+// Packets handed to one worker, together with their position in the capture
+struct WorkBatch {
+    static constexpr size_t kCapacity = 256;
+
+    std::vector<PacketView> packets;
+    std::vector<uint64_t> packetNumbers;  // 1-based capture order of each packet
+    PacketBatch* source = nullptr;        // Streaming buffer the views point into, if any
+};
+
+// Runs the Ethernet -> IP -> TCP/UDP parser chain into its own private set of
+// statistics tables. Either driven inline through processPacket, or on its own
+// thread fed with WorkBatches through an SPSC ring. IPv4 fragments are put
+// back together by an IPDefragmenter before the transport layer. With a
+// reassembly budget, TCP payload for application parsers goes through a
+// TCPReassembler first.
+class PacketWorker : private StreamConsumer {
+public:
+    static constexpr size_t kQueueDepth = 8;
+
+    PacketWorker(const ProtocolRegistry& registry, bool serializePlugins, ReassemblyBudget* reassemblyBudget);
+    ~PacketWorker();
+    PacketWorker(const PacketWorker&) = delete;
+    PacketWorker& operator=(const PacketWorker&) = delete;
+
+    void processPacket(const PacketView& packet, uint64_t packetNumber);
+
+    // Packets in capture order. Packets the filter rejects are dropped first.
+    // With checksum verification on the headers of the rest are decoded a
+    // batch at a time and packets failing a checksum are counted and dropped
+    // rather than parsed. Batch plugins have been handed every packet by the
+    // time it returns.
+    void processBatch(const PacketView* packets, const uint64_t* packetNumbers, size_t count);
+    StatsTables& getTables() { return tables; }
+    void setFlowTimeout(uint64_t usec);
+    void setVerifyChecksums(bool verify);
+
+    // IPv4 datagrams being reassembled at once, 0 leaves fragments unreassembled
+    void setFragmentSlots(size_t slots);
+
+    // Packets the filter rejects are dropped before the parser chain. The
+    // filter has to outlive the worker.
+    void setFilter(const PacketFilter* packetFilter) { filter = packetFilter; }
+    uint64_t packetsFilteredOut() const { return filteredOut; }
+
+    // IPv6 packets seen by a filter with host or net tests, which take IPv4 addresses
+    uint64_t packetsUnaddressed() const { return unaddressed; }
+
+    // Tagged and IPv6 packets seen while verifying checksums, which only
+    // looks into untagged IPv4 frames
+    uint64_t packetsUnchecked() const { return unchecked; }
+
+    // End of input, drops whatever the reassemblers still hold and flushes batch plugins
+    void finishStreams();
+
+    // This worker's state for a plugin built against PluginABI.h, for its report
+    void* pluginState(ProtocolId protocol) const { return parserFactory.pluginState(protocol); }
+
+    // Threaded operation. submit(nullptr) tells the worker no more batches follow.
+    void start();
+    bool submit(WorkBatch* batch) { return inbox.tryPush(batch); }
+    bool reclaim(WorkBatch*& batch) { return outbox.tryPop(batch); }
+    void join();
+
+    // Threaded operation on a source of our own. Packets are numbered from
+    // packetCounter, which all workers share.
+    void startSource(PacketSource& source, std::atomic<uint64_t>& packetCounter);
+    bool sourceFinished() const { return sourceDone.load(std::memory_order_acquire); }
+
+private:
+    StatsTables tables;
+    ParserFactory parserFactory;
+    std::unique_ptr<TCPReassembler> reassembler;
+    std::unique_ptr<IPDefragmenter> defragmenter;
+    SPSCRing<WorkBatch*> inbox;
+    SPSCRing<WorkBatch*> outbox;
+    std::thread thread;
+    std::atomic<bool> sourceDone{false};
+    MetricsSlot* metrics = nullptr;  // Only with make METRICS=1
+    std::unique_ptr<HeaderBatch> headers;  // Only when verifying checksums
+    std::vector<PacketView> admitted;      // Packets of a batch that passed the filter, to be checksummed
+    std::vector<uint64_t> admittedNumbers;
+    const PacketFilter* filter = nullptr;
+    uint64_t filteredOut = 0;
+    uint64_t unchecked = 0;
+    uint64_t unaddressed = 0;
+
+    bool admit(const PacketView& packet);
+    void parsePacket(const PacketView& packet, uint64_t packetNumber);
+    void run();
+    void runSource(PacketSource& source, std::atomic<uint64_t>& packetCounter);
+    void runChain(ProtocolId protocol, const uint8_t* packet, size_t length, size_t offset, PacketContext& context);
+    void consumeStream(ProtocolId protocol, const uint8_t* packet, size_t length, size_t offset,
+                       PacketContext& context) override;
+};
+
+} // namespace NetworkParser
@@ -1,30 +1,72 @@
 #pragma once
+#include <cstddef>
+#include <cstdint>
 #include <iostream>
 #include <string>
-#include <iostream>
+#include "IPAddress.hpp"
 
 namespace NetworkParser {
 
-struct Stats {
-    size_t packetsIn = 0;
-    size_t packetsOut = 0;
-    size_t bytesIn = 0;
-    size_t bytesOut = 0;
-    std::string ip1 = "";
-    std::string ip2 = "";
+// Integer protocol identifiers handed out by ProtocolRegistry. Built-in
+// protocols have fixed ids, dynamically loaded ones are numbered after them.
+using ProtocolId = uint16_t;
+namespace Protocol {
+constexpr ProtocolId None = 0;
+constexpr ProtocolId Ethernet = 1;
+constexpr ProtocolId IP = 2;
+constexpr ProtocolId TCP = 3;
+constexpr ProtocolId UDP = 4;
+constexpr ProtocolId IPv6 = 5;
+constexpr ProtocolId FirstDynamic = 6;
+}
+
+// Per-packet state threaded through the parser chain. It is plain data that
+// each layer fills in and passes on by reference, so walking the chain never
+// allocates. Addresses are host order.
+struct PacketContext {
+    uint64_t packetNumber = 0;  // 1-based position in the capture
+    uint32_t timestampSec = 0;
+    uint32_t timestampUsec = 0;
+
+    uint32_t srcAddress = 0;
+    uint32_t destAddress = 0;
+    uint16_t srcPort = 0;
+    uint16_t destPort = 0;
+    uint8_t ipProtocol = 0;
+    uint8_t tcpFlags = 0;
+    uint32_t tcpSequence = 0;
+    bool hasAddresses = false;  // Set once the IP header validated
+    bool hasPorts = false;      // Set once a TCP or UDP header validated
+
+    // Offsets from the start of the packet, 0 until the layer is reached
+    uint32_t networkOffset = 0;
+    uint32_t transportOffset = 0;
+    uint32_t payloadOffset = 0;
+    uint32_t networkEnd = 0;  // End of the IP datagram, before any link layer padding
+
+    // Kept after the fields above so plugins built before IPv6 still find them
+    uint8_t ipVersion = 0;    // 4 or 6 once the IP header validated
+    IPAddress srcAddress6;    // IPv6 only, srcAddress and destAddress stay 0
+    IPAddress destAddress6;
+    bool ipFragment = false;  // IPv4 fragment, the transport header is only in the reassembled datagram
+
+    uint64_t timestampMicros() const { return static_cast<uint64_t>(timestampSec) * 1000000 + timestampUsec; }
 };
 
 class Parser {
 public:
     virtual ~Parser() = default;
 
-    // Pure virtual function to parse the packet
-    virtual Stats parsePacket(const uint8_t* packet, size_t length, size_t offset, Stats ip_add_stats) = 0;
+    // Pure virtual function to parse the packet, offset is where this layer starts
+    virtual void parsePacket(const uint8_t* packet, size_t length, size_t offset, PacketContext& context) = 0;
 
     // Function to get the offset for the next parser
     virtual size_t getOffset() const { return 0; }
 
     // Function to determine the next parser
     virtual std::string nextParser() const { return ""; }
+
+    // Integer form of nextParser used by the dispatch loop
+    virtual ProtocolId nextProtocol() const { return Protocol::None; }
 };
 } // namespace NetworkParser
\ No newline at end of file
@@ -1,63 +1,192 @@
 #include "ParserFactory.hpp"
-#include <dlfcn.h>
+#include <algorithm>
+#include <cstdint>
+#include <mutex>
+#include <new>
 
 namespace NetworkParser {
 
-ParserFactory::ParserFactory(const std::unordered_map<std::string, std::string>& map) 
-    : libraryMapping(map) {}
+static std::mutex pluginMutex;
 
-std::unique_ptr<Parser> ParserFactory::createParser(const std::string& identifier) {
-    // Check built-in parsers first
-    if (identifier == "Ethernet") return std::make_unique<EthernetParser>();
-    if (identifier == "IP") return std::make_unique<IPParser>();
-    if (identifier == "TCP") return std::make_unique<TCPParser>();
-    if (identifier == "UDP") return std::make_unique<UDPParser>();
+// Forwards to a dynamically loaded parser. With serialize set, every call is
+// made while holding the plugin lock.
+class PluginParser : public Parser {
+public:
+    PluginParser(Parser* parser, const ProtocolRegistry& registry, bool serialize)
+        : parser(parser), registry(registry), serialize(serialize) {}
+    ~PluginParser() override {
+        std::unique_lock<std::mutex> lock(pluginMutex, std::defer_lock);
+        if (serialize) lock.lock();
+        parser.reset();
+    }
 
-    // Handle dynamic protocols
-    return loadParserDynamically(identifier);
-}
+    void parsePacket(const uint8_t* packet, size_t length, size_t offset, PacketContext& context) override {
+        std::unique_lock<std::mutex> lock(pluginMutex, std::defer_lock);
+        if (serialize) lock.lock();
+        parser->parsePacket(packet, length, offset, context);
+    }
+    size_t getOffset() const override { return parser->getOffset(); }
+    std::string nextParser() const override { return parser->nextParser(); }
+
+    // Plugins still name their successor, which is rare enough to resolve by name
+    ProtocolId nextProtocol() const override {
+        std::string next = parser->nextParser();
+        return next.empty() ? Protocol::None : registry.find(next);
+    }
+
+private:
+    std::unique_ptr<Parser> parser;
+    const ProtocolRegistry& registry;
+    bool serialize;
+};
+
+// Queues payloads for a plugin built against PluginABI.h and hands them over
+// a batch at a time. The payload bytes are copied into the worker's batch
+// arena, since the packet they came from may be recycled before the batch
+// is full. The arena is reset once every plugin has been flushed.
+class BatchPluginParser : public Parser {
+public:
+    static constexpr size_t kBatchPackets = 64;
+
+    BatchPluginParser(const NPPlugin& plugin, void* state, bool serialize, Arena& arena, const NPAllocator& scratch)
+        : plugin(plugin), state(state), serialize(serialize), arena(arena), scratch(scratch) {
+        pending.reserve(kBatchPackets);
+    }
+    ~BatchPluginParser() override {
+        flush();
+        std::unique_lock<std::mutex> lock(pluginMutex, std::defer_lock);
+        if (serialize) lock.lock();
+        plugin.destroyState(state);
+    }
+
+    void parsePacket(const uint8_t* packet, size_t length, size_t offset, PacketContext& context) override {
+        size_t end = context.networkEnd ? std::min<size_t>(length, context.networkEnd) : length;
+        size_t payloadLength = (offset < end) ? end - offset : 0;
+
+        NPPacket& queued = pending.emplace_back();
+        queued.payload = arena.copy(packet + offset, payloadLength);
+        queued.payloadLength = static_cast<uint32_t>(payloadLength);
+        queued.tcpSequence = context.tcpSequence;
+        queued.packetNumber = context.packetNumber;
+        queued.timestampMicros = context.timestampMicros();
+        queued.srcAddress = context.srcAddress;
+        queued.destAddress = context.destAddress;
+        queued.srcPort = context.srcPort;
+        queued.destPort = context.destPort;
+        queued.ipProtocol = context.ipProtocol;
+        queued.tcpFlags = context.tcpFlags;
+        queued.ipVersion = context.ipVersion;
+        queued.reserved = 0;
+        context.srcAddress6.toBytes(queued.srcAddress6);
+        context.destAddress6.toBytes(queued.destAddress6);
+
+        if (pending.size() == kBatchPackets) flush();
+    }
+
+    void flush() {
+        if (pending.empty()) return;
+
+        std::unique_lock<std::mutex> lock(pluginMutex, std::defer_lock);
+        if (serialize) lock.lock();
+        plugin.parseBatch(state, pending.data(), pending.size(), &scratch);
+        if (lock.owns_lock()) lock.unlock();
+
+        pending.clear();
+    }
+
+    void* pluginState() const { return state; }
+
+    // Plugins see application data only, nothing is chained after them
+    size_t getOffset() const override { return 0; }
+    std::string nextParser() const override { return ""; }
+    ProtocolId nextProtocol() const override { return Protocol::None; }
 
-std::unique_ptr<Parser> ParserFactory::loadParserDynamically(const std::string& identifier) {
-    auto libIt = libraryMapping.find(identifier);
-    if (libIt == libraryMapping.end()) {
-        std::cerr << "No library mapping found for protocol: " << identifier << "\n";
+private:
+    const NPPlugin& plugin;
+    void* state;
+    bool serialize;
+    Arena& arena;
+    const NPAllocator& scratch;
+    std::vector<NPPacket> pending;
+};
+
+// Keeps the NPAllocator contract: a bad alignment, a size the arena can't
+// add up without overflowing, or running out of memory all give NULL, as an
+// exception can't unwind through the plugin
+static void* allocateScratch(void* context, size_t size, size_t alignment) {
+    if (!alignment || (alignment & (alignment - 1))) return nullptr;
+    if (alignment > SIZE_MAX / 4 || size > SIZE_MAX / 4) return nullptr;
+    try {
+        return static_cast<Arena*>(context)->allocate(size, alignment);
+    } catch (const std::bad_alloc&) {
         return nullptr;
     }
+}
+
+ParserFactory::ParserFactory(const ProtocolRegistry& registry, StatsTables& tables, bool serializePlugins)
+    : registry(registry), serializePlugins(serializePlugins) {
+    scratch.context = &arena;
+    scratch.allocate = allocateScratch;
+    parsers.resize(registry.size());
+    unavailable.resize(registry.size(), false);
+
+    // Built-in parsers
+    parsers[Protocol::Ethernet] = std::make_unique<EthernetParser>();
+    parsers[Protocol::IP] = std::make_unique<IPParser>(tables);
+    parsers[Protocol::IPv6] = std::make_unique<IPv6Parser>(tables);
+    parsers[Protocol::TCP] = std::make_unique<TCPParser>(tables, registry);
+    parsers[Protocol::UDP] = std::make_unique<UDPParser>(tables, registry);
+}
+
+Parser* ParserFactory::createDynamicParser(ProtocolId protocol) {
+    if (protocol >= parsers.size() || unavailable[protocol]) return nullptr;
 
-    // Check if already loaded
-    auto handleIt = loadedLibraries.find(identifier);
-    if (handleIt != loadedLibraries.end()) {
-        void* handle = handleIt->second;
-        using CreateFunc = Parser* (*)();
-        CreateFunc create = (CreateFunc)dlsym(handle, "createNewParser");
-        if (!create) {
-            std::cerr << "Failed to find create function for " << identifier 
-                     << ": " << dlerror() << "\n";
+    if (const NPPlugin* plugin = registry.plugin(protocol)) {
+        bool serialize = serializePlugins && !(plugin->capabilities & NP_PLUGIN_THREAD_STATE);
+        std::unique_lock<std::mutex> lock(pluginMutex, std::defer_lock);
+        if (serialize) lock.lock();
+        void* state = plugin->createState(registry.nameOf(protocol).c_str());
+        if (lock.owns_lock()) lock.unlock();
+
+        if (!state) {
+            unavailable[protocol] = true;
             return nullptr;
         }
-        return std::unique_ptr<Parser>(create());
+        parsers[protocol] = std::make_unique<BatchPluginParser>(*plugin, state, serialize, arena, scratch);
+        batchProtocols.push_back(protocol);
+        return parsers[protocol].get();
     }
 
-    // Load new library
-    void* handle = dlopen(libIt->second.c_str(), RTLD_LAZY | RTLD_GLOBAL);
-    if (!handle) {
-        std::cerr << "Failed to load library for " << identifier 
-                 << ": " << dlerror() << "\n";
+    ProtocolRegistry::CreateFunc create = registry.createFunction(protocol);
+    if (!create) {
+        // The library failed to load, which was reported once at startup
+        unavailable[protocol] = true;
         return nullptr;
     }
 
-    loadedLibraries[identifier] = handle;
-    using CreateFunc = Parser* (*)();
-    CreateFunc create = (CreateFunc)dlsym(handle, "createNewParser");
-    
-    if (!create) {
-        std::cerr << "Failed to find create function for " << identifier 
-                 << ": " << dlerror() << "\n";
-        dlclose(handle);
+    std::unique_lock<std::mutex> lock(pluginMutex, std::defer_lock);
+    if (serializePlugins) lock.lock();
+    Parser* parser = create();
+    if (lock.owns_lock()) lock.unlock();
+
+    if (!parser) {
+        unavailable[protocol] = true;
         return nullptr;
     }
+    parsers[protocol] = std::make_unique<PluginParser>(parser, registry, serializePlugins);
+    return parsers[protocol].get();
+}
+
+void ParserFactory::flushPlugins() {
+    for (ProtocolId protocol : batchProtocols) {
+        static_cast<BatchPluginParser*>(parsers[protocol].get())->flush();
+    }
+    arena.reset();
+}
 
-    return std::unique_ptr<Parser>(create());
+void* ParserFactory::pluginState(ProtocolId protocol) const {
+    if (std::find(batchProtocols.begin(), batchProtocols.end(), protocol) == batchProtocols.end()) return nullptr;
+    return static_cast<const BatchPluginParser*>(parsers[protocol].get())->pluginState();
 }
 
-} // namespace NetworkParser
\ No newline at end of file
+} // namespace NetworkParser
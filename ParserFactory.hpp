@@ -3,27 +3,55 @@
 #include <iostream>
 #include <memory>
 #include <string>
-#include <unordered_map>
+#include <vector>
+#include "Arena.hpp"
 #include "Parser.hpp"
 #include "Ethernet.hpp"
 #include "IPParser.hpp"
+#include "IPv6Parser.hpp"
 #include "TCPParser.hpp"
 #include "UDPParser.hpp"
+#include "ProtocolRegistry.hpp"
+#include "StatsTables.hpp"
 
 
 
 namespace NetworkParser {
 
+// Owns one long-lived parser instance per protocol for a single worker.
+// Built-in parsers record into tables. With serializePlugins set, calls into
+// dynamically loaded parsers are made under a process-wide lock, since plugins
+// keep their statistics in globals shared by every worker thread. Plugins
+// built against PluginABI.h get a state of their own per worker instead and
+// skip the lock if they declare NP_PLUGIN_THREAD_STATE.
 class ParserFactory {
 public:
-    explicit ParserFactory(const std::unordered_map<std::string, std::string>& map);
-    std::unique_ptr<Parser> createParser(const std::string& identifier);
+    ParserFactory(const ProtocolRegistry& registry, StatsTables& tables, bool serializePlugins = false);
+
+    // Parser for the protocol, nullptr if it has no parser available
+    Parser* getParser(ProtocolId protocol) {
+        if (protocol < parsers.size() && parsers[protocol]) return parsers[protocol].get();
+        return createDynamicParser(protocol);
+    }
+
+    // Hand packets still queued for batch plugins over to them and free the
+    // batch arena. Payloads are copied into it when queued, so the caller may
+    // reuse packet memory at any time.
+    void flushPlugins();
+
+    // This worker's state for a batch plugin protocol, nullptr if it never saw one
+    void* pluginState(ProtocolId protocol) const;
 
 private:
-    std::unordered_map<std::string, std::string> libraryMapping;
-    std::unordered_map<std::string, void*> loadedLibraries;
-    
-    std::unique_ptr<Parser> loadParserDynamically(const std::string& identifier);
+    const ProtocolRegistry& registry;
+    bool serializePlugins;
+    Arena arena;                                   // Payloads and plugin scratch until the next flushPlugins,
+    NPAllocator scratch;                           // handed to plugins as this. Both outlive the parsers.
+    std::vector<std::unique_ptr<Parser>> parsers;  // Indexed by ProtocolId
+    std::vector<ProtocolId> batchProtocols;        // Those served by a BatchPluginParser
+    std::vector<bool> unavailable;                 // Dynamic protocols whose library failed to load
+
+    Parser* createDynamicParser(ProtocolId protocol);
 };
 
-} // namespace NetworkParser
\ No newline at end of file
+} // namespace NetworkParser
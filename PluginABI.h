@@ -0,0 +1,89 @@
+// C interface for protocol plugin libraries. Everything that crosses the
+// library boundary is plain C, so a plugin doesn't have to be built with the
+// same compiler or standard library as the parser, or in C++ at all.
+//
+// A plugin exports NP_PLUGIN_ENTRY_SYMBOL, which returns a static NPPlugin
+// describing it. Libraries without that symbol are loaded through the older
+// createNewParser and genReport functions.
+#ifndef NETWORK_PARSER_PLUGIN_ABI_H
+#define NETWORK_PARSER_PLUGIN_ABI_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Bumped whenever a struct below changes other than by appending to NPPlugin
+#define NP_PLUGIN_ABI_VERSION 3
+#define NP_PLUGIN_ENTRY_SYMBOL "networkParserPlugin"
+
+// Application data of one TCP segment or UDP datagram with its connection.
+// TCP data arrives in stream order once reassembly is on.
+typedef struct NPPacket {
+    const uint8_t* payload;  // Valid until parseBatch returns
+    uint32_t payloadLength;
+    uint32_t tcpSequence;
+    uint64_t packetNumber;   // 1-based position in the capture
+    uint64_t timestampMicros;
+    uint32_t srcAddress;     // IPv4 only, host byte order
+    uint32_t destAddress;
+    uint16_t srcPort;
+    uint16_t destPort;
+    uint8_t ipProtocol;      // 6 for TCP, 17 for UDP
+    uint8_t tcpFlags;
+    uint8_t ipVersion;       // 4 or 6
+    uint8_t reserved;
+    uint8_t srcAddress6[16]; // IPv6 only, network byte order
+    uint8_t destAddress6[16];
+} NPPacket;
+
+// A port whose traffic goes to the plugin, unless tcp-port-mapping.dat maps it elsewhere
+typedef struct NPPortClaim {
+    uint8_t ipProtocol;  // 6 for TCP, 17 for UDP
+    uint8_t reserved;
+    uint16_t port;
+} NPPortClaim;
+
+// Scratch memory for a batch. It stays valid until parseBatch returns, and is
+// reclaimed all at once, with the batch's payloads, when the worker next resets
+// its batch arena. A plugin uses it for whatever it doesn't keep instead of
+// malloc, and keeps no pointers into it once parseBatch returns.
+typedef struct NPAllocator {
+    void* context;
+    void* (*allocate)(void* context, size_t size, size_t alignment);  // Alignment a power of two, NULL if out of memory
+} NPAllocator;
+
+// Capability bits
+#define NP_PLUGIN_THREAD_STATE 0x1  // States share nothing, so each worker thread calls its own without a lock
+
+typedef struct NPPlugin {
+    uint32_t abiVersion;  // NP_PLUGIN_ABI_VERSION the plugin was built against
+    uint32_t structSize;  // sizeof(NPPlugin) as the plugin saw it, fields past it are absent
+    uint32_t capabilities;
+    const NPPortClaim* ports;
+    size_t portCount;
+
+    // One state per worker thread and protocol the library is mapped to
+    void* (*createState)(const char* protocol);
+    void (*destroyState)(void* state);
+
+    // Packets in capture order, in batches of up to a few dozen. Payloads are
+    // held in the same scratch memory the plugin is given.
+    void (*parseBatch)(void* state, const NPPacket* packets, size_t count, const NPAllocator* scratch);
+
+    // Called once at the end with every worker's state for the protocol,
+    // which may be none. Writes the plugin's reports, nonzero on failure.
+    int (*report)(const char* protocol, void* const* states, size_t stateCount);
+} NPPlugin;
+
+// The host passes the version it was built with, a plugin that can't serve
+// it returns NULL
+typedef const NPPlugin* (*NPPluginEntry)(uint32_t hostAbiVersion);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
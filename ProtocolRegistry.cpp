@@ -0,0 +1,162 @@
+#include "ProtocolRegistry.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <dlfcn.h>
+#include <netinet/in.h>
+
+namespace NetworkParser {
+
+ProtocolRegistry::ProtocolRegistry(const std::unordered_map<std::string, std::string>& libraryMapping) {
+    for (const char* name : {"None", "Ethernet", "IP", "TCP", "UDP", "IPv6"}) {
+        registerProtocol(name);
+    }
+
+    // Number the dynamic protocols in name order so ids are stable between runs
+    std::vector<std::string> dynamicNames;
+    for (const auto& [protocol, libPath] : libraryMapping) {
+        dynamicNames.push_back(protocol);
+    }
+    std::sort(dynamicNames.begin(), dynamicNames.end());
+
+    for (const std::string& protocol : dynamicNames) {
+        ProtocolId id = registerProtocol(protocol);
+        const std::string& libPath = libraryMapping.at(protocol);
+
+        void* handle = dlopen(libPath.c_str(), RTLD_LAZY | RTLD_GLOBAL);
+        if (!handle) {
+            std::cerr << "Failed to load library for " << protocol << ": " << dlerror() << "\n";
+            continue;
+        }
+        libraryHandles[id] = handle;
+
+        NPPluginEntry entry = (NPPluginEntry)dlsym(handle, NP_PLUGIN_ENTRY_SYMBOL);
+        if (entry) {
+            if (!loadPlugin(id, entry(NP_PLUGIN_ABI_VERSION))) {
+                dlclose(handle);
+                libraryHandles[id] = nullptr;
+            }
+            continue;
+        }
+
+        reportFunctions[id] = (ReportFunc)dlsym(handle, "genReport");
+        CreateFunc create = (CreateFunc)dlsym(handle, "createNewParser");
+        if (!create) {
+            std::cerr << "Failed to find create function for " << protocol
+                      << ": " << dlerror() << "\n";
+            continue;
+        }
+        createFunctions[id] = create;
+    }
+
+    // DNS over UDP used to be hard coded in UDPParser
+    mapUDPPort(53, "DNS");
+}
+
+ProtocolRegistry::~ProtocolRegistry() {
+    for (void* handle : libraryHandles) {
+        if (handle) dlclose(handle);
+    }
+}
+
+ProtocolId ProtocolRegistry::registerProtocol(const std::string& name) {
+    auto it = ids.find(name);
+    if (it != ids.end()) return it->second;
+
+    ProtocolId id = static_cast<ProtocolId>(names.size());
+    names.push_back(name);
+    ids[name] = id;
+    libraryHandles.push_back(nullptr);
+    plugins.push_back(nullptr);
+    createFunctions.push_back(nullptr);
+    reportFunctions.push_back(nullptr);
+    return id;
+}
+
+bool ProtocolRegistry::loadPlugin(ProtocolId id, const NPPlugin* plugin) {
+    const std::string& protocol = names[id];
+    if (!plugin) {
+        std::cerr << "Plugin for " << protocol << " doesn't support ABI version " << NP_PLUGIN_ABI_VERSION << "\n";
+        return false;
+    }
+    if (plugin->abiVersion != NP_PLUGIN_ABI_VERSION) {
+        std::cerr << "Plugin for " << protocol << " was built for ABI version " << plugin->abiVersion
+                  << ", expected " << NP_PLUGIN_ABI_VERSION << "\n";
+        return false;
+    }
+
+    // Fields appended to NPPlugin since the plugin was built are absent and
+    // read as zero, a plugin built against a longer one has them ignored
+    constexpr size_t kRequiredSize = offsetof(NPPlugin, parseBatch) + sizeof(NPPlugin::parseBatch);
+    if (plugin->structSize < kRequiredSize) {
+        std::cerr << "Plugin for " << protocol << " describes itself in " << plugin->structSize
+                  << " bytes, at least " << kRequiredSize << " are needed\n";
+        return false;
+    }
+    NPPlugin& copy = pluginCopies.emplace_back();
+    std::memset(&copy, 0, sizeof(copy));
+    std::memcpy(&copy, plugin, std::min<size_t>(plugin->structSize, sizeof(copy)));
+    plugin = &copy;
+
+    if (!plugin->createState || !plugin->destroyState || !plugin->parseBatch) {
+        std::cerr << "Plugin for " << protocol << " is missing its state or batch functions\n";
+        return false;
+    }
+    plugins[id] = plugin;
+
+    // Claimed ports rank below every line of tcp-port-mapping.dat
+    for (size_t i = 0; i < plugin->portCount; i++) {
+        const NPPortClaim& claim = plugin->ports[i];
+        std::vector<PortEntry>* ports = (claim.ipProtocol == IPPROTO_TCP)   ? &tcpPorts
+                                        : (claim.ipProtocol == IPPROTO_UDP) ? &udpPorts
+                                                                            : nullptr;
+        if (ports && (*ports)[claim.port].protocol == Protocol::None) {
+            (*ports)[claim.port].protocol = id;
+            (*ports)[claim.port].rank = kClaimRank;
+        }
+    }
+    return true;
+}
+
+ProtocolId ProtocolRegistry::find(const std::string& name) const {
+    auto it = ids.find(name);
+    return (it == ids.end()) ? Protocol::None : it->second;
+}
+
+bool ProtocolRegistry::loadTCPPortMapping(const std::string& filePath) {
+    std::ifstream tcp_mapping_file(filePath);
+    if (!tcp_mapping_file) {
+        std::cerr << "Error opening dat file for mapping" << std::endl;
+        return false;
+    }
+
+    std::string line;
+    uint16_t rank = 0;
+    while (std::getline(tcp_mapping_file, line)) {
+        size_t equalPos = line.find('=');
+        if (equalPos == std::string::npos) {
+            continue;
+        }
+
+        int mappedPort = std::stoi(line.substr(0, equalPos));
+        std::string protocol = line.substr(equalPos + 1);
+        if (mappedPort < 0 || mappedPort > 65535) continue;
+
+        PortEntry& entry = tcpPorts[mappedPort];
+        if (entry.protocol == Protocol::None || entry.rank == kClaimRank) {
+            entry.protocol = registerProtocol(protocol);
+            entry.rank = rank;
+        }
+        rank++;
+    }
+    return true;
+}
+
+void ProtocolRegistry::mapUDPPort(uint16_t port, const std::string& protocol) {
+    udpPorts[port].protocol = registerProtocol(protocol);
+    udpPorts[port].rank = 0;
+}
+
+} // namespace NetworkParser
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Parser.hpp"
+#include "PluginABI.h"
+
+namespace NetworkParser {
+
+// Assigns integer ids to every protocol at startup, loads the protocol
+// libraries once, and resolves the port to protocol mappings into flat lookup
+// tables so per-packet dispatch never compares strings or touches the disk.
+// The same handles serve parsing and reporting.
+class ProtocolRegistry {
+public:
+    using CreateFunc = Parser* (*)();
+    using ReportFunc = void (*)();
+
+    explicit ProtocolRegistry(const std::unordered_map<std::string, std::string>& libraryMapping);
+    ~ProtocolRegistry();
+    ProtocolRegistry(const ProtocolRegistry&) = delete;
+    ProtocolRegistry& operator=(const ProtocolRegistry&) = delete;
+
+    // Id for a protocol name, Protocol::None if it was never registered
+    ProtocolId find(const std::string& name) const;
+    const std::string& nameOf(ProtocolId id) const { return names[id]; }
+    size_t size() const { return names.size(); }
+
+    // Library serving a dynamic protocol, nullptr if it failed to load
+    void* libraryHandle(ProtocolId id) const { return libraryHandles[id]; }
+
+    // Descriptor of a library built against PluginABI.h, nullptr for older ones
+    const NPPlugin* plugin(ProtocolId id) const { return plugins[id]; }
+
+    // Factory and report hook of an older library, nullptr if it lacks them
+    CreateFunc createFunction(ProtocolId id) const { return createFunctions[id]; }
+    ReportFunc reportFunction(ProtocolId id) const { return reportFunctions[id]; }
+
+    // Read "port=PROTOCOL" lines, earlier lines win when both ports are mapped.
+    // Mapped ports take precedence over ports claimed by plugins.
+    bool loadTCPPortMapping(const std::string& filePath);
+    void mapUDPPort(uint16_t port, const std::string& protocol);
+
+    ProtocolId tcpProtocolFor(uint16_t srcPort, uint16_t destPort) const {
+        return lookup(tcpPorts, srcPort, destPort);
+    }
+    ProtocolId udpProtocolFor(uint16_t srcPort, uint16_t destPort) const {
+        return lookup(udpPorts, srcPort, destPort);
+    }
+
+private:
+    struct PortEntry {
+        ProtocolId protocol = Protocol::None;
+        uint16_t rank = UINT16_MAX;  // Position in the mapping file
+    };
+    static constexpr uint16_t kClaimRank = UINT16_MAX - 1;  // Ports claimed by a plugin
+
+    std::vector<std::string> names;
+    std::unordered_map<std::string, ProtocolId> ids;
+    std::vector<void*> libraryHandles;
+    std::vector<const NPPlugin*> plugins;
+    std::deque<NPPlugin> pluginCopies;  // A plugin's NPPlugin with the fields it predates zeroed
+    std::vector<CreateFunc> createFunctions;
+    std::vector<ReportFunc> reportFunctions;
+    std::vector<PortEntry> tcpPorts = std::vector<PortEntry>(65536);
+    std::vector<PortEntry> udpPorts = std::vector<PortEntry>(65536);
+
+    ProtocolId registerProtocol(const std::string& name);
+    bool loadPlugin(ProtocolId id, const NPPlugin* plugin);
+
+    static ProtocolId lookup(const std::vector<PortEntry>& ports, uint16_t srcPort, uint16_t destPort) {
+        const PortEntry& src = ports[srcPort];
+        const PortEntry& dest = ports[destPort];
+        return (dest.rank <= src.rank) ? dest.protocol : src.protocol;
+    }
+};
+
+} // namespace NetworkParser
@@ -0,0 +1,656 @@
+#include "QueryEngine.hpp"
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <iostream>
+#include "FlatHashMap.hpp"
+
+namespace NetworkParser {
+
+namespace {
+
+struct Token {
+    enum Kind { Word, Number, Text, Symbol, End };
+    Kind kind;
+    std::string text;
+};
+
+enum class Aggregate { None, Count, Sum };
+enum class Compare { Equal, NotEqual, Less, LessEqual, Greater, GreaterEqual };
+
+// A select, group or order item as written, before its column is looked up
+struct ItemText {
+    Aggregate aggregate = Aggregate::None;
+    std::string column;  // Empty for COUNT(*)
+};
+
+struct PredicateText {
+    std::string column;
+    Compare op;
+    Token literal;
+};
+
+struct ParsedQuery {
+    bool star = false;
+    std::vector<ItemText> items;
+    std::string table;
+    std::vector<PredicateText> where;
+    std::vector<std::string> groupBy;
+    bool ordered = false;
+    ItemText orderBy;
+    bool descending = false;
+    size_t limit = SIZE_MAX;
+};
+
+// The same with every column resolved against the table
+struct Item {
+    Aggregate aggregate;
+    int column;  // -1 for COUNT(*)
+};
+
+struct Predicate {
+    int column;
+    Compare op;
+    uint64_t value;
+};
+
+using GroupKey = std::array<uint64_t, QueryEngine::kMaxGroupColumns>;
+
+struct GroupKeyHash {
+    size_t operator()(const GroupKey& key) const {
+        uint64_t hash = 0;
+        for (uint64_t part : key) hash = hashMix(hash ^ part);
+        return hash;
+    }
+};
+
+bool equalsIgnoringCase(const std::string& a, const std::string& b) {
+    return a.size() == b.size() &&
+           std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+               return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y));
+           });
+}
+
+bool tokenize(const std::string& query, std::vector<Token>& tokens, std::string& error) {
+    size_t i = 0;
+    while (i < query.size()) {
+        char c = query[i];
+        if (std::isspace(static_cast<unsigned char>(c))) {
+            i++;
+        } else if (std::isalpha(static_cast<unsigned char>(c)) || c == '_') {
+            size_t start = i;
+            while (i < query.size() && (std::isalnum(static_cast<unsigned char>(query[i])) || query[i] == '_')) i++;
+            tokens.push_back({Token::Word, query.substr(start, i - start)});
+        } else if (std::isdigit(static_cast<unsigned char>(c))) {
+            // Dots are kept so addresses and fractional timestamps stay one token
+            size_t start = i;
+            while (i < query.size() && (std::isdigit(static_cast<unsigned char>(query[i])) || query[i] == '.')) i++;
+            tokens.push_back({Token::Number, query.substr(start, i - start)});
+        } else if (c == '\'') {
+            size_t end = query.find('\'', i + 1);
+            if (end == std::string::npos) {
+                error = "unterminated string";
+                return false;
+            }
+            tokens.push_back({Token::Text, query.substr(i + 1, end - i - 1)});
+            i = end + 1;
+        } else if ((c == '<' || c == '>' || c == '!') && i + 1 < query.size() &&
+                   (query[i + 1] == '=' || (c == '<' && query[i + 1] == '>'))) {
+            tokens.push_back({Token::Symbol, query.substr(i, 2)});
+            i += 2;
+        } else if (std::string("*,()=<>;").find(c) != std::string::npos) {
+            tokens.push_back({Token::Symbol, std::string(1, c)});
+            i++;
+        } else {
+            error = std::string("unexpected character '") + c + "'";
+            return false;
+        }
+    }
+    tokens.push_back({Token::End, ""});
+    return true;
+}
+
+// Recursive descent over the token list, one method per clause
+class QueryParser {
+public:
+    QueryParser(const std::vector<Token>& tokens, std::string& error) : tokens(tokens), error(error) {}
+
+    bool parse(ParsedQuery& query) {
+        if (!expectKeyword("SELECT")) return false;
+        if (acceptSymbol("*")) {
+            query.star = true;
+        } else {
+            do {
+                ItemText item;
+                if (!parseItem(item)) return false;
+                query.items.push_back(item);
+            } while (acceptSymbol(","));
+        }
+
+        if (!expectKeyword("FROM") || !expectWord(query.table)) return false;
+
+        if (acceptKeyword("WHERE")) {
+            do {
+                PredicateText predicate;
+                if (!parsePredicate(predicate)) return false;
+                query.where.push_back(predicate);
+            } while (acceptKeyword("AND"));
+        }
+
+        if (acceptKeyword("GROUP")) {
+            if (!expectKeyword("BY")) return false;
+            do {
+                std::string column;
+                if (!expectWord(column)) return false;
+                query.groupBy.push_back(column);
+            } while (acceptSymbol(","));
+        }
+
+        if (acceptKeyword("ORDER")) {
+            if (!expectKeyword("BY") || !parseItem(query.orderBy)) return false;
+            query.ordered = true;
+            if (acceptKeyword("DESC")) query.descending = true;
+            else acceptKeyword("ASC");
+        }
+
+        if (acceptKeyword("LIMIT")) {
+            const Token& limit = peek();
+            if (limit.kind != Token::Number ||
+                std::from_chars(limit.text.data(), limit.text.data() + limit.text.size(), query.limit).ec != std::errc()) {
+                return fail("expected a row count after LIMIT");
+            }
+            position++;
+        }
+
+        acceptSymbol(";");
+        if (peek().kind != Token::End) return fail("unexpected '" + peek().text + "'");
+        return true;
+    }
+
+private:
+    const std::vector<Token>& tokens;
+    std::string& error;
+    size_t position = 0;
+
+    const Token& peek() const { return tokens[position]; }
+
+    bool fail(const std::string& message) {
+        error = message;
+        return false;
+    }
+
+    bool acceptKeyword(const char* keyword) {
+        if (peek().kind != Token::Word || !equalsIgnoringCase(peek().text, keyword)) return false;
+        position++;
+        return true;
+    }
+
+    bool expectKeyword(const char* keyword) {
+        return acceptKeyword(keyword) || fail(std::string("expected ") + keyword);
+    }
+
+    bool acceptSymbol(const char* symbol) {
+        if (peek().kind != Token::Symbol || peek().text != symbol) return false;
+        position++;
+        return true;
+    }
+
+    bool expectSymbol(const char* symbol) {
+        return acceptSymbol(symbol) || fail(std::string("expected '") + symbol + "'");
+    }
+
+    bool expectWord(std::string& word) {
+        if (peek().kind != Token::Word) return fail("expected a name but found '" + peek().text + "'");
+        word = tokens[position++].text;
+        return true;
+    }
+
+    // column, COUNT(*), COUNT(column) or SUM(column)
+    bool parseItem(ItemText& item) {
+        if (peek().kind == Token::Word && tokens[position + 1].text == "(") {
+            if (acceptKeyword("COUNT")) {
+                item.aggregate = Aggregate::Count;
+                acceptSymbol("(");
+                if (acceptSymbol("*")) return expectSymbol(")");
+                return expectWord(item.column) && expectSymbol(")");
+            }
+            if (acceptKeyword("SUM")) {
+                item.aggregate = Aggregate::Sum;
+                acceptSymbol("(");
+                return expectWord(item.column) && expectSymbol(")");
+            }
+            return fail("unknown function " + peek().text);
+        }
+        return expectWord(item.column);
+    }
+
+    bool parsePredicate(PredicateText& predicate) {
+        if (!expectWord(predicate.column)) return false;
+        static const std::pair<const char*, Compare> operators[] = {
+            {"=", Compare::Equal},      {"!=", Compare::NotEqual},    {"<>", Compare::NotEqual},
+            {"<", Compare::Less},       {"<=", Compare::LessEqual},   {">", Compare::Greater},
+            {">=", Compare::GreaterEqual}};
+        bool matched = false;
+        for (const auto& [symbol, op] : operators) {
+            if (acceptSymbol(symbol)) {
+                predicate.op = op;
+                matched = true;
+                break;
+            }
+        }
+        if (!matched) return fail("expected a comparison after " + predicate.column);
+        if (peek().kind != Token::Number && peek().kind != Token::Text) {
+            return fail("expected a number, address or quoted string after " + predicate.column);
+        }
+        predicate.literal = tokens[position++];
+        return true;
+    }
+};
+
+bool parseInteger(const std::string& text, uint64_t& value) {
+    auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+    return result.ec == std::errc() && result.ptr == text.data() + text.size();
+}
+
+// Literal in the units the column is stored in
+bool parseLiteral(const ColumnSpec& column, const Token& literal, uint64_t& value, std::string& error) {
+    if (column.type == ColumnType::Dictionary) {
+        if (literal.kind != Token::Text) {
+            error = column.name + " is compared with a quoted string";
+            return false;
+        }
+        // A value the column never holds matches nothing
+        auto found = std::find(column.dictionary.begin(), column.dictionary.end(), literal.text);
+        value = found - column.dictionary.begin();
+        return true;
+    }
+    if (literal.kind != Token::Number) {
+        error = column.name + " is compared with a number";
+        return false;
+    }
+
+    const std::string& text = literal.text;
+    if (column.type == ColumnType::Address && text.find('.') != std::string::npos) {
+        uint32_t address;
+        if (!parseIPv4(text, address)) {
+            error = "bad address " + text;
+            return false;
+        }
+        value = address;
+        return true;
+    }
+    if (column.type == ColumnType::Timestamp) {
+        // Seconds since the epoch, with an optional fraction
+        size_t dot = text.find('.');
+        uint64_t seconds;
+        std::string fraction = dot == std::string::npos ? "" : text.substr(dot + 1);
+        fraction = (fraction + "000000").substr(0, 6);
+        uint64_t micros;
+        if (!parseInteger(text.substr(0, dot), seconds) || !parseInteger(fraction, micros)) {
+            error = "bad timestamp " + text;
+            return false;
+        }
+        value = seconds * 1000000 + micros;
+        return true;
+    }
+    if (!parseInteger(text, value)) {
+        error = "bad number " + text;
+        return false;
+    }
+    return true;
+}
+
+// Keep the selected rows whose value passes. The row is always written and
+// the count only advances when it passes, so the loop has no branch on the
+// data and compiles to straight line code.
+template <typename Pass>
+size_t narrow(const uint64_t* values, uint32_t* selection, size_t count, Pass pass) {
+    size_t kept = 0;
+    for (size_t i = 0; i < count; i++) {
+        uint32_t row = selection[i];
+        selection[kept] = row;
+        kept += pass(values[row]);
+    }
+    return kept;
+}
+
+size_t applyPredicate(const Predicate& predicate, const uint64_t* values, uint32_t* selection, size_t count) {
+    uint64_t operand = predicate.value;
+    switch (predicate.op) {
+        case Compare::Equal: return narrow(values, selection, count, [=](uint64_t v) { return v == operand; });
+        case Compare::NotEqual: return narrow(values, selection, count, [=](uint64_t v) { return v != operand; });
+        case Compare::Less: return narrow(values, selection, count, [=](uint64_t v) { return v < operand; });
+        case Compare::LessEqual: return narrow(values, selection, count, [=](uint64_t v) { return v <= operand; });
+        case Compare::Greater: return narrow(values, selection, count, [=](uint64_t v) { return v > operand; });
+        case Compare::GreaterEqual: return narrow(values, selection, count, [=](uint64_t v) { return v >= operand; });
+    }
+    return count;
+}
+
+std::string formatValue(const ColumnSpec* column, uint64_t value) {
+    if (!column) return std::to_string(value);
+    switch (column->type) {
+        case ColumnType::Address:
+            return ipv4ToString(static_cast<uint32_t>(value));
+        case ColumnType::Timestamp: {
+            std::string fraction = std::to_string(value % 1000000);
+            return std::to_string(value / 1000000) + "." + std::string(6 - fraction.size(), '0') + fraction;
+        }
+        case ColumnType::Dictionary:
+            return value < column->dictionary.size() ? column->dictionary[value] : "?";
+        default:
+            return std::to_string(value);
+    }
+}
+
+QueryTable makeTable(std::vector<ColumnSpec> columns) {
+    QueryTable table;
+    table.values.resize(columns.size());
+    table.columns = std::move(columns);
+    return table;
+}
+
+void addCounters(QueryTable& table, size_t column, const Counters& counters) {
+    table.values[column].push_back(counters.packetsIn);
+    table.values[column + 1].push_back(counters.packetsOut);
+    table.values[column + 2].push_back(counters.bytesIn);
+    table.values[column + 3].push_back(counters.bytesOut);
+    table.rows++;
+}
+
+QueryTable snapshotPorts(const std::vector<Counters>& portStats) {
+    QueryTable table = makeTable(counterColumns({{"port", ColumnType::UInt16}}));
+    for (size_t port = 0; port < portStats.size(); port++) {
+        if (!portStats[port].packetsIn && !portStats[port].packetsOut) continue;
+        table.values[0].push_back(port);
+        addCounters(table, 1, portStats[port]);
+    }
+    return table;
+}
+
+QueryTable snapshotFlows(const FlowTable& flows) {
+    QueryTable table = makeTable(flowColumns());
+    flows.forEachRecord([&](const FlowRecord& record) {
+        // Address columns hold IPv4 addresses, IPv6 flows are only in the reports
+        if (!record.isIPv4()) return;
+        const FlowEntry& entry = record.entry;
+        uint64_t row[] = {record.clientAddress().ipv4(), record.serverAddress().ipv4(), record.clientPort(), record.serverPort(),
+                          entry.packetsToClient,  entry.packetsToServer,  entry.bytesToClient,  entry.bytesToServer,
+                          static_cast<uint64_t>(entry.state), entry.firstSeen, entry.lastSeen};
+        for (size_t column = 0; column < table.columns.size(); column++) table.values[column].push_back(row[column]);
+        table.rows++;
+    });
+    return table;
+}
+
+QueryTable snapshotSeries(const TimeSeries& series) {
+    QueryTable table = makeTable({{"intervalStart", ColumnType::Timestamp},
+                                  {"packets", ColumnType::UInt64},
+                                  {"bytes", ColumnType::UInt64}});
+    for (const TimeBucket& bucket : series.buckets()) {
+        table.values[0].push_back(bucket.number * series.interval());
+        table.values[1].push_back(bucket.packets);
+        table.values[2].push_back(bucket.bytes);
+        table.rows++;
+    }
+    return table;
+}
+
+} // namespace
+
+int QueryTable::columnIndex(const std::string& name) const {
+    for (size_t i = 0; i < columns.size(); i++) {
+        if (equalsIgnoringCase(columns[i].name, name)) return static_cast<int>(i);
+    }
+    return -1;
+}
+
+const std::vector<std::string>& QueryEngine::tableNames() {
+    static const std::vector<std::string> names = {"ip_stats",  "ip_interactions", "ip_series",
+                                                   "tcp_ports", "tcp_flows",       "tcp_series",
+                                                   "udp_ports", "udp_flows",       "udp_series"};
+    return names;
+}
+
+const QueryTable* QueryEngine::snapshot(const std::string& name) {
+    auto cached = snapshots.find(name);
+    if (cached != snapshots.end()) return &cached->second;
+
+    QueryTable table;
+    if (name == "ip_stats") {
+        table = makeTable(counterColumns({{"ipAddress", ColumnType::Address}}));
+        for (const auto& [address, counters] : sortedByKey(tables.ip.individualStats)) {
+            table.values[0].push_back(address);
+            addCounters(table, 1, counters);
+        }
+    } else if (name == "ip_interactions") {
+        table = makeTable(counterColumns({{"srcIp", ColumnType::Address}, {"destIp", ColumnType::Address}}));
+        for (const auto& [interaction, counters] : sortedByKey(tables.ip.interactionStats)) {
+            table.values[0].push_back(interaction >> 32);
+            table.values[1].push_back(interaction & 0xFFFFFFFF);
+            addCounters(table, 2, counters);
+        }
+    } else if (name == "ip_series") {
+        table = snapshotSeries(tables.ip.timeSeries);
+    } else if (name == "tcp_ports") {
+        table = snapshotPorts(tables.tcp.portStats);
+    } else if (name == "tcp_flows") {
+        table = snapshotFlows(tables.tcp.flows);
+    } else if (name == "tcp_series") {
+        table = snapshotSeries(tables.tcp.timeSeries);
+    } else if (name == "udp_ports") {
+        table = snapshotPorts(tables.udp.portStats);
+    } else if (name == "udp_flows") {
+        table = snapshotFlows(tables.udp.flows);
+    } else if (name == "udp_series") {
+        table = snapshotSeries(tables.udp.timeSeries);
+    } else {
+        return nullptr;
+    }
+    return &snapshots.emplace(name, std::move(table)).first->second;
+}
+
+bool QueryEngine::run(const std::string& query, std::ostream& out) {
+    auto startTime = std::chrono::steady_clock::now();
+    std::string error;
+    auto failed = [&]() {
+        std::cerr << "Query error: " << error << "\n  in: " << query << "\n";
+        return false;
+    };
+
+    std::vector<Token> tokens;
+    ParsedQuery parsed;
+    if (!tokenize(query, tokens, error)) return failed();
+    QueryParser parser(tokens, error);
+    if (!parser.parse(parsed)) return failed();
+
+    const QueryTable* table = snapshot(parsed.table);
+    if (!table) {
+        error = "unknown table " + parsed.table + ", expected one of";
+        for (const std::string& name : tableNames()) error += " " + name;
+        return failed();
+    }
+
+    // Resolve every column against the table
+    auto resolve = [&](const std::string& name, int& column) {
+        column = table->columnIndex(name);
+        if (column < 0) error = "no column " + name + " in " + parsed.table;
+        return column >= 0;
+    };
+    auto resolveItem = [&](const ItemText& text, Item& item) {
+        item.aggregate = text.aggregate;
+        item.column = -1;
+        return text.column.empty() || resolve(text.column, item.column);
+    };
+
+    std::vector<Item> items;
+    if (parsed.star) {
+        for (size_t column = 0; column < table->columns.size(); column++) {
+            items.push_back({Aggregate::None, static_cast<int>(column)});
+        }
+    }
+    for (const ItemText& text : parsed.items) {
+        Item item;
+        if (!resolveItem(text, item)) return failed();
+        items.push_back(item);
+    }
+
+    std::vector<Predicate> predicates;
+    for (const PredicateText& text : parsed.where) {
+        Predicate predicate{0, text.op, 0};
+        if (!resolve(text.column, predicate.column) ||
+            !parseLiteral(table->columns[predicate.column], text.literal, predicate.value, error)) {
+            return failed();
+        }
+        predicates.push_back(predicate);
+    }
+
+    std::vector<int> groupBy;
+    for (const std::string& name : parsed.groupBy) {
+        int column;
+        if (!resolve(name, column)) return failed();
+        groupBy.push_back(column);
+    }
+    if (groupBy.size() > kMaxGroupColumns) {
+        error = "at most " + std::to_string(kMaxGroupColumns) + " GROUP BY columns";
+        return failed();
+    }
+
+    bool aggregated = !groupBy.empty();
+    for (const Item& item : items) aggregated |= item.aggregate != Aggregate::None;
+    if (aggregated) {
+        for (const Item& item : items) {
+            if (item.aggregate == Aggregate::None &&
+                std::find(groupBy.begin(), groupBy.end(), item.column) == groupBy.end()) {
+                error = table->columns[item.column].name + " must be in GROUP BY or inside an aggregate";
+                return failed();
+            }
+        }
+    }
+
+    // Results are ordered by an output column, or by any table column when not aggregating
+    int orderItem = -1;
+    int orderColumn = -1;
+    if (parsed.ordered) {
+        Item order;
+        if (!resolveItem(parsed.orderBy, order)) return failed();
+        for (size_t i = 0; i < items.size(); i++) {
+            if (items[i].aggregate == order.aggregate && items[i].column == order.column) orderItem = static_cast<int>(i);
+        }
+        if (!aggregated && order.aggregate == Aggregate::None) {
+            orderColumn = order.column;
+        } else if (orderItem < 0) {
+            error = "ORDER BY must name a selected column or aggregate";
+            return failed();
+        }
+    }
+
+    // Scan the table a block at a time, narrowing the selection by each filter
+    std::vector<uint32_t> matched;                   // Rows, when not aggregating
+    std::vector<uint64_t> groupValues;               // items.size() values per group
+    FlatHashMap<GroupKey, size_t, GroupKeyHash> groups;  // Key to group number + 1
+    if (aggregated && groupBy.empty()) groupValues.assign(items.size(), 0);
+
+    std::vector<uint32_t> selection(kBlockRows);
+    for (size_t start = 0; start < table->rows; start += kBlockRows) {
+        size_t count = std::min(kBlockRows, table->rows - start);
+        for (size_t i = 0; i < count; i++) selection[i] = static_cast<uint32_t>(start + i);
+        for (const Predicate& predicate : predicates) {
+            count = applyPredicate(predicate, table->values[predicate.column].data(), selection.data(), count);
+        }
+
+        if (!aggregated) {
+            matched.insert(matched.end(), selection.begin(), selection.begin() + count);
+        } else if (groupBy.empty()) {
+            // One group, each aggregate runs over the whole selection in turn
+            for (size_t i = 0; i < items.size(); i++) {
+                if (items[i].aggregate == Aggregate::Count || items[i].column < 0) {
+                    groupValues[i] += count;
+                    continue;
+                }
+                const uint64_t* values = table->values[items[i].column].data();
+                uint64_t sum = 0;
+                for (size_t s = 0; s < count; s++) sum += values[selection[s]];
+                groupValues[i] += sum;
+            }
+        } else {
+            for (size_t s = 0; s < count; s++) {
+                uint32_t row = selection[s];
+                GroupKey key{};
+                for (size_t g = 0; g < groupBy.size(); g++) key[g] = table->values[groupBy[g]][row];
+                size_t& slot = groups[key];
+                if (!slot) {
+                    slot = groupValues.size() / items.size() + 1;
+                    groupValues.resize(groupValues.size() + items.size(), 0);
+                }
+                uint64_t* values = &groupValues[(slot - 1) * items.size()];
+                for (size_t i = 0; i < items.size(); i++) {
+                    switch (items[i].aggregate) {
+                        case Aggregate::None: values[i] = table->values[items[i].column][row]; break;
+                        case Aggregate::Count: values[i]++; break;
+                        case Aggregate::Sum: values[i] += table->values[items[i].column][row]; break;
+                    }
+                }
+            }
+        }
+    }
+
+    // Every result row as one value per item
+    size_t resultRows = aggregated ? (items.empty() ? 0 : groupValues.size() / items.size()) : matched.size();
+    auto cell = [&](size_t row, size_t item) {
+        if (aggregated) return groupValues[row * items.size() + item];
+        return table->values[items[item].column][matched[row]];
+    };
+
+    // Rank rows by the order key, ties keep scan order, and only the first LIMIT are sorted
+    std::vector<uint32_t> order(resultRows);
+    for (size_t i = 0; i < resultRows; i++) order[i] = static_cast<uint32_t>(i);
+    size_t shown = std::min(parsed.limit, resultRows);
+    if (parsed.ordered) {
+        auto key = [&](uint32_t row) {
+            return orderItem >= 0 ? cell(row, orderItem) : table->values[orderColumn][matched[row]];
+        };
+        auto before = [&](uint32_t a, uint32_t b) {
+            uint64_t keyA = key(a);
+            uint64_t keyB = key(b);
+            if (keyA != keyB) return parsed.descending ? keyA > keyB : keyA < keyB;
+            return a < b;
+        };
+        std::partial_sort(order.begin(), order.begin() + shown, order.end(), before);
+    }
+
+    // Lay the result out as an aligned text table
+    std::vector<std::vector<std::string>> text(1);
+    for (const Item& item : items) {
+        std::string name = item.column >= 0 ? table->columns[item.column].name : "*";
+        if (item.aggregate == Aggregate::Count) name = "COUNT(" + name + ")";
+        if (item.aggregate == Aggregate::Sum) name = "SUM(" + name + ")";
+        text[0].push_back(name);
+    }
+    for (size_t r = 0; r < shown; r++) {
+        text.emplace_back();
+        for (size_t i = 0; i < items.size(); i++) {
+            const ColumnSpec* column = items[i].aggregate == Aggregate::None ? &table->columns[items[i].column] : nullptr;
+            text.back().push_back(formatValue(column, cell(order[r], i)));
+        }
+    }
+    std::vector<size_t> widths(items.size(), 0);
+    for (const auto& row : text) {
+        for (size_t i = 0; i < row.size(); i++) widths[i] = std::max(widths[i], row[i].size());
+    }
+    for (const auto& row : text) {
+        for (size_t i = 0; i < row.size(); i++) {
+            out << row[i];
+            if (i + 1 < row.size()) out << std::string(widths[i] - row[i].size() + 2, ' ');
+        }
+        out << "\n";
+    }
+
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - startTime;
+    out << "(" << shown << (shown == 1 ? " row" : " rows") << " in " << elapsed.count() << " ms)\n";
+    return true;
+}
+
+} // namespace NetworkParser
@@ -0,0 +1,54 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "ArrowWriter.hpp"
+#include "StatsTables.hpp"
+
+namespace NetworkParser {
+
+// Column major copy of one statistics table. Every value is widened to 64
+// bits, addresses and ports included, so one scan loop serves all columns.
+struct QueryTable {
+    std::vector<ColumnSpec> columns;
+    std::vector<std::vector<uint64_t>> values;  // values[column][row]
+    size_t rows = 0;
+
+    // Index of the column, ignoring case, or -1
+    int columnIndex(const std::string& name) const;
+};
+
+// Answers small SQL style queries straight from the merged statistics
+// tables, without writing them out first:
+//
+//   SELECT ip1, SUM(bytesIn), COUNT(*) FROM tcp_flows
+//   WHERE state = 'ESTABLISHED' AND destPort = 443
+//   GROUP BY ip1 ORDER BY SUM(bytesIn) DESC LIMIT 10
+//
+// A table is copied into a columnar snapshot the first time a query names
+// it. Filters run over blocks of kBlockRows rows a column at a time,
+// narrowing a selection vector, before rows are grouped or ranked.
+class QueryEngine {
+public:
+    static constexpr size_t kBlockRows = 1024;
+    static constexpr size_t kMaxGroupColumns = 4;
+
+    explicit QueryEngine(const StatsTables& tables) : tables(tables) {}
+
+    // Run one query and print its result, false with an error if it doesn't parse
+    bool run(const std::string& query, std::ostream& out);
+
+    // Names accepted after FROM
+    static const std::vector<std::string>& tableNames();
+
+private:
+    const StatsTables& tables;
+    std::map<std::string, QueryTable> snapshots;
+
+    const QueryTable* snapshot(const std::string& name);
+};
+
+} // namespace NetworkParser
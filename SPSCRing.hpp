@@ -0,0 +1,59 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+namespace NetworkParser {
+
+// Lock-free single producer / single consumer ring of fixed capacity
+template <typename T>
+class SPSCRing {
+public:
+    explicit SPSCRing(size_t minCapacity) {
+        size_t capacity = 2;
+        while (capacity < minCapacity) capacity <<= 1;
+        slots.resize(capacity);
+        mask = capacity - 1;
+    }
+
+    SPSCRing(const SPSCRing&) = delete;
+    SPSCRing& operator=(const SPSCRing&) = delete;
+
+    // Producer side, returns false when the ring is full
+    bool tryPush(const T& item) {
+        size_t tail = tailIndex.load(std::memory_order_relaxed);
+        if (tail - cachedHead > mask) {
+            cachedHead = headIndex.load(std::memory_order_acquire);
+            if (tail - cachedHead > mask) return false;
+        }
+        slots[tail & mask] = item;
+        tailIndex.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side, returns false when the ring is empty
+    bool tryPop(T& item) {
+        size_t head = headIndex.load(std::memory_order_relaxed);
+        if (head == cachedTail) {
+            cachedTail = tailIndex.load(std::memory_order_acquire);
+            if (head == cachedTail) return false;
+        }
+        item = slots[head & mask];
+        headIndex.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t capacity() const { return mask + 1; }
+
+private:
+    std::vector<T> slots;
+    size_t mask;
+
+    // Producer and consumer indices live on separate cache lines
+    alignas(64) std::atomic<size_t> tailIndex{0};
+    size_t cachedHead = 0;
+    alignas(64) std::atomic<size_t> headIndex{0};
+    size_t cachedTail = 0;
+};
+
+} // namespace NetworkParser
@@ -0,0 +1,105 @@
+#include "Sketches.hpp"
+#include <cmath>
+
+namespace NetworkParser {
+
+void HyperLogLog::merge(const HyperLogLog& other) {
+    for (size_t i = 0; i < registers.size(); i++) {
+        registers[i] = std::max(registers[i], other.registers[i]);
+    }
+}
+
+uint64_t HyperLogLog::estimate() const {
+    double buckets = static_cast<double>(registers.size());
+    double sum = 0;
+    size_t empty = 0;
+    for (uint8_t rank : registers) {
+        sum += std::ldexp(1.0, -rank);
+        if (rank == 0) empty++;
+    }
+    double alpha = 0.7213 / (1 + 1.079 / buckets);
+    double estimate = alpha * buckets * buckets / sum;
+
+    // The raw estimate is biased for small counts, linear counting is not
+    if (estimate <= 2.5 * buckets && empty) estimate = buckets * std::log(buckets / empty);
+    return static_cast<uint64_t>(estimate + 0.5);
+}
+
+Counters CountMinSketch::estimate(uint64_t key) const {
+    uint64_t hash = hashMix(key);
+    uint64_t step = hashMix(hash) | 1;
+    Counters result;
+    for (size_t row = 0; row < kDepth; row++, hash += step) {
+        const Counters& cell = cells[row * (mask + 1) + (hash & mask)];
+        result = row ? smaller(result, cell) : cell;
+    }
+    return result;
+}
+
+void CountMinSketch::merge(const CountMinSketch& other) {
+    for (size_t i = 0; i < cells.size(); i++) {
+        cells[i].add(other.cells[i]);
+    }
+}
+
+IPSketches::IPSketches(size_t topK)
+    : topK(topK),
+      addressPackets(topK * kCandidatesPerRow),
+      addressBytes(topK * kCandidatesPerRow),
+      pairPackets(topK * kCandidatesPerRow),
+      pairBytes(topK * kCandidatesPerRow) {}
+
+void IPSketches::add(uint32_t source, uint32_t destination, uint64_t payloadBytes, uint64_t datagramBytes) {
+    Counters sent;
+    sent.packetsOut = 1;
+    sent.bytesOut = payloadBytes;
+    Counters received;
+    received.packetsIn = 1;
+    received.bytesIn = payloadBytes;
+    Counters sourceBound = addressCounters.add(source, sent);
+    Counters destinationBound = addressCounters.add(destination, received);
+    addressPackets.add(source, 1, sourceBound.packetsIn + sourceBound.packetsOut);
+    addressPackets.add(destination, 1, destinationBound.packetsIn + destinationBound.packetsOut);
+    addressBytes.add(source, payloadBytes, sourceBound.bytesIn + sourceBound.bytesOut);
+    addressBytes.add(destination, payloadBytes, destinationBound.bytesIn + destinationBound.bytesOut);
+    addresses.add(source);
+    addresses.add(destination);
+
+    uint64_t pair = addressPairKey(source, destination);
+    Counters interaction;
+    interaction.packetsOut = 1;
+    interaction.bytesOut = datagramBytes;
+    Counters pairBound = pairCounters.add(pair, interaction);
+    pairPackets.add(pair, 1, pairBound.packetsOut);
+    pairBytes.add(pair, datagramBytes, pairBound.bytesOut);
+    pairs.add(pair);
+}
+
+void IPSketches::merge(const IPSketches& other) {
+    addressPackets.merge(other.addressPackets);
+    addressBytes.merge(other.addressBytes);
+    pairPackets.merge(other.pairPackets);
+    pairBytes.merge(other.pairBytes);
+    addressCounters.merge(other.addressCounters);
+    pairCounters.merge(other.pairCounters);
+    addresses.merge(other.addresses);
+    pairs.merge(other.pairs);
+}
+
+void IPSketches::fill(FlatHashMap<uint32_t, Counters>& individualStats,
+                      FlatHashMap<uint64_t, Counters>& interactionStats) const {
+    individualStats.clear();
+    for (const SpaceSaving<uint32_t>* heavy : {&addressPackets, &addressBytes}) {
+        for (const auto& entry : heavy->top(topK)) {
+            individualStats[entry.key] = addressCounters.estimate(entry.key);
+        }
+    }
+    interactionStats.clear();
+    for (const SpaceSaving<uint64_t>* heavy : {&pairPackets, &pairBytes}) {
+        for (const auto& entry : heavy->top(topK)) {
+            interactionStats[entry.key] = pairCounters.estimate(entry.key);
+        }
+    }
+}
+
+} // namespace NetworkParser
@@ -0,0 +1,244 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "FlatHashMap.hpp"
+#include "StatsTables.hpp"
+
+namespace NetworkParser {
+
+// Approximate distinct count in fixed memory. One byte register per bucket,
+// 2^kPrecision buckets, relative standard error about 1.04 / sqrt(buckets),
+// so 0.8% for 16 KiB. Small counts fall back to linear counting and are
+// close to exact. Registers merge by taking the larger.
+class HyperLogLog {
+public:
+    static constexpr unsigned kPrecision = 14;
+
+    HyperLogLog() : registers(size_t(1) << kPrecision) {}
+
+    void add(uint64_t key) {
+        uint64_t hash = hashMix(key + 0x9e3779b97f4a7c15ull);
+        size_t bucket = hash >> (64 - kPrecision);
+        uint64_t rest = hash << kPrecision;
+        uint8_t rank = rest ? __builtin_clzll(rest) + 1 : 64 - kPrecision + 1;
+        if (rank > registers[bucket]) registers[bucket] = rank;
+    }
+
+    void merge(const HyperLogLog& other);
+    uint64_t estimate() const;
+
+private:
+    std::vector<uint8_t> registers;
+};
+
+// Count-Min sketch of the four packet and byte counters, kDepth rows of
+// width cells. An estimate never undercounts, and with probability
+// 1 - e^-kDepth overcounts each field by at most e / width of that field's
+// total over every key. Sketches of the same width merge by adding cells.
+class CountMinSketch {
+public:
+    static constexpr size_t kDepth = 4;
+    static constexpr size_t kDefaultWidth = 4096;  // Power of two
+
+    explicit CountMinSketch(size_t width = kDefaultWidth) : mask(width - 1), cells(kDepth * width) {}
+
+    // Add delta to key and give its estimate afterwards
+    Counters add(uint64_t key, const Counters& delta) {
+        uint64_t hash = hashMix(key);
+        uint64_t step = hashMix(hash) | 1;
+        Counters result;
+        for (size_t row = 0; row < kDepth; row++, hash += step) {
+            Counters& cell = cells[row * (mask + 1) + (hash & mask)];
+            cell.add(delta);
+            result = row ? smaller(result, cell) : cell;
+        }
+        return result;
+    }
+
+    Counters estimate(uint64_t key) const;
+    void merge(const CountMinSketch& other);
+
+private:
+    size_t mask;
+    std::vector<Counters> cells;
+
+    static Counters smaller(const Counters& a, const Counters& b) {
+        Counters result;
+        result.packetsIn = std::min(a.packetsIn, b.packetsIn);
+        result.packetsOut = std::min(a.packetsOut, b.packetsOut);
+        result.bytesIn = std::min(a.bytesIn, b.bytesIn);
+        result.bytesOut = std::min(a.bytesOut, b.bytesOut);
+        return result;
+    }
+};
+
+// Space-Saving heavy hitters over capacity counters. Every key whose weight
+// is above total / capacity is kept, and a kept key's count overestimates its
+// true weight by at most its error, itself at most total / capacity. Counters
+// stay put in their slots while a min-heap of slot numbers finds the smallest
+// one to replace, so a key is only hashed to find its slot.
+//
+// An upper bound on a new key's total weight, such as a Count-Min estimate,
+// keeps it from evicting a counter it could never overtake. That spares the
+// heap from churning through the long tail of keys seen only a few times,
+// and a key whose weight is above the smallest kept count is still kept.
+template <typename Key>
+class SpaceSaving {
+public:
+    struct Entry {
+        Key key;
+        uint64_t count;
+        uint64_t error;
+    };
+
+    explicit SpaceSaving(size_t capacity) : capacity(std::max<size_t>(1, capacity)), slots(capacity * 2) {
+        entries.reserve(this->capacity);
+        heap.reserve(this->capacity);
+        heapPositions.reserve(this->capacity);
+    }
+
+    void add(const Key& key, uint64_t weight, uint64_t bound = UINT64_MAX) {
+        if (uint32_t* slot = slots.find(key)) {
+            entries[*slot].count += weight;
+            siftDown(heapPositions[*slot]);
+        } else if (entries.size() < capacity) {
+            uint32_t slot = entries.size();
+            entries.push_back(Entry{key, weight, 0});
+            heap.push_back(slot);
+            heapPositions.push_back(slot);
+            slots[key] = slot;
+            siftUp(slot);
+        } else {
+            uint32_t slot = heap[0];
+            Entry& entry = entries[slot];
+            if (bound <= entry.count) return;
+
+            // Take over the smallest counter, inheriting its count as error
+            uint64_t count = std::min(entry.count + weight, bound);
+            slots.erase(entry.key);
+            entry = Entry{key, count, count - weight};
+            slots[key] = slot;
+            siftDown(0);
+        }
+    }
+
+    // Mergeable summary combination: a key missing from one side may have had
+    // up to that side's smallest count, so it is charged that much as error
+    void merge(const SpaceSaving& other) {
+        uint64_t ownFloor = entries.size() < capacity ? 0 : entries[heap[0]].count;
+        uint64_t otherFloor = other.entries.size() < other.capacity ? 0 : other.entries[other.heap[0]].count;
+
+        std::vector<Entry> combined;
+        combined.reserve(entries.size() + other.entries.size());
+        for (const Entry& entry : entries) {
+            const uint32_t* slot = other.slots.find(entry.key);
+            const Entry* match = slot ? &other.entries[*slot] : nullptr;
+            combined.push_back(Entry{entry.key, entry.count + (match ? match->count : otherFloor),
+                                     entry.error + (match ? match->error : otherFloor)});
+        }
+        for (const Entry& entry : other.entries) {
+            if (!slots.find(entry.key)) {
+                combined.push_back(Entry{entry.key, entry.count + ownFloor, entry.error + ownFloor});
+            }
+        }
+
+        if (combined.size() > capacity) {
+            std::nth_element(combined.begin(), combined.begin() + capacity, combined.end(),
+                             [](const Entry& a, const Entry& b) { return a.count > b.count; });
+            combined.resize(capacity);
+        }
+        entries = std::move(combined);
+        slots.clear();
+        heap.clear();
+        heapPositions.clear();
+        for (uint32_t slot = 0; slot < entries.size(); slot++) {
+            slots[entries[slot].key] = slot;
+            heap.push_back(slot);
+            heapPositions.push_back(slot);
+            siftUp(slot);
+        }
+    }
+
+    // The k largest counters, largest first
+    std::vector<Entry> top(size_t k) const {
+        std::vector<Entry> sorted = entries;
+        k = std::min(k, sorted.size());
+        std::partial_sort(sorted.begin(), sorted.begin() + k, sorted.end(),
+                          [](const Entry& a, const Entry& b) { return a.count > b.count; });
+        sorted.resize(k);
+        return sorted;
+    }
+
+private:
+    size_t capacity;
+    std::vector<Entry> entries;
+    std::vector<uint32_t> heap;           // Slots, smallest count first
+    std::vector<uint32_t> heapPositions;  // Where each slot sits in the heap
+    FlatHashMap<Key, uint32_t> slots;     // Slot of every kept key
+
+    uint64_t countAt(size_t index) const { return entries[heap[index]].count; }
+
+    void place(size_t index, uint32_t slot) {
+        heap[index] = slot;
+        heapPositions[slot] = index;
+    }
+
+    void siftUp(size_t index) {
+        uint32_t slot = heap[index];
+        uint64_t count = entries[slot].count;
+        while (index > 0) {
+            size_t parent = (index - 1) / 2;
+            if (countAt(parent) <= count) break;
+            place(index, heap[parent]);
+            index = parent;
+        }
+        place(index, slot);
+    }
+
+    void siftDown(size_t index) {
+        uint32_t slot = heap[index];
+        uint64_t count = entries[slot].count;
+        while (true) {
+            size_t child = 2 * index + 1;
+            if (child >= heap.size()) break;
+            if (child + 1 < heap.size() && countAt(child + 1) < countAt(child)) child++;
+            if (count <= countAt(child)) break;
+            place(index, heap[child]);
+            index = child;
+        }
+        place(index, slot);
+    }
+};
+
+// Fixed memory stand-in for the exact address and address pair tables of
+// the IP layer. Heavy hitters by packets and by bytes pick the rows worth
+// reporting, the Count-Min sketches give their counters and the distinct
+// counters stand in for the table sizes.
+struct IPSketches {
+    static constexpr size_t kCandidatesPerRow = 4;  // Space-Saving counters kept per reported row
+
+    explicit IPSketches(size_t topK);
+
+    size_t topK;
+    SpaceSaving<uint32_t> addressPackets;
+    SpaceSaving<uint32_t> addressBytes;
+    SpaceSaving<uint64_t> pairPackets;  // addressPairKey(source, destination)
+    SpaceSaving<uint64_t> pairBytes;
+    CountMinSketch addressCounters;
+    CountMinSketch pairCounters;
+    HyperLogLog addresses;
+    HyperLogLog pairs;
+
+    // payloadBytes feed the address counters and datagramBytes the pair
+    // counters, matching the exact tables
+    void add(uint32_t source, uint32_t destination, uint64_t payloadBytes, uint64_t datagramBytes);
+    void merge(const IPSketches& other);
+
+    // Estimated counters of the heaviest topK addresses and pairs by packets,
+    // plus any that are only heavy by bytes
+    void fill(FlatHashMap<uint32_t, Counters>& individualStats, FlatHashMap<uint64_t, Counters>& interactionStats) const;
+};
+
+} // namespace NetworkParser
@@ -0,0 +1,200 @@
+#include "StatsTables.hpp"
+#include "Sketches.hpp"
+#include <charconv>
+#include <arpa/inet.h>
+
+namespace NetworkParser {
+
+template <typename Key, typename Value>
+static void mergeCounters(FlatHashMap<Key, Value>& into, const FlatHashMap<Key, Value>& from) {
+    for (const auto& slot : from) {
+        into[slot.key].add(slot.value);
+    }
+}
+
+static void mergePortCounters(std::vector<Counters>& into, const std::vector<Counters>& from) {
+    for (size_t port = 0; port < into.size(); port++) {
+        into[port].add(from[port]);
+    }
+}
+
+std::string ipv4ToString(uint32_t address) {
+    return std::to_string((address >> 24) & 0xFF) + "." +
+           std::to_string((address >> 16) & 0xFF) + "." +
+           std::to_string((address >> 8) & 0xFF) + "." +
+           std::to_string(address & 0xFF);
+}
+
+std::string ipAddressToString(const IPAddress& address) {
+    if (address.isIPv4()) return ipv4ToString(address.ipv4());
+    uint8_t bytes[16];
+    char text[INET6_ADDRSTRLEN];
+    address.toBytes(bytes);
+    return inet_ntop(AF_INET6, bytes, text, sizeof(text)) ? text : "";
+}
+
+bool parseIPv4(const std::string& text, uint32_t& address) {
+    const char* at = text.data();
+    const char* end = text.data() + text.size();
+    address = 0;
+    for (int part = 0; part < 4; part++) {
+        if (part && (at == end || *at++ != '.')) return false;
+        unsigned octet = 0;
+        auto result = std::from_chars(at, end, octet);
+        if (result.ec != std::errc() || result.ptr - at > 3 || octet > 255) return false;
+        address = (address << 8) | octet;
+        at = result.ptr;
+    }
+    return at == end;
+}
+
+size_t countActivePorts(const std::vector<Counters>& portStats) {
+    size_t active = 0;
+    for (const Counters& counters : portStats) {
+        if (counters.packetsIn || counters.packetsOut) active++;
+    }
+    return active;
+}
+
+std::vector<ColumnSpec> counterColumns(std::vector<ColumnSpec> keyColumns) {
+    for (const char* name : {"packetsIn", "packetsOut", "bytesIn", "bytesOut"}) {
+        keyColumns.push_back({name, ColumnType::UInt64});
+    }
+    return keyColumns;
+}
+
+void appendCounters(ArrowWriter& writer, const Counters& counters) {
+    writer.add(counters.packetsIn).add(counters.packetsOut).add(counters.bytesIn).add(counters.bytesOut);
+    writer.endRow();
+}
+
+void appendCounters(CsvWriter& writer, const Counters& counters) {
+    writer.add(counters.packetsIn).add(counters.packetsOut).add(counters.bytesIn).add(counters.bytesOut);
+    writer.endRow();
+}
+
+bool writePortStatsArrow(const std::string& filePath, const std::vector<Counters>& portStats) {
+    ArrowWriter writer(counterColumns({{"unique-port", ColumnType::UInt16}}));
+    if (!writer.open(filePath)) return false;
+    for (size_t port = 0; port < portStats.size(); port++) {
+        const Counters& counters = portStats[port];
+        if (!counters.packetsIn && !counters.packetsOut) continue;
+        writer.add(port);
+        appendCounters(writer, counters);
+    }
+    return writer.close();
+}
+
+bool writeTimeSeriesArrow(const std::string& filePath, const TimeSeries& series) {
+    ArrowWriter writer({{"intervalStart", ColumnType::Timestamp},
+                        {"packets", ColumnType::UInt64},
+                        {"bytes", ColumnType::UInt64}});
+    if (!writer.open(filePath)) return false;
+    for (const TimeBucket& bucket : series.buckets()) {
+        writer.add(bucket.number * series.interval()).add(bucket.packets).add(bucket.bytes);
+        writer.endRow();
+    }
+    return writer.close();
+}
+
+IPStatsTable::IPStatsTable() = default;
+IPStatsTable::~IPStatsTable() = default;
+
+void IPStatsTable::approximate(size_t topK) {
+    sketches = std::make_unique<IPSketches>(topK);
+}
+
+void IPStatsTable::finishSketches() {
+    if (sketches) sketches->fill(individualStats, interactionStats);
+}
+
+uint64_t IPStatsTable::uniqueAddresses() const {
+    return sketches ? sketches->addresses.estimate() : individualStats.size();
+}
+
+uint64_t IPStatsTable::uniqueInteractions() const {
+    return sketches ? sketches->pairs.estimate() : interactionStats.size();
+}
+
+void FragmentStats::add(const FragmentStats& other) {
+    fragments += other.fragments;
+    reassembled += other.reassembled;
+    timedOut += other.timedOut;
+    overflows += other.overflows;
+    invalid += other.invalid;
+    droppedFragments += other.droppedFragments;
+}
+
+void IPStatsTable::merge(IPStatsTable& other) {
+    mergeCounters(individualStats, other.individualStats);
+    mergeCounters(interactionStats, other.interactionStats);
+    if (sketches && other.sketches) sketches->merge(*other.sketches);
+    fragments.add(other.fragments);
+    timeSeries.merge(other.timeSeries);
+    if (other.totalPackets) {
+        firstTimestamp = totalPackets ? std::min(firstTimestamp, other.firstTimestamp) : other.firstTimestamp;
+        lastTimestamp = std::max(lastTimestamp, other.lastTimestamp);
+    }
+    totalPackets += other.totalPackets;
+    totalBytes += other.totalBytes;
+}
+
+void IPv6StatsTable::merge(IPv6StatsTable& other) {
+    mergeCounters(individualStats, other.individualStats);
+    mergeCounters(interactionStats, other.interactionStats);
+    timeSeries.merge(other.timeSeries);
+    if (other.totalPackets) {
+        firstTimestamp = totalPackets ? std::min(firstTimestamp, other.firstTimestamp) : other.firstTimestamp;
+        lastTimestamp = std::max(lastTimestamp, other.lastTimestamp);
+    }
+    totalPackets += other.totalPackets;
+    totalBytes += other.totalBytes;
+}
+
+void ReassemblyStats::add(const ReassemblyStats& other) {
+    flows += other.flows;
+    deliveredBytes += other.deliveredBytes;
+    zeroCopyBytes += other.zeroCopyBytes;
+    bufferedBytes += other.bufferedBytes;
+    retransmittedBytes += other.retransmittedBytes;
+    gapBytes += other.gapBytes;
+    droppedSegments += other.droppedSegments;
+    droppedBytes += other.droppedBytes;
+}
+
+void TCPStatsTable::merge(TCPStatsTable& other) {
+    mergePortCounters(portStats, other.portStats);
+    flows.merge(other.flows);
+    reassembly.add(other.reassembly);
+    timeSeries.merge(other.timeSeries);
+    totalPackets += other.totalPackets;
+    totalBytes += other.totalBytes;
+}
+
+void UDPStatsTable::merge(UDPStatsTable& other) {
+    mergePortCounters(portStats, other.portStats);
+    flows.merge(other.flows);
+    timeSeries.merge(other.timeSeries);
+    totalPackets += other.totalPackets;
+    totalBytes += other.totalBytes;
+}
+
+void StatsTables::setInterval(uint64_t usec) {
+    ip.timeSeries.setInterval(usec);
+    ipv6.timeSeries.setInterval(usec);
+    tcp.timeSeries.setInterval(usec);
+    udp.timeSeries.setInterval(usec);
+}
+
+void StatsTables::approximate(size_t topK) {
+    ip.approximate(topK);
+}
+
+void StatsTables::merge(StatsTables& other) {
+    ip.merge(other.ip);
+    ipv6.merge(other.ipv6);
+    tcp.merge(other.tcp);
+    udp.merge(other.udp);
+}
+
+} // namespace NetworkParser
@@ -0,0 +1,184 @@
+#pragma once
+#include "Parser.hpp"
+#include "ArrowWriter.hpp"
+#include "CsvWriter.hpp"
+#include "FlatHashMap.hpp"
+#include "FlowTable.hpp"
+#include "TimeSeries.hpp"
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include <cstdint>
+
+namespace NetworkParser {
+
+// Packet and byte counters kept for every address, port and connection
+struct Counters {
+    uint64_t packetsIn = 0;
+    uint64_t packetsOut = 0;
+    uint64_t bytesIn = 0;
+    uint64_t bytesOut = 0;
+
+    void add(const Counters& other) {
+        packetsIn += other.packetsIn;
+        packetsOut += other.packetsOut;
+        bytesIn += other.bytesIn;
+        bytesOut += other.bytesOut;
+    }
+};
+
+// Key for an ordered pair of IPv4 addresses
+inline uint64_t addressPairKey(uint32_t source, uint32_t destination) {
+    return (static_cast<uint64_t>(source) << 32) | destination;
+}
+
+struct IPSketches;
+
+// Counts of the IPv4 fragment reassembler
+struct FragmentStats {
+    uint64_t fragments = 0;         // Fragments taken in
+    uint64_t reassembled = 0;       // Datagrams put back together and parsed
+    uint64_t timedOut = 0;          // Datagrams given up on after the timeout or at the end of the capture
+    uint64_t overflows = 0;         // Datagrams given up on to make room when every slot was taken
+    uint64_t invalid = 0;           // Fragments with impossible offsets or lengths
+    uint64_t droppedFragments = 0;  // Fragments thrown away with a datagram given up on
+
+    void add(const FragmentStats& other);
+};
+
+// Statistics gathered by the IP layer, keyed by host order IPv4 addresses
+struct IPStatsTable {
+    FlatHashMap<uint32_t, Counters> individualStats;
+    FlatHashMap<uint64_t, Counters> interactionStats;  // addressPairKey(source, destination)
+    std::unique_ptr<IPSketches> sketches;  // Approximate mode, fed instead of the two tables above
+    FragmentStats fragments;
+    TimeSeries timeSeries;
+    uint64_t firstTimestamp = 0;  // Microseconds since the epoch, 0 before the first packet
+    uint64_t lastTimestamp = 0;
+    size_t totalPackets = 0;
+    size_t totalBytes = 0;
+
+    IPStatsTable();
+    ~IPStatsTable();
+
+    // Keep fixed size sketches instead of a row per address and address pair,
+    // reporting only the topK heaviest. Set before any packets are parsed.
+    void approximate(size_t topK);
+
+    // Turn the sketches into estimated rows of the two tables, once every
+    // worker's table has been merged in
+    void finishSketches();
+
+    // Distinct addresses and address pairs, estimated in approximate mode
+    uint64_t uniqueAddresses() const;
+    uint64_t uniqueInteractions() const;
+
+    void merge(IPStatsTable& other);
+};
+
+// Statistics gathered by the IPv6 layer, the same as for IPv4 with 128 bit
+// keys. Always exact, --top-talkers only covers IPv4.
+struct IPv6StatsTable {
+    FlatHashMap<IPAddress, Counters> individualStats;
+    FlatHashMap<IPAddressPair, Counters> interactionStats;
+    TimeSeries timeSeries;
+    uint64_t firstTimestamp = 0;  // Microseconds since the epoch, 0 before the first packet
+    uint64_t lastTimestamp = 0;
+    size_t totalPackets = 0;
+    size_t totalBytes = 0;
+
+    void merge(IPv6StatsTable& other);
+};
+
+// Dotted quad for a host order IPv4 address
+std::string ipv4ToString(uint32_t address);
+
+// Host order IPv4 address from a dotted quad, false if it isn't one
+bool parseIPv4(const std::string& text, uint32_t& address);
+
+// Byte accounting of the TCP stream reassembler
+struct ReassemblyStats {
+    uint64_t flows = 0;               // Flows whose payload went to an application parser
+    uint64_t deliveredBytes = 0;      // Handed on in stream order
+    uint64_t zeroCopyBytes = 0;       // Of those, passed on straight from the packet
+    uint64_t bufferedBytes = 0;       // Copied aside because they arrived ahead of a hole
+    uint64_t retransmittedBytes = 0;  // Already delivered or held, trimmed away
+    uint64_t gapBytes = 0;            // Holes skipped when there was no room to wait for them
+    uint64_t droppedSegments = 0;     // Thrown away on reset, timeout or end of capture, or too far ahead
+    uint64_t droppedBytes = 0;
+
+    void add(const ReassemblyStats& other);
+};
+
+// Statistics gathered by the TCP layer
+struct TCPStatsTable {
+    std::vector<Counters> portStats = std::vector<Counters>(65536);  // Indexed by port
+    FlowTable flows;                                                 // Per 5-tuple connections
+    ReassemblyStats reassembly;
+    TimeSeries timeSeries;
+    size_t totalPackets = 0;
+    size_t totalBytes = 0;
+
+    void merge(TCPStatsTable& other);
+};
+
+// Statistics gathered by the UDP layer
+struct UDPStatsTable {
+    std::vector<Counters> portStats = std::vector<Counters>(65536);  // Indexed by port
+    FlowTable flows;                                                 // Per 5-tuple connections
+    TimeSeries timeSeries;
+    size_t totalPackets = 0;
+    size_t totalBytes = 0;
+
+    void merge(UDPStatsTable& other);
+};
+
+// Number of ports that saw at least one packet
+size_t countActivePorts(const std::vector<Counters>& portStats);
+
+// Arrow report columns: the key columns followed by packetsIn,packetsOut,bytesIn,bytesOut
+std::vector<ColumnSpec> counterColumns(std::vector<ColumnSpec> keyColumns);
+
+// Append the four counters to the row being written and end it
+void appendCounters(ArrowWriter& writer, const Counters& counters);
+void appendCounters(CsvWriter& writer, const Counters& counters);
+
+// Arrow versions of the port and time series reports shared by TCP and UDP
+bool writePortStatsArrow(const std::string& filePath, const std::vector<Counters>& portStats);
+bool writeTimeSeriesArrow(const std::string& filePath, const TimeSeries& series);
+
+// Copy a table out into a vector ordered by key, for deterministic reports
+template <typename Key, typename Value>
+std::vector<std::pair<Key, Value>> sortedByKey(const FlatHashMap<Key, Value>& table) {
+    std::vector<std::pair<Key, Value>> rows;
+    rows.reserve(table.size());
+    for (const auto& slot : table) {
+        rows.emplace_back(slot.key, slot.value);
+    }
+    std::sort(rows.begin(), rows.end(),
+              [](const auto& a, const auto& b) { return a.first < b.first; });
+    return rows;
+}
+
+// Every table filled in while parsing. Each worker thread owns one and the
+// results are merged before the reports are written.
+struct StatsTables {
+    IPStatsTable ip;
+    IPv6StatsTable ipv6;
+    TCPStatsTable tcp;
+    UDPStatsTable udp;
+
+    // Length of the time series intervals, set before any packets are parsed
+    void setInterval(uint64_t usec);
+
+    // Report the topK heaviest hosts and address pairs from fixed size
+    // sketches, set before any packets are parsed
+    void approximate(size_t topK);
+
+    // Folds other into this table, other's flows are moved rather than copied
+    void merge(StatsTables& other);
+};
+
+} // namespace NetworkParser
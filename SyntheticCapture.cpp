@@ -0,0 +1,225 @@
+#include "SyntheticCapture.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include "Ethernet.hpp"
+#include "FlatHashMap.hpp"
+#include "IPParser.hpp"
+#include "TCPParser.hpp"
+
+namespace NetworkParser {
+
+namespace {
+
+constexpr uint32_t kStartSec = 1700000000;
+constexpr uint32_t kPacketSpacingUsec = 10;
+constexpr size_t kEthernetLength = sizeof(EthernetFrameHeader);
+constexpr size_t kIPLength = sizeof(IPv4Header);
+constexpr size_t kTCPLength = sizeof(TCPHeader);
+constexpr size_t kUDPLength = 8;
+constexpr uint16_t kTCPServerPorts[] = {80, 443, 22, 21, 25, 8080};
+constexpr uint16_t kUDPServerPorts[] = {53, 123, 161, 5353};
+
+// splitmix64 stream, the same on every platform unlike the std distributions
+class Random {
+public:
+    explicit Random(uint64_t seed) : state(seed) {}
+
+    uint64_t next() {
+        state += 0x9e3779b97f4a7c15ull;
+        return hashMix(state);
+    }
+    uint64_t below(uint64_t bound) { return next() % bound; }
+    double unit() { return (next() >> 11) * (1.0 / 9007199254740992.0); }
+
+private:
+    uint64_t state;
+};
+
+struct Flow {
+    uint32_t client;
+    uint32_t server;
+    uint16_t clientPort;
+    uint16_t serverPort;
+    bool tcp;
+    uint8_t handshake = 0;  // TCP packets of the SYN, SYN-ACK, ACK exchange sent so far
+    uint32_t clientSequence;
+    uint32_t serverSequence;
+};
+
+void put16(uint8_t* at, uint16_t value) {
+    at[0] = value >> 8;
+    at[1] = value & 0xFF;
+}
+
+void put32(uint8_t* at, uint32_t value) {
+    put16(at, value >> 16);
+    put16(at + 2, value & 0xFFFF);
+}
+
+// Ones' complement sum of big endian 16 bit words
+uint32_t sumWords(const uint8_t* data, size_t length, uint32_t sum = 0) {
+    for (size_t i = 0; i + 1 < length; i += 2) sum += (data[i] << 8) | data[i + 1];
+    if (length & 1) sum += data[length - 1] << 8;
+    return sum;
+}
+
+uint16_t foldChecksum(uint32_t sum) {
+    while (sum >> 16) sum = (sum & 0xFFFF) + (sum >> 16);
+    return static_cast<uint16_t>(~sum);
+}
+
+} // namespace
+
+bool parseSizeMix(const std::string& text, std::vector<FrameSizeWeight>& mix) {
+    std::vector<FrameSizeWeight> parsed;
+    std::stringstream entries(text);
+    std::string entry;
+    while (std::getline(entries, entry, ',')) {
+        size_t colon = entry.find(':');
+        try {
+            FrameSizeWeight size;
+            size.frameBytes = std::stoul(entry.substr(0, colon));
+            size.weight = colon == std::string::npos ? 1.0 : std::stod(entry.substr(colon + 1));
+            if (size.frameBytes > 65535 || size.weight <= 0) return false;
+            parsed.push_back(size);
+        } catch (const std::exception&) {
+            return false;
+        }
+    }
+    if (parsed.empty()) return false;
+    mix = parsed;
+    return true;
+}
+
+bool writeSyntheticCapture(const std::string& path, const SyntheticCaptureOptions& options) {
+    if (!options.flows || !options.hosts || options.sizeMix.empty()) {
+        std::cerr << "Error: A synthetic capture needs at least one flow, host and frame size.\n";
+        return false;
+    }
+
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    if (!file) {
+        std::cerr << "Error: Could not open " << path << " for writing.\n";
+        return false;
+    }
+    std::vector<char> buffer(1 << 20);
+    std::setvbuf(file, buffer.data(), _IOFBF, buffer.size());
+
+    Random random(options.seed);
+
+    // Hosts are scattered over 10.0.0.0/8 so they don't sit in one hash bucket run
+    std::vector<uint32_t> hosts(options.hosts);
+    for (uint32_t& host : hosts) host = 0x0A000000 | (random.next() & 0x00FFFFFF);
+
+    std::vector<Flow> flows(options.flows);
+    for (Flow& flow : flows) {
+        flow.tcp = random.unit() < options.tcpRatio;
+        // A flow's two ends differ, or the parser can't tell its directions
+        // apart. Two hosts can draw the same address, and with a single host
+        // the server takes its neighbour.
+        size_t clientHost = random.below(hosts.size());
+        size_t serverHost = (clientHost + 1 + random.below(std::max<size_t>(hosts.size() - 1, 1))) % hosts.size();
+        flow.client = hosts[clientHost];
+        flow.server = hosts[serverHost];
+        if (flow.server == flow.client) flow.server ^= 1;
+        flow.serverPort = flow.tcp ? kTCPServerPorts[random.below(std::size(kTCPServerPorts))]
+                                   : kUDPServerPorts[random.below(std::size(kUDPServerPorts))];
+        do {
+            flow.clientPort = 1024 + random.below(65536 - 1024);
+        } while (flow.clientPort == flow.serverPort);
+        flow.clientSequence = static_cast<uint32_t>(random.next());
+        flow.serverSequence = static_cast<uint32_t>(random.next());
+    }
+
+    double totalWeight = 0;
+    for (const FrameSizeWeight& size : options.sizeMix) totalWeight += size.weight;
+
+    PcapGlobalHeader header = {0xa1b2c3d4, 2, 4, 0, 0, 65535, 1};
+    bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1;
+
+    uint8_t frame[65536 + kEthernetLength];
+    for (uint64_t i = 0; i < options.packets && ok; i++) {
+        Flow& flow = flows[random.below(flows.size())];
+
+        double pick = random.unit() * totalWeight;
+        uint32_t frameBytes = options.sizeMix.back().frameBytes;
+        for (const FrameSizeWeight& size : options.sizeMix) {
+            if (pick < size.weight) {
+                frameBytes = size.frameBytes;
+                break;
+            }
+            pick -= size.weight;
+        }
+
+        // The first three packets of a TCP flow are its handshake, the SYN-ACK
+        // coming from the server
+        bool handshaking = flow.tcp && flow.handshake < 3;
+        bool fromClient = handshaking ? flow.handshake != 1 : random.below(2) == 0;
+        size_t transportLength = flow.tcp ? kTCPLength : kUDPLength;
+        size_t headerBytes = kEthernetLength + kIPLength + transportLength;
+        size_t payloadLength = (handshaking || frameBytes <= headerBytes) ? 0 : frameBytes - headerBytes;
+        size_t length = headerBytes + payloadLength;
+        std::memset(frame, 0, length);
+
+        uint8_t* ethernet = frame;
+        put16(ethernet + 12, 0x0800);
+
+        uint8_t* ip = frame + kEthernetLength;
+        uint32_t source = fromClient ? flow.client : flow.server;
+        uint32_t destination = fromClient ? flow.server : flow.client;
+        uint16_t sourcePort = fromClient ? flow.clientPort : flow.serverPort;
+        uint16_t destinationPort = fromClient ? flow.serverPort : flow.clientPort;
+        ip[0] = 0x45;
+        put16(ip + 2, kIPLength + transportLength + payloadLength);
+        put16(ip + 4, i & 0xFFFF);
+        ip[8] = 64;
+        ip[9] = flow.tcp ? 6 : 17;
+        put32(ip + 12, source);
+        put32(ip + 16, destination);
+        put16(ip + 10, foldChecksum(sumWords(ip, kIPLength)));
+
+        uint8_t* transport = ip + kIPLength;
+        put16(transport, sourcePort);
+        put16(transport + 2, destinationPort);
+        uint8_t* payload = transport + transportLength;
+        for (size_t b = 0; b < payloadLength; b++) payload[b] = static_cast<uint8_t>(i + b);
+
+        size_t segmentLength = transportLength + payloadLength;
+        if (flow.tcp) {
+            static constexpr uint8_t kHandshakeFlags[] = {0x02, 0x12, 0x10};  // SYN, SYN|ACK, ACK
+            uint32_t& sequence = fromClient ? flow.clientSequence : flow.serverSequence;
+            put32(transport + 4, sequence);
+            if (flow.handshake != 0) put32(transport + 8, fromClient ? flow.serverSequence : flow.clientSequence);
+            transport[12] = (kTCPLength / 4) << 4;
+            transport[13] = handshaking ? kHandshakeFlags[flow.handshake] : 0x18;  // or PSH|ACK
+            put16(transport + 14, 65535);
+            sequence += (handshaking && flow.handshake < 2) ? 1 : payloadLength;  // SYNs take one number
+            if (handshaking) flow.handshake++;
+        } else {
+            put16(transport + 4, segmentLength);
+        }
+
+        // Pseudo header, then the segment itself
+        uint32_t sum = sumWords(ip + 12, 8);
+        sum += ip[9];
+        sum += segmentLength;
+        uint16_t checksum = foldChecksum(sumWords(transport, segmentLength, sum));
+        if (!flow.tcp && checksum == 0) checksum = 0xFFFF;  // 0 means no checksum for UDP
+        put16(transport + (flow.tcp ? 16 : 6), checksum);
+
+        uint64_t timestamp = static_cast<uint64_t>(i) * kPacketSpacingUsec;
+        PcapPacketHeader record = {static_cast<uint32_t>(kStartSec + timestamp / 1000000),
+                                   static_cast<uint32_t>(timestamp % 1000000), static_cast<uint32_t>(length),
+                                   static_cast<uint32_t>(length)};
+        ok = std::fwrite(&record, sizeof(record), 1, file) == 1 && std::fwrite(frame, 1, length, file) == length;
+    }
+
+    ok = (std::fclose(file) == 0) && ok;
+    if (!ok) std::cerr << "Error: Failed writing " << path << ".\n";
+    return ok;
+}
+
+} // namespace NetworkParser
@@ -0,0 +1,34 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace NetworkParser {
+
+// One entry of the frame size mix
+struct FrameSizeWeight {
+    uint32_t frameBytes;  // Ethernet frame, headers included
+    double weight;
+};
+
+// Shape of a generated capture. The same options and seed always give the
+// same file, byte for byte.
+struct SyntheticCaptureOptions {
+    uint64_t packets = 200000;
+    uint32_t flows = 10000;        // Concurrent TCP/UDP conversations packets are drawn from
+    uint32_t hosts = 5000;         // Distinct IPv4 addresses the flows' ends are drawn from
+    double tcpRatio = 0.7;         // Share of flows that are TCP, the rest are UDP
+    std::vector<FrameSizeWeight> sizeMix = {{64, 0.5}, {576, 0.3}, {1500, 0.2}};
+    uint64_t seed = 1;
+};
+
+// "size:weight,size:weight,..." as the frame size mix, false if malformed
+bool parseSizeMix(const std::string& text, std::vector<FrameSizeWeight>& mix);
+
+// Write a classic pcap of Ethernet/IPv4 TCP and UDP packets with valid
+// checksums. Every flow runs between two different addresses, and every TCP
+// flow opens with a SYN, SYN-ACK, ACK handshake and then carries data in
+// sequence both ways. False with an error on cerr if it can't be written.
+bool writeSyntheticCapture(const std::string& path, const SyntheticCaptureOptions& options);
+
+} // namespace NetworkParser
@@ -1,17 +1,18 @@
 #include "TCPParser.hpp"
-#include <fstream>
+#include "Metrics.hpp"
 #include <iostream>
-#include <netinet/in.h> 
+#include <netinet/in.h>
 
 namespace NetworkParser {
 
-TCPParser::TCPParser(std::string _filePath) : filePath(_filePath) {}
+TCPParser::TCPParser(StatsTables& tables, const ProtocolRegistry& registry)
+    : stats(tables.tcp), registry(registry) {}
 
-Stats TCPParser::parsePacket(const uint8_t* packet, size_t length, size_t offset, Stats ip_add_stats) {
-    Stats placeholder;
+void TCPParser::parsePacket(const uint8_t* packet, size_t length, size_t offset, PacketContext& context) {
+    nextProtocolId = Protocol::None;
     if (length < offset + sizeof(TCPHeader)) {
-        std::cerr << "Error: Malformed TCP packet - insufficient length for TCP header." << std::endl;
-        return placeholder;
+        reportPacketError(PacketError::TCPTruncated);
+        return;
     }
 
     const TCPHeader* tcpHeader = reinterpret_cast<const TCPHeader*>(packet + offset);
@@ -25,46 +26,34 @@ Stats TCPParser::parsePacket(const uint8_t* packet, size_t length, size_t offset
 
     // Ensure the packet is large enough to contain the TCP header
     if (length < offset + headerLength) {
-        std::cerr << "Error: Malformed TCP packet - insufficient length for TCP header." << std::endl;
-        return placeholder;
+        reportPacketError(PacketError::TCPTruncated);
+        return;
     }
 
     // Update statistics
-    tcpTotalPackets++;
-    tcpTotalBytes += (length - offset - headerLength);
-
-    // Update unique ports
-    tcpUniquePorts.insert(srcPort);
-    tcpUniquePorts.insert(destPort);
+    stats.totalPackets++;
+    stats.totalBytes += (length - offset - headerLength);
+    stats.timeSeries.add(context.timestampMicros(), length - offset - headerLength);
 
     // Update port stats
-    tcpPortStats[srcPort].packetsOut++;
-    tcpPortStats[destPort].packetsIn++;
-    tcpPortStats[srcPort].bytesOut += (length - offset - headerLength);
-    tcpPortStats[destPort].bytesIn += (length - offset - headerLength);
-
-    // Update unique interactions and connection stats
-    auto connection = (srcPort < destPort) ? std::make_pair(srcPort, destPort)
-                                           : std::make_pair(destPort, srcPort);
-
-    tcpUniqueInteractions.insert(connection);
-
-    // Update connection stats with IP addresses
-    tcpConnectionStats[connection].ip1 = ip_add_stats.ip1;
-    tcpConnectionStats[connection].ip2 = ip_add_stats.ip2;
-
-    if (srcPort < destPort) {
-        tcpConnectionStats[connection].packetsOut++;
-        tcpConnectionStats[connection].bytesOut += (length - offset - headerLength);
-    } else {
-        tcpConnectionStats[connection].packetsIn++;
-        tcpConnectionStats[connection].bytesIn += (length - offset - headerLength);
+    stats.portStats[srcPort].packetsOut++;
+    stats.portStats[destPort].packetsIn++;
+    stats.portStats[srcPort].bytesOut += (length - offset - headerLength);
+    stats.portStats[destPort].bytesIn += (length - offset - headerLength);
+
+    context.srcPort = srcPort;
+    context.destPort = destPort;
+    context.hasPorts = true;
+    context.tcpFlags = tcpHeader->flags;
+    context.tcpSequence = ntohl(tcpHeader->sequenceNumber);
+
+    // Update the connection, which needs the addresses from a valid IP header
+    if (context.hasAddresses) {
+        stats.flows.update(context, length - offset - headerLength);
     }
 
-    src_port = srcPort;
-    dest_port = destPort;
-
-    return ip_add_stats;
+    context.payloadOffset = offset + headerLength;
+    nextProtocolId = registry.tcpProtocolFor(srcPort, destPort);
 }
 
 size_t TCPParser::getOffset() const {
@@ -72,51 +61,26 @@ size_t TCPParser::getOffset() const {
     return tcpHeaderLength;
 }
 
-std::string TCPParser::nextParser() const {
-    size_t tcpHeaderLength = (src_port < dest_port) ? sizeof(TCPHeader) : sizeof(TCPHeader);
-    size_t payloadSize = tcpTotalBytes - tcpHeaderLength;
-    /*
-    if (payloadSize > 0) {
-        if (dest_port == 80 || dest_port == 8080 || src_port == 80 || src_port == 8080) {
-            return "HTTP";  // Next parser is HTTP
-        }
-    }*/
-
-    std::ifstream tcp_mapping_file("tcp-port-mapping.dat");
-    if (!tcp_mapping_file) {
-        std::cerr << "Error opening dat file for mapping" << std::endl;
-        return "";
-    }
-
-    std::string line;
-    while(std::getline(tcp_mapping_file, line)) {
-        size_t equalPos = line.find('=');
-        if (equalPos == std::string::npos) {
-            continue;
-        }
-
-        int mappedPort = std::stoi(line.substr(0, equalPos));
-        std::string protocol = line.substr(equalPos + 1);
-
-        if (dest_port == mappedPort || src_port == mappedPort) {
-            return protocol;
-        }
-    }
+ProtocolId TCPParser::nextProtocol() const {
+    // Resolved from the port mapping table when the segment was parsed
+    return nextProtocolId;
+}
 
-    return "";
+void TCPParser::generateReport(const TCPStatsTable& stats, ReportFormat format) {
+    if (writesCsv(format)) writeCsvReport(stats);
+    if (writesArrow(format)) writeArrowReport(stats);
 }
 
-void TCPParser::generateReport() {
+void TCPParser::writeCsvReport(const TCPStatsTable& stats) {
     // Generate port stats report
-    std::ofstream tcpPortStatsFile("output-tcp-csv-files/tcp-port-stats.csv");
-    if (tcpPortStatsFile.is_open()) {
-        tcpPortStatsFile << "unique-port,packetsIn,packetsOut,bytesIn,bytesOut\n";
-        for (const auto& [port, stats] : tcpPortStats) {
-            tcpPortStatsFile << port << ","
-                             << stats.packetsIn << ","
-                             << stats.packetsOut << ","
-                             << stats.bytesIn << ","
-                             << stats.bytesOut << "\n";
+    CsvWriter tcpPortStatsFile;
+    if (tcpPortStatsFile.open("output-tcp-csv-files/tcp-port-stats.csv")) {
+        tcpPortStatsFile.line("unique-port,packetsIn,packetsOut,bytesIn,bytesOut");
+        for (size_t port = 0; port < stats.portStats.size(); port++) {
+            const Counters& portStats = stats.portStats[port];
+            if (!portStats.packetsIn && !portStats.packetsOut) continue;
+            tcpPortStatsFile.add(port);
+            appendCounters(tcpPortStatsFile, portStats);
         }
         tcpPortStatsFile.close();
     } else {
@@ -124,36 +88,130 @@ void TCPParser::generateReport() {
     }
 
     // Generate connection stats report
-    std::ofstream tcpConnectionStatsFile("output-tcp-csv-files/tcp-connection-stats.csv");
-    if (tcpConnectionStatsFile.is_open()) {
-        tcpConnectionStatsFile << "ip1,ip2,srcPort,destPort,packetsIn,packetsOut,bytesIn,bytesOut\n";
-        for (const auto& [connection, stats] : tcpConnectionStats) {
-            tcpConnectionStatsFile << stats.ip1 << ","
-                                   << stats.ip2 << ","
-                                   << connection.first << ","
-                                   << connection.second << ","
-                                   << stats.packetsIn << ","
-                                   << stats.packetsOut << ","
-                                   << stats.bytesIn << ","
-                                   << stats.bytesOut << "\n";
-        }
+    CsvWriter tcpConnectionStatsFile;
+    if (tcpConnectionStatsFile.open("output-tcp-csv-files/tcp-connection-stats.csv")) {
+        tcpConnectionStatsFile.line("ip1,ip2,srcPort,destPort,packetsIn,packetsOut,bytesIn,bytesOut,state,firstSeen,lastSeen");
+        stats.flows.forEachRecord([&](const FlowRecord& record) {
+            writeFlowRow(tcpConnectionStatsFile, record);
+        });
         tcpConnectionStatsFile.close();
     } else {
         std::cerr << "Error: Could not open tcp-connection-stats.csv for writing.\n";
     }
 
     // Generate general summary report for TCP
-    std::ofstream tcpSummaryFile("output-tcp-csv-files/tcp-general-summary.csv");
-    if (tcpSummaryFile.is_open()) {
-        tcpSummaryFile << "#packets,bytes,#unique-ports,uniqueConnections\n";
-        tcpSummaryFile << tcpTotalPackets << ","
-                       << tcpTotalBytes << ","
-                       << tcpPortStats.size() << ","
-                       << tcpConnectionStats.size() << "\n";
+    CsvWriter tcpSummaryFile;
+    if (tcpSummaryFile.open("output-tcp-csv-files/tcp-general-summary.csv")) {
+        tcpSummaryFile.line("#packets,bytes,#unique-ports,uniqueConnections");
+        tcpSummaryFile.add(stats.totalPackets)
+            .add(stats.totalBytes)
+            .add(countActivePorts(stats.portStats))
+            .add(stats.flows.totalFlows());
+        tcpSummaryFile.endRow();
         tcpSummaryFile.close();
     } else {
         std::cerr << "Error: Could not open tcp-general-summary.csv for writing.\n";
     }
+
+    // Generate per interval time series for TCP
+    CsvWriter tcpTimeSeriesFile;
+    if (tcpTimeSeriesFile.open("output-tcp-csv-files/tcp-time-series.csv")) {
+        tcpTimeSeriesFile.line("intervalStart,packets,bytes");
+        stats.timeSeries.writeRows(tcpTimeSeriesFile);
+        tcpTimeSeriesFile.close();
+    } else {
+        std::cerr << "Error: Could not open tcp-time-series.csv for writing.\n";
+    }
+
+    // Generate stream reassembly summary
+    CsvWriter reassemblyFile;
+    if (reassemblyFile.open("output-tcp-csv-files/tcp-reassembly-summary.csv")) {
+        const ReassemblyStats& reassembly = stats.reassembly;
+        reassemblyFile.line("flows,deliveredBytes,zeroCopyBytes,bufferedBytes,retransmittedBytes,gapBytes,droppedSegments,droppedBytes");
+        reassemblyFile.add(reassembly.flows)
+            .add(reassembly.deliveredBytes)
+            .add(reassembly.zeroCopyBytes)
+            .add(reassembly.bufferedBytes)
+            .add(reassembly.retransmittedBytes)
+            .add(reassembly.gapBytes)
+            .add(reassembly.droppedSegments)
+            .add(reassembly.droppedBytes);
+        reassemblyFile.endRow();
+        reassemblyFile.close();
+    } else {
+        std::cerr << "Error: Could not open tcp-reassembly-summary.csv for writing.\n";
+    }
+}
+
+void TCPParser::writeArrowReport(const TCPStatsTable& stats) {
+    if (!writePortStatsArrow("output-tcp-csv-files/tcp-port-stats.arrow", stats.portStats)) {
+        std::cerr << "Error: Could not write tcp-port-stats.arrow.\n";
+    }
+
+    // IPv6 connections go to a table of their own, only written when there are any
+    ArrowWriter tcpConnectionStatsTable(flowColumns());
+    ArrowWriter tcpConnectionStatsTable6(flowColumns(true));
+    bool opened6 = false;
+    if (tcpConnectionStatsTable.open("output-tcp-csv-files/tcp-connection-stats.arrow")) {
+        stats.flows.forEachRecord([&](const FlowRecord& record) {
+            if (record.isIPv4()) {
+                appendFlowRow(tcpConnectionStatsTable, record);
+                return;
+            }
+            if (!opened6) {
+                opened6 = true;
+                if (!tcpConnectionStatsTable6.open("output-tcp-csv-files/tcp-connection-stats-ipv6.arrow")) {
+                    std::cerr << "Error: Could not open tcp-connection-stats-ipv6.arrow for writing.\n";
+                }
+            }
+            if (tcpConnectionStatsTable6.isOpen()) appendFlowRow(tcpConnectionStatsTable6, record);
+        });
+        tcpConnectionStatsTable.close();
+        if (tcpConnectionStatsTable6.isOpen()) tcpConnectionStatsTable6.close();
+    } else {
+        std::cerr << "Error: Could not open tcp-connection-stats.arrow for writing.\n";
+    }
+
+    ArrowWriter tcpSummaryTable({{"#packets", ColumnType::UInt64},
+                                 {"bytes", ColumnType::UInt64},
+                                 {"#unique-ports", ColumnType::UInt64},
+                                 {"uniqueConnections", ColumnType::UInt64}});
+    if (tcpSummaryTable.open("output-tcp-csv-files/tcp-general-summary.arrow")) {
+        tcpSummaryTable.add(stats.totalPackets)
+            .add(stats.totalBytes)
+            .add(countActivePorts(stats.portStats))
+            .add(stats.flows.totalFlows());
+        tcpSummaryTable.endRow();
+        tcpSummaryTable.close();
+    } else {
+        std::cerr << "Error: Could not open tcp-general-summary.arrow for writing.\n";
+    }
+
+    if (!writeTimeSeriesArrow("output-tcp-csv-files/tcp-time-series.arrow", stats.timeSeries)) {
+        std::cerr << "Error: Could not write tcp-time-series.arrow.\n";
+    }
+
+    const ReassemblyStats& reassembly = stats.reassembly;
+    std::vector<ColumnSpec> reassemblyColumns;
+    for (const char* name : {"flows", "deliveredBytes", "zeroCopyBytes", "bufferedBytes", "retransmittedBytes",
+                             "gapBytes", "droppedSegments", "droppedBytes"}) {
+        reassemblyColumns.push_back({name, ColumnType::UInt64});
+    }
+    ArrowWriter reassemblyTable(reassemblyColumns);
+    if (reassemblyTable.open("output-tcp-csv-files/tcp-reassembly-summary.arrow")) {
+        reassemblyTable.add(reassembly.flows)
+            .add(reassembly.deliveredBytes)
+            .add(reassembly.zeroCopyBytes)
+            .add(reassembly.bufferedBytes)
+            .add(reassembly.retransmittedBytes)
+            .add(reassembly.gapBytes)
+            .add(reassembly.droppedSegments)
+            .add(reassembly.droppedBytes);
+        reassemblyTable.endRow();
+        reassemblyTable.close();
+    } else {
+        std::cerr << "Error: Could not open tcp-reassembly-summary.arrow for writing.\n";
+    }
 }
 
 } // namespace NetworkParser
\ No newline at end of file
@@ -1,33 +1,31 @@
 #pragma once
 #include "Parser.hpp"
 #include "IPParser.hpp"
+#include "StatsTables.hpp"
+#include "ArrowWriter.hpp"
+#include "CsvWriter.hpp"
+#include "ProtocolRegistry.hpp"
 #include <string>
-#include <map>
-#include <set>
 #include <vector>
 
 namespace NetworkParser {
 
-static std::map<uint16_t, Stats> tcpPortStats;  // Stats per port
-static std::map<std::pair<uint16_t, uint16_t>, Stats> tcpConnectionStats;  // Stats per connection
-static size_t tcpTotalPackets;
-static size_t tcpTotalBytes;
-static std::set<uint16_t> tcpUniquePorts;
-static std::set<std::pair<uint16_t, uint16_t>> tcpUniqueInteractions; 
-
 class TCPParser : public Parser {
 public:
-    TCPParser(std::string _filePath = "");
-    Stats parsePacket(const uint8_t* packet, size_t length, size_t offset, Stats ip_add_stats) override;
-    std::string nextParser() const override;
-    static void generateReport();
+    TCPParser(StatsTables& tables, const ProtocolRegistry& registry);
+    void parsePacket(const uint8_t* packet, size_t length, size_t offset, PacketContext& context) override;
+    ProtocolId nextProtocol() const override;
+    static void generateReport(const TCPStatsTable& stats, ReportFormat format);
     size_t getOffset() const override;
 
 private:
-    std::string filePath;
-    uint16_t src_port;
-    uint16_t dest_port;
-    uint8_t tcpHeaderLength;
+    static void writeCsvReport(const TCPStatsTable& stats);
+    static void writeArrowReport(const TCPStatsTable& stats);
+
+    TCPStatsTable& stats;
+    const ProtocolRegistry& registry;
+    ProtocolId nextProtocolId = Protocol::None;
+    uint8_t tcpHeaderLength = 0;
 };
 
 #pragma pack(push, 1)
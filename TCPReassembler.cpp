@@ -0,0 +1,219 @@
+#include "TCPReassembler.hpp"
+#include <algorithm>
+
+namespace NetworkParser {
+
+// TCP flag bits
+static constexpr uint8_t kFin = 0x01;
+static constexpr uint8_t kSyn = 0x02;
+static constexpr uint8_t kRst = 0x04;
+
+// Segments this far ahead of the stream are not treated as part of it
+static constexpr int64_t kMaxSequenceGap = 64 << 20;
+
+TCPReassembler::TCPReassembler(ReassemblyBudget& budget, ReassemblyStats& stats, StreamConsumer& consumer)
+    : budget(budget), stats(stats), consumer(consumer), flows(256) {}
+
+TCPReassembler::~TCPReassembler() {
+    finish();
+}
+
+void TCPReassembler::accept(ProtocolId protocol, const uint8_t* packet, size_t length, size_t offset,
+                            PacketContext& context) {
+    size_t payload = (length > offset) ? length - offset : 0;
+    uint8_t flags = context.tcpFlags;
+
+    uint64_t timestamp = context.timestampMicros();
+    if (timestamp > now) now = timestamp;
+    if (now - lastSweep >= kSweepIntervalUsec) sweep();
+
+    bool senderIsA;
+    FlowKey key = makeFlowKey(context, senderIsA);
+    Flow* flow = flows.find(key);
+    if (!flow) {
+        // Nothing to reassemble from a bare ACK, or a reset of a flow we never tracked
+        if ((flags & kRst) || (!payload && !(flags & (kSyn | kFin)))) return;
+        flow = &flows[key];
+        flow->protocol = protocol;
+        stats.flows++;
+    }
+    flow->lastSeen = std::max(flow->lastSeen, timestamp);
+
+    if (flags & kRst) {
+        discard(flow->directions[0]);
+        discard(flow->directions[1]);
+        flows.erase(key);
+        return;
+    }
+
+    Direction& direction = flow->directions[senderIsA ? 0 : 1];
+    uint32_t sequence = context.tcpSequence;
+    if (flags & kSyn) {
+        // A SYN that does not match the stream start means the ports were reused
+        uint32_t streamStart = direction.nextSequence - static_cast<uint32_t>(direction.delivered);
+        if (direction.synchronized && streamStart != sequence + 1) {
+            discard(direction);
+            direction = Direction();
+        }
+        if (!direction.synchronized) {
+            direction.nextSequence = sequence + 1;
+            direction.synchronized = true;
+        }
+        sequence++;  // Data carried on a SYN starts after it
+    } else if (!direction.synchronized) {
+        // Picked up mid-stream, the stream starts with this segment
+        direction.nextSequence = sequence;
+        direction.synchronized = true;
+    }
+
+    int64_t delta = static_cast<int32_t>(sequence - direction.nextSequence);
+    if (delta < -static_cast<int64_t>(direction.delivered)) {
+        // Starts before anything we tracked, so it can only be an old retransmit
+        stats.retransmittedBytes += payload;
+        return;
+    }
+    if (delta > kMaxSequenceGap) {
+        stats.droppedSegments++;
+        stats.droppedBytes += payload;
+        return;
+    }
+
+    uint64_t streamOffset = direction.delivered + delta;
+    if (flags & kFin) direction.finOffset = streamOffset + payload;
+
+    if (payload) {
+        if (streamOffset > direction.delivered &&
+            !buffer(direction, packet + offset, payload, streamOffset)) {
+            // No room to hold it, so give up on the hole in front of it
+            skipTo(*flow, direction, streamOffset, context);
+        }
+        if (streamOffset <= direction.delivered) {
+            stats.zeroCopyBytes += deliver(*flow, direction, packet, length, offset, streamOffset, context);
+            drain(*flow, direction, context);
+        }
+    }
+
+    // Done once both sides have been delivered up to their FIN
+    const Direction& first = flow->directions[0];
+    const Direction& second = flow->directions[1];
+    if (first.delivered >= first.finOffset && second.delivered >= second.finOffset) {
+        discard(flow->directions[0]);
+        discard(flow->directions[1]);
+        flows.erase(key);
+    }
+}
+
+size_t TCPReassembler::deliver(Flow& flow, Direction& direction, const uint8_t* packet, size_t length,
+                               size_t offset, uint64_t streamOffset, PacketContext& context) {
+    size_t payload = length - offset;
+    uint64_t end = streamOffset + payload;
+    if (end <= direction.delivered) {
+        stats.retransmittedBytes += payload;
+        return 0;
+    }
+
+    // Bytes the consumer already has are trimmed off the front
+    size_t overlap = direction.delivered - streamOffset;
+    stats.retransmittedBytes += overlap;
+    consumer.consumeStream(flow.protocol, packet, length, offset + overlap, context);
+
+    size_t fresh = payload - overlap;
+    stats.deliveredBytes += fresh;
+    direction.delivered = end;
+    direction.nextSequence += static_cast<uint32_t>(fresh);
+    return fresh;
+}
+
+void TCPReassembler::drain(Flow& flow, Direction& direction, PacketContext& context) {
+    while (!direction.pending.empty()) {
+        auto first = direction.pending.begin();
+        if (first->first > direction.delivered) break;
+
+        uint64_t streamOffset = first->first;
+        std::vector<uint8_t> data = std::move(first->second);
+        direction.pending.erase(first);
+        direction.pendingBytes -= data.size();
+        budget.release(data.size());
+
+        deliver(flow, direction, data.data(), data.size(), 0, streamOffset, context);
+        pool.release(std::move(data));
+    }
+}
+
+bool TCPReassembler::buffer(Direction& direction, const uint8_t* data, size_t length, uint64_t streamOffset) {
+    auto existing = direction.pending.find(streamOffset);
+    if (existing != direction.pending.end() && existing->second.size() >= length) {
+        stats.retransmittedBytes += length;
+        return true;
+    }
+
+    if (direction.pendingBytes + length > kMaxFlowBufferedBytes || !budget.reserve(length)) return false;
+
+    if (existing != direction.pending.end()) {
+        // A longer copy of a segment we hold replaces it
+        size_t previous = existing->second.size();
+        direction.pendingBytes -= previous;
+        budget.release(previous);
+        stats.retransmittedBytes += previous;
+        pool.release(std::move(existing->second));
+        existing->second = pool.acquire(data, length);
+    } else {
+        direction.pending.emplace(streamOffset, pool.acquire(data, length));
+    }
+    direction.pendingBytes += length;
+    stats.bufferedBytes += length;
+    return true;
+}
+
+void TCPReassembler::skipTo(Flow& flow, Direction& direction, uint64_t streamOffset, PacketContext& context) {
+    while (direction.delivered < streamOffset) {
+        uint64_t target = streamOffset;
+        if (!direction.pending.empty()) target = std::min(target, direction.pending.begin()->first);
+
+        if (target > direction.delivered) {
+            uint64_t gap = target - direction.delivered;
+            stats.gapBytes += gap;
+            direction.delivered = target;
+            direction.nextSequence += static_cast<uint32_t>(gap);
+        }
+        drain(flow, direction, context);
+    }
+}
+
+void TCPReassembler::discard(Direction& direction) {
+    for (auto& [streamOffset, data] : direction.pending) {
+        stats.droppedSegments++;
+        stats.droppedBytes += data.size();
+        budget.release(data.size());
+        pool.release(std::move(data));
+    }
+    direction.pending.clear();
+    direction.pendingBytes = 0;
+}
+
+void TCPReassembler::sweep() {
+    lastSweep = now;
+    expired.clear();
+    for (const auto& slot : flows) {
+        if (now - slot.value.lastSeen > idleTimeoutUsec) expired.push_back(slot.key);
+    }
+    for (const FlowKey& key : expired) {
+        Flow* flow = flows.find(key);
+        discard(flow->directions[0]);
+        discard(flow->directions[1]);
+        flows.erase(key);
+    }
+}
+
+void TCPReassembler::finish() {
+    expired.clear();
+    for (const auto& slot : flows) expired.push_back(slot.key);
+    for (const FlowKey& key : expired) {
+        Flow* flow = flows.find(key);
+        discard(flow->directions[0]);
+        discard(flow->directions[1]);
+        flows.erase(key);
+    }
+}
+
+} // namespace NetworkParser
@@ -0,0 +1,107 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <vector>
+#include "Parser.hpp"
+#include "BufferPool.hpp"
+#include "FlatHashMap.hpp"
+#include "FlowTable.hpp"
+#include "StatsTables.hpp"
+
+namespace NetworkParser {
+
+// Receives reassembled stream data. The bytes are packet[offset, length), the
+// same layout a parser gets for a single packet.
+class StreamConsumer {
+public:
+    virtual ~StreamConsumer() = default;
+    virtual void consumeStream(ProtocolId protocol, const uint8_t* packet, size_t length, size_t offset,
+                               PacketContext& context) = 0;
+};
+
+// Bytes of out of order data that every reassembler together may hold. Shared
+// by all worker threads.
+class ReassemblyBudget {
+public:
+    explicit ReassemblyBudget(size_t capBytes) : capBytes(capBytes) {}
+
+    // Claim bytes, false if that would go over the cap
+    bool reserve(size_t bytes) {
+        size_t current = usedBytes.load(std::memory_order_relaxed);
+        do {
+            if (current + bytes > capBytes) return false;
+        } while (!usedBytes.compare_exchange_weak(current, current + bytes, std::memory_order_relaxed));
+        return true;
+    }
+    void release(size_t bytes) { usedBytes.fetch_sub(bytes, std::memory_order_relaxed); }
+
+private:
+    const size_t capBytes;
+    std::atomic<size_t> usedBytes{0};
+};
+
+// Puts the payload of each direction of a TCP flow back in sequence order and
+// hands contiguous byte ranges to the application parser. A segment that
+// continues the stream is passed on straight from the packet, only segments
+// that arrive ahead of a hole are copied into pooled buffers. Retransmitted
+// and overlapping bytes are trimmed. When a flow goes over its own limit or
+// the shared budget is spent, the flow skips the hole instead of buffering
+// more, so one stalled flow cannot take all the memory.
+class TCPReassembler {
+public:
+    static constexpr size_t kMaxFlowBufferedBytes = 1 << 20;
+    static constexpr uint64_t kSweepIntervalUsec = 5ull * 1000000;
+
+    TCPReassembler(ReassemblyBudget& budget, ReassemblyStats& stats, StreamConsumer& consumer);
+    ~TCPReassembler();
+    TCPReassembler(const TCPReassembler&) = delete;
+    TCPReassembler& operator=(const TCPReassembler&) = delete;
+
+    void setIdleTimeout(uint64_t usec) { idleTimeoutUsec = usec; }
+
+    // One segment of a flow carrying protocol, its payload is packet[offset, length)
+    void accept(ProtocolId protocol, const uint8_t* packet, size_t length, size_t offset, PacketContext& context);
+
+    // Drop everything still buffered, at the end of the capture
+    void finish();
+
+private:
+    // One direction of a flow. Positions are stream offsets, the number of
+    // payload bytes since the point where tracking started.
+    struct Direction {
+        std::map<uint64_t, std::vector<uint8_t>> pending;  // Out of order data by stream offset
+        size_t pendingBytes = 0;
+        uint64_t delivered = 0;            // Next stream offset owed to the consumer
+        uint64_t finOffset = UINT64_MAX;   // Stream offset of the FIN once seen
+        uint32_t nextSequence = 0;         // Sequence number of delivered
+        bool synchronized = false;
+    };
+
+    struct Flow {
+        Direction directions[2];  // Indexed by sender, 0 for endpoint A of the key
+        ProtocolId protocol = Protocol::None;
+        uint64_t lastSeen = 0;
+    };
+
+    ReassemblyBudget& budget;
+    ReassemblyStats& stats;
+    StreamConsumer& consumer;
+    BufferPool pool;
+    FlatHashMap<FlowKey, Flow, FlowKeyHash> flows;
+    uint64_t idleTimeoutUsec = FlowTable::kDefaultIdleTimeoutUsec;
+    uint64_t now = 0;
+    uint64_t lastSweep = 0;
+    std::vector<FlowKey> expired;  // Scratch list reused by sweep
+
+    size_t deliver(Flow& flow, Direction& direction, const uint8_t* packet, size_t length, size_t offset,
+                   uint64_t streamOffset, PacketContext& context);
+    void drain(Flow& flow, Direction& direction, PacketContext& context);
+    bool buffer(Direction& direction, const uint8_t* data, size_t length, uint64_t streamOffset);
+    void skipTo(Flow& flow, Direction& direction, uint64_t streamOffset, PacketContext& context);
+    void discard(Direction& direction);
+    void sweep();
+};
+
+} // namespace NetworkParser
@@ -0,0 +1,56 @@
+#include "TimeSeries.hpp"
+#include <algorithm>
+
+namespace NetworkParser {
+
+// Make bucket hold interval number, false if the packet was recorded some other way
+bool TimeSeries::claim(TimeBucket& bucket, uint64_t number, uint64_t bytes) {
+    if (bucket.packets && bucket.number > number) {
+        // Too late for the ring, the slot has moved on to a newer interval
+        retired.push_back(TimeBucket{number, 1, bytes});
+        return false;
+    }
+    if (bucket.packets) retired.push_back(bucket);
+    bucket = TimeBucket();
+    bucket.number = number;
+    return true;
+}
+
+void TimeSeries::merge(TimeSeries& other) {
+    retired.insert(retired.end(), other.retired.begin(), other.retired.end());
+    for (TimeBucket& bucket : other.ring) {
+        if (bucket.packets) retired.push_back(bucket);
+        bucket = TimeBucket();
+    }
+    other.retired.clear();
+}
+
+std::vector<TimeBucket> TimeSeries::buckets() const {
+    std::vector<TimeBucket> all = retired;
+    for (const TimeBucket& bucket : ring) {
+        if (bucket.packets) all.push_back(bucket);
+    }
+    std::sort(all.begin(), all.end(),
+              [](const TimeBucket& a, const TimeBucket& b) { return a.number < b.number; });
+
+    // The same interval can show up more than once, from late packets or merged workers
+    std::vector<TimeBucket> combined;
+    for (const TimeBucket& bucket : all) {
+        if (!combined.empty() && combined.back().number == bucket.number) {
+            combined.back().packets += bucket.packets;
+            combined.back().bytes += bucket.bytes;
+        } else {
+            combined.push_back(bucket);
+        }
+    }
+    return combined;
+}
+
+void TimeSeries::writeRows(CsvWriter& out) const {
+    for (const TimeBucket& bucket : buckets()) {
+        out.addTimestamp(bucket.number * intervalUsec).add(bucket.packets).add(bucket.bytes);
+        out.endRow();
+    }
+}
+
+} // namespace NetworkParser
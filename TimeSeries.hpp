@@ -0,0 +1,59 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "CsvWriter.hpp"
+
+namespace NetworkParser {
+
+// Counts for one interval of capture time
+struct TimeBucket {
+    uint64_t number = UINT64_MAX;  // Packet timestamp divided by the interval length
+    uint64_t packets = 0;
+    uint64_t bytes = 0;
+};
+
+// Packet and byte counts per fixed interval of capture time, updated as each
+// packet goes by. Recent intervals live in a preallocated ring indexed by
+// interval number. When a packet lands on a slot that still holds an older
+// interval, that interval is retired to a list, so writing the series out
+// never needs another pass over the capture.
+class TimeSeries {
+public:
+    static constexpr size_t kRingBuckets = 4096;  // Power of two
+    static constexpr uint64_t kDefaultIntervalUsec = 1000000;
+
+    TimeSeries() : ring(kRingBuckets) {}
+
+    // Only meaningful before the first packet is added
+    void setInterval(uint64_t usec) { intervalUsec = usec ? usec : kDefaultIntervalUsec; }
+    uint64_t interval() const { return intervalUsec; }
+
+    void add(uint64_t timestampUsec, uint64_t bytes) {
+        uint64_t number = timestampUsec / intervalUsec;
+        TimeBucket& bucket = ring[number & (kRingBuckets - 1)];
+        if (bucket.number != number) {
+            if (!claim(bucket, number, bytes)) return;
+        }
+        bucket.packets++;
+        bucket.bytes += bytes;
+    }
+
+    // Take over every interval of other, which is left empty
+    void merge(TimeSeries& other);
+
+    // Every interval that saw packets, in time order
+    std::vector<TimeBucket> buckets() const;
+
+    // Write intervalStart,packets,bytes rows
+    void writeRows(CsvWriter& out) const;
+
+private:
+    std::vector<TimeBucket> ring;
+    std::vector<TimeBucket> retired;
+    uint64_t intervalUsec = kDefaultIntervalUsec;
+
+    bool claim(TimeBucket& bucket, uint64_t number, uint64_t bytes);
+};
+
+} // namespace NetworkParser
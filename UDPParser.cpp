@@ -1,20 +1,18 @@
 #include "UDPParser.hpp"
-#include <fstream>
+#include "Metrics.hpp"
 #include <iostream>
 #include <netinet/in.h>  // for ntohs()
 
 namespace NetworkParser {
 
-Stats UDPParser::req_stats;
+UDPParser::UDPParser(StatsTables& tables, const ProtocolRegistry& registry)
+    : stats(tables.udp), registry(registry) {}
 
-UDPParser::UDPParser(std::string _filePath) : filePath(_filePath) {}
-
-Stats UDPParser::parsePacket(const uint8_t* packet, size_t length, size_t offset, Stats ip_add_stats) {
-    req_stats = ip_add_stats;
-    Stats placeholder;
+void UDPParser::parsePacket(const uint8_t* packet, size_t length, size_t offset, PacketContext& context) {
+    nextProtocolId = Protocol::None;
     if (length < offset + sizeof(UDPHeader)) {
-        //std::cerr << "Error: Malformed UDP packet - insufficient length for UDP header." << std::endl;
-        return placeholder;
+        reportPacketError(PacketError::UDPTruncated);
+        return;
     }
 
     const UDPHeader* udpHeader = reinterpret_cast<const UDPHeader*>(packet + offset);
@@ -25,60 +23,53 @@ Stats UDPParser::parsePacket(const uint8_t* packet, size_t length, size_t offset
 
     // Ensure the packet length matches the header's length field
     if (length < offset + ntohs(udpHeader->length)) {
-        //std::cerr << "Error: Malformed UDP packet - length mismatch." << std::endl;
-        return placeholder;
+        reportPacketError(PacketError::UDPLength);
+        return;
     }
 
     // Update statistics
-    udpTotalPackets++;
-    udpTotalBytes += (length - offset - sizeof(UDPHeader));
-
-    // Update unique ports
-    udpUniquePorts.insert(srcPort);
-    udpUniquePorts.insert(destPort);
+    stats.totalPackets++;
+    stats.totalBytes += (length - offset - sizeof(UDPHeader));
+    stats.timeSeries.add(context.timestampMicros(), length - offset - sizeof(UDPHeader));
 
     // Update port stats
-    udpPortStats[srcPort].packetsOut++;
-    udpPortStats[destPort].packetsIn++;
-    udpPortStats[srcPort].bytesOut += (length - offset - sizeof(UDPHeader));
-    udpPortStats[destPort].bytesIn += (length - offset - sizeof(UDPHeader));
-
-    // Update unique interactions and connection stats
-    auto connection = (srcPort < destPort) ? std::make_pair(srcPort, destPort)
-                                           : std::make_pair(destPort, srcPort);
-
-    udpUniqueInteractions.insert(connection);
-
-    if (srcPort < destPort) {
-        udpConnectionStats[connection].packetsOut++;
-        udpConnectionStats[connection].bytesOut += (length - offset - sizeof(UDPHeader));
-    } else {
-        udpConnectionStats[connection].packetsIn++;
-        udpConnectionStats[connection].bytesIn += (length - offset - sizeof(UDPHeader));
+    stats.portStats[srcPort].packetsOut++;
+    stats.portStats[destPort].packetsIn++;
+    stats.portStats[srcPort].bytesOut += (length - offset - sizeof(UDPHeader));
+    stats.portStats[destPort].bytesIn += (length - offset - sizeof(UDPHeader));
+
+    context.srcPort = srcPort;
+    context.destPort = destPort;
+    context.hasPorts = true;
+
+    // Update the connection, which needs the addresses from a valid IP header
+    if (context.hasAddresses) {
+        stats.flows.update(context, length - offset - sizeof(UDPHeader));
     }
 
-    req_stats = ip_add_stats;
-    src_port = srcPort;
-    dest_port = destPort;
-
-    return req_stats;
+    context.payloadOffset = offset + sizeof(UDPHeader);
+    nextProtocolId = registry.udpProtocolFor(srcPort, destPort);
 }
 
 size_t UDPParser::getOffset() const {
     return sizeof(UDPHeader);
 }
 
-void UDPParser::generateReport() {
+void UDPParser::generateReport(const UDPStatsTable& stats, ReportFormat format) {
+    if (writesCsv(format)) writeCsvReport(stats);
+    if (writesArrow(format)) writeArrowReport(stats);
+}
+
+void UDPParser::writeCsvReport(const UDPStatsTable& stats) {
     // Generate port stats report
-    std::ofstream udpPortStatsFile("output-udp-csv-files/udp-port-stats.csv");
-    if (udpPortStatsFile.is_open()) {
-        udpPortStatsFile << "unique-port,packetsIn,packetsOut,bytesIn,bytesOut\n";
-        for (const auto& [port, stats] : udpPortStats) {
-            udpPortStatsFile << port << ","
-                             << stats.packetsIn << ","
-                             << stats.packetsOut << ","
-                             << stats.bytesIn << ","
-                             << stats.bytesOut << "\n";
+    CsvWriter udpPortStatsFile;
+    if (udpPortStatsFile.open("output-udp-csv-files/udp-port-stats.csv")) {
+        udpPortStatsFile.line("unique-port,packetsIn,packetsOut,bytesIn,bytesOut");
+        for (size_t port = 0; port < stats.portStats.size(); port++) {
+            const Counters& portStats = stats.portStats[port];
+            if (!portStats.packetsIn && !portStats.packetsOut) continue;
+            udpPortStatsFile.add(port);
+            appendCounters(udpPortStatsFile, portStats);
         }
         udpPortStatsFile.close();
     } else {
@@ -86,49 +77,94 @@ void UDPParser::generateReport() {
     }
 
     // Generate connection stats report
-    std::ofstream udpConnectionStatsFile("output-udp-csv-files/udp-connection-stats.csv");
-    if (udpConnectionStatsFile.is_open()) {
-        udpConnectionStatsFile << "ip1,ip2,srcPort,destPort,packetsIn,packetsOut,bytesIn,bytesOut\n";
-        for (const auto& [connection, stats] : udpConnectionStats) {
-            udpConnectionStatsFile << req_stats.ip1 << ","
-                                   << req_stats.ip2 << ","
-                                   << connection.first << ","
-                                   << connection.second << ","
-                                   << stats.packetsIn << ","
-                                   << stats.packetsOut << ","
-                                   << stats.bytesIn << ","
-                                   << stats.bytesOut << "\n";
-        }
+    CsvWriter udpConnectionStatsFile;
+    if (udpConnectionStatsFile.open("output-udp-csv-files/udp-connection-stats.csv")) {
+        udpConnectionStatsFile.line("ip1,ip2,srcPort,destPort,packetsIn,packetsOut,bytesIn,bytesOut,state,firstSeen,lastSeen");
+        stats.flows.forEachRecord([&](const FlowRecord& record) {
+            writeFlowRow(udpConnectionStatsFile, record);
+        });
         udpConnectionStatsFile.close();
     } else {
         std::cerr << "Error: Could not open udp-connection-stats.csv for writing.\n";
     }
 
     // Generate general summary report for UDP
-    std::ofstream udpSummaryFile("output-udp-csv-files/udp-general-summary.csv");
-    if (udpSummaryFile.is_open()) {
-        udpSummaryFile << "#packets,bytes,#unique-ports,uniqueConnections\n";
-        udpSummaryFile << udpTotalPackets << ","
-                       << udpTotalBytes << ","
-                       << udpPortStats.size() << ","
-                       << udpConnectionStats.size() << "\n";
+    CsvWriter udpSummaryFile;
+    if (udpSummaryFile.open("output-udp-csv-files/udp-general-summary.csv")) {
+        udpSummaryFile.line("#packets,bytes,#unique-ports,uniqueConnections");
+        udpSummaryFile.add(stats.totalPackets)
+            .add(stats.totalBytes)
+            .add(countActivePorts(stats.portStats))
+            .add(stats.flows.totalFlows());
+        udpSummaryFile.endRow();
         udpSummaryFile.close();
     } else {
         std::cerr << "Error: Could not open udp-general-summary.csv for writing.\n";
     }
+
+    // Generate per interval time series for UDP
+    CsvWriter udpTimeSeriesFile;
+    if (udpTimeSeriesFile.open("output-udp-csv-files/udp-time-series.csv")) {
+        udpTimeSeriesFile.line("intervalStart,packets,bytes");
+        stats.timeSeries.writeRows(udpTimeSeriesFile);
+        udpTimeSeriesFile.close();
+    } else {
+        std::cerr << "Error: Could not open udp-time-series.csv for writing.\n";
+    }
 }
 
-std::string UDPParser::nextParser() const {
-    size_t udpHeaderLength = (src_port < dest_port) ? sizeof(UDPHeader) : sizeof(UDPHeader);
-    size_t payloadSize = udpTotalBytes - udpHeaderLength;
+void UDPParser::writeArrowReport(const UDPStatsTable& stats) {
+    if (!writePortStatsArrow("output-udp-csv-files/udp-port-stats.arrow", stats.portStats)) {
+        std::cerr << "Error: Could not write udp-port-stats.arrow.\n";
+    }
 
-    if (payloadSize > 0) {
-        if (dest_port == 53 || src_port == 53) {
-            return "DNS";  // Next parser is DNS
-        }
+    // IPv6 connections go to a table of their own, only written when there are any
+    ArrowWriter udpConnectionStatsTable(flowColumns());
+    ArrowWriter udpConnectionStatsTable6(flowColumns(true));
+    bool opened6 = false;
+    if (udpConnectionStatsTable.open("output-udp-csv-files/udp-connection-stats.arrow")) {
+        stats.flows.forEachRecord([&](const FlowRecord& record) {
+            if (record.isIPv4()) {
+                appendFlowRow(udpConnectionStatsTable, record);
+                return;
+            }
+            if (!opened6) {
+                opened6 = true;
+                if (!udpConnectionStatsTable6.open("output-udp-csv-files/udp-connection-stats-ipv6.arrow")) {
+                    std::cerr << "Error: Could not open udp-connection-stats-ipv6.arrow for writing.\n";
+                }
+            }
+            if (udpConnectionStatsTable6.isOpen()) appendFlowRow(udpConnectionStatsTable6, record);
+        });
+        udpConnectionStatsTable.close();
+        if (udpConnectionStatsTable6.isOpen()) udpConnectionStatsTable6.close();
+    } else {
+        std::cerr << "Error: Could not open udp-connection-stats.arrow for writing.\n";
     }
 
-    return "None";
+    ArrowWriter udpSummaryTable({{"#packets", ColumnType::UInt64},
+                                 {"bytes", ColumnType::UInt64},
+                                 {"#unique-ports", ColumnType::UInt64},
+                                 {"uniqueConnections", ColumnType::UInt64}});
+    if (udpSummaryTable.open("output-udp-csv-files/udp-general-summary.arrow")) {
+        udpSummaryTable.add(stats.totalPackets)
+            .add(stats.totalBytes)
+            .add(countActivePorts(stats.portStats))
+            .add(stats.flows.totalFlows());
+        udpSummaryTable.endRow();
+        udpSummaryTable.close();
+    } else {
+        std::cerr << "Error: Could not open udp-general-summary.arrow for writing.\n";
+    }
+
+    if (!writeTimeSeriesArrow("output-udp-csv-files/udp-time-series.arrow", stats.timeSeries)) {
+        std::cerr << "Error: Could not write udp-time-series.arrow.\n";
+    }
+}
+
+ProtocolId UDPParser::nextProtocol() const {
+    // Resolved from the port mapping table when the datagram was parsed
+    return nextProtocolId;
 }
 
 } // namespace NetworkParser
\ No newline at end of file
@@ -1,32 +1,29 @@
 #pragma once
 #include "Parser.hpp"
+#include "StatsTables.hpp"
+#include "ArrowWriter.hpp"
+#include "CsvWriter.hpp"
+#include "ProtocolRegistry.hpp"
 #include <string>
-#include <map>
-#include <set>
 #include <vector>
 
 namespace NetworkParser {
 
-static std::map<uint16_t, Stats> udpPortStats;  // Stats per port
-static std::map<std::pair<uint16_t, uint16_t>, Stats> udpConnectionStats;  // Stats per connection
-static size_t udpTotalPackets;
-static size_t udpTotalBytes;
-static std::set<uint16_t> udpUniquePorts;
-static std::set<std::pair<uint16_t, uint16_t>> udpUniqueInteractions;
-
 class UDPParser : public Parser {
 public:
-    UDPParser(std::string _filePath = "");
-    Stats parsePacket(const uint8_t* packet, size_t length, size_t offset, Stats ip_add_stats) override;
-    std::string nextParser() const override;
-    static void generateReport();
+    UDPParser(StatsTables& tables, const ProtocolRegistry& registry);
+    void parsePacket(const uint8_t* packet, size_t length, size_t offset, PacketContext& context) override;
+    ProtocolId nextProtocol() const override;
+    static void generateReport(const UDPStatsTable& stats, ReportFormat format);
     size_t getOffset() const override;
 
 private:
-    std::string filePath;
-    static Stats req_stats;
-    uint16_t src_port;
-    uint16_t dest_port;
+    static void writeCsvReport(const UDPStatsTable& stats);
+    static void writeArrowReport(const UDPStatsTable& stats);
+
+    UDPStatsTable& stats;
+    const ProtocolRegistry& registry;
+    ProtocolId nextProtocolId = Protocol::None;
 };
 
 #pragma pack(push, 1)
@@ -1,24 +1,284 @@
 #include <iostream>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+#include <filesystem>
+#include <glob.h>
 #include "Controller.hpp"
 #include "Ethernet.hpp"
 
+static void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " [--huge-pages] [--stream] [--memory-cap <MB>] [--threads <N>]\n"
+              << "       [--flow-timeout <sec>] [--reassembly-cap <MB>] [--fragment-slots <N>] [--replay-rate <pps>]\n"
+              << "       [--duration <sec>] [--interval <sec>] [--format csv|arrow|both|none] [--query <sql>]\n"
+              << "       [--query-file <file>] [--top-talkers <K>] [--index] [--host <ip>]\n"
+              << "       [--flow <ip>:<port>-<ip>:<port>[/tcp|/udp]] [--from <sec>] [--to <sec>] [--metrics <file>]\n"
+              << "       [--metrics-interval <sec>] [--verify-checksums]\n"
+              << "       [--filter <expression>] <pcap_file>... | --live <interface>" << std::endl;
+}
+
+// A capture argument is a file, a directory whose files are all captures, or
+// a glob pattern. Directories and patterns expand in name order, which is
+// capture order for rotated files.
+static bool expandCapturePath(const std::string& path, std::vector<std::string>& filePaths) {
+    std::error_code error;
+    if (std::filesystem::is_directory(path, error)) {
+        std::vector<std::string> entries;
+        for (const auto& entry : std::filesystem::directory_iterator(path, error)) {
+            // Skip the indexes --index leaves next to the captures
+            if (!entry.is_regular_file() || entry.path().extension() == ".idx") continue;
+            entries.push_back(entry.path().string());
+        }
+        if (error || entries.empty()) {
+            std::cerr << "No capture files in directory: " << path << std::endl;
+            return false;
+        }
+        std::sort(entries.begin(), entries.end());
+        filePaths.insert(filePaths.end(), entries.begin(), entries.end());
+        return true;
+    }
+    if (path.find_first_of("*?[") == std::string::npos) {
+        filePaths.push_back(path);
+        return true;
+    }
+
+    glob_t matches;
+    if (glob(path.c_str(), 0, nullptr, &matches) != 0) {
+        std::cerr << "No capture files match: " << path << std::endl;
+        globfree(&matches);
+        return false;
+    }
+    for (size_t match = 0; match < matches.gl_pathc; match++) filePaths.push_back(matches.gl_pathv[match]);
+    globfree(&matches);
+    return true;
+}
+
+// A whole number of at least 0. strtoull would take a minus sign and wrap
+// the value around, so only digits are accepted.
+static bool parseCount(const char* text, size_t& value) {
+    if (!std::isdigit(static_cast<unsigned char>(text[0]))) return false;
+    errno = 0;
+    char* end;
+    unsigned long long parsed = std::strtoull(text, &end, 10);
+    if (*end || errno == ERANGE || parsed > SIZE_MAX) return false;
+    value = static_cast<size_t>(parsed);
+    return true;
+}
+
+// A finite number of at least 0, such as a rate or a number of seconds
+static bool parseNumber(const char* text, double& value) {
+    errno = 0;
+    char* end;
+    double parsed = std::strtod(text, &end);
+    if (end == text || *end || errno == ERANGE || !std::isfinite(parsed) || parsed < 0) return false;
+    value = parsed;
+    return true;
+}
+
+// Seconds since the epoch as microseconds, rejecting anything past what fits
+static bool parseTimestamp(const char* text, uint64_t& usec) {
+    double seconds;
+    if (!parseNumber(text, seconds) || seconds * 1e6 >= 18446744073709551615.0) return false;
+    usec = static_cast<uint64_t>(seconds * 1e6);
+    return true;
+}
+
+// One end of a flow, a.b.c.d:port
+static bool parseEndpoint(const std::string& text, uint32_t& address, uint16_t& port) {
+    size_t colon = text.rfind(':');
+    if (colon == std::string::npos || !NetworkParser::parseIPv4(text.substr(0, colon), address)) return false;
+    size_t value;
+    if (!parseCount(text.c_str() + colon + 1, value) || value > 0xFFFF) return false;
+    port = static_cast<uint16_t>(value);
+    return true;
+}
+
+// Either direction of a flow, optionally limited to one transport protocol
+static bool parseFlow(std::string text, NetworkParser::FlowKey& flow) {
+    NetworkParser::PacketContext context;
+    size_t slash = text.find('/');
+    if (slash != std::string::npos) {
+        std::string protocol = text.substr(slash + 1);
+        if (protocol == "tcp") {
+            context.ipProtocol = 6;
+        } else if (protocol == "udp") {
+            context.ipProtocol = 17;
+        } else {
+            return false;
+        }
+        text.resize(slash);
+    }
+    size_t dash = text.find('-');
+    if (dash == std::string::npos ||
+        !parseEndpoint(text.substr(0, dash), context.srcAddress, context.srcPort) ||
+        !parseEndpoint(text.substr(dash + 1), context.destAddress, context.destPort)) {
+        return false;
+    }
+    bool senderIsA;
+    flow = NetworkParser::makeFlowKey(context, senderIsA);
+    return true;
+}
+
+// Queries in a file are separated by semicolons
+static bool readQueries(const char* path, std::vector<std::string>& queries) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        std::cerr << "Error: Could not open query file " << path << std::endl;
+        return false;
+    }
+    std::string query;
+    while (std::getline(file, query, ';')) {
+        size_t start = query.find_first_not_of(" \t\r\n");
+        if (start == std::string::npos) continue;
+        queries.push_back(query.substr(start, query.find_last_not_of(" \t\r\n") + 1 - start));
+    }
+    return true;
+}
+
+// Stop live capture or replay cleanly so the reports still get written
+static void handleInterrupt(int) {
+    NetworkParser::requestSourceStop();
+}
+
 int main(int argc, const char* argv[]) {
-    if (argc < 2) {
-        std::cerr << "Usage: " << argv[0] << " <pcap_file>" << std::endl;
+    NetworkParser::ControllerOptions options;
+    std::vector<std::string> pcapFilePaths;
+    std::string liveInterface;
+
+    // The option before argv[at] was given a value it can't take
+    auto invalidValue = [&](int at) {
+        std::cerr << "Invalid value for " << argv[at - 1] << ": " << argv[at] << std::endl;
+        printUsage(argv[0]);
         return 1;
+    };
+
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--huge-pages") == 0) {
+            options.useHugePages = true;
+        } else if (std::strcmp(argv[i], "--stream") == 0) {
+            options.streaming = true;
+        } else if (std::strcmp(argv[i], "--memory-cap") == 0 && i + 1 < argc) {
+            if (!parseCount(argv[++i], options.memoryCapMB)) return invalidValue(i);
+        } else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            if (!parseCount(argv[++i], options.threads)) return invalidValue(i);
+        } else if (std::strcmp(argv[i], "--flow-timeout") == 0 && i + 1 < argc) {
+            if (!parseCount(argv[++i], options.flowTimeoutSec)) return invalidValue(i);
+        } else if (std::strcmp(argv[i], "--reassembly-cap") == 0 && i + 1 < argc) {
+            if (!parseCount(argv[++i], options.reassemblyCapMB)) return invalidValue(i);
+        } else if (std::strcmp(argv[i], "--fragment-slots") == 0 && i + 1 < argc) {
+            if (!parseCount(argv[++i], options.fragmentSlots)) return invalidValue(i);
+        } else if (std::strcmp(argv[i], "--live") == 0 && i + 1 < argc) {
+            liveInterface = argv[++i];
+        } else if (std::strcmp(argv[i], "--replay-rate") == 0 && i + 1 < argc) {
+            if (!parseNumber(argv[++i], options.replayRate)) return invalidValue(i);
+        } else if (std::strcmp(argv[i], "--duration") == 0 && i + 1 < argc) {
+            if (!parseCount(argv[++i], options.durationSec)) return invalidValue(i);
+        } else if (std::strcmp(argv[i], "--interval") == 0 && i + 1 < argc) {
+            if (!parseNumber(argv[++i], options.intervalSec)) return invalidValue(i);
+        } else if (std::strcmp(argv[i], "--top-talkers") == 0 && i + 1 < argc) {
+            if (!parseCount(argv[++i], options.topTalkers)) return invalidValue(i);
+        } else if (std::strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+            const char* format = argv[++i];
+            if (std::strcmp(format, "csv") == 0) {
+                options.reportFormat = NetworkParser::ReportFormat::Csv;
+            } else if (std::strcmp(format, "arrow") == 0) {
+                options.reportFormat = NetworkParser::ReportFormat::Arrow;
+            } else if (std::strcmp(format, "both") == 0) {
+                options.reportFormat = NetworkParser::ReportFormat::Both;
+            } else if (std::strcmp(format, "none") == 0) {
+                options.reportFormat = NetworkParser::ReportFormat::None;
+            } else {
+                std::cerr << "Unknown report format: " << format << std::endl;
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--query") == 0 && i + 1 < argc) {
+            options.queries.push_back(argv[++i]);
+        } else if (std::strcmp(argv[i], "--query-file") == 0 && i + 1 < argc) {
+            if (!readQueries(argv[++i], options.queries)) return 1;
+        } else if (std::strcmp(argv[i], "--index") == 0) {
+            options.useIndex = true;
+        } else if (std::strcmp(argv[i], "--host") == 0 && i + 1 < argc) {
+            if (!NetworkParser::parseIPv4(argv[++i], options.selection.host)) {
+                std::cerr << "Invalid host address: " << argv[i] << std::endl;
+                return 1;
+            }
+            options.selection.hasHost = true;
+        } else if (std::strcmp(argv[i], "--flow") == 0 && i + 1 < argc) {
+            if (!parseFlow(argv[++i], options.selection.flow)) {
+                std::cerr << "Invalid flow: " << argv[i] << std::endl;
+                return 1;
+            }
+            options.selection.hasFlow = true;
+        } else if (std::strcmp(argv[i], "--from") == 0 && i + 1 < argc) {
+            if (!parseTimestamp(argv[++i], options.selection.fromUsec)) return invalidValue(i);
+        } else if (std::strcmp(argv[i], "--to") == 0 && i + 1 < argc) {
+            if (!parseTimestamp(argv[++i], options.selection.toUsec)) return invalidValue(i);
+        } else if (std::strcmp(argv[i], "--metrics") == 0 && i + 1 < argc) {
+            options.metricsPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--metrics-interval") == 0 && i + 1 < argc) {
+            if (!parseNumber(argv[++i], options.metricsIntervalSec)) return invalidValue(i);
+        } else if (std::strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            std::string error;
+            if (!options.filter.compile(argv[++i], error)) {
+                std::cerr << "Invalid filter: " << error << "\n  in: " << argv[i] << std::endl;
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--verify-checksums") == 0) {
+            options.verifyChecksums = true;
+        } else if (argv[i][0] == '-') {
+            std::cerr << "Unknown option: " << argv[i] << std::endl;
+            printUsage(argv[0]);
+            return 1;
+        } else if (!expandCapturePath(argv[i], pcapFilePaths)) {
+            return 1;
+        }
+    }
+
+    if (pcapFilePaths.empty() == liveInterface.empty()) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    if (pcapFilePaths.size() > 1 && (options.useIndex || options.replayRate > 0)) {
+        std::cerr << "--index and --replay-rate only apply to a single capture file" << std::endl;
+        return 1;
+    }
+    if ((options.selection.active() || options.useIndex) && (!liveInterface.empty() || options.replayRate > 0)) {
+        std::cerr << "--index, --host, --flow, --from and --to only apply to reading a capture file" << std::endl;
+        return 1;
+    }
+    if (!liveInterface.empty() || options.replayRate > 0) {
+        std::signal(SIGINT, handleInterrupt);
+        std::signal(SIGTERM, handleInterrupt);
     }
-    
-    std::string pcapFilePath = argv[1];
 
     try {
         // Initialize the Controller
-        NetworkParser::Controller controller;
+        NetworkParser::Controller controller(options);
 
-        // Open the PCAP file and load the packets
-        std::cout << "Loading PCAP file: " << pcapFilePath << "..." << std::endl;
-        if (!controller.loadPCAPFile(pcapFilePath)) {
-            std::cerr << "Failed to load PCAP file: " << pcapFilePath << std::endl;
-            return 1;
+        if (!liveInterface.empty()) {
+            // Capture from the interface until the duration ends or we are interrupted
+            std::cout << "Capturing on interface: " << liveInterface << "..." << std::endl;
+            if (!controller.openInterface(liveInterface)) {
+                return 1;
+            }
+        } else if (pcapFilePaths.size() == 1) {
+            // Open the PCAP file and validate its header
+            std::cout << "Loading PCAP file: " << pcapFilePaths[0] << "..." << std::endl;
+            if (!controller.loadPCAPFile(pcapFilePaths[0])) {
+                std::cerr << "Failed to load PCAP file: " << pcapFilePaths[0] << std::endl;
+                return 1;
+            }
+        } else {
+            // Each file is opened by the worker that processes it
+            std::cout << "Loading " << pcapFilePaths.size() << " PCAP files..." << std::endl;
+            controller.loadPCAPFiles(pcapFilePaths);
         }
 
         // Process the packets
@@ -32,4 +292,4 @@ int main(int argc, const char* argv[]) {
     }
 
     return 0;
-}
\ No newline at end of file
+}
@@ -2,12 +2,14 @@ import argparse
 import subprocess
 import os
 import pandas as pd
+import pyarrow as pa
+import pyarrow.ipc as ipc
 import pyarrow.parquet as pq
 import duckdb
 
-def run_parser(parser_executable, pcap_file):
+def run_parser(parser_executable, pcap_file, report_format):
     try:
-        subprocess.run([parser_executable, pcap_file], check=True)
+        subprocess.run([parser_executable, '--format', report_format, pcap_file], check=True)
         print(f"Successfully ran {parser_executable} on {pcap_file}")
     except subprocess.CalledProcessError as e:
         print(f"Error running parser: {e}")
@@ -25,18 +27,26 @@ def csv_to_parquet(csv_file, parquet_file):
         print(f"Error converting to parquet: {e}")
         exit(1)
 
-def execute_sql_query(parquet_file, query_file):
+def load_parquet(conn, parquet_file):
+    # Register the Parquet file as a table
+    conn.execute(f"CREATE TABLE data AS SELECT * FROM '{parquet_file}'")
+
+def load_arrow(conn, arrow_file):
+    # Memory map the parser's Arrow file, DuckDB scans the columns in place
+    try:
+        table = ipc.open_file(pa.memory_map(arrow_file)).read_all()
+        conn.register('data', table)
+        print(f"Mapped {arrow_file} ({table.num_rows} rows)")
+    except Exception as e:
+        print(f"Error reading arrow file: {e}")
+        exit(1)
+
+def execute_sql_query(conn, query_file):
     try:
         # Read the query from file
         with open(query_file, 'r') as f:
             query = f.read().strip()
         
-        # Connect to DuckDB in-memory database
-        conn = duckdb.connect()
-        
-        # Register the Parquet file as a table
-        conn.execute(f"CREATE TABLE data AS SELECT * FROM '{parquet_file}'")
-        
         # Execute the query
         result = conn.execute(query).fetchdf()
         
@@ -52,20 +62,29 @@ def main():
     parser.add_argument('parser_executable', help='Path to the C++ parser executable')
     parser.add_argument('pcap_file', help='Path to the PCAP file to analyze')
     parser.add_argument('output_dir', help='Directory containing output CSV files')
-    parser.add_argument('target_csv', help='Name of the CSV file to convert to parquet')
+    parser.add_argument('target_csv', help='Name of the report to query, e.g. tcp-connection-stats.csv')
     parser.add_argument('query_file', help='File containing SQL query to execute')
+    parser.add_argument('--csv', action='store_true',
+                        help='Have the parser write CSV and convert it to parquet instead of reading its Arrow output')
     
     args = parser.parse_args()
 
     # Construct full paths
-    csv_path = os.path.join(args.output_dir, args.target_csv)
-    parquet_path = os.path.join(args.output_dir, os.path.splitext(args.target_csv)[0] + '.parquet')
-    
-    run_parser(args.parser_executable, args.pcap_file)
+    stem = os.path.join(args.output_dir, os.path.splitext(args.target_csv)[0])
+    csv_path = stem + '.csv'
+    parquet_path = stem + '.parquet'
+    arrow_path = stem + '.arrow'
     
-    csv_to_parquet(csv_path, parquet_path)
+    conn = duckdb.connect()
+    if args.csv:
+        run_parser(args.parser_executable, args.pcap_file, 'csv')
+        csv_to_parquet(csv_path, parquet_path)
+        load_parquet(conn, parquet_path)
+    else:
+        run_parser(args.parser_executable, args.pcap_file, 'arrow')
+        load_arrow(conn, arrow_path)
     
-    execute_sql_query(parquet_path, args.query_file)
+    execute_sql_query(conn, args.query_file)
 
 if __name__ == '__main__':
     main()
\ No newline at end of file